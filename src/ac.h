@@ -0,0 +1,348 @@
+#ifndef AC_H_INCLUDED
+#	define AC_H_INCLUDED
+
+#include "nonlinear.h"
+
+
+/// AC small-signal analysis.
+/// The circuit is assembled once into real G, C and Γ (inverse inductance) matrices, so
+///   Y(ω) = G + j*(ω*C - Γ/ω)
+/// costs one pass over n*n entries per frequency.
+/// The nonzero pattern doesn't change with ω, so the symbolic LU is shared by every point.
+/// The sources are `i` lines. The system has a row per node and none per branch, so `v`
+/// sources have nowhere to go, the deck warns about them and they're left out. Drive the
+/// circuit with their Norton equivalent, an `i` source across the source resistance.
+
+enum {
+	AC_SWEEP_NONE = 0,
+	AC_SWEEP_LIN,
+	AC_SWEEP_DEC,
+	AC_SWEEP_OCT,
+};
+
+/// .ac <lin|dec|oct> <points> <fstart> <fstop>
+/// lin: `points` total, dec/oct: `points` per decade/octave.
+struct ACSweep {
+	rat     fstart, fstop;
+	size_t  points;
+	uint8_t kind;
+};
+
+struct ACSystem {
+	rat              *G, *C, *Gam; /// n x n, row-major.
+	cplx             *rhs;         /// AC source phasors.
+	rat              *dc;          /// DC sources, small-signal ignores them.
+	struct LUSymbolic sym;
+	uint8_t           matrix_id_to_node[MAX_NODES];
+	size_t            n;
+};
+
+CIRCUIT_EXPORT NO_NULLS size_t ac_sweep_count(struct ACSweep const *const sw) {
+	if( sw->kind==AC_SWEEP_NONE || sw->points==0 || rat_le(sw->fstart, rat_zero()) || rat_lt(sw->fstop, sw->fstart) ) {
+		return 0;
+	}
+	switch( sw->kind ) {
+		case AC_SWEEP_LIN:
+			return sw->points;
+		case AC_SWEEP_DEC: case AC_SWEEP_OCT: {
+			rat const base = rat_from_int(sw->kind==AC_SWEEP_DEC? 10 : 2);
+			rat const span = rat_log_base(rat_div(sw->fstop, sw->fstart), base);
+			/// nudge so an exact decade/octave count lands on fstop.
+			rat const steps = rat_add(rat_mul(span, rat_from_int(sw->points)), float_to_rat(1E-6));
+			return ( size_t )(rat_to_float(rat_floor(steps))) + 1;
+		}
+	}
+	return 0;
+}
+
+CIRCUIT_EXPORT NO_NULLS rat ac_sweep_freq(struct ACSweep const *const sw, size_t const i) {
+	switch( sw->kind ) {
+		case AC_SWEEP_LIN: {
+			if( sw->points < 2 ) {
+				return sw->fstart;
+			}
+			rat const step = rat_div(rat_sub(sw->fstop, sw->fstart), rat_from_int(sw->points - 1));
+			return rat_addmul(sw->fstart, step, rat_from_int(i));
+		}
+		case AC_SWEEP_DEC: case AC_SWEEP_OCT: {
+			rat const base = rat_from_int(sw->kind==AC_SWEEP_DEC? 10 : 2);
+			return rat_mul(sw->fstart, rat_pow(base, rat_div(rat_from_int(i), rat_from_int(sw->points))));
+		}
+	}
+	return sw->fstart;
+}
+
+/// returns true if `line` was an .ac directive, malformed ones leave `sw` off.
+CIRCUIT_EXPORT NO_NULLS bool ac_parse_directive(struct ACSweep *const restrict sw, char const line[const restrict static 1]) {
+	char kind[8] = {0}, start_tok[48] = {0}, stop_tok[48] = {0};
+	size_t points = 0;
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word != 3 || strncmp(line, ".ac", 3) != 0 ) {
+		return false;
+	}
+	*sw = (struct ACSweep){0};
+	if( sscanf(line, " .ac %7s %zu %47s %47s", kind, &points, start_tok, stop_tok) < 4 ) {
+		return true;
+	}
+	for( size_t i=0; kind[i] != 0; i++ ) {
+		kind[i] = tolower(kind[i]);
+	}
+	sw->kind   = !strcmp(kind, "lin")? AC_SWEEP_LIN : !strcmp(kind, "dec")? AC_SWEEP_DEC : !strcmp(kind, "oct")? AC_SWEEP_OCT : AC_SWEEP_NONE;
+	sw->points = points;
+	sw->fstart = parse_si_scalar(start_tok);
+	sw->fstop  = parse_si_scalar(stop_tok);
+	return true;
+}
+
+/// true if any component is of `kind`.
+CIRCUIT_EXPORT NO_NULLS bool circuit_has_kind(struct Circuit const *const c, uint8_t const kind) {
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+			if( cmp->kind==kind ) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/// assembles G, C, Γ and the source vector on the front stack, devices aren't stamped so callers refuse circuits that have any.
+CIRCUIT_EXPORT NO_NULLS bool circuit_build_ac(struct Circuit *const c, struct ACSystem *const sys) {
+	uint8_t node_to_matrix_id[MAX_NODES];
+	memset(node_to_matrix_id, -1, sizeof node_to_matrix_id);
+	sys->n = setup_matrix_ids(c->active_nodes, &node_to_matrix_id, &sys->matrix_id_to_node);
+	size_t const n = sys->n;
+	if( n==0 ) {
+		return false;
+	}
+	sys->G   = alloc_vec(&c->bistack, n*n);
+	sys->C   = alloc_vec(&c->bistack, n*n);
+	sys->Gam = alloc_vec(&c->bistack, n*n);
+	sys->rhs = bistack_alloc_front_vec(&c->bistack, n, sizeof *sys->rhs);
+	rat *const dc_rhs = sys->dc = alloc_vec(&c->bistack, n);
+	if( sys->G==NULL || sys->C==NULL || sys->Gam==NULL || sys->rhs==NULL || dc_rhs==NULL ) {
+		return false;
+	}
+	for( size_t i=0; i < n; i++ ) {
+		sys->rhs[i] = cplx_zero();
+	}
+	
+	uint8_t const (*const n2m)[MAX_NODES] = ( uint8_t const(*)[MAX_NODES] )(&node_to_matrix_id);
+	/// room for the biggest single component, a macromodel tied to every node.
+	size_t const stamp_cap = n*n + n;
+	struct Stamp *const stamps = bistack_alloc_front_vec(&c->bistack, stamp_cap, sizeof *stamps);
+	if( stamps==NULL ) {
+		return false;
+	}
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+			struct StampBuffer buf = { .data = stamps, .cap = stamp_cap };
+			uint8_t const a = (*n2m)[cmp->owner];
+			bool const b_g = node_is_ground(cmp->node);
+			uint8_t const b = b_g? a : (*n2m)[cmp->node];
+			switch( cmp->kind ) {
+				case COMP_RESISTOR: case COMP_MACROMODEL: case COMP_DC_CURRENT_SRC: {
+					/// DC sources are shorted/opened in small-signal, their right-hand side only goes to `dc`.
+					comp_stamp_dc(cmp, n2m, &buf);
+					stamps_apply(&buf, n, sys->G, dc_rhs);
+					break;
+				}
+				case COMP_CAPACITOR: {
+					stamp_push_conductance(&buf, a, b, b_g, cmp->value);
+					stamps_apply(&buf, n, sys->C, dc_rhs);
+					break;
+				}
+				case COMP_INDUCTOR: {
+					if( rat_lt(rat_abs(cmp->value), rat_epsilon()) ) {
+						break;
+					}
+					stamp_push_conductance(&buf, a, b, b_g, rat_recip(cmp->value));
+					stamps_apply(&buf, n, sys->Gam, dc_rhs);
+					break;
+				}
+				case COMP_AC_CURRENT_SRC: {
+					/// same orientation as the DC source: i A+ B- amps ==> A --i-> B
+					sys->rhs[a] = cplx_sub_rat(sys->rhs[a], cmp->value);
+					if( !b_g ) {
+						sys->rhs[b] = cplx_add_rat(sys->rhs[b], cmp->value);
+					}
+					break;
+				}
+			}
+		}
+	}
+	
+	size_t rows[MAX_NODES] = {0};
+	rat const eps = rat_epsilon();
+	for( size_t i=0; i < n; i++ ) {
+		for( size_t j=0; j < n; j++ ) {
+			size_t const ij = idx_2_to_1(i,j,n);
+			if( !rat_lt(rat_abs(sys->G[ij]), eps) || !rat_lt(rat_abs(sys->C[ij]), eps) || !rat_lt(rat_abs(sys->Gam[ij]), eps) ) {
+				rows[i] |= (1 << j);
+			}
+		}
+	}
+	lu_symbolic_from_pattern(n, rows, &sys->sym);
+	return true;
+}
+
+/// Y(ω) into `Y`.
+CIRCUIT_EXPORT NO_NULLS void ac_system_at(struct ACSystem const *const restrict sys, rat const omega, cplx Y[const restrict]) {
+	size_t const nn = sys->n * sys->n;
+	for( size_t i=0; i < nn; i++ ) {
+		rat const susceptance = rat_sub(rat_mul(omega, sys->C[i]), rat_div(sys->Gam[i], omega));
+		Y[i] = cplx_make(sys->G[i], susceptance);
+	}
+}
+
+/// complex twin of lu_factor_scheduled, level by level on one thread, its callers run whole points on each.
+CIRCUIT_EXPORT NO_NULLS bool lu_factor_scheduled_cplx(struct LUSymbolic const *const restrict sym, cplx A[const restrict]) {
+	size_t const n = sym->n;
+	rat const eps = rat_epsilon();
+	for( size_t l=0; l < sym->factor_depth; l++ ) {
+		for( size_t o=sym->factor_levels[l]; o < sym->factor_levels[l+1]; o++ ) {
+			size_t const k = sym->factor_order[o];
+			for( size_t i=k; i < n; i++ ) {
+				if( i > k && !(sym->L_rows[i] & (1 << k)) ) {
+					continue;
+				}
+				cplx acc = A[idx_2_to_1(i,k,n)];
+				for( size_t j=0; j < k; j++ ) {
+					if( (sym->L_rows[i] & (1 << j)) && (sym->U_rows[j] & (1 << k)) ) {
+						acc = cplx_sub_cplx(acc, cplx_mul_cplx(A[idx_2_to_1(i,j,n)], A[idx_2_to_1(j,k,n)]));
+					}
+				}
+				A[idx_2_to_1(i,k,n)] = acc;
+			}
+			for( size_t i=k+1; i < n; i++ ) {
+				if( !(sym->U_rows[k] & (1 << i)) ) {
+					continue;
+				}
+				cplx acc = A[idx_2_to_1(k,i,n)];
+				for( size_t j=0; j < k; j++ ) {
+					if( (sym->L_rows[k] & (1 << j)) && (sym->U_rows[j] & (1 << i)) ) {
+						acc = cplx_sub_cplx(acc, cplx_mul_cplx(A[idx_2_to_1(k,j,n)], A[idx_2_to_1(j,i,n)]));
+					}
+				}
+				A[idx_2_to_1(k,i,n)] = acc;
+			}
+			cplx const pivot = A[idx_2_to_1(k,k,n)];
+			if( rat_lt(cplx_abs(pivot), eps) ) {
+				return false;
+			}
+			for( size_t i=k+1; i < n; i++ ) {
+				if( sym->L_rows[i] & (1 << k) ) {
+					A[idx_2_to_1(i,k,n)] = cplx_div_cplx(A[idx_2_to_1(i,k,n)], pivot);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+/// complex twin of lu_solve_scheduled, on one thread like the factorization.
+CIRCUIT_EXPORT NO_NULLS void lu_solve_scheduled_cplx(struct LUSymbolic const *const restrict sym, cplx const LU[const restrict], cplx b[const restrict]) {
+	size_t const n = sym->n;
+	for( size_t l=0; l < sym->forward_depth; l++ ) {
+		for( size_t o=sym->forward_levels[l]; o < sym->forward_levels[l+1]; o++ ) {
+			size_t const i = sym->forward_order[o];
+			for( size_t j=0; j < i; j++ ) {
+				if( sym->L_rows[i] & (1 << j) ) {
+					b[i] = cplx_sub_cplx(b[i], cplx_mul_cplx(LU[idx_2_to_1(i,j,n)], b[j]));
+				}
+			}
+		}
+	}
+	for( size_t l=0; l < sym->backward_depth; l++ ) {
+		for( size_t o=sym->backward_levels[l]; o < sym->backward_levels[l+1]; o++ ) {
+			size_t const i = sym->backward_order[o];
+			for( size_t j=i+1; j < n; j++ ) {
+				if( sym->U_rows[i] & (1 << j) ) {
+					b[i] = cplx_sub_cplx(b[i], cplx_mul_cplx(LU[idx_2_to_1(i,j,n)], b[j]));
+				}
+			}
+			b[i] = cplx_div_cplx(b[i], LU[idx_2_to_1(i,i,n)]);
+		}
+	}
+}
+
+/// solves one frequency point into `x`, `Y` is scratch. false if Y(ω) is singular.
+CIRCUIT_EXPORT NO_NULLS bool ac_solve_point(struct ACSystem const *const restrict sys, rat const freq, cplx Y[const restrict], cplx x[const restrict]) {
+	rat const omega = rat_mul(rat_mul(rat_from_int(2), rat_pi()), freq);
+	ac_system_at(sys, omega, Y);
+	if( !lu_factor_scheduled_cplx(&sys->sym, Y) ) {
+		return false;
+	}
+	memcpy(x, sys->rhs, sys->n * sizeof *x);
+	lu_solve_scheduled_cplx(&sys->sym, Y, x);
+	return true;
+}
+
+CIRCUIT_EXPORT NO_NULLS void ac_print_point(FILE *const restrict out, struct ACSystem const *const restrict sys, cplx const x[const restrict]) {
+	for( size_t i=0; i < sys->n; i++ ) {
+		char mag[48] = {0}, deg[48] = {0};
+		rat phase = rat_zero();
+		rat const m = cplx_to_polar(x[i], &phase);
+		fprintf(out, "  V%u = %s @ %s deg\n", sys->matrix_id_to_node[i], rat_to_cstr(m, sizeof mag, mag), rat_to_cstr(rat_rad_to_deg(phase), sizeof deg, deg));
+	}
+}
+
+/// a chunk of sweep points, every one with its own Y and x.
+struct ACChunk {
+	struct ACSystem const *sys;
+	struct ACSweep  const *sw;
+	cplx                  *Y, *x;
+	bool                  *ok;
+	size_t                 first;
+};
+
+CIRCUIT_EXPORT void ac_point_body(void *const ctx, size_t const p, size_t const worker) {
+	struct ACChunk const *const ch = ctx;
+	size_t const n = ch->sys->n;
+	( void )(worker);
+	ch->ok[p] = ac_solve_point(ch->sys, ac_sweep_freq(ch->sw, ch->first + p), &ch->Y[p*n*n], &ch->x[p*n]);
+}
+
+/**
+ * Runs the sweep and prints magnitude/phase of every node per point.
+ * Points are independent of each other, each only needs its own Y and x, so they're
+ * solved par_threads() at a time through par_for and printed in order after each chunk.
+ */
+CIRCUIT_EXPORT NO_NULLS void circuit_solve_ac(struct Circuit *const restrict c, struct ACSweep const *const restrict sw, FILE *const restrict out) {
+	if( circuit_has_devices(c) ) {
+		fputs("ac: linear circuits only\n", out);
+		return;
+	}
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	size_t const count = ac_sweep_count(sw);
+	struct ACSystem sys = {0};
+	if( count==0 || !circuit_build_ac(c, &sys) ) {
+		bistack_release_front(&c->bistack, mark);
+		return;
+	}
+	size_t const n = sys.n;
+	size_t const chunk = par_threads() < count? par_threads() : count;
+	struct ACChunk ch = { .sys = &sys, .sw = sw };
+	ch.Y  = bistack_alloc_front_vec(&c->bistack, chunk*n*n, sizeof *ch.Y);
+	ch.x  = bistack_alloc_front_vec(&c->bistack, chunk*n, sizeof *ch.x);
+	ch.ok = bistack_alloc_front_vec(&c->bistack, chunk, sizeof *ch.ok);
+	if( ch.Y==NULL || ch.x==NULL || ch.ok==NULL ) {
+		bistack_release_front(&c->bistack, mark);
+		return;
+	}
+	for( ch.first=0; ch.first < count; ch.first += chunk ) {
+		size_t const points = count - ch.first < chunk? count - ch.first : chunk;
+		par_for(points, ac_point_body, &ch);
+		for( size_t p=0; p < points; p++ ) {
+			char num[48] = {0};
+			fprintf(out, "f = %s Hz\n", rat_to_cstr(ac_sweep_freq(sw, ch.first + p), sizeof num, num));
+			if( !ch.ok[p] ) {
+				fputs("  singular\n", out);
+				continue;
+			}
+			ac_print_point(out, &sys, &ch.x[p*n]);
+		}
+	}
+	bistack_release_front(&c->bistack, mark);
+}
+#endif
@@ -0,0 +1,289 @@
+#ifndef BATCH_H_INCLUDED
+#	define BATCH_H_INCLUDED
+
+#include "rcache.h"
+#	ifndef TICE_H
+#include <pthread.h>
+#	endif
+
+
+/// Batch mode, many netlists solved by one process.
+///   litespice --batch jobs.txt    one netlist path per line, # comments.
+///   litespice --batch -           netlists on stdin, each ended by a .end line.
+/// The backing memory is split into BATCH_WORKERS arenas, one per worker thread and bound as
+/// its bistack_local. A worker takes the next job off the shared input, builds the circuit in
+/// its arena and runs the deck into a buffer of its own, so no circuit memory is allocated per
+/// job and startup is paid once.
+/// A job's lines are kept in a chained arena off the end of the worker's slice, a netlist
+/// that outgrows it spills into mapped chunks that go away when the job is done.
+/// Each job's output starts with a "job <k> <name>" line and goes out whole, in input
+/// order, whichever worker finishes first.
+/// With --cache <dir> [limit_kb] after either form, jobs go through rcache.h's result cache,
+/// its lookups and stores are taken under the queue's lock.
+/// PC only, the calculator has neither files to batch nor threads.
+
+enum {
+	BATCH_WORKERS   = 4,
+	BATCH_LINE_LEN  = 100,
+	BATCH_PATH_LEN  = 256,
+	BATCH_CHUNK_LEN = 64U << 10,
+};
+
+#	ifndef TICE_H
+/// the input and output every worker shares, all of it behind `lock`.
+struct BatchQueue {
+	pthread_mutex_t    lock;
+	pthread_cond_t     emitted;  /// signalled every time a job's output goes out.
+	FILE              *in;       /// the manifest, or the netlist stream itself.
+	FILE              *out;
+	struct BatchStats *stats;
+	size_t             next_job, next_emit;
+	bool               stream;
+};
+#	endif
+
+struct BatchWorker {
+	struct TIBiStack    stack;  /// bound as the thread's bistack_local for as long as it runs.
+	struct TIChainArena lines;
+	struct ResultCache *cache;  /// NULL to always run.
+	struct BatchQueue  *queue;
+	size_t              jobs, id;
+};
+
+struct BatchStats {
+	size_t jobs, failed, lines;
+	size_t per_worker[BATCH_WORKERS];
+};
+
+/// the line minus its newline, false on a blank, a * comment or a # comment.
+CIRCUIT_EXPORT NO_NULLS bool batch_clean_line(char line[const restrict static 1]) {
+	line[strcspn(line, "\r\n")] = 0;
+	size_t i = 0;
+	skip_ws(line, &i);
+	return line[i] != 0 && line[i] != '*' && line[i] != '#';
+}
+
+/// ".end" on its own, what ends a netlist in a stream.
+CIRCUIT_EXPORT NO_NULLS bool batch_is_end(char const line[const restrict static 1]) {
+	size_t i = 0;
+	skip_ws(line, &i);
+	size_t const word = strcspn(&line[i], " \t\r\n");
+	return word==4 && strncmp(&line[i], ".end", 4)==0;
+}
+
+/// parses the kept lines into the circuit and runs them, a circuit that doesn't fit isn't run at all.
+CIRCUIT_EXPORT NO_NULLS void batch_run_lines(struct DeckLine const *const restrict head, struct Circuit *const restrict c, FILE *const restrict out) {
+	struct Deck deck = {0};
+	size_t line = 1;
+	for( struct DeckLine const *l = head; l != NULL; l=l->next, line++ ) {
+		if( deck_add_line(&deck, c, l->text)==ERR_OOM ) {
+			fprintf(out, "batch: out of memory at line %zu\n", line);
+			return;
+		}
+	}
+	deck_run(&deck, c, out);
+}
+
+/// one netlist taken off the input, `index` is its place in it and in the output.
+struct BatchJob {
+	struct DeckLine *head;
+	size_t           index, lines;
+	bool             kept;  /// false once a line didn't fit, the job is reported instead of run.
+	char             name[BATCH_PATH_LEN];
+};
+
+/// keeps the lines of one netlist from `in` in the worker's line arena, up to EOF or a .end line.
+CIRCUIT_EXPORT NO_NULLS void batch_read_deck(struct BatchWorker *const restrict w, FILE *const restrict in, struct BatchJob *const restrict job) {
+	struct DeckLine **tail = &job->head;
+	job->kept = true;
+	for( char line[BATCH_LINE_LEN] = {0}; fgets(line, sizeof line, in) != NULL; ) {
+		if( batch_is_end(line) ) {
+			break;
+		} else if( batch_clean_line(line) ) {
+			struct DeckLine *const l = job->kept? deck_line_keep(&w->lines, line) : NULL;
+			if( l != NULL ) {
+				*tail = l;
+				tail = &l->next;
+			}
+			job->kept = l != NULL;
+			job->lines++;
+		}
+	}
+}
+
+/**
+ * Runs a job's kept lines in a fresh circuit under a "job <k> <name>" line, or replays its cached output.
+ * The circuit takes the whole of the calling thread's bistack_local.
+ */
+CIRCUIT_EXPORT NO_NULLS void batch_run_job(struct BatchWorker *const restrict w, struct BatchJob const *const restrict job, FILE *const restrict out) {
+	struct TIBiStack const *const stack = bistack_local();
+	struct Circuit circuit = circuit_make(stack->len, stack->mem);
+	fprintf(out, "job %zu %s\n", job->index, job->name);
+	w->jobs++;
+	if( !job->kept ) {
+		fputs("batch: netlist too large\n", out);
+	}
+	bool done = !job->kept;
+#	ifndef TICE_H
+	if( !done && w->cache != NULL && deck_lines_cacheable(job->head) ) {
+		uint64_t const key = deck_lines_hash(job->head);
+		pthread_mutex_lock(&w->queue->lock);
+		done = rcache_replay(w->cache, key, out);
+		pthread_mutex_unlock(&w->queue->lock);
+		FILE *const tmp = done? NULL : rcache_begin(w->cache, key, w->id);
+		if( tmp != NULL ) {
+			batch_run_lines(job->head, &circuit, tmp);
+			pthread_mutex_lock(&w->queue->lock);
+			rcache_store(w->cache, key, w->id, tmp, out);
+			pthread_mutex_unlock(&w->queue->lock);
+			done = true;
+		}
+	} else if( !done && w->cache != NULL ) {
+		pthread_mutex_lock(&w->queue->lock);
+		w->cache->bypassed++;
+		pthread_mutex_unlock(&w->queue->lock);
+	}
+#	endif
+	if( !done ) {
+		batch_run_lines(job->head, &circuit, out);
+	}
+}
+
+#	ifndef TICE_H
+CIRCUIT_EXPORT void batch_pool_make(struct BatchWorker pool[const restrict static BATCH_WORKERS], uint8_t mem[const restrict static 1], size_t const len, struct ResultCache *const cache, struct BatchQueue *const queue) {
+	size_t const slice = (len / BATCH_WORKERS) & ~( size_t )(TI_MEM_ALIGN - 1);
+	size_t const lines = (slice / 8) & ~( size_t )(TI_MEM_ALIGN - 1);
+	for( size_t k=0; k < BATCH_WORKERS; k++ ) {
+		pool[k] = (struct BatchWorker){
+			.lines = chain_make(&mem[k*slice + slice - lines], lines, BATCH_CHUNK_LEN),
+			.stack = bistack_make(&mem[k*slice], slice - lines), .cache = cache, .queue = queue, .id = k,
+		};
+	}
+}
+
+/**
+ * Takes the next job off the queue, false when the input is used up.
+ * A stream job's lines are read here under the lock since they are the input,
+ * a manifest job only gets its path and is read by the worker afterwards.
+ */
+CIRCUIT_EXPORT NO_NULLS bool batch_take_job(struct BatchWorker *const restrict w, struct BatchJob *const restrict job) {
+	struct BatchQueue *const q = w->queue;
+	bool got = false;
+	pthread_mutex_lock(&q->lock);
+	while( !got && !feof(q->in) && !ferror(q->in) ) {
+		*job = (struct BatchJob){ .name = "-" };
+		if( q->stream ) {
+			batch_read_deck(w, q->in, job);
+			got = job->lines > 0;
+		} else {
+			got = fgets(job->name, sizeof job->name, q->in) != NULL && batch_clean_line(job->name);
+		}
+	}
+	job->index = q->next_job;
+	q->next_job += got;
+	pthread_mutex_unlock(&q->lock);
+	return got;
+}
+
+/// writes a job's buffered output once every job before it is out, then lets the next one go.
+CIRCUIT_EXPORT NO_NULLS void batch_emit(struct BatchQueue *const restrict q, struct BatchJob const *const restrict job, char const text[const restrict], size_t const size) {
+	pthread_mutex_lock(&q->lock);
+	while( q->next_emit != job->index ) {
+		pthread_cond_wait(&q->emitted, &q->lock);
+	}
+	fwrite(text, 1, size, q->out);
+	q->stats->lines  += job->lines;
+	q->stats->failed += job->lines==0;
+	q->next_emit++;
+	pthread_cond_broadcast(&q->emitted);
+	pthread_mutex_unlock(&q->lock);
+}
+
+/// a worker thread, takes jobs and runs them into its own buffer until the input runs out.
+CIRCUIT_EXPORT void *batch_worker_main(void *const arg) {
+	struct BatchWorker *const w = arg;
+	struct TIBiStack *const was = bistack_local_bind(&w->stack);
+	for( ;; ) {
+		struct TIChainMark const mark = chain_mark(&w->lines);
+		struct BatchJob job;
+		if( !batch_take_job(w, &job) ) {
+			break;
+		}
+		char *text = NULL;
+		size_t size = 0;
+		FILE *const buf = open_memstream(&text, &size);
+		if( buf==NULL ) {
+			job.lines = 0;
+			char line[BATCH_PATH_LEN + 48] = {0};
+			snprintf(line, sizeof line, "job %zu %s\nbatch: out of memory\n", job.index, job.name);
+			batch_emit(w->queue, &job, line, strlen(line));
+			chain_release(&w->lines, mark);
+			continue;
+		}
+		if( !w->queue->stream ) {
+			FILE *const netlist = fopen(job.name, "r");
+			if( netlist != NULL ) {
+				batch_read_deck(w, netlist, &job);
+				fclose(netlist);
+			}
+			if( job.lines==0 ) {
+				fprintf(buf, "job %zu %s\nbatch: %s\n", job.index, job.name, netlist==NULL? "can't open netlist" : "empty netlist");
+			}
+		}
+		if( job.lines > 0 ) {
+			batch_run_job(w, &job, buf);
+		}
+		fclose(buf);
+		batch_emit(w->queue, &job, text, size);
+		free(text);
+		chain_release(&w->lines, mark);
+	}
+	( void )(bistack_local_bind(was));
+	return NULL;
+}
+
+/**
+ * Runs every job of a manifest, or every .end-separated netlist of a stream when
+ * `manifest` is "-", out of `mem`, through `cache` unless it's NULL.
+ * Returns false if the manifest couldn't be opened.
+ */
+CIRCUIT_EXPORT bool batch_run(char const manifest[const restrict static 1], uint8_t mem[const restrict static 1], size_t const len, struct ResultCache *const cache, FILE *const restrict out, struct BatchStats *const restrict stats) {
+	*stats = (struct BatchStats){0};
+	bool const stream = !strcmp(manifest, "-");
+	struct BatchQueue queue = {
+		.lock = PTHREAD_MUTEX_INITIALIZER, .emitted = PTHREAD_COND_INITIALIZER,
+		.in = stream? stdin : fopen(manifest, "r"), .out = out, .stats = stats, .stream = stream,
+	};
+	if( queue.in==NULL ) {
+		return false;
+	}
+	struct BatchWorker pool[BATCH_WORKERS];
+	batch_pool_make(pool, mem, len, cache, &queue);
+	pthread_t threads[BATCH_WORKERS];
+	bool started[BATCH_WORKERS] = {0};
+	size_t running = 0;
+	for( size_t k=0; k < BATCH_WORKERS; k++ ) {
+		started[k] = pthread_create(&threads[k], NULL, batch_worker_main, &pool[k])==0;
+		running += started[k];
+	}
+	/// no threads to be had, the first worker does every job here.
+	if( running==0 ) {
+		batch_worker_main(&pool[0]);
+	}
+	for( size_t k=0; k < BATCH_WORKERS; k++ ) {
+		if( started[k] ) {
+			pthread_join(threads[k], NULL);
+		}
+	}
+	if( !stream ) {
+		fclose(queue.in);
+	}
+	stats->jobs = queue.next_job;
+	for( size_t k=0; k < BATCH_WORKERS; k++ ) {
+		stats->per_worker[k] = pool[k].jobs;
+		chain_free(&pool[k].lines);
+	}
+	return true;
+}
+#	endif
+#endif
@@ -0,0 +1,153 @@
+#ifndef BENCH_H_INCLUDED
+#	define BENCH_H_INCLUDED
+
+#include "deck.h"
+
+
+/// Thread scaling benchmark for the par_for loops.
+///   litespice --bench [max_threads]
+/// Runs every kernel on a built-in 9-node mesh at 1, 2, 4, ... up to max_threads (64 if not
+/// given) and prints the best of BENCH_REPS wall times in ms with the speedup over one thread.
+///   rref     the dense sequential gaussian_rref DC solve, the reference the others replace.
+///   lu       the DC solve on the scheduled LU, etree levels and level-scheduled substitutions.
+///   dissect  the DC solve by nested dissection, one subdomain per task.
+///   ac       an AC sweep, one point per task.
+///   mc       a Monte Carlo run, one worker per task.
+/// The kernels repeat enough to take a few ms each. rref never threads and the mesh is too
+/// small to partition its stamping, on a mesh this small lu and dissect show what waking the pool costs.
+/// PC only.
+
+#	ifndef TICE_H
+#include <time.h>
+
+enum {
+	BENCH_REPS      = 5,
+	BENCH_DC_ITERS  = 2000,
+	BENCH_AC_POINTS = 2000,
+	BENCH_MC_RUNS   = 4000,
+};
+
+enum BenchKernel {
+	BenchRref,
+	BenchLu,
+	BenchDissect,
+	BenchAc,
+	BenchMc,
+	MAX_BENCH_KERNELS,
+};
+
+/// a 3x3 resistor grid with a capacitor from every node, a DC drive at one corner, an AC one at the other.
+CIRCUIT_EXPORT NO_NULLS void bench_mesh(struct Circuit *const restrict c) {
+	circuit_add_from_string(c,
+		"R 1 2 1k\nR 2 3 2.2k\nR 4 5 1k\nR 5 6 2.2k\nR 7 8 1k\nR 8 9 2.2k\n"
+		"R 1 4 3.3k\nR 4 7 1k\nR 2 5 3.3k\nR 5 8 1k\nR 3 6 3.3k\nR 6 9 1k\n"
+		"R 1 0 10k\nR 9 0 4.7k\nR 5 0 22k\n"
+		"C 1 0 1u\nC 2 0 2.2u\nC 3 0 1u\nC 4 0 2.2u\nC 5 0 1u\nC 6 0 2.2u\nC 7 0 1u\nC 8 0 2.2u\nC 9 0 1u\n"
+		"I 1 0 -1m\ni 9 0 -1\n");
+}
+
+CIRCUIT_EXPORT double bench_now_ms(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ( double )(ts.tv_sec) * 1e3 + ( double )(ts.tv_nsec) * 1e-6;
+}
+
+/// one repetition of `kernel`, all of its scratch comes off the circuit's front stack and goes back.
+CIRCUIT_EXPORT NO_NULLS void bench_kernel(struct Circuit *const restrict c, enum BenchKernel const kernel, FILE *const restrict sink) {
+	rat V[MAX_NODES];
+	switch( kernel ) {
+		case BenchRref: {
+			for( size_t k=0; k < BENCH_DC_ITERS; k++ ) {
+				struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+				uint8_t matrix_id_to_node[MAX_NODES] = {0};
+				rat *G = NULL, *rhs = NULL;
+				size_t const n = circuit_build_dc(c, &matrix_id_to_node, &G, &rhs);
+				if( n > 0 && G != NULL && rhs != NULL ) {
+					( void )(gaussian_rref(n, G, rhs));
+				}
+				bistack_release_front(&c->bistack, mark);
+			}
+			break;
+		}
+		case BenchLu:
+			for( size_t k=0; k < BENCH_DC_ITERS; k++ ) {
+				( void )(circuit_dc_voltages(c, &V));
+			}
+			break;
+		case BenchDissect:
+			for( size_t k=0; k < BENCH_DC_ITERS; k++ ) {
+				struct Dissection nd;
+				bool fell_back = false;
+				( void )(circuit_dc_voltages_dissected(c, &V, &nd, &fell_back));
+			}
+			break;
+		case BenchAc: {
+			struct ACSweep const sw = { .fstart = rat_from_int(1), .fstop = rat_from_int(100000), .points = BENCH_AC_POINTS, .kind = AC_SWEEP_LIN };
+			circuit_solve_ac(c, &sw, sink);
+			break;
+		}
+		case BenchMc: {
+			struct MCSettings mc = { .samples = BENCH_MC_RUNS, .seed = 1 };
+			mc.tol[COMP_RESISTOR]  = rat_div(rat_from_int(5), rat_from_int(100));
+			mc.tol[COMP_CAPACITOR] = rat_div(rat_from_int(10), rat_from_int(100));
+			struct MCResult res;
+			( void )(circuit_monte_carlo(c, &mc, &res));
+			break;
+		}
+		case MAX_BENCH_KERNELS:
+			break;
+	}
+}
+
+/**
+ * Prints one row per thread count, restores the thread count it found.
+ * Returns false when the mesh doesn't fit in `mem` or the AC output can't be thrown away.
+ */
+CIRCUIT_EXPORT bool bench_run(size_t const max_threads, uint8_t mem[const restrict static 1], size_t const len, FILE *const restrict out) {
+	static char const *const names[MAX_BENCH_KERNELS] = { "rref", "lu", "dissect", "ac", "mc" };
+	struct Circuit c = circuit_make(len, mem);
+	bench_mesh(&c);
+	if( c.components[1]==NULL ) {
+		return false;
+	}
+	FILE *const sink = fopen("/dev/null", "w");
+	if( sink==NULL ) {
+		return false;
+	}
+	size_t const restore = par_threads();
+	size_t const top = max_threads==0? 1 : max_threads > PAR_MAX_THREADS? PAR_MAX_THREADS : max_threads;
+	fprintf(out, "%-8s", "threads");
+	for( size_t k=0; k < MAX_BENCH_KERNELS; k++ ) {
+		fprintf(out, " %18s", names[k]);
+	}
+	fputc('\n', out);
+	double base[MAX_BENCH_KERNELS] = {0};
+	for( size_t threads=1;; threads = threads*2 > top? top : threads*2 ) {
+		par_set_threads(threads);
+		fprintf(out, "%-8zu", threads);
+		for( size_t k=0; k < MAX_BENCH_KERNELS; k++ ) {
+			double best = 0.0;
+			for( size_t rep=0; rep < BENCH_REPS; rep++ ) {
+				double const start = bench_now_ms();
+				bench_kernel(&c, ( enum BenchKernel )(k), sink);
+				double const ms = bench_now_ms() - start;
+				if( rep==0 || ms < best ) {
+					best = ms;
+				}
+			}
+			if( threads==1 ) {
+				base[k] = best;
+			}
+			fprintf(out, " %9.2fms %5.2fx", best, best > 0.0? base[k] / best : 0.0);
+		}
+		fputc('\n', out);
+		if( threads==top ) {
+			break;
+		}
+	}
+	par_set_threads(restore);
+	fclose(sink);
+	return true;
+}
+#	endif
+#endif
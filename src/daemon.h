@@ -0,0 +1,394 @@
+#ifndef DAEMON_H_INCLUDED
+#	define DAEMON_H_INCLUDED
+
+#include "batch.h"
+
+
+/// Topology-keyed cache of symbolic factorizations, and a local solver server around it.
+/// A circuit's topology hash covers its active nodes and every component's kind and
+/// terminals, controlling nodes included, but no values. Circuits that only differ in
+/// values share one entry, so a hit skips lu_symbolic's ordering, fill and scheduling
+/// and goes straight to stamping and the numeric factorization.
+/// Every entry also keeps the topology's stamp program, the G or rhs slot each stamp of the
+/// component walk lands in. A hit stamps the components once and scatters the values by
+/// it, without the counting pass or any index arithmetic. A walk that comes out a
+/// different length (a zero-ohm resistor stamps nothing) builds the matrix the usual way.
+/// Before an entry is used its pattern is checked to cover the new matrix's nonzeros,
+/// which catches collisions and values that cancel to zero.
+/// Entries live in a fixed array sized by a byte cap, the least recently used one goes
+/// when it's full.
+///   litespice --serve /tmp/litespice.sock [cache_kb]
+/// Each connection sends a netlist and half-closes, or ends it with .end, and gets back
+/// the DC operating point followed by "cache: hit|miss". A netlist with directives is run
+/// whole like a batch job instead, followed by "cache: bypassed". A lone .stats line gets
+/// the cache counters. POSIX only, there are no sockets on the calculator.
+
+enum {
+	SYMCACHE_MAX_STAMPS = 128, /// longer walks get no stamp program.
+};
+
+struct SymCacheEntry {
+	struct LUSymbolic sym;
+	uint64_t          key, used;
+	uint8_t           matrix_id_to_node[MAX_NODES];
+	uint8_t           slots[SYMCACHE_MAX_STAMPS];  /// row*n + col in G, n*n + row in rhs.
+	size_t            n, stamps;                   /// no stamp program when `stamps` is 0.
+};
+
+struct SymCache {
+	struct SymCacheEntry *entries;
+	uint64_t              clock;
+	size_t                cap, count;
+	size_t                hits, misses, evictions, rejected, replayed, bypassed;
+};
+
+/// FNV-1a over the structure, values left out.
+CIRCUIT_EXPORT NO_NULLS uint64_t circuit_topology_hash(struct Circuit const *const c) {
+	uint64_t h = FNV_OFFSET;
+	for( size_t i=0; i < sizeof c->active_nodes; i++ ) {
+		h = fnv1a_byte(h, ( uint8_t )(c->active_nodes >> (8*i)));
+	}
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+			h = fnv1a_byte(h, cmp->kind);
+			h = fnv1a_byte(h, cmp->owner);
+			h = fnv1a_byte(h, cmp->node);
+			if( cmp->kind >= COMP_VCCS && cmp->kind <= COMP_CCCS ) {
+				h = fnv1a_byte(h, cmp->aux.dep.np);
+				h = fnv1a_byte(h, cmp->aux.dep.nn);
+			}
+		}
+	}
+	return h;
+}
+
+/// room for as many entries as fit in `bytes`, at least one and at most half of what `s` has left, on its back.
+CIRCUIT_EXPORT NO_NULLS bool symcache_make(struct SymCache *const restrict cache, struct TIBiStack *const restrict s, size_t const bytes) {
+	*cache = (struct SymCache){0};
+	size_t const most = (s->back - s->front) / 2;
+	cache->cap = (bytes < most? bytes : most) / sizeof *cache->entries;
+	if( cache->cap==0 ) {
+		cache->cap = 1;
+	}
+	cache->entries = bistack_alloc_back_vec(s, cache->cap, sizeof *cache->entries);
+	return cache->entries != NULL;
+}
+
+CIRCUIT_EXPORT NO_NULLS size_t symcache_bytes(struct SymCache const *const cache) {
+	return cache->count * sizeof *cache->entries;
+}
+
+/// true if every nonzero of A has a slot in the entry's L/U pattern.
+CIRCUIT_EXPORT NO_NULLS bool symcache_covers(struct SymCacheEntry const *const restrict e, size_t const n, rat const A[const restrict static n*n], uint8_t const matrix_id_to_node[const restrict static MAX_NODES]) {
+	if( e->n != n || memcmp(e->matrix_id_to_node, matrix_id_to_node, MAX_NODES) != 0 ) {
+		return false;
+	}
+	rat const eps = rat_epsilon();
+	for( size_t i=0; i < n; i++ ) {
+		size_t const slots = e->sym.L_rows[i] | e->sym.U_rows[i] | (( size_t )(1) << i);
+		for( size_t j=0; j < n; j++ ) {
+			if( !(slots & (( size_t )(1) << j)) && !rat_lt(rat_abs(A[idx_2_to_1(i,j,n)]), eps) ) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * The cached analysis for `key` that fits A, or NULL after counting a miss.
+ * A hit is stamped most recently used.
+ */
+CIRCUIT_EXPORT NO_NULLS struct SymCacheEntry *symcache_lookup(struct SymCache *const restrict cache, uint64_t const key, size_t const n, rat const A[const restrict static n*n], uint8_t const matrix_id_to_node[const restrict static MAX_NODES]) {
+	for( size_t k=0; k < cache->count; k++ ) {
+		struct SymCacheEntry *const e = &cache->entries[k];
+		if( e->key != key ) {
+			continue;
+		} else if( !symcache_covers(e, n, A, matrix_id_to_node) ) {
+			cache->rejected++;
+			break;
+		}
+		e->used = ++cache->clock;
+		cache->hits++;
+		return e;
+	}
+	cache->misses++;
+	return NULL;
+}
+
+/// analyzes A and keeps it under `key`, replacing a stale entry for the key or the least recently used one.
+CIRCUIT_EXPORT NO_NULLS struct SymCacheEntry *symcache_insert(struct SymCache *const restrict cache, uint64_t const key, size_t const n, rat const A[const restrict static n*n], uint8_t const matrix_id_to_node[const restrict static MAX_NODES]) {
+	struct SymCacheEntry *slot = NULL;
+	for( size_t k=0; k < cache->count && slot==NULL; k++ ) {
+		if( cache->entries[k].key==key ) {
+			slot = &cache->entries[k];
+		}
+	}
+	if( slot==NULL && cache->count < cache->cap ) {
+		slot = &cache->entries[cache->count++];
+	} else if( slot==NULL ) {
+		slot = &cache->entries[0];
+		for( size_t k=1; k < cache->count; k++ ) {
+			if( cache->entries[k].used < slot->used ) {
+				slot = &cache->entries[k];
+			}
+		}
+		cache->evictions++;
+	}
+	slot->key  = key;
+	slot->n    = n;
+	slot->used = ++cache->clock;
+	memcpy(slot->matrix_id_to_node, matrix_id_to_node, MAX_NODES);
+	lu_symbolic(n, A, &slot->sym);
+	return slot;
+}
+
+/// the entry for `key` without touching the counters, NULL if there's none.
+CIRCUIT_EXPORT NO_NULLS struct SymCacheEntry *symcache_find(struct SymCache const *const cache, uint64_t const key) {
+	for( size_t k=0; k < cache->count; k++ ) {
+		if( cache->entries[k].key==key ) {
+			return &cache->entries[k];
+		}
+	}
+	return NULL;
+}
+
+/// records where each stamp of the circuit's walk lands, none when the walk is too long or doesn't fit on the stack.
+CIRCUIT_EXPORT NO_NULLS void symcache_record_program(struct SymCacheEntry *const restrict e, struct Circuit *const restrict c) {
+	e->stamps = 0;
+	uint8_t node_to_matrix_id[MAX_NODES], matrix_id_to_node[MAX_NODES];
+	size_t const n = setup_matrix_ids(c->active_nodes, &node_to_matrix_id, &matrix_id_to_node);
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	struct StampBuffer buf = { .cap = SYMCACHE_MAX_STAMPS };
+	buf.data = bistack_alloc_front_vec(&c->bistack, buf.cap, sizeof *buf.data);
+	if( buf.data==NULL || n != e->n ) {
+		bistack_release_front(&c->bistack, mark);
+		return;
+	}
+	circuit_stamp_nodes(c, 1, MAX_NODES, ( uint8_t const(*)[MAX_NODES] )(&node_to_matrix_id), &buf);
+	if( buf.len <= buf.cap ) {
+		for( size_t i=0; i < buf.len; i++ ) {
+			struct Stamp const *const st = &buf.data[i];
+			e->slots[i] = st->col==STAMP_RHS? n*n + st->row : idx_2_to_1(st->row, st->col, n);
+		}
+		e->stamps = buf.len;
+	}
+	bistack_release_front(&c->bistack, mark);
+}
+
+/**
+ * Builds the DC system from the entry's stamp program into front-stack G/rhs.
+ * False with nothing kept when the walk doesn't match the program or memory runs out.
+ */
+CIRCUIT_EXPORT NO_NULLS bool circuit_build_dc_program(struct Circuit *const restrict c, struct SymCacheEntry const *const restrict e, uint8_t (*const restrict matrix_id_to_node)[MAX_NODES], rat **const restrict G_out, rat **const restrict I_out) {
+	uint8_t node_to_matrix_id[MAX_NODES];
+	size_t const n = setup_matrix_ids(c->active_nodes, &node_to_matrix_id, matrix_id_to_node);
+	if( e->stamps==0 || n != e->n || memcmp(*matrix_id_to_node, e->matrix_id_to_node, n) != 0 ) {
+		return false;
+	}
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	rat *const G = alloc_vec(&c->bistack, n*n + n);
+	struct TIBiStackMark const scratch = bistack_mark(&c->bistack);
+	struct StampBuffer buf = { .cap = e->stamps };
+	buf.data = bistack_alloc_front_vec(&c->bistack, buf.cap + 1, sizeof *buf.data);
+	if( G != NULL && buf.data != NULL ) {
+		circuit_stamp_nodes(c, 1, MAX_NODES, ( uint8_t const(*)[MAX_NODES] )(&node_to_matrix_id), &buf);
+	}
+	if( G==NULL || buf.data==NULL || buf.len != e->stamps ) {
+		bistack_release_front(&c->bistack, mark);
+		return false;
+	}
+	for( size_t i=0; i < buf.len; i++ ) {
+		G[e->slots[i]] = rat_add(G[e->slots[i]], buf.data[i].val);
+	}
+	bistack_release_front(&c->bistack, scratch);
+	*G_out = G;
+	*I_out = &G[n*n];
+	return true;
+}
+
+/**
+ * DC operating point of a linear circuit through the cache, scattered by node into V_out.
+ * `hit` says whether the analysis came from the cache. Returns ERR_OK, ERR_OOM or ERR_SINGULAR.
+ */
+CIRCUIT_EXPORT NO_NULLS int circuit_dc_cached(struct Circuit *const restrict c, struct SymCache *const restrict cache, rat (*const restrict V_out)[MAX_NODES], bool *const restrict hit) {
+	for( size_t i=0; i < MAX_NODES; i++ ) {
+		(*V_out)[i] = rat_zero();
+	}
+	*hit = false;
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	uint8_t matrix_id_to_node[MAX_NODES] = {0};
+	rat *G = NULL, *x = NULL;
+	uint64_t const key = circuit_topology_hash(c);
+	struct SymCacheEntry const *const known = symcache_find(cache, key);
+	bool const replayed = known != NULL && circuit_build_dc_program(c, known, &matrix_id_to_node, &G, &x);
+	size_t const n = replayed? known->n : circuit_build_dc(c, &matrix_id_to_node, &G, &x);
+	rat *const A = n > 0? bistack_alloc_front_vec(&c->bistack, n*n, sizeof *A) : NULL;
+	int err = ERR_OK;
+	if( n==0 || G==NULL || x==NULL || A==NULL ) {
+		err = n==0? ERR_OK : ERR_OOM;
+		goto done;
+	}
+	memcpy(A, G, n*n * sizeof *A);
+	struct SymCacheEntry *e = symcache_lookup(cache, key, n, G, matrix_id_to_node);
+	*hit = e != NULL;
+	cache->replayed += *hit && replayed;
+	if( e==NULL ) {
+		e = symcache_insert(cache, key, n, G, matrix_id_to_node);
+		symcache_record_program(e, c);
+	}
+	if( lu_factor_scheduled(&e->sym, A) ) {
+		lu_solve_scheduled(&e->sym, A, x);
+	} else {
+		uint8_t piv[MAX_NODES] = {0};
+		if( !lu_factor(n, G, piv) ) {
+			err = ERR_SINGULAR;
+			goto done;
+		}
+		lu_solve(n, G, piv, x);
+	}
+	for( size_t i=0; i < n; i++ ) {
+		(*V_out)[matrix_id_to_node[i]] = x[i];
+	}
+done:
+	bistack_release_front(&c->bistack, mark);
+	return err;
+}
+
+CIRCUIT_EXPORT NO_NULLS void symcache_print_stats(struct SymCache const *const cache, FILE *const out) {
+	fprintf(out, "cache: %zu hits, %zu misses, %zu evictions, %zu rejected, %zu stamp replays, %zu bypassed, %zu/%zu entries, %zu bytes\n",
+		cache->hits, cache->misses, cache->evictions, cache->rejected, cache->replayed, cache->bypassed, cache->count, cache->cap, symcache_bytes(cache));
+}
+
+#	ifndef TICE_H
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+enum {
+	DAEMON_CACHE_BYTES = 64U << 10,
+	DAEMON_LINE_LEN    = 100,
+};
+
+/// reads one request from `in` into a fresh circuit on `arena` and answers on `out`.
+CIRCUIT_EXPORT NO_NULLS void daemon_handle(FILE *const restrict in, FILE *const restrict out, uint8_t arena[const restrict], size_t const len, struct SymCache *const restrict cache) {
+	struct Circuit circuit = circuit_make(len, arena);
+	struct Deck deck = {0};
+	size_t lines = 0, oom_at = 0, directives = 0;
+	for( char line[DAEMON_LINE_LEN] = {0}; fgets(line, sizeof line, in) != NULL; ) {
+		if( batch_is_end(line) ) {
+			break;
+		} else if( !batch_clean_line(line) ) {
+			continue;
+		} else if( lines==0 && strcspn(line, " \t")==6 && strncmp(line, ".stats", 6)==0 ) {
+			symcache_print_stats(cache, out);
+			return;
+		}
+		lines++;
+		size_t i = 0;
+		skip_ws(line, &i);
+		directives += line[i]=='.';
+		/// the rest of a request that doesn't fit is still read so the reply comes after all of it.
+		if( oom_at==0 && deck_add_line(&deck, &circuit, line)==ERR_OOM ) {
+			oom_at = lines;
+		}
+	}
+	if( lines==0 ) {
+		fputs("error: empty netlist\n", out);
+		return;
+	} else if( oom_at != 0 ) {
+		fprintf(out, "error: out of memory at line %zu\n", oom_at);
+		return;
+	} else if( directives > 0 ) {
+		/// the analyses want the whole deck, the cache only knows the DC point.
+		deck_run(&deck, &circuit, out);
+		cache->bypassed++;
+		fputs("cache: bypassed\n", out);
+		return;
+	} else if( circuit_has_devices(&circuit) ) {
+		circuit_solve_op(&circuit, out);
+		return;
+	}
+	rat V[MAX_NODES];
+	bool hit = false;
+	int const err = circuit_dc_cached(&circuit, cache, &V, &hit);
+	if( err != ERR_OK ) {
+		fputs(err==ERR_SINGULAR? "error: singular circuit\n" : "error: out of memory\n", out);
+		return;
+	}
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		if( circuit.active_nodes & (1 << node) ) {
+			char num[48] = {0};
+			fprintf(out, "V%u = %s\n", node, rat_to_cstr(V[node], sizeof num, num));
+		}
+	}
+	fprintf(out, "cache: %s\n", hit? "hit" : "miss");
+}
+
+/// clears a stale socket left at `path` by an earlier server, false if something else is there.
+CIRCUIT_EXPORT NO_NULLS bool daemon_clear_socket(char const path[const static 1]) {
+	struct stat st;
+	if( lstat(path, &st) != 0 ) {
+		return true;
+	}
+	return S_ISSOCK(st.st_mode) && unlink(path)==0;
+}
+
+/**
+ * Serves requests on the Unix socket at `path` one at a time, forever or until
+ * `max_requests` when that's nonzero. The cache takes `cache_bytes` off the back of
+ * `mem`, every request gets the rest. Returns false if the socket couldn't be set up
+ * or `path` names something other than a socket. A client hanging up early doesn't
+ * take the server down with SIGPIPE.
+ */
+CIRCUIT_EXPORT NO_NULLS bool daemon_serve(char const path[const restrict static 1], uint8_t mem[const restrict], size_t const len, size_t const cache_bytes, size_t const max_requests, FILE *const restrict log) {
+	struct TIBiStack store = bistack_make(mem, len);
+	struct SymCache cache;
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if( !symcache_make(&cache, &store, cache_bytes) || strlen(path) >= sizeof addr.sun_path || !daemon_clear_socket(path) ) {
+		return false;
+	}
+	strcpy(addr.sun_path, path);
+	signal(SIGPIPE, SIG_IGN);
+	/// the request arena ends where the cache starts, cut to whole numbers so the circuit's components stay aligned.
+	size_t const request_len = store.back & ~( size_t )(sizeof(rat) - 1);
+	int const listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if( listener < 0 || bind(listener, ( struct sockaddr const* )(&addr), sizeof addr) != 0 || listen(listener, 8) != 0 ) {
+		if( listener >= 0 ) {
+			close(listener);
+		}
+		return false;
+	}
+	fprintf(log, "serving on %s, cache of %zu entries\n", path, cache.cap);
+	for( size_t served=0; max_requests==0 || served < max_requests; served++ ) {
+		int const conn = accept(listener, NULL, NULL);
+		if( conn < 0 ) {
+			continue;
+		}
+		/// separate streams for each direction, closing both closes the connection once.
+		int const conn_out = dup(conn);
+		FILE *const in  = fdopen(conn, "r");
+		FILE *const out = conn_out >= 0? fdopen(conn_out, "w") : NULL;
+		if( in != NULL && out != NULL ) {
+			daemon_handle(in, out, mem, request_len, &cache);
+		}
+		if( out != NULL ) {
+			fclose(out);
+		} else if( conn_out >= 0 ) {
+			close(conn_out);
+		}
+		if( in != NULL ) {
+			fclose(in);
+		} else {
+			close(conn);
+		}
+	}
+	symcache_print_stats(&cache, log);
+	close(listener);
+	daemon_clear_socket(path);
+	return true;
+}
+#	endif
+#endif
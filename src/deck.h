@@ -0,0 +1,152 @@
+#ifndef DECK_H_INCLUDED
+#	define DECK_H_INCLUDED
+
+#include "node.h"
+#include "ac.h"
+#include "mor.h"
+#include "multirate.h"
+#include "hb.h"
+#include "montecarlo.h"
+#include "param.h"
+#include "sens.h"
+#include "nport.h"
+#include "probe.h"
+#include "wave.h"
+#include "measure.h"
+#include "four.h"
+#include "reduce.h"
+#include "macromodel.h"
+#include "dissect.h"
+
+
+/// A netlist is components plus dot-directives asking for analyses.
+/// The deck keeps the requested analyses, they run after the DC operating point.
+struct Deck {
+	struct ACSweep           ac;
+	struct MORSettings       mor;
+	struct TranSettings      tran;
+	struct MultirateSettings multirate;
+	struct HBSettings        hb;
+	struct MCSettings        mc;
+	struct ParamDeck         params;
+	struct SensSettings      sens;
+	struct NPortSettings     nport;
+	struct PrintSettings     print;
+	struct WaveSettings      wave;
+	struct MeasureSet        measures;
+	struct FourSettings      four;
+	struct ReduceSettings    reduce;
+	struct SubcktTable       subckts;
+	struct DissectSettings   dissect;
+};
+
+/// feeds one netlist line, directives go to the deck and everything else to the circuit.
+CIRCUIT_EXPORT int deck_add_line(struct Deck *const restrict d, struct Circuit *const restrict c, char const line[const restrict static 1]) {
+	size_t i = 0;
+	skip_ws(line, &i);
+	/// inside .subckt the lines build the block, parameters stay with the top level.
+	struct Circuit *const target = d->subckts.open? &d->subckts.block : c;
+	if( line[i]=='X' || line[i]=='x' ) {
+		return subckt_add_instance(&d->subckts, target, &line[i]);
+	} else if( line[i] != '.' ) {
+		return strchr(line, '{') != NULL && !d->subckts.open? param_add_component(&d->params, c, line) : circuit_add_from_line(target, line);
+	}
+	char const *const directive = &line[i];
+	if( subckt_parse_directive(&d->subckts, c, directive) || ac_parse_directive(&d->ac, directive) || mor_parse_directive(&d->mor, directive) || tran_parse_directive(&d->tran, directive) || mr_parse_directive(&d->multirate, directive) || hb_parse_directive(&d->hb, directive) || mc_parse_directive(&d->mc, directive) || param_parse_directive(&d->params, directive) || step_parse_directive(&d->params, directive) || sens_parse_directive(&d->sens, directive) || nport_parse_directive(&d->nport, directive) || print_parse_directive(&d->print, directive) || wave_parse_directive(&d->wave, directive) || measure_parse_directive(&d->measures, directive) || four_parse_directive(&d->four, directive) || reduce_parse_directive(&d->reduce, directive) || dissect_parse_directive(&d->dissect, directive) ) {
+		return ERR_OK;
+	}
+	/// unknown directives are skipped like unknown components.
+	return ERR_OK;
+}
+
+/**
+ * Runs .reduce over the circuit, keeping every node a directive names.
+ * Decks that refer to single components (parameters, .sens, .mc) or have devices are left as they are.
+ * Returns true if the circuit was reduced.
+ */
+CIRCUIT_EXPORT NO_NULLS bool deck_reduce(struct Deck const *const restrict d, struct Circuit *const restrict c, struct Reduction *const restrict red, FILE *const restrict out) {
+	if( d->params.bindings != NULL || d->sens.outputs != 0 || d->mc.samples > 0 || d->mc.corners || circuit_has_devices(c) ) {
+		fputs("reduce: skipped, the deck needs its components as written\n", out);
+		return false;
+	}
+	size_t keep = d->print.probes | d->four.four_nodes | d->four.fft_nodes;
+	for( size_t k=0; k < d->nport.ports; k++ ) {
+		keep |= (1 << d->nport.plus[k]) | (1 << d->nport.minus[k]);
+	}
+	for( size_t k=0; k < d->measures.count; k++ ) {
+		keep |= (1 << d->measures.m[k].node) | (1 << d->measures.m[k].ref);
+	}
+	if( circuit_reduce(c, red, keep)==ERR_OOM ) {
+		fputs("reduce: out of memory\n", out);
+	}
+	return true;
+}
+
+CIRCUIT_EXPORT NO_NULLS void deck_run(struct Deck *const restrict d, struct Circuit *const restrict c, FILE *const restrict out) {
+	param_print_rejected(&d->params, out);
+	if( circuit_has_kind(c, COMP_AC_VOLTAGE_SRC) ) {
+		fputs("v: AC voltage sources aren't stamped, use an i source with its Norton equivalent\n", out);
+	}
+	struct Reduction red = {0};
+	bool const reduced = d->reduce.on && deck_reduce(d, c, &red, out);
+	if( circuit_has_devices(c) ) {
+		circuit_solve_op(c, out);
+	} else if( d->dissect.on ) {
+		circuit_solve_dissected(c, out);
+	} else if( d->print.probes != 0 ) {
+		circuit_solve_print(c, &d->print, out);
+	} else {
+		circuit_solve_dc(c, out);
+	}
+	if( reduced ) {
+		reduction_print(c, &red, out);
+	}
+	if( d->sens.outputs != 0 ) {
+		circuit_solve_sens(c, &d->sens, out);
+	}
+	if( d->nport.ports > 0 ) {
+		circuit_solve_nport(c, &d->nport, out);
+	}
+	if( d->params.step_dims > 0 ) {
+		circuit_solve_step(c, &d->params, out);
+	}
+	if( ac_sweep_count(&d->ac) > 0 ) {
+		/// the reduced model only covers RC networks, anything else sweeps the full system.
+		if( d->mor.order==0 || !circuit_solve_ac_mor(c, &d->ac, &d->mor, out) ) {
+			circuit_solve_ac(c, &d->ac, out);
+		}
+	}
+	if( rat_lt(rat_zero(), d->tran.tstop) ) {
+		struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+		struct TranSink sink = { .emit = tran_print_point, .ctx = out };
+		struct WaveWriter wave;
+		bool const streamed = wave_begin(&d->wave, c, &wave, &sink, out);
+		/// measurements replace the printed waveform, a .wave file still gets every point.
+		bool const quiet = d->measures.count > 0 && !streamed;
+		struct SpectrumCapture spectrum;
+		struct TranSink spectral_sink;
+		bool const spectral = spectrum_begin(&d->four, c, &d->tran, &spectrum, quiet? NULL : &sink, &spectral_sink, out);
+		struct TranSink const *const points = spectral? &spectral_sink : &sink;
+		if( d->measures.count > 0 ) {
+			circuit_measure_sweep(c, &d->params, &d->tran, &d->multirate, &d->measures, spectral || streamed? points : NULL, out);
+		} else if( d->multirate.on ) {
+			circuit_solve_tran_multirate(c, &d->tran, &d->multirate, points, out);
+		} else {
+			circuit_solve_tran(c, &d->tran, points, out);
+		}
+		if( spectral ) {
+			spectrum_end(&d->four, c, &spectrum, out);
+		}
+		if( streamed ) {
+			wave_end(&d->wave, &wave, out);
+		}
+		bistack_release_back(&c->bistack, mark);
+	}
+	if( rat_lt(rat_zero(), d->hb.freq) ) {
+		circuit_solve_hb(c, &d->hb, out);
+	}
+	if( d->mc.samples > 0 || d->mc.corners ) {
+		circuit_solve_monte_carlo(c, &d->mc, out);
+	}
+}
+#endif
@@ -0,0 +1,389 @@
+#ifndef DISSECT_H_INCLUDED
+#	define DISSECT_H_INCLUDED
+
+#include "node.h"
+
+
+/// Nested dissection of the circuit graph.
+/// The node set is bisected recursively by a BFS level separator until the pieces are small.
+/// Leaves become independent subdomains, every separator node goes into one global separator.
+/// In that order the nodal matrix is block-arrowhead:
+///   | G_11       G_1S |
+///   |     G_22   G_2S |
+///   | G_S1 G_S2  G_SS |
+/// so each subdomain factors on its own and only hands a Schur update to the separator.
+/// Every subdomain writes its update into a buffer of its own, the separator block sums
+/// them afterwards, so the eliminations share nothing but read-only G and run through par_for,
+/// and so do the back-substitutions once the separator is solved.
+///   .options dissect    solve the DC operating point this way.
+
+enum {
+	ND_LEAF_NODES = 2, /// stop bisecting at this many nodes.
+};
+
+struct Dissection {
+	size_t  domains[MAX_NODES]; /// node bitflags of each independent subdomain.
+	size_t  separator;          /// node bitflag of every separator, eliminated last.
+	uint8_t domain_count;
+};
+
+struct DissectSettings {
+	bool on;
+};
+
+/// .options ..., only `dissect` is known, other options are skipped.
+CIRCUIT_EXPORT NO_NULLS bool dissect_parse_directive(struct DissectSettings *const restrict ds, char const line[const restrict static 1]) {
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word != 8 || strncmp(line, ".options", 8) != 0 ) {
+		return false;
+	}
+	for( size_t i=8; line[i] != 0; ) {
+		skip_ws(line, &i);
+		size_t const len = strcspn(&line[i], " \t\r\n");
+		if( len==0 ) {
+			break;
+		}
+		ds->on |= len==7 && strncmp(&line[i], "dissect", 7)==0;
+		i += len;
+	}
+	return true;
+}
+
+CIRCUIT_EXPORT size_t bits_count(size_t bits) {
+	size_t count = 0;
+	for( ; bits != 0; bits &= bits - 1 ) {
+		count++;
+	}
+	return count;
+}
+
+CIRCUIT_EXPORT size_t bits_lowest(size_t const bits) {
+	for( size_t i=0; i < MAX_NODES; i++ ) {
+		if( bits & (1 << i) ) {
+			return i;
+		}
+	}
+	return MAX_NODES;
+}
+
+/// node adjacency as bitflags, ground left out since it isn't in the matrix.
+CIRCUIT_EXPORT NO_NULLS void circuit_adjacency(struct Circuit const *const c, size_t (*const adj)[MAX_NODES]) {
+	memset(*adj, 0, sizeof *adj);
+	for( uint8_t node=0; node < MAX_NODES; node++ ) {
+		for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+			size_t touched = (1 << cmp->owner) | (1 << cmp->node);
+			switch( cmp->kind ) {
+				case COMP_VCCS: case COMP_VCVS: case COMP_CCVS: case COMP_CCCS:
+					touched |= (1 << cmp->aux.dep.np) | (1 << cmp->aux.dep.nn);
+					break;
+				case COMP_MACROMODEL:
+					for( size_t i=0; i < cmp->aux.macro->model->ports; i++ ) {
+						touched |= (1 << cmp->aux.macro->nodes[i]);
+					}
+					break;
+				case COMP_DIODE: case COMP_MOSFET: case COMP_BJT:
+					for( size_t t=0; t < device_terminals(cmp->kind); t++ ) {
+						touched |= (1 << cmp->aux.dev->nodes[t]);
+					}
+					break;
+			}
+			touched &= ~(1 << GND_IDX);
+			for( size_t i=1; i < MAX_NODES; i++ ) {
+				if( touched & (1 << i) ) {
+					(*adj)[i] |= touched & ~(1 << i);
+				}
+			}
+		}
+	}
+}
+
+/// BFS levels inside `set` starting at `root`, returns the number of levels.
+CIRCUIT_EXPORT NO_NULLS size_t bfs_levels(size_t const (*const adj)[MAX_NODES], size_t const set, size_t const root, size_t (*const levels)[MAX_NODES]) {
+	size_t seen = (1 << root);
+	size_t n = 0;
+	(*levels)[n++] = (1 << root);
+	for(;;) {
+		size_t next = 0;
+		for( size_t i=0; i < MAX_NODES; i++ ) {
+			if( (*levels)[n-1] & (1 << i) ) {
+				next |= (*adj)[i];
+			}
+		}
+		next &= set & ~seen;
+		if( next==0 ) {
+			return n;
+		}
+		seen |= next;
+		(*levels)[n++] = next;
+	}
+}
+
+CIRCUIT_EXPORT NO_NULLS void dissect_set(size_t const (*const adj)[MAX_NODES], size_t const set, struct Dissection *const nd) {
+	if( set==0 ) {
+		return;
+	} else if( bits_count(set) <= ND_LEAF_NODES ) {
+		nd->domains[nd->domain_count++] = set;
+		return;
+	}
+	
+	/// a second sweep from the far end gives a pseudo-peripheral root and a deeper level structure.
+	size_t levels[MAX_NODES] = {0};
+	size_t depth = bfs_levels(adj, set, bits_lowest(set), &levels);
+	depth = bfs_levels(adj, set, bits_lowest(levels[depth-1]), &levels);
+	
+	size_t reached = 0;
+	for( size_t l=0; l < depth; l++ ) {
+		reached |= levels[l];
+	}
+	if( reached != set ) {
+		/// already disconnected, no separator needed.
+		dissect_set(adj, reached, nd);
+		dissect_set(adj, set & ~reached, nd);
+		return;
+	} else if( depth < 3 ) {
+		nd->domains[nd->domain_count++] = set;
+		return;
+	}
+	
+	size_t const mid = depth / 2;
+	size_t part_a = 0, part_b = 0;
+	for( size_t l=0; l < depth; l++ ) {
+		if( l < mid ) {
+			part_a |= levels[l];
+		} else if( l > mid ) {
+			part_b |= levels[l];
+		}
+	}
+	nd->separator |= levels[mid];
+	dissect_set(adj, part_a, nd);
+	dissect_set(adj, part_b, nd);
+}
+
+CIRCUIT_EXPORT NO_NULLS void circuit_dissect(struct Circuit const *const c, struct Dissection *const nd) {
+	*nd = (struct Dissection){0};
+	size_t adj[MAX_NODES] = {0};
+	circuit_adjacency(c, &adj);
+	dissect_set(( size_t const(*)[MAX_NODES] )(&adj), c->active_nodes & ~(1 << GND_IDX), nd);
+}
+
+/// matrix ids of the nodes in `bits`, returns how many.
+CIRCUIT_EXPORT NO_NULLS size_t dissect_gather_ids(size_t const bits, uint8_t const (*const node_to_matrix_id)[MAX_NODES], uint8_t (*const ids)[MAX_NODES]) {
+	size_t k = 0;
+	for( size_t i=1; i < MAX_NODES; i++ ) {
+		if( bits & (1 << i) ) {
+			(*ids)[k++] = (*node_to_matrix_id)[i];
+		}
+	}
+	return k;
+}
+
+/**
+ * Eliminates one subdomain `d` (size k) against the separator `s` (size m) into its own update:
+ *   U = G_sd * G_dd^-1 * G_ds
+ *   u = G_sd * G_dd^-1 * r_d
+ * Writes only its own buffers, so subdomains don't depend on each other.
+ * The factors of G_dd are left in `G_dd`/`piv` for the back-substitution.
+ */
+CIRCUIT_EXPORT bool dissect_eliminate_domain(
+	size_t  const n,   rat const G[const restrict static n*n], rat const rhs[const restrict static n],
+	size_t  const k,   uint8_t const d[const restrict static k],
+	size_t  const m,   uint8_t const s[const restrict static m],
+	rat           G_dd[const restrict static k*k], uint8_t piv[const restrict static k], rat col[const restrict static k],
+	rat           U[const restrict], rat u[const restrict]
+) {
+	for( size_t i=0; i < k; i++ ) {
+		for( size_t j=0; j < k; j++ ) {
+			G_dd[idx_2_to_1(i,j,k)] = G[idx_2_to_1(d[i], d[j], n)];
+		}
+	}
+	if( !lu_factor(k, G_dd, piv) ) {
+		return false;
+	}
+	/// columns of G_ds, then the RHS as column m.
+	for( size_t j=0; j <= m; j++ ) {
+		bool any = false;
+		for( size_t i=0; i < k; i++ ) {
+			col[i] = j < m? G[idx_2_to_1(d[i], s[j], n)] : rhs[d[i]];
+			any |= !rat_eq(col[i], rat_zero(), rat_epsilon());
+		}
+		if( !any ) {
+			continue;
+		}
+		lu_solve(k, G_dd, piv, col);
+		for( size_t r=0; r < m; r++ ) {
+			rat acc = rat_zero();
+			for( size_t i=0; i < k; i++ ) {
+				acc = rat_addmul(acc, G[idx_2_to_1(s[r], d[i], n)], col[i]);
+			}
+			if( j < m ) {
+				U[idx_2_to_1(r,j,m)] = acc;
+			} else {
+				u[r] = acc;
+			}
+		}
+	}
+	return true;
+}
+
+/// x_d = G_dd^-1 * (r_d - G_ds * x_s), with `G_dd` already factored.
+CIRCUIT_EXPORT void dissect_back_substitute(
+	size_t  const n,   rat const G[const restrict static n*n], rat const rhs[const restrict static n],
+	size_t  const k,   uint8_t const d[const restrict static k],
+	size_t  const m,   uint8_t const s[const restrict static m], rat const x_s[const restrict],
+	rat     const G_dd[const restrict static k*k], uint8_t const piv[const restrict static k],
+	rat           x_d[const restrict static k]
+) {
+	for( size_t i=0; i < k; i++ ) {
+		x_d[i] = rhs[d[i]];
+		for( size_t j=0; j < m; j++ ) {
+			x_d[i] = rat_sub(x_d[i], rat_mul(G[idx_2_to_1(d[i], s[j], n)], x_s[j]));
+		}
+	}
+	lu_solve(k, G_dd, piv, x_d);
+}
+
+/// every subdomain's buffers and ids, what the par_for bodies work on.
+struct DissectDomains {
+	rat     const *G, *rhs, *x_s;
+	uint8_t const *s;
+	size_t         n, m;
+	uint8_t        d[MAX_NODES][MAX_NODES];
+	size_t         k[MAX_NODES];
+	rat           *G_dd[MAX_NODES], *col[MAX_NODES], *U[MAX_NODES], *u[MAX_NODES];
+	uint8_t       *piv[MAX_NODES];
+	bool           ok[MAX_NODES];
+};
+
+CIRCUIT_EXPORT void dissect_eliminate_body(void *const ctx, size_t const dom, size_t const worker) {
+	struct DissectDomains *const dd = ctx;
+	( void )(worker);
+	dd->ok[dom] = dissect_eliminate_domain(dd->n, dd->G, dd->rhs, dd->k[dom], dd->d[dom], dd->m, dd->s, dd->G_dd[dom], dd->piv[dom], dd->col[dom], dd->U[dom], dd->u[dom]);
+}
+
+CIRCUIT_EXPORT void dissect_back_substitute_body(void *const ctx, size_t const dom, size_t const worker) {
+	struct DissectDomains *const dd = ctx;
+	( void )(worker);
+	dissect_back_substitute(dd->n, dd->G, dd->rhs, dd->k[dom], dd->d[dom], dd->m, dd->s, dd->x_s, dd->G_dd[dom], dd->piv[dom], dd->col[dom]);
+}
+
+/**
+ * DC solve by nested dissection, results scattered by node number like circuit_dc_voltages.
+ * The split it used goes into `nd`. Falls back to the plain solve when it runs out of
+ * memory or a subdomain or the separator is singular, and sets `fell_back` then.
+ */
+CIRCUIT_EXPORT NO_NULLS enum RREFResult circuit_dc_voltages_dissected(struct Circuit *const c, rat (*const V_out)[MAX_NODES], struct Dissection *const nd, bool *const fell_back) {
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	*fell_back = false;
+	circuit_dissect(c, nd);
+	
+	for( size_t i=0; i < MAX_NODES; i++ ) {
+		(*V_out)[i] = rat_zero();
+	}
+	uint8_t matrix_id_to_node[MAX_NODES] = {0};
+	uint8_t node_to_matrix_id[MAX_NODES] = {0};
+	rat *G = NULL;
+	rat *rhs = NULL;
+	size_t const n = circuit_build_dc(c, &matrix_id_to_node, &G, &rhs);
+	if( n==0 || G==NULL || rhs==NULL ) {
+		bistack_release_front(&c->bistack, mark);
+		return RREFResultOk;
+	}
+	for( size_t i=0; i < n; i++ ) {
+		node_to_matrix_id[matrix_id_to_node[i]] = i;
+	}
+	
+	uint8_t s[MAX_NODES] = {0};
+	size_t const m = dissect_gather_ids(nd->separator, ( uint8_t const(*)[MAX_NODES] )(&node_to_matrix_id), &s);
+	rat *const S   = alloc_vec(&c->bistack, m*m + 1);
+	rat *const r_s = alloc_vec(&c->bistack, m + 1);
+	/// every subdomain keeps its factors until the separator is solved.
+	struct DissectDomains *const dd = bistack_alloc_front(&c->bistack, sizeof *dd);
+	if( S==NULL || r_s==NULL || dd==NULL ) {
+		bistack_release_front(&c->bistack, mark);
+		*fell_back = true;
+		return circuit_dc_voltages(c, V_out);
+	}
+	*dd = (struct DissectDomains){ .G = G, .rhs = rhs, .x_s = r_s, .s = s, .n = n, .m = m };
+	for( size_t i=0; i < m; i++ ) {
+		r_s[i] = rhs[s[i]];
+		for( size_t j=0; j < m; j++ ) {
+			S[idx_2_to_1(i,j,m)] = G[idx_2_to_1(s[i], s[j], n)];
+		}
+	}
+	for( size_t dom=0; dom < nd->domain_count; dom++ ) {
+		size_t const k = dd->k[dom] = dissect_gather_ids(nd->domains[dom], ( uint8_t const(*)[MAX_NODES] )(&node_to_matrix_id), &dd->d[dom]);
+		dd->G_dd[dom] = alloc_vec(&c->bistack, k*k);
+		dd->piv[dom]  = bistack_alloc_front(&c->bistack, k);
+		dd->col[dom]  = alloc_vec(&c->bistack, k);
+		dd->U[dom]    = alloc_vec(&c->bistack, m*m + 1);
+		dd->u[dom]    = alloc_vec(&c->bistack, m + 1);
+		if( dd->G_dd[dom]==NULL || dd->piv[dom]==NULL || dd->col[dom]==NULL || dd->U[dom]==NULL || dd->u[dom]==NULL ) {
+			bistack_release_front(&c->bistack, mark);
+			*fell_back = true;
+			return circuit_dc_voltages(c, V_out);
+		}
+	}
+	
+	/// independent per subdomain, each one only writes its own factors and update.
+	par_for(nd->domain_count, dissect_eliminate_body, dd);
+	for( size_t dom=0; dom < nd->domain_count; dom++ ) {
+		if( !dd->ok[dom] ) {
+			bistack_release_front(&c->bistack, mark);
+			*fell_back = true;
+			return circuit_dc_voltages(c, V_out);
+		}
+	}
+	/// the reduction, in domain order so the sums don't depend on who finished first.
+	for( size_t dom=0; dom < nd->domain_count; dom++ ) {
+		for( size_t i=0; i < m; i++ ) {
+			r_s[i] = rat_sub(r_s[i], dd->u[dom][i]);
+			for( size_t j=0; j < m; j++ ) {
+				S[idx_2_to_1(i,j,m)] = rat_sub(S[idx_2_to_1(i,j,m)], dd->U[dom][idx_2_to_1(i,j,m)]);
+			}
+		}
+	}
+	
+	if( m > 0 ) {
+		uint8_t piv_s[MAX_NODES] = {0};
+		if( !lu_factor(m, S, piv_s) ) {
+			bistack_release_front(&c->bistack, mark);
+			*fell_back = true;
+			return circuit_dc_voltages(c, V_out);
+		}
+		lu_solve(m, S, piv_s, r_s);
+		for( size_t i=0; i < m; i++ ) {
+			(*V_out)[matrix_id_to_node[s[i]]] = r_s[i];
+		}
+	}
+	par_for(nd->domain_count, dissect_back_substitute_body, dd);
+	for( size_t dom=0; dom < nd->domain_count; dom++ ) {
+		for( size_t i=0; i < dd->k[dom]; i++ ) {
+			(*V_out)[matrix_id_to_node[dd->d[dom][i]]] = dd->col[dom][i];
+		}
+	}
+	bistack_release_front(&c->bistack, mark);
+	return RREFResultOk;
+}
+
+/// the DC voltages through the dissected solve, with how the circuit split.
+CIRCUIT_EXPORT NO_NULLS void circuit_solve_dissected(struct Circuit *const restrict c, FILE *const restrict out) {
+	struct Dissection nd;
+	bool fell_back;
+	rat V[MAX_NODES];
+	if( circuit_dc_voltages_dissected(c, &V, &nd, &fell_back)==RREFResultBadMatrix ) {
+		fputs("dc: singular circuit\n", out);
+		return;
+	}
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		if( c->active_nodes & (1 << node) ) {
+			char num[48] = {0};
+			fprintf(out, "V%u = %s\n", node, rat_to_cstr(V[node], sizeof num, num));
+		}
+	}
+	if( fell_back ) {
+		fputs("dissect: fell back to the plain solve\n", out);
+	} else {
+		fprintf(out, "dissect: %u subdomains, %zu separator nodes\n", nd.domain_count, bits_count(nd.separator));
+	}
+}
+#endif
@@ -0,0 +1,149 @@
+#ifndef FFT_H_INCLUDED
+#	define FFT_H_INCLUDED
+
+#include "node.h"
+
+
+/// Radix-2 FFT over the cplx type.
+///   forward: X[k] = sum x[m] * e^(-j*2*pi*k*m/n)
+///   inverse: x[m] = 1/n * sum X[k] * e^(+j*2*pi*k*m/n)
+
+CIRCUIT_EXPORT bool fft_is_pow2(size_t const n) {
+	return n != 0 && (n & (n - 1))==0;
+}
+
+/// smallest power of two >= n.
+CIRCUIT_EXPORT size_t fft_size_for(size_t const n) {
+	size_t p = 1;
+	while( p < n ) {
+		p <<= 1;
+	}
+	return p;
+}
+
+CIRCUIT_EXPORT void fft_bit_reverse(size_t const n, cplx x[const static n]) {
+	for( size_t i=1, j=0; i < n; i++ ) {
+		size_t bit = n >> 1;
+		for( ; j & bit; bit >>= 1 ) {
+			j ^= bit;
+		}
+		j ^= bit;
+		if( i < j ) {
+			cplx const tmp = x[i];
+			x[i] = x[j];
+			x[j] = tmp;
+		}
+	}
+}
+
+CIRCUIT_EXPORT void fft_scale_inverse(size_t const n, cplx x[const static n]) {
+	rat const scale = rat_recip(rat_from_int(n));
+	for( size_t i=0; i < n; i++ ) {
+		x[i] = cplx_mul_rat(x[i], scale);
+	}
+}
+
+/// in place, returns false if n isn't a power of two.
+CIRCUIT_EXPORT bool fft_radix2(size_t const n, cplx x[const static n], bool const inverse) {
+	if( !fft_is_pow2(n) ) {
+		return false;
+	}
+	fft_bit_reverse(n, x);
+	rat const two_pi = rat_mul(rat_from_int(2), rat_pi());
+	for( size_t len=2; len <= n; len <<= 1 ) {
+		rat const angle = rat_div(inverse? two_pi : rat_neg(two_pi), rat_from_int(len));
+		cplx const w_len = cplx_from_polar(rat_pos1(), angle);
+		for( size_t i=0; i < n; i += len ) {
+			cplx w = cplx_one();
+			for( size_t k=0; k < len/2; k++ ) {
+				cplx const u = x[i + k];
+				cplx const v = cplx_mul_cplx(x[i + k + len/2], w);
+				x[i + k]         = cplx_add_cplx(u, v);
+				x[i + k + len/2] = cplx_sub_cplx(u, v);
+				w = cplx_mul_cplx(w, w_len);
+			}
+		}
+	}
+	if( inverse ) {
+		fft_scale_inverse(n, x);
+	}
+	return true;
+}
+
+/// tw[k] = e^(-+j*2*pi*k/n) for k < n/2, each computed directly so long transforms don't drift.
+CIRCUIT_EXPORT void fft_twiddles(size_t const n, cplx tw[const static n/2], bool const inverse) {
+	rat const two_pi = rat_mul(rat_from_int(2), rat_pi());
+	rat const step = rat_div(inverse? two_pi : rat_neg(two_pi), rat_from_int(n));
+	for( size_t k=0; k < n/2; k++ ) {
+		tw[k] = cplx_from_polar(rat_pos1(), rat_mul(step, rat_from_int(k)));
+	}
+}
+
+/**
+ * fft_radix2 against a table from fft_twiddles for the same n and direction.
+ * The stage of length len reads every (n/len)th entry, so one table serves all stages
+ * and every transform of that size, no trig in the loop.
+ */
+CIRCUIT_EXPORT bool fft_radix2_twiddled(size_t const n, cplx x[const static n], cplx const tw[const static n/2], bool const inverse) {
+	if( !fft_is_pow2(n) ) {
+		return false;
+	}
+	fft_bit_reverse(n, x);
+	for( size_t len=2; len <= n; len <<= 1 ) {
+		size_t const stride = n / len;
+		for( size_t i=0; i < n; i += len ) {
+			for( size_t k=0; k < len/2; k++ ) {
+				cplx const u = x[i + k];
+				cplx const v = cplx_mul_cplx(x[i + k + len/2], tw[k*stride]);
+				x[i + k]         = cplx_add_cplx(u, v);
+				x[i + k + len/2] = cplx_sub_cplx(u, v);
+			}
+		}
+	}
+	if( inverse ) {
+		fft_scale_inverse(n, x);
+	}
+	return true;
+}
+
+
+/** Windows */
+enum {
+	FFT_WINDOW_RECT, FFT_WINDOW_HANN, FFT_WINDOW_HAMMING, FFT_WINDOW_BLACKMAN,
+	FFT_WINDOWS,
+};
+
+/// periodic form, w(i) over i < n, so a whole number of cycles stays whole.
+CIRCUIT_EXPORT rat fft_window_at(uint8_t const kind, size_t const i, size_t const n) {
+	rat const phase = rat_div(rat_mul(rat_mul(rat_from_int(2), rat_pi()), rat_from_int(i)), rat_from_int(n));
+	switch( kind ) {
+		case FFT_WINDOW_HANN:
+			return rat_sub(float_to_rat(0.5f), rat_mul(float_to_rat(0.5f), rat_cos(phase)));
+		case FFT_WINDOW_HAMMING:
+			return rat_sub(float_to_rat(0.54f), rat_mul(float_to_rat(0.46f), rat_cos(phase)));
+		case FFT_WINDOW_BLACKMAN:
+			return rat_add(rat_sub(float_to_rat(0.42f), rat_mul(float_to_rat(0.5f), rat_cos(phase))), rat_mul(float_to_rat(0.08f), rat_cos(rat_mul(rat_from_int(2), phase))));
+		default:
+			return rat_pos1();
+	}
+}
+
+/// the window's mean, what a bin's amplitude has to be divided by.
+CIRCUIT_EXPORT rat fft_window_gain(uint8_t const kind) {
+	switch( kind ) {
+		case FFT_WINDOW_HANN:     return float_to_rat(0.5f);
+		case FFT_WINDOW_HAMMING:  return float_to_rat(0.54f);
+		case FFT_WINDOW_BLACKMAN: return float_to_rat(0.42f);
+		default:                  return rat_pos1();
+	}
+}
+
+CIRCUIT_EXPORT void fft_window_apply(uint8_t const kind, size_t const n, cplx x[const static n]) {
+	if( kind==FFT_WINDOW_RECT ) {
+		return;
+	}
+	for( size_t i=0; i < n; i++ ) {
+		x[i] = cplx_mul_rat(x[i], fft_window_at(kind, i, n));
+	}
+}
+#endif
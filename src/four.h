@@ -0,0 +1,280 @@
+#ifndef FOUR_H_INCLUDED
+#	define FOUR_H_INCLUDED
+
+#include "fft.h"
+#include "tran.h"
+
+
+/// Spectra of transient waveforms, computed in-process as the points come out.
+///   .four <freq> V(n) ...    harmonics 1..9 of the last period before tstop, plus THD.
+///   .fft V(n) ... [np=<points>] [window=rect|hann|hamming|blackman]
+///                            spectrum of the whole run, np rounded up to a power of two.
+/// Output points are resampled onto a uniform grid while streaming, by linear
+/// interpolation between the two points around each grid time, so the solver's step
+/// never has to match the transform. Only the grid buffers are kept.
+/// The grids are powers of two long, so radix-2 with one precomputed twiddle table per
+/// size covers every transform. .four's grid spans exactly one period, harmonic h lands
+/// in bin h and needs no window.
+
+enum {
+	FOUR_HARMONICS = 9,
+	FOUR_POINTS    =
+#	ifdef TICE_H
+		32,
+#	else
+		256,
+#	endif
+	FFT_DEFAULT_POINTS =
+#	ifdef TICE_H
+		64,
+#	else
+		1024,
+#	endif
+};
+
+struct FourSettings {
+	rat     freq;
+	size_t  four_nodes, fft_nodes, points;  /// node bitflags.
+	uint8_t window;
+};
+
+/// one uniform grid being filled, a row of n samples per node in `nodes`.
+struct SpectrumGrid {
+	cplx  *buf;
+	rat    t0, dt;
+	size_t n, filled, nodes;
+};
+
+struct SpectrumCapture {
+	struct SpectrumGrid    four, fft;
+	struct TranSink const *inner;
+	rat                    t_prev, v_prev[MAX_NODES];
+	bool                   seen;
+};
+
+CIRCUIT_EXPORT NO_NULLS size_t four_parse_nodes(char const line[const restrict static 1], size_t i) {
+	size_t nodes = 0;
+	for( ; line[i] != 0; ) {
+		skip_ws(line, &i);
+		if( tolower(line[i]) != 'v' ) {
+			while( line[i] != 0 && !isspace(line[i]) ) {
+				i++;
+			}
+			continue;
+		}
+		while( line[i] != 0 && !isdigit(line[i]) && !isspace(line[i]) ) {
+			i++;
+		}
+		unsigned long const node = strtoul(&line[i], NULL, 10);
+		if( node > 0 && node < MAX_NODES ) {
+			nodes |= ( size_t )(1) << node;
+		}
+		while( line[i] != 0 && !isspace(line[i]) ) {
+			i++;
+		}
+	}
+	return nodes;
+}
+
+/// .four and .fft
+CIRCUIT_EXPORT NO_NULLS bool four_parse_directive(struct FourSettings *const restrict fs, char const line[const restrict static 1]) {
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word==5 && strncmp(line, ".four", 5)==0 ) {
+		char freq[48] = {0};
+		if( sscanf(line, " .four %47s", freq)==1 ) {
+			size_t i = 5;
+			skip_ws(line, &i);
+			fs->freq = parse_si_scalar(freq);
+			fs->four_nodes = four_parse_nodes(line, i + strlen(freq));
+		}
+		return true;
+	} else if( word != 4 || strncmp(line, ".fft", 4) != 0 ) {
+		return false;
+	}
+	fs->fft_nodes = four_parse_nodes(line, 4);
+	fs->points = FFT_DEFAULT_POINTS;
+	fs->window = FFT_WINDOW_HANN;
+	static char const *const windows[FFT_WINDOWS] = { "rect", "hann", "hamming", "blackman" };
+	for( char const *opt = strchr(line, '='); opt != NULL; opt = strchr(opt + 1, '=') ) {
+		if( opt - line >= 2 && tolower(opt[-1])=='p' && tolower(opt[-2])=='n' ) {
+			unsigned long const np = strtoul(opt + 1, NULL, 10);
+			fs->points = fft_size_for(np < 4? 4 : np);
+		} else {
+			for( uint8_t w=0; w < FFT_WINDOWS; w++ ) {
+				size_t const len = strlen(windows[w]);
+				if( strncmp(opt + 1, windows[w], len)==0 ) {
+					fs->window = w;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+CIRCUIT_EXPORT size_t spectrum_rows(size_t const nodes) {
+	size_t rows = 0;
+	for( size_t i=1; i < MAX_NODES; i++ ) {
+		rows += (nodes >> i) & 1;
+	}
+	return rows;
+}
+
+/// fills every grid time up to t, interpolating from the previous point.
+CIRCUIT_EXPORT NO_NULLS void spectrum_grid_push(struct SpectrumGrid *const restrict g, struct SpectrumCapture const *const restrict cap, rat const t, rat const (*const V)[MAX_NODES]) {
+	if( g->nodes==0 ) {
+		return;
+	}
+	while( g->filled < g->n ) {
+		rat const tg = rat_addmul(g->t0, rat_from_int(g->filled), g->dt);
+		if( rat_lt(t, tg) ) {
+			break;
+		}
+		/// before the first point the waveform holds its first value.
+		bool const lerp = cap->seen && rat_lt(cap->t_prev, t) && rat_lt(cap->t_prev, tg);
+		rat const frac = lerp? rat_div(rat_sub(tg, cap->t_prev), rat_sub(t, cap->t_prev)) : rat_pos1();
+		size_t row = 0;
+		for( size_t i=1; i < MAX_NODES; i++ ) {
+			if( g->nodes & (1 << i) ) {
+				rat const v = lerp? rat_addmul(cap->v_prev[i], frac, rat_sub((*V)[i], cap->v_prev[i])) : (*V)[i];
+				g->buf[row++*g->n + g->filled] = cplx_make(v, rat_zero());
+			}
+		}
+		g->filled++;
+	}
+}
+
+/// TranSink callback, `ctx` is the SpectrumCapture.
+CIRCUIT_EXPORT void spectrum_emit(void *const ctx, rat const t, size_t const node_bits, rat const (*const V)[MAX_NODES]) {
+	struct SpectrumCapture *const cap = ctx;
+	if( cap->seen && rat_lt(t, cap->t_prev) ) {
+		/// a new run, e.g. the next .step point, the spectrum is the latest one's.
+		cap->four.filled = cap->fft.filled = 0;
+		cap->seen = false;
+	}
+	spectrum_grid_push(&cap->four, cap, t, V);
+	spectrum_grid_push(&cap->fft,  cap, t, V);
+	cap->t_prev = t;
+	memcpy(cap->v_prev, *V, sizeof cap->v_prev);
+	cap->seen = true;
+	if( cap->inner != NULL ) {
+		cap->inner->emit(cap->inner->ctx, t, node_bits, V);
+	}
+}
+
+/**
+ * Sets up the grids on the circuit's back stack and points `sink` at the capture,
+ * which passes every point on to `inner` when it's there. The caller restores the
+ * back mark after spectrum_end. False when nothing was asked for or it can't be had.
+ */
+CIRCUIT_EXPORT bool spectrum_begin(struct FourSettings const *const restrict fs, struct Circuit *const restrict c, struct TranSettings const *const restrict tr, struct SpectrumCapture *const restrict cap, struct TranSink const *const inner, struct TranSink *const restrict sink, FILE *const restrict out) {
+	*cap = (struct SpectrumCapture){ .inner = inner };
+	if( fs->four_nodes != 0 && rat_lt(rat_zero(), fs->freq) ) {
+		rat const period = rat_recip(fs->freq);
+		if( rat_lt(tr->tstop, period) ) {
+			fputs("four: the run is shorter than one period\n", out);
+		} else {
+			cap->four = (struct SpectrumGrid){
+				.t0 = rat_sub(tr->tstop, period), .dt = rat_div(period, rat_from_int(FOUR_POINTS)),
+				.n = FOUR_POINTS, .nodes = fs->four_nodes,
+			};
+		}
+	}
+	if( fs->fft_nodes != 0 && fs->points > 0 ) {
+		cap->fft = (struct SpectrumGrid){
+			.t0 = rat_zero(), .dt = rat_div(tr->tstop, rat_from_int(fs->points)),
+			.n = fs->points, .nodes = fs->fft_nodes,
+		};
+	}
+	struct SpectrumGrid *const grids[] = { &cap->four, &cap->fft };
+	for( size_t k=0; k < sizeof grids / sizeof grids[0]; k++ ) {
+		if( grids[k]->nodes==0 ) {
+			continue;
+		}
+		grids[k]->buf = bistack_alloc_back_vec(&c->bistack, grids[k]->n * spectrum_rows(grids[k]->nodes), sizeof *grids[k]->buf);
+		if( grids[k]->buf==NULL ) {
+			fputs("four: out of memory\n", out);
+			grids[k]->nodes = 0;
+		}
+	}
+	if( cap->four.nodes==0 && cap->fft.nodes==0 ) {
+		return false;
+	}
+	*sink = (struct TranSink){ .emit = spectrum_emit, .ctx = cap };
+	return true;
+}
+
+/// transforms every row of a filled grid in place, twiddles on the front stack.
+CIRCUIT_EXPORT NO_NULLS bool spectrum_transform(struct Circuit *const restrict c, struct SpectrumGrid *const restrict g, uint8_t const window) {
+	cplx *const tw = bistack_alloc_front_vec(&c->bistack, g->n/2, sizeof *tw);
+	if( tw==NULL ) {
+		return false;
+	}
+	fft_twiddles(g->n, tw, false);
+	size_t const rows = spectrum_rows(g->nodes);
+	for( size_t r=0; r < rows; r++ ) {
+		fft_window_apply(window, g->n, &g->buf[r*g->n]);
+		fft_radix2_twiddled(g->n, &g->buf[r*g->n], tw, false);
+	}
+	return true;
+}
+
+/// amplitude of bin k of an n point transform, one-sided.
+CIRCUIT_EXPORT rat spectrum_amplitude(cplx const X, size_t const k, size_t const n, uint8_t const window) {
+	rat const scale = rat_mul(rat_from_int(n), fft_window_gain(window));
+	return rat_div(rat_mul(cplx_abs(X), rat_from_int(k==0? 1 : 2)), scale);
+}
+
+CIRCUIT_EXPORT NO_NULLS void spectrum_end(struct FourSettings const *const restrict fs, struct Circuit *const restrict c, struct SpectrumCapture *const restrict cap, FILE *const restrict out) {
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	char num[48] = {0}, mag[48] = {0}, deg[48] = {0}, norm[48] = {0};
+	struct SpectrumGrid *const four = &cap->four;
+	if( four->nodes != 0 && four->filled==four->n && spectrum_transform(c, four, FFT_WINDOW_RECT) ) {
+		size_t row = 0;
+		for( size_t i=1; i < MAX_NODES; i++ ) {
+			if( !(four->nodes & (1 << i)) ) {
+				continue;
+			}
+			cplx const *const X = &four->buf[row++*four->n];
+			rat const fund = spectrum_amplitude(X[1], 1, four->n, FFT_WINDOW_RECT);
+			fprintf(out, "four V%zu: fundamental %s Hz, DC %s\n", i, rat_to_cstr(fs->freq, sizeof num, num),
+				rat_to_cstr(rat_div(cplx_real(X[0]), rat_from_int(four->n)), sizeof mag, mag));
+			bool const silent = rat_lt(rat_abs(fund), rat_epsilon());
+			rat distortion = rat_zero();
+			for( size_t h=1; h <= FOUR_HARMONICS && h < four->n/2; h++ ) {
+				rat const a = spectrum_amplitude(X[h], h, four->n, FFT_WINDOW_RECT);
+				if( h > 1 ) {
+					distortion = rat_addmul(distortion, a, a);
+				}
+				fprintf(out, "  %zu %s Hz  %s  %s deg  %s\n", h,
+					rat_to_cstr(rat_mul(fs->freq, rat_from_int(h)), sizeof num, num),
+					rat_to_cstr(a, sizeof mag, mag),
+					rat_to_cstr(rat_rad_to_deg(cplx_phase(X[h])), sizeof deg, deg),
+					silent? "-" : rat_to_cstr(rat_div(a, fund), sizeof norm, norm));
+			}
+			if( !silent ) {
+				fprintf(out, "  THD %s%%\n", rat_to_cstr(rat_mul(rat_div(rat_sqrt(distortion), fund), rat_from_int(100)), sizeof num, num));
+			}
+		}
+	} else if( four->nodes != 0 ) {
+		fputs("four: incomplete period\n", out);
+	}
+	struct SpectrumGrid *const fft = &cap->fft;
+	if( fft->nodes != 0 && fft->filled==fft->n && spectrum_transform(c, fft, fs->window) ) {
+		rat const df = rat_recip(rat_mul(fft->dt, rat_from_int(fft->n)));
+		size_t row = 0;
+		for( size_t i=1; i < MAX_NODES; i++ ) {
+			if( !(fft->nodes & (1 << i)) ) {
+				continue;
+			}
+			cplx const *const X = &fft->buf[row++*fft->n];
+			fprintf(out, "fft V%zu: %zu points, df %s Hz\n", i, fft->n, rat_to_cstr(df, sizeof num, num));
+			for( size_t k=0; k <= fft->n/2; k++ ) {
+				fprintf(out, "  %s Hz  %s\n", rat_to_cstr(rat_mul(df, rat_from_int(k)), sizeof num, num), rat_to_cstr(spectrum_amplitude(X[k], k, fft->n, fs->window), sizeof mag, mag));
+			}
+		}
+	} else if( fft->nodes != 0 ) {
+		fputs("fft: incomplete run\n", out);
+	}
+	bistack_release_front(&c->bistack, mark);
+}
+#endif
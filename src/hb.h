@@ -0,0 +1,596 @@
+#ifndef HB_H_INCLUDED
+#	define HB_H_INCLUDED
+
+#include "ac.h"
+#include "fft.h"
+#include "tran.h"
+
+
+/// Harmonic balance, the periodic steady state solved directly for its Fourier coefficients.
+/// The unknowns are the phasors X_k of every node for harmonics k = 0..H of the fundamental,
+///   v(t) = X_0 + sum Re(X_k * e^(j*k*ω*t))
+/// and the balance Y(kω) X_k + I_k(X) = B_k is solved by Newton from the DC operating point.
+/// I(X) are the device currents: X goes to N time samples through the inverse FFT, every
+/// device is evaluated at each sample and the currents come back through the forward FFT.
+/// Each Newton step runs right-preconditioned restarted GMRES on the Jacobian, applied the
+/// same way with the devices' conductances at each sample instead of their currents.
+/// The preconditioner is block-diagonal, one factored Y(kω) + mean conductance per harmonic.
+/// Linear elements never mix harmonics, so without devices it's exact, GMRES is done in one
+/// iteration and one Newton step is the whole solve.
+/// The devices mix X_k with conj(X_l), so the Jacobian is only real-linear and GMRES runs over
+/// the reals, the Hessenberg entries are the real parts of the inner products.
+/// A step moves no sample of any node by more than hb_max_step() volts. If Newton doesn't
+/// converge the AC excitation is ramped up from zero instead, like DC source stepping.
+/// One period of the result goes back to the time domain through the inverse FFT.
+/// `i` sources drive the fundamental as A*cos(ωt), DC sources drive harmonic 0.
+
+enum {
+	HB_KRYLOV_DIM   = 12, /// GMRES restart length.
+	HB_MAX_RESTARTS = 8,
+	HB_NEWTON_ITERS = 100,
+};
+
+CIRCUIT_EXPORT rat hb_max_step(void) {
+	return float_to_rat(0.5f);
+}
+
+/// .hb <fundamental> [harmonics]
+struct HBSettings {
+	rat    freq;
+	size_t harmonics;
+};
+
+/// harmonic k of a vector lives at [k*n, (k+1)*n), sample m of a waveform at [m*n, (m+1)*n).
+struct HBSystem {
+	struct ACSystem   ac;
+	struct LUSymbolic sym;         /// of the blocks, dense once devices fill them in.
+	cplx             *blocks;      /// (H+1) factored n x n blocks.
+	cplx             *b;           /// excitation.
+	rat              *Gt;          /// N n x n device conductances, one per sample, NULL for a linear circuit.
+	rat              *Gmean;       /// their average, n x n.
+	rat              *wave, *cur;  /// N*n samples.
+	cplx             *spectrum;    /// N scratch.
+	rat               omega;
+	size_t            H, N, len;   /// len = (H+1)*n.
+	uint8_t           node_to_matrix_id[MAX_NODES];
+};
+
+struct HBResult {
+	rat    residual;  /// relative.
+	size_t newton, iterations;
+};
+
+CIRCUIT_EXPORT NO_NULLS bool hb_parse_directive(struct HBSettings *const restrict hb, char const line[const restrict static 1]) {
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word != 3 || strncmp(line, ".hb", 3) != 0 ) {
+		return false;
+	}
+	char freq_tok[48] = {0};
+	size_t harmonics = 8;
+	*hb = (struct HBSettings){0};
+	if( sscanf(line, " .hb %47s %zu", freq_tok, &harmonics) < 1 ) {
+		return true;
+	}
+	hb->freq      = parse_si_scalar(freq_tok);
+	hb->harmonics = harmonics;
+	return true;
+}
+
+/// Y(kω) into `Y`, an inductor at DC is a short, taken as its admittance at a millionth of ω.
+CIRCUIT_EXPORT NO_NULLS void hb_block_at(struct ACSystem const *const restrict ac, size_t const k, rat const omega, cplx Y[const restrict]) {
+	if( k > 0 ) {
+		ac_system_at(ac, rat_mul(omega, rat_from_int(k)), Y);
+		return;
+	}
+	rat const short_omega = rat_mul(omega, float_to_rat(1E-6f));
+	for( size_t i=0; i < ac->n * ac->n; i++ ) {
+		Y[i] = cplx_make(rat_add(ac->G[i], rat_div(ac->Gam[i], short_omega)), rat_zero());
+	}
+}
+
+/// the N samples of n signals from their harmonics 0..H, into wave.
+CIRCUIT_EXPORT NO_NULLS void hb_to_time(size_t const N, size_t const n, size_t const H, cplx const X[const restrict], cplx spectrum[const restrict], rat wave[const restrict]) {
+	/// real signal: X_k/2 at +k and its conjugate at -k, scaled for the inverse's 1/N.
+	rat const half_N = rat_div(rat_from_int(N), rat_from_int(2));
+	for( size_t i=0; i < n; i++ ) {
+		for( size_t m=0; m < N; m++ ) {
+			spectrum[m] = cplx_zero();
+		}
+		spectrum[0] = cplx_mul_rat(X[i], rat_from_int(N));
+		for( size_t k=1; k <= H; k++ ) {
+			cplx const Xk = X[k*n + i];
+			spectrum[k]     = cplx_add_cplx(spectrum[k], cplx_mul_rat(Xk, half_N));
+			spectrum[N - k] = cplx_add_cplx(spectrum[N - k], cplx_mul_rat(cplx_conj(Xk), half_N));
+		}
+		fft_radix2(N, spectrum, true);
+		for( size_t m=0; m < N; m++ ) {
+			wave[idx_2_to_1(m, i, n)] = cplx_real(spectrum[m]);
+		}
+	}
+}
+
+/// adds harmonics 0..H of n sampled real signals into X, the inverse of hb_to_time.
+CIRCUIT_EXPORT NO_NULLS void hb_to_freq(size_t const N, size_t const n, size_t const H, rat const wave[const restrict], cplx spectrum[const restrict], cplx X[const restrict]) {
+	rat const dc = rat_recip(rat_from_int(N)), ac = rat_div(rat_from_int(2), rat_from_int(N));
+	for( size_t i=0; i < n; i++ ) {
+		for( size_t m=0; m < N; m++ ) {
+			spectrum[m] = cplx_make(wave[idx_2_to_1(m, i, n)], rat_zero());
+		}
+		fft_radix2(N, spectrum, false);
+		for( size_t k=0; k <= H; k++ ) {
+			X[k*n + i] = cplx_add_cplx(X[k*n + i], cplx_mul_rat(spectrum[k], k==0? dc : ac));
+		}
+	}
+}
+
+/**
+ * Evaluates every device at each sample of X. Fills Gt and Gmean and adds the
+ * device currents' harmonics into I_dev.
+ */
+CIRCUIT_EXPORT NO_NULLS void hb_devices_eval(struct HBSystem const *const restrict sys, struct DeviceBatch batches[const static DEVICE_KINDS], cplx const X[const restrict], cplx I_dev[const restrict]) {
+	size_t const n = sys->ac.n, N = sys->N;
+	hb_to_time(N, n, sys->H, X, sys->spectrum, sys->wave);
+	memset(sys->Gt, 0, N*n*n * sizeof *sys->Gt);
+	memset(sys->cur, 0, N*n * sizeof *sys->cur);
+	for( size_t m=0; m < N; m++ ) {
+		/// device_stamp's view of sample m, its rhs collects the companion sources.
+		struct NRSystem at = { .A = &sys->Gt[m*n*n], .rhs = &sys->cur[m*n], .x = &sys->wave[m*n], .n = n };
+		memcpy(at.node_to_matrix_id, sys->node_to_matrix_id, sizeof at.node_to_matrix_id);
+		for( size_t b=0; b < DEVICE_KINDS; b++ ) {
+			struct DeviceBatch *const batch = &batches[b];
+			size_t const junctions = device_junctions(batch->kind);
+			for( size_t d=0; d < batch->count; d++ ) {
+				for( size_t k=0; k < junctions; k++ ) {
+					uint8_t p = 0, q = 0;
+					device_junction(batch->kind, k, &p, &q);
+					batch->vj[k][d] = rat_sub(nr_node_voltage(&at, batch->nodes[p][d]), nr_node_voltage(&at, batch->nodes[q][d]));
+					batch->arg[k][d] = junction_arg(batch->vj[k][d]);
+				}
+			}
+			if( batch->kind != COMP_MOSFET ) {
+				for( size_t k=0; k < junctions; k++ ) {
+					rat_exp_vec(batch->count, batch->arg[k], batch->arg[k]);
+				}
+			}
+			for( size_t d=0; d < batch->count; d++ ) {
+				device_eval(batch, d, device_gmin(), ( rat[2] ){ batch->arg[0][d], batch->arg[1][d] });
+				device_stamp(&at, batch, d);
+			}
+		}
+		/// linearized right at the sample, so the current itself is G*v - rhs.
+		for( size_t i=0; i < n; i++ ) {
+			rat acc = rat_neg(at.rhs[i]);
+			for( size_t j=0; j < n; j++ ) {
+				acc = rat_addmul(acc, at.A[idx_2_to_1(i,j,n)], at.x[j]);
+			}
+			at.rhs[i] = acc;
+		}
+	}
+	for( size_t i=0; i < n*n; i++ ) {
+		rat acc = rat_zero();
+		for( size_t m=0; m < N; m++ ) {
+			acc = rat_add(acc, sys->Gt[m*n*n + i]);
+		}
+		sys->Gmean[i] = rat_div(acc, rat_from_int(N));
+	}
+	hb_to_freq(N, n, sys->H, sys->cur, sys->spectrum, I_dev);
+}
+
+/// y = A*x over the linear part, built from G, C and Γ directly.
+CIRCUIT_EXPORT NO_NULLS void hb_apply_linear(struct HBSystem const *const restrict sys, cplx const x[const restrict], cplx y[const restrict], cplx Y[const restrict]) {
+	size_t const n = sys->ac.n;
+	for( size_t k=0; k <= sys->H; k++ ) {
+		hb_block_at(&sys->ac, k, sys->omega, Y);
+		for( size_t i=0; i < n; i++ ) {
+			cplx acc = cplx_zero();
+			for( size_t j=0; j < n; j++ ) {
+				acc = cplx_add_cplx(acc, cplx_mul_cplx(Y[idx_2_to_1(i,j,n)], x[k*n + j]));
+			}
+			y[k*n + i] = acc;
+		}
+	}
+}
+
+/// y = J*x, the linear part plus the devices linearized at every sample.
+CIRCUIT_EXPORT NO_NULLS void hb_apply(struct HBSystem const *const restrict sys, cplx const x[const restrict], cplx y[const restrict], cplx Y[const restrict]) {
+	hb_apply_linear(sys, x, y, Y);
+	if( sys->Gt==NULL ) {
+		return;
+	}
+	size_t const n = sys->ac.n;
+	hb_to_time(sys->N, n, sys->H, x, sys->spectrum, sys->wave);
+	for( size_t m=0; m < sys->N; m++ ) {
+		rat const *const G = &sys->Gt[m*n*n];
+		for( size_t i=0; i < n; i++ ) {
+			rat acc = rat_zero();
+			for( size_t j=0; j < n; j++ ) {
+				acc = rat_addmul(acc, G[idx_2_to_1(i,j,n)], sys->wave[idx_2_to_1(m, j, n)]);
+			}
+			sys->cur[idx_2_to_1(m, i, n)] = acc;
+		}
+	}
+	hb_to_freq(sys->N, n, sys->H, sys->cur, sys->spectrum, y);
+}
+
+/// x = M^-1 * x through the factored blocks.
+CIRCUIT_EXPORT NO_NULLS void hb_precondition(struct HBSystem const *const sys, cplx x[const]) {
+	size_t const n = sys->ac.n;
+	for( size_t k=0; k <= sys->H; k++ ) {
+		lu_solve_scheduled_cplx(&sys->sym, &sys->blocks[k*n*n], &x[k*n]);
+	}
+}
+
+/// factors Y(kω) + Gmean for every harmonic, false if one is singular.
+CIRCUIT_EXPORT NO_NULLS bool hb_factor_blocks(struct HBSystem const *const sys) {
+	size_t const n = sys->ac.n;
+	for( size_t k=0; k <= sys->H; k++ ) {
+		cplx *const block = &sys->blocks[k*n*n];
+		hb_block_at(&sys->ac, k, sys->omega, block);
+		if( sys->Gt != NULL ) {
+			for( size_t i=0; i < n*n; i++ ) {
+				block[i] = cplx_add_rat(block[i], sys->Gmean[i]);
+			}
+		}
+		if( !lu_factor_scheduled_cplx(&sys->sym, block) ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// sum conj(a[i]) * b[i].
+CIRCUIT_EXPORT cplx cvec_dot(size_t const n, cplx const a[const static n], cplx const b[const static n]) {
+	cplx acc = cplx_zero();
+	for( size_t i=0; i < n; i++ ) {
+		acc = cplx_add_cplx(acc, cplx_mul_cplx(cplx_conj(a[i]), b[i]));
+	}
+	return acc;
+}
+
+CIRCUIT_EXPORT rat cvec_norm(size_t const n, cplx const a[const static n]) {
+	return rat_sqrt(cplx_real(cvec_dot(n, a, a)));
+}
+
+/**
+ * Restarted GMRES on J*M^-1*u = r, x = M^-1*u, starting from `x`.
+ * - V: (HB_KRYLOV_DIM+1) * len basis, w, z: len scratch, Y: n*n scratch.
+ * Adds its iterations to res->iterations.
+ */
+CIRCUIT_EXPORT NO_NULLS void hb_gmres(
+	struct HBSystem const *const restrict sys,
+	cplx            const                 r[const restrict],
+	cplx                                  x[const restrict],
+	rat              const                tol,
+	cplx                                  V[const restrict],
+	cplx                                  w[const restrict],
+	cplx                                  z[const restrict],
+	cplx                                  Y[const restrict],
+	struct HBResult      *const restrict  res
+) {
+	enum { M = HB_KRYLOV_DIM };
+	size_t const len = sys->len;
+	cplx Hm[M+1][M], g[M+1], sn[M];
+	rat  cs[M];
+	rat const r_norm = cvec_norm(len, r);
+	if( rat_lt(r_norm, rat_epsilon()) ) {
+		memset(x, 0, len * sizeof *x);
+		return;
+	}
+	for( size_t restart=0; restart < HB_MAX_RESTARTS; restart++ ) {
+		/// residual r - J*x into V_0.
+		hb_apply(sys, x, w, Y);
+		for( size_t i=0; i < len; i++ ) {
+			V[i] = cplx_sub_cplx(r[i], w[i]);
+		}
+		rat const beta = cvec_norm(len, V);
+		if( rat_le(rat_div(beta, r_norm), tol) ) {
+			break;
+		}
+		for( size_t i=0; i < len; i++ ) {
+			V[i] = cplx_div_rat(V[i], beta);
+		}
+		g[0] = cplx_make(beta, rat_zero());
+		size_t j = 0;
+		while( j < M ) {
+			cplx *const vj = &V[j*len], *const vn = &V[(j+1)*len];
+			memcpy(z, vj, len * sizeof *z);
+			hb_precondition(sys, z);
+			hb_apply(sys, z, vn, Y);
+			for( size_t i=0; i <= j; i++ ) {
+				Hm[i][j] = cplx_make(cplx_real(cvec_dot(len, &V[i*len], vn)), rat_zero());
+				for( size_t e=0; e < len; e++ ) {
+					vn[e] = cplx_sub_cplx(vn[e], cplx_mul_cplx(Hm[i][j], V[i*len + e]));
+				}
+			}
+			rat const h_next = cvec_norm(len, vn);
+			Hm[j+1][j] = cplx_make(h_next, rat_zero());
+			if( !rat_lt(h_next, rat_epsilon()) ) {
+				for( size_t e=0; e < len; e++ ) {
+					vn[e] = cplx_div_rat(vn[e], h_next);
+				}
+			}
+			/// earlier rotations, then one that zeroes H[j+1][j].
+			for( size_t i=0; i < j; i++ ) {
+				cplx const top = cplx_add_cplx(cplx_mul_rat(Hm[i][j], cs[i]), cplx_mul_cplx(sn[i], Hm[i+1][j]));
+				Hm[i+1][j] = cplx_sub_cplx(cplx_mul_rat(Hm[i+1][j], cs[i]), cplx_mul_cplx(cplx_conj(sn[i]), Hm[i][j]));
+				Hm[i][j] = top;
+			}
+			rat const a_abs = cplx_abs(Hm[j][j]);
+			rat const rho = rat_sqrt(rat_addmul(rat_mul(a_abs, a_abs), h_next, h_next));
+			if( rat_lt(a_abs, rat_epsilon()) ) {
+				cs[j] = rat_zero();
+				sn[j] = cplx_one();
+				Hm[j][j] = cplx_make(h_next, rat_zero());
+			} else {
+				cplx const phase = cplx_div_rat(Hm[j][j], a_abs);
+				cs[j] = rat_div(a_abs, rho);
+				sn[j] = cplx_mul_rat(phase, rat_div(h_next, rho));
+				Hm[j][j] = cplx_mul_rat(phase, rho);
+			}
+			Hm[j+1][j] = cplx_zero();
+			g[j+1] = cplx_neg(cplx_mul_cplx(cplx_conj(sn[j]), g[j]));
+			g[j]   = cplx_mul_rat(g[j], cs[j]);
+			res->iterations++;
+			j++;
+			if( rat_le(rat_div(cplx_abs(g[j]), r_norm), tol) || rat_lt(h_next, rat_epsilon()) ) {
+				break;
+			}
+		}
+		/// back substitution for y, then x += M^-1 * V*y.
+		for( size_t i=j; i-- > 0; ) {
+			for( size_t k=i+1; k < j; k++ ) {
+				g[i] = cplx_sub_cplx(g[i], cplx_mul_cplx(Hm[i][k], g[k]));
+			}
+			g[i] = cplx_div_cplx(g[i], Hm[i][i]);
+		}
+		memset(z, 0, len * sizeof *z);
+		for( size_t i=0; i < j; i++ ) {
+			for( size_t e=0; e < len; e++ ) {
+				z[e] = cplx_add_cplx(z[e], cplx_mul_cplx(g[i], V[i*len + e]));
+			}
+		}
+		hb_precondition(sys, z);
+		for( size_t e=0; e < len; e++ ) {
+			x[e] = cplx_add_cplx(x[e], z[e]);
+		}
+	}
+}
+
+/**
+ * F = B - Y*X - I(X) into `F`, with the harmonics of the excitation scaled by `scale`,
+ * evaluating the devices at X on the way. Returns |F| / |B|, or |F| without excitation.
+ */
+CIRCUIT_EXPORT NO_NULLS rat hb_residual(struct HBSystem const *const restrict sys, struct DeviceBatch batches[const static DEVICE_KINDS], cplx const X[const restrict], rat const scale, cplx F[const restrict], cplx Y[const restrict]) {
+	size_t const n = sys->ac.n;
+	hb_apply_linear(sys, X, F, Y);
+	if( sys->Gt != NULL ) {
+		hb_devices_eval(sys, batches, X, F);
+	}
+	for( size_t i=0; i < sys->len; i++ ) {
+		cplx const b = i < n? sys->b[i] : cplx_mul_rat(sys->b[i], scale);
+		F[i] = cplx_sub_cplx(b, F[i]);
+	}
+	rat const b_norm = cvec_norm(sys->len, sys->b);
+	rat const f_norm = cvec_norm(sys->len, F);
+	return rat_lt(b_norm, rat_epsilon())? f_norm : rat_div(f_norm, b_norm);
+}
+
+/**
+ * Newton from X at the given excitation scale.
+ * - F, D: len scratch, the rest as hb_gmres.
+ * Returns true once it converged, false if it didn't or a block went singular.
+ */
+CIRCUIT_EXPORT NO_NULLS bool hb_newton(
+	struct HBSystem const *const restrict sys,
+	struct DeviceBatch                    batches[const static DEVICE_KINDS],
+	cplx                                  X[const restrict],
+	rat              const                scale,
+	cplx                                  F[const restrict],
+	cplx                                  D[const restrict],
+	cplx                                  V[const restrict],
+	cplx                                  w[const restrict],
+	cplx                                  z[const restrict],
+	cplx                                  Y[const restrict],
+	struct HBResult      *const restrict  res
+) {
+	size_t const n = sys->ac.n;
+	rat const reltol = float_to_rat(1E-3f), vntol = float_to_rat(1E-6f);
+	for( size_t iter=0; iter < HB_NEWTON_ITERS; iter++ ) {
+		res->newton++;
+		( void )(hb_residual(sys, batches, X, scale, F, Y));
+		if( !hb_factor_blocks(sys) ) {
+			return false;
+		}
+		memset(D, 0, sys->len * sizeof *D);
+		hb_gmres(sys, F, D, float_to_rat(1E-9f), V, w, z, Y, res);
+		if( sys->Gt==NULL ) {
+			/// the linear balance is solved in one step.
+			memcpy(X, D, sys->len * sizeof *X);
+			return true;
+		}
+		/// damped so no sample of any node moves more than hb_max_step().
+		hb_to_time(sys->N, n, sys->H, D, sys->spectrum, sys->wave);
+		rat swing = rat_zero();
+		for( size_t i=0; i < sys->N * n; i++ ) {
+			swing = rat_max(swing, rat_abs(sys->wave[i]));
+		}
+		rat const alpha = rat_lt(hb_max_step(), swing)? rat_div(hb_max_step(), swing) : rat_pos1();
+		bool converged = rat_le(swing, hb_max_step());
+		for( size_t i=0; i < sys->len; i++ ) {
+			cplx const step = cplx_mul_rat(D[i], alpha);
+			X[i] = cplx_add_cplx(X[i], step);
+			if( rat_lt(rat_addmul(vntol, reltol, cplx_abs(X[i])), cplx_abs(step)) ) {
+				converged = false;
+			}
+		}
+		if( converged ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Solves the periodic steady state into `X` ((H+1)*n phasors, allocated on the front stack).
+ * The caller resets the front stack once it's done with `sys` and `X`.
+ * Returns ERR_OK, ERR_OOM, ERR_SINGULAR when a linear block is singular or Newton didn't
+ * converge (res->newton > 0), or ERR_NODE_OOB for an empty circuit or bad settings.
+ */
+CIRCUIT_EXPORT NO_NULLS int circuit_hb(struct Circuit *const restrict c, struct HBSettings const *const restrict hb, struct HBSystem *const restrict sys, cplx **const restrict X, struct HBResult *const restrict res) {
+	*sys = (struct HBSystem){ .H = hb->harmonics };
+	*res = (struct HBResult){ .residual = rat_zero() };
+	if( rat_le(hb->freq, rat_zero()) || !circuit_build_ac(c, &sys->ac) ) {
+		return sys->ac.n==0 || rat_le(hb->freq, rat_zero())? ERR_NODE_OOB : ERR_OOM;
+	}
+	size_t const n = sys->ac.n;
+	bool const devices = circuit_has_devices(c);
+	sys->omega  = rat_mul(rat_mul(rat_from_int(2), rat_pi()), hb->freq);
+	sys->len    = (sys->H + 1) * n;
+	/// twice the samples one period is printed at, so the devices' harmonics alias less.
+	sys->N      = fft_size_for(4*sys->H + 4);
+	sys->sym    = sys->ac.sym;
+	sys->blocks = bistack_alloc_front_vec(&c->bistack, (sys->H + 1) * n*n, sizeof *sys->blocks);
+	sys->b      = bistack_alloc_front_vec(&c->bistack, sys->len, sizeof *sys->b);
+	*X          = bistack_alloc_front_vec(&c->bistack, sys->len, sizeof **X);
+	cplx *const V = bistack_alloc_front_vec(&c->bistack, (HB_KRYLOV_DIM + 1) * sys->len, sizeof *V);
+	cplx *const w = bistack_alloc_front_vec(&c->bistack, sys->len, sizeof *w);
+	cplx *const z = bistack_alloc_front_vec(&c->bistack, sys->len, sizeof *z);
+	cplx *const F = bistack_alloc_front_vec(&c->bistack, sys->len, sizeof *F);
+	cplx *const D = bistack_alloc_front_vec(&c->bistack, sys->len, sizeof *D);
+	cplx *const Y = bistack_alloc_front_vec(&c->bistack, n*n, sizeof *Y);
+	if( sys->blocks==NULL || sys->b==NULL || *X==NULL || V==NULL || w==NULL || z==NULL || F==NULL || D==NULL || Y==NULL ) {
+		return ERR_OOM;
+	}
+	for( size_t i=0; i < sys->len; i++ ) {
+		sys->b[i] = (*X)[i] = cplx_zero();
+	}
+	for( size_t i=0; i < n; i++ ) {
+		sys->b[i] = cplx_make(sys->ac.dc[i], rat_zero());
+		if( sys->H > 0 ) {
+			sys->b[n + i] = sys->ac.rhs[i];
+		}
+		sys->node_to_matrix_id[sys->ac.matrix_id_to_node[i]] = i;
+	}
+	
+	struct DeviceBatch batches[DEVICE_KINDS] = {0};
+	if( !devices ) {
+		if( !hb_newton(sys, batches, *X, rat_pos1(), F, D, V, w, z, Y, res) ) {
+			return ERR_SINGULAR;
+		}
+		res->residual = hb_residual(sys, batches, *X, rat_pos1(), F, Y);
+		return ERR_OK;
+	}
+	
+	sys->Gt       = alloc_vec(&c->bistack, sys->N * n*n);
+	sys->Gmean    = alloc_vec(&c->bistack, n*n);
+	sys->wave     = alloc_vec(&c->bistack, sys->N * n);
+	sys->cur      = alloc_vec(&c->bistack, sys->N * n);
+	sys->spectrum = bistack_alloc_front_vec(&c->bistack, sys->N, sizeof *sys->spectrum);
+	cplx *const X_dc = bistack_alloc_front_vec(&c->bistack, sys->len, sizeof *X_dc);
+	if( sys->Gt==NULL || sys->Gmean==NULL || sys->wave==NULL || sys->cur==NULL || sys->spectrum==NULL || X_dc==NULL || !device_batches_make(c, batches) ) {
+		return ERR_OOM;
+	}
+	/// devices fill in entries the linear pattern doesn't have.
+	size_t dense[MAX_NODES] = {0};
+	for( size_t i=0; i < n; i++ ) {
+		dense[i] = (( size_t )(1) << n) - 1;
+	}
+	lu_symbolic_from_pattern(n, dense, &sys->sym);
+	
+	/// start from the operating point, or from nothing if there isn't one.
+	rat V_op[MAX_NODES];
+	struct NRStats op_stats;
+	int const op_err = circuit_dc_nonlinear(c, &V_op, &op_stats);
+	if( op_err==ERR_OOM ) {
+		return ERR_OOM;
+	}
+	for( size_t i=0; i < sys->len; i++ ) {
+		X_dc[i] = cplx_zero();
+	}
+	for( size_t i=0; i < n; i++ ) {
+		X_dc[i] = cplx_make(op_err==ERR_OK? V_op[sys->ac.matrix_id_to_node[i]] : rat_zero(), rat_zero());
+	}
+	memcpy(*X, X_dc, sys->len * sizeof **X);
+	bool ok = hb_newton(sys, batches, *X, rat_pos1(), F, D, V, w, z, Y, res);
+	if( !ok ) {
+		/// excitation stepping: ramp the harmonics' sources up from zero, halving the step on failure.
+		memcpy(*X, X_dc, sys->len * sizeof **X);
+		rat scale = rat_zero(), step = float_to_rat(0.25f);
+		ok = true;
+		while( ok && rat_lt(scale, rat_pos1()) ) {
+			rat const next = rat_min(rat_pos1(), rat_add(scale, step));
+			memcpy(X_dc, *X, sys->len * sizeof *X_dc);
+			if( hb_newton(sys, batches, *X, next, F, D, V, w, z, Y, res) ) {
+				scale = next;
+				step = rat_mul(step, float_to_rat(1.5f));
+			} else {
+				memcpy(*X, X_dc, sys->len * sizeof **X);
+				step = rat_div(step, rat_from_int(2));
+				ok = rat_lt(float_to_rat(1E-3f), step);
+			}
+		}
+	}
+	if( !ok ) {
+		return ERR_SINGULAR;
+	}
+	res->residual = hb_residual(sys, batches, *X, rat_pos1(), F, Y);
+	return ERR_OK;
+}
+
+/// hands one period of the steady state to `sink`, sampled at a power of two >= 2H+2 points.
+CIRCUIT_EXPORT NO_NULLS bool hb_emit_period(struct Circuit *const restrict c, struct HBSystem const *const restrict sys, cplx const X[const restrict], struct TranSink const *const restrict sink) {
+	size_t const n = sys->ac.n;
+	size_t const N = fft_size_for(2*sys->H + 2);
+	cplx *const spectrum = bistack_alloc_front_vec(&c->bistack, N, sizeof *spectrum);
+	rat  *const wave     = alloc_vec(&c->bistack, N*n);
+	if( spectrum==NULL || wave==NULL ) {
+		return false;
+	}
+	hb_to_time(N, n, sys->H, X, spectrum, wave);
+	size_t node_bits = 0;
+	rat V[MAX_NODES] = {0};
+	for( size_t i=0; i < MAX_NODES; i++ ) {
+		V[i] = rat_zero();
+	}
+	for( size_t i=0; i < n; i++ ) {
+		node_bits |= (1 << sys->ac.matrix_id_to_node[i]);
+	}
+	rat const period = rat_recip(rat_div(sys->omega, rat_mul(rat_from_int(2), rat_pi())));
+	for( size_t m=0; m < N; m++ ) {
+		for( size_t i=0; i < n; i++ ) {
+			V[sys->ac.matrix_id_to_node[i]] = wave[idx_2_to_1(m, i, n)];
+		}
+		sink->emit(sink->ctx, rat_div(rat_mul(period, rat_from_int(m)), rat_from_int(N)), node_bits, &V);
+	}
+	return true;
+}
+
+/// prints every harmonic's phasors, then one period in the time domain.
+CIRCUIT_EXPORT NO_NULLS void circuit_solve_hb(struct Circuit *const restrict c, struct HBSettings const *const restrict hb, FILE *const restrict out) {
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	struct HBSystem sys;
+	struct HBResult res;
+	cplx *X = NULL;
+	int const err = circuit_hb(c, hb, &sys, &X, &res);
+	if( err==ERR_SINGULAR && res.newton > 0 && sys.Gt != NULL ) {
+		fprintf(out, "hb: no convergence after %zu Newton iterations\n", res.newton);
+		bistack_release_front(&c->bistack, mark);
+		return;
+	} else if( err != ERR_OK ) {
+		fputs(err==ERR_SINGULAR? "hb: singular harmonic block\n" : err==ERR_OOM? "hb: out of memory\n" : "", out);
+		bistack_release_front(&c->bistack, mark);
+		return;
+	}
+	char num[48] = {0}, resid[48] = {0};
+	fprintf(out, "hb: %zu harmonics of %s Hz, %zu Newton, %zu Krylov iterations, residual %s\n", sys.H, rat_to_cstr(hb->freq, sizeof num, num), res.newton, res.iterations, rat_to_cstr(res.residual, sizeof resid, resid));
+	for( size_t k=0; k <= sys.H; k++ ) {
+		fprintf(out, "harmonic %zu (%s Hz)\n", k, rat_to_cstr(rat_mul(hb->freq, rat_from_int(k)), sizeof num, num));
+		ac_print_point(out, &sys.ac, &X[k*sys.ac.n]);
+	}
+	struct TranSink const sink = { .emit = tran_print_point, .ctx = out };
+	if( !hb_emit_period(c, &sys, X, &sink) ) {
+		fputs("hb: out of memory\n", out);
+	}
+	bistack_release_front(&c->bistack, mark);
+}
+#endif
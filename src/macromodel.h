@@ -0,0 +1,302 @@
+#ifndef MACROMODEL_H_INCLUDED
+#	define MACROMODEL_H_INCLUDED
+
+#include "node.h"
+
+
+/// Kron reduction (Schur complement) of a block's internal nodes.
+/// With the matrix split into ports P and internals I:
+///   Y = G_PP - G_PI * G_II^-1 * G_IP
+///   J = I_P  - G_PI * G_II^-1 * I_I
+/// The block's internals are solved once here, every instance only stamps Y and J.
+/// Netlists get blocks through subcircuits:
+///   .subckt amp 1 2      ports are the block's own nodes 1 and 2, 0 is the shared ground.
+///   R 1 3 1k
+///   ...
+///   .ends
+///   X1 4 5 amp           an instance tying port 1 to node 4 and port 2 to node 5.
+/// The block is read into memory borrowed off the parent's front stack and reduced at .ends,
+/// only its Y and J stay, on the parent's back stack.
+
+enum {
+	MAX_SUBCKTS     = 8,
+	SUBCKT_NAME_LEN = 16,
+};
+
+struct SubcktDef {
+	char               name[SUBCKT_NAME_LEN];
+	struct Macromodel *model;  /// NULL when the block didn't reduce, `err` says why.
+	int                err;
+};
+
+/// a deck's subcircuits, `block` is the one being read while `open`.
+struct SubcktTable {
+	struct SubcktDef     defs[MAX_SUBCKTS];
+	struct Circuit       block;
+	struct TIBiStackMark mark;  /// the parent's stacks before the block borrowed its memory.
+	uint8_t              ports[MAX_NODES];
+	size_t               count, port_count;
+	bool                 open;
+};
+
+/**
+ * Reduces `block` down to `port_count` ports.
+ * - ports: nodes of `block` to keep, must be active and not ground (ground is the shared reference).
+ * - store: where Y and J live, usually the back of the parent's bistack so they outlive `block`.
+ * `block`'s front stack is used as scratch and reset on return.
+ *
+ * Returns ERR_OK, ERR_BAD_PORT, ERR_SINGULAR (floating internals) or ERR_OOM.
+ */
+CIRCUIT_EXPORT NO_NULLS int circuit_make_macromodel(
+	struct Circuit     *const restrict block,
+	size_t              const          port_count,
+	uint8_t             const          ports[const restrict static port_count],
+	struct TIBiStack   *const restrict store,
+	struct Macromodel  *const restrict model_out
+) {
+	struct TIBiStackMark const mark = bistack_mark(&block->bistack);
+	if( port_count==0 || port_count >= MAX_NODES ) {
+		return ERR_BAD_PORT;
+	}
+	uint8_t matrix_id_to_node[MAX_NODES] = {0};
+	rat *G = NULL;
+	rat *rhs = NULL;
+	size_t const n = circuit_build_dc(block, &matrix_id_to_node, &G, &rhs);
+	int err = ERR_OK;
+	if( n==0 || G==NULL || rhs==NULL ) {
+		err = n==0? ERR_BAD_PORT : ERR_OOM;
+		goto done;
+	}
+	
+	/// split matrix ids into ports followed by internals.
+	uint8_t order[MAX_NODES] = {0};
+	size_t port_bits = 0;
+	for( size_t p=0; p < port_count; p++ ) {
+		bool found = false;
+		for( size_t i=0; i < n; i++ ) {
+			if( matrix_id_to_node[i]==ports[p] ) {
+				order[p] = i;
+				found = true;
+				break;
+			}
+		}
+		if( !found || (port_bits & (1 << ports[p])) ) {
+			err = ERR_BAD_PORT;
+			goto done;
+		}
+		port_bits |= (1 << ports[p]);
+	}
+	size_t const m = n - port_count;
+	for( size_t i=0, k=port_count; i < n; i++ ) {
+		if( !(port_bits & (1 << matrix_id_to_node[i])) ) {
+			order[k++] = i;
+		}
+	}
+	
+	model_out->ports = port_count;
+	model_out->Y = bistack_alloc_back_vec(store, port_count*port_count, sizeof *model_out->Y);
+	model_out->J = bistack_alloc_back_vec(store, port_count, sizeof *model_out->J);
+	if( model_out->Y==NULL || model_out->J==NULL ) {
+		err = ERR_OOM;
+		goto done;
+	}
+	for( size_t i=0; i < port_count; i++ ) {
+		model_out->J[i] = rhs[order[i]];
+		for( size_t j=0; j < port_count; j++ ) {
+			model_out->Y[idx_2_to_1(i,j,port_count)] = G[idx_2_to_1(order[i], order[j], n)];
+		}
+	}
+	if( m==0 ) {
+		goto done;
+	}
+	
+	/// factor G_II once, then eliminate it against every port column and the RHS.
+	rat     *const G_II = alloc_vec(&block->bistack, m*m);
+	rat     *const col  = alloc_vec(&block->bistack, m);
+	uint8_t *const piv  = bistack_alloc_front(&block->bistack, m);
+	if( G_II==NULL || col==NULL || piv==NULL ) {
+		err = ERR_OOM;
+		goto done;
+	}
+	for( size_t i=0; i < m; i++ ) {
+		for( size_t j=0; j < m; j++ ) {
+			G_II[idx_2_to_1(i,j,m)] = G[idx_2_to_1(order[port_count+i], order[port_count+j], n)];
+		}
+	}
+	if( !lu_factor(m, G_II, piv) ) {
+		err = ERR_SINGULAR;
+		goto done;
+	}
+	/// column j <= port_count, the last one is the RHS.
+	for( size_t j=0; j <= port_count; j++ ) {
+		for( size_t i=0; i < m; i++ ) {
+			size_t const row = order[port_count+i];
+			col[i] = j < port_count? G[idx_2_to_1(row, order[j], n)] : rhs[row];
+		}
+		lu_solve(m, G_II, piv, col);
+		for( size_t p=0; p < port_count; p++ ) {
+			rat acc = rat_zero();
+			for( size_t i=0; i < m; i++ ) {
+				acc = rat_addmul(acc, G[idx_2_to_1(order[p], order[port_count+i], n)], col[i]);
+			}
+			if( j < port_count ) {
+				size_t const pj = idx_2_to_1(p,j,port_count);
+				model_out->Y[pj] = rat_sub(model_out->Y[pj], acc);
+			} else {
+				model_out->J[p] = rat_sub(model_out->J[p], acc);
+			}
+		}
+	}
+done:
+	bistack_release_front(&block->bistack, mark);
+	return err;
+}
+
+/// places an instance of `model` into `c`, port i ties to `nodes[i]`.
+CIRCUIT_EXPORT NO_NULLS int circuit_add_macromodel(
+	struct Circuit          *const restrict c,
+	struct Macromodel const *const restrict model,
+	uint8_t                  const          nodes[const restrict static model->ports]
+) {
+	/// the instance is stamped from its owner's list, so the owner can't be ground.
+	size_t owner = model->ports;
+	size_t node_bits = 0;
+	for( size_t i=0; i < model->ports; i++ ) {
+		if( nodes[i] >= MAX_NODES ) {
+			return ERR_NODE_OOB;
+		} else if( owner==model->ports && !node_is_ground(nodes[i]) ) {
+			owner = i;
+		}
+		node_bits |= (1 << nodes[i]);
+	}
+	if( owner==model->ports ) {
+		return ERR_SELF_LOOP;
+	}
+	
+	struct MacroInstance *const inst = bistack_alloc_back(&c->bistack, sizeof *inst);
+	if( inst==NULL ) {
+		return ERR_OOM;
+	}
+	inst->model = model;
+	memcpy(inst->nodes, nodes, model->ports);
+	
+	struct Comp *const comp = component_new(&c->bistack, rat_zero(), COMP_MACROMODEL, GND_IDX);
+	if( comp==NULL ) {
+		return ERR_OOM;
+	}
+	comp->aux.macro = inst;
+	circuit_connect_component(c, nodes[owner], GND_IDX, comp);
+	c->active_nodes |= node_bits;
+	return ERR_OK;
+}
+
+CIRCUIT_EXPORT NO_NULLS struct SubcktDef const *subckt_find(struct SubcktTable const *const restrict tab, char const name[const restrict static 1], size_t const len) {
+	for( size_t k=0; k < tab->count; k++ ) {
+		if( strlen(tab->defs[k].name)==len && strncmp(tab->defs[k].name, name, len)==0 ) {
+			return &tab->defs[k];
+		}
+	}
+	return NULL;
+}
+
+/// .subckt name port ..., the block gets half of what the parent has left.
+CIRCUIT_EXPORT NO_NULLS void subckt_begin(struct SubcktTable *const restrict tab, struct Circuit *const restrict c, char const line[const restrict static 1]) {
+	size_t i = 7;
+	skip_ws(line, &i);
+	size_t const len = strcspn(&line[i], " \t\r\n");
+	if( tab->open || tab->count >= MAX_SUBCKTS || len==0 || len >= SUBCKT_NAME_LEN ) {
+		return;
+	}
+	struct SubcktDef *const def = &tab->defs[tab->count];
+	*def = (struct SubcktDef){ .err = ERR_BAD_PORT };
+	memcpy(def->name, &line[i], len);
+	tab->port_count = 0;
+	for( i += len; line[i] != 0 && tab->port_count < MAX_NODES - 1; ) {
+		skip_ws(line, &i);
+		if( !isdigit(line[i]) ) {
+			break;
+		}
+		char *end = NULL;
+		tab->ports[tab->port_count++] = strtoul(&line[i], &end, 10);
+		i = end - line;
+	}
+	tab->mark = bistack_mark(&c->bistack);
+	size_t const room = ((c->bistack.back - c->bistack.front) / 2) & ~( size_t )(sizeof(rat) - 1);
+	uint8_t *const mem = room > 0? bistack_alloc_front(&c->bistack, room) : NULL;
+	if( mem==NULL ) {
+		def->err = ERR_OOM;
+		tab->count++;
+		return;
+	}
+	tab->block = circuit_make(room, mem);
+	tab->open = true;
+}
+
+/// .ends, reduces the block onto the parent's back stack and gives its memory back.
+CIRCUIT_EXPORT NO_NULLS void subckt_end(struct SubcktTable *const restrict tab, struct Circuit *const restrict c) {
+	if( !tab->open ) {
+		return;
+	}
+	struct SubcktDef *const def = &tab->defs[tab->count++];
+	struct Macromodel *const model = bistack_alloc_back(&c->bistack, sizeof *model);
+	def->err = model==NULL? ERR_OOM : circuit_make_macromodel(&tab->block, tab->port_count, tab->ports, &c->bistack, model);
+	def->model = def->err==ERR_OK? model : NULL;
+	if( def->model==NULL ) {
+		bistack_release(&c->bistack, tab->mark);
+	} else {
+		bistack_release_front(&c->bistack, tab->mark);
+	}
+	tab->open = false;
+}
+
+/// returns true if `line` was .subckt or .ends.
+CIRCUIT_EXPORT NO_NULLS bool subckt_parse_directive(struct SubcktTable *const restrict tab, struct Circuit *const restrict c, char const line[const restrict static 1]) {
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word==7 && strncmp(line, ".subckt", 7)==0 ) {
+		subckt_begin(tab, c, line);
+		return true;
+	} else if( word==5 && strncmp(line, ".ends", 5)==0 ) {
+		subckt_end(tab, c);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * X<label> node ... name, an instance of a subcircuit defined before it.
+ * Returns ERR_BAD_PORT for an unknown subcircuit or the wrong number of nodes, the
+ * definition's own error if its block didn't reduce, or circuit_add_macromodel's result.
+ */
+CIRCUIT_EXPORT NO_NULLS int subckt_add_instance(struct SubcktTable const *const restrict tab, struct Circuit *const restrict c, char const line[const restrict static 1]) {
+	uint8_t nodes[MAX_NODES] = {0};
+	size_t count = 0, i = strcspn(line, " \t\r\n");
+	char const *name = NULL;
+	size_t name_len = 0;
+	for( skip_ws(line, &i); line[i] != 0 && line[i] != '\r' && line[i] != '\n'; skip_ws(line, &i) ) {
+		size_t const len = strcspn(&line[i], " \t\r\n");
+		if( name != NULL ) {
+			/// the name comes last.
+			return ERR_BAD_PORT;
+		} else if( !isdigit(line[i]) ) {
+			name = &line[i];
+			name_len = len;
+		} else if( count < MAX_NODES ) {
+			unsigned long const node = strtoul(&line[i], NULL, 10);
+			if( node >= MAX_NODES ) {
+				return ERR_NODE_OOB;
+			}
+			nodes[count++] = node;
+		}
+		i += len;
+	}
+	struct SubcktDef const *const def = name != NULL? subckt_find(tab, name, name_len) : NULL;
+	if( def==NULL ) {
+		return ERR_BAD_PORT;
+	} else if( def->model==NULL ) {
+		return def->err;
+	} else if( count != def->model->ports ) {
+		return ERR_BAD_PORT;
+	}
+	return circuit_add_macromodel(c, def->model, nodes);
+}
+#endif
@@ -1,6 +1,12 @@
 //#include <tice.h>
+#ifndef TICE_H
+/// mmap, sockets, open_memstream and friends are POSIX, not ISO C.
+#	define _DEFAULT_SOURCE
+#endif
 #include <stdlib.h>
-#include "node.h"
+#include "daemon.h"
+#include "watch.h"
+#include "bench.h"
 
 
 enum {
@@ -11,31 +17,89 @@ enum {
 		1U << 20
 #	endif
 };
-uint8_t backing_mem[MEM_SIZE];
+_Alignas(max_align_t) uint8_t backing_mem[MEM_SIZE];
 
-int main(void) {
+int main(int const argc, char *argv[const]) {
 #ifdef TICE_H
 #	warning "compiling for TI84 Calc"
+	( void )(argc);
+	( void )(argv);
 	os_ClrLCDFull();
 #else
 #	warning "compiling for PC/Other"
 #endif
-	puts("Welcome to LiteSpiCE");
 	struct Circuit circuit = circuit_make(sizeof backing_mem, backing_mem);
 #ifdef TICE_H
+	puts("Welcome to LiteSpiCE");
 	puts("Press 'enter' to continue.");
 	while( os_GetCSC() != sk_Enter );
 	os_ClrLCDFull();
 	char num_buff[64] = {0};
 	printf("%s\n", rat_to_cstr(os_Int24ToReal(10), sizeof num_buff, num_buff));
-	circuit_solve_dc(&circuit);
+	circuit_solve_dc(&circuit, stdout);
 	puts("Calc'ed Voltages. Press 'enter' to continue.");
 	while( os_GetCSC() != sk_Enter );
 	os_ClrLCDFull();
 	puts("Press 'clear' to Exit.");
 	while( os_GetCSC() != sk_Clear );
 #else
+	/// litespice [--threads <n>] ..., how many threads the solvers' par_for loops use, 1 by default.
+	int const shift = argc > 2 && !strcmp(argv[1], "--threads")? 2 : 0;
+	if( shift > 0 ) {
+		par_set_threads(strtoul(argv[2], NULL, 10));
+	}
+	int const args = argc - shift;
+	char *const *const arg = argv + shift;
+	/// litespice --batch <manifest|-> [--cache <dir> [limit_kb]], every netlist out of the one backing memory.
+	if( args > 2 && !strcmp(arg[1], "--batch") ) {
+		struct ResultCache results;
+		bool const cached = args > 4 && !strcmp(arg[3], "--cache");
+		size_t const limit_kb = args > 5? strtoul(arg[5], NULL, 10) : RCACHE_DEFAULT_KB;
+		if( cached && !rcache_open(&results, arg[4], limit_kb << 10) ) {
+			fprintf(stderr, "can't use cache directory %s\n", arg[4]);
+			return 1;
+		}
+		struct BatchStats stats;
+		if( !batch_run(arg[2], backing_mem, sizeof backing_mem, cached? &results : NULL, stdout, &stats) ) {
+			fprintf(stderr, "can't open manifest %s\n", arg[2]);
+			return 1;
+		}
+		printf("batch: %zu jobs, %zu failed, %zu lines\n", stats.jobs, stats.failed, stats.lines);
+		if( cached ) {
+			rcache_print_stats(&results, stdout);
+		}
+		return 0;
+	}
+	/// litespice --serve <socket> [cache_kb], solves netlists sent to a Unix socket until killed.
+	if( args > 2 && !strcmp(arg[1], "--serve") ) {
+		size_t const cache_bytes = args > 3? strtoul(arg[3], NULL, 10) << 10 : DAEMON_CACHE_BYTES;
+		if( !daemon_serve(arg[2], backing_mem, sizeof backing_mem, cache_bytes, 0, stderr) ) {
+			fprintf(stderr, "can't serve on %s\n", arg[2]);
+			return 1;
+		}
+		return 0;
+	}
+	/// litespice --watch <netlist> [reloads], re-solves the netlist on every save.
+	if( args > 2 && !strcmp(arg[1], "--watch") ) {
+		size_t const reloads = args > 3? strtoul(arg[3], NULL, 10) : 0;
+		if( !watch_run(arg[2], backing_mem, sizeof backing_mem, reloads, stdout) ) {
+			fprintf(stderr, "can't watch %s\n", arg[2]);
+			return 1;
+		}
+		return 0;
+	}
+	/// litespice --bench [max_threads], the thread scaling table, see bench.h.
+	if( args > 1 && !strcmp(arg[1], "--bench") ) {
+		size_t const max_threads = args > 2? strtoul(arg[2], NULL, 10) : PAR_MAX_THREADS;
+		if( !bench_run(max_threads, backing_mem, sizeof backing_mem, stdout) ) {
+			fputs("can't set up the benchmark\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
+	puts("Welcome to LiteSpiCE");
 	/// fill the circuit.
+	struct Deck deck = {0};
 	enum{ COMP_ENTRY_CSTR_LEN = 100 };
 	for(;;) {
 		char comp_entry[COMP_ENTRY_CSTR_LEN] = {0};
@@ -43,16 +107,16 @@ int main(void) {
 		fgets(&comp_entry[0], sizeof comp_entry - 1, stdin);
 		size_t const l = strlen(comp_entry);
 		comp_entry[l - 1] = 0;
-		if( tolower(comp_entry[0])=='q' ) {
+		if( tolower(comp_entry[0])=='q' && (comp_entry[1]==0 || tolower(comp_entry[1])=='u') ) {
 			puts("Exiting LiteSpiCE...");
 			break;
 		} else if( comp_entry[0]==0 ) {
 			break;
 		}
 		printf("entry:: '%s'\n", comp_entry);
-		circuit_add_from_line(&circuit, comp_entry);
+		deck_add_line(&deck, &circuit, comp_entry);
 	}
-	circuit_solve_dc(&circuit);
+	deck_run(&deck, &circuit, stdout);
 #endif
 }
 
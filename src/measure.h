@@ -0,0 +1,330 @@
+#ifndef MEASURE_H_INCLUDED
+#	define MEASURE_H_INCLUDED
+
+#include "multirate.h"
+#include "montecarlo.h"
+#include "param.h"
+
+
+/// Transient measurements, evaluated point by point as the solver emits them.
+///   .measure <name> avg|rms|max|min|pp V(n) [from=<t>] [to=<t>]
+///   .measure <name> rise V(n) <lo> <hi>       time from crossing lo to crossing hi,
+///                                             a fall time when lo > hi.
+///   .measure <name> delay V(a) V(b) <level>   from V(a) crossing level to V(b) crossing it.
+/// Each measurement keeps the previous point and a few accumulators, nothing else,
+/// so with measurements on the waveform isn't printed or kept at all unless .wave asks.
+/// Averages integrate by trapezoids clipped to the window, crossings interpolate
+/// linearly between points. Under .step every point of the sweep runs the transient
+/// again and the results are summarized over the runs.
+
+enum {
+	MEAS_AVG, MEAS_RMS, MEAS_MAX, MEAS_MIN, MEAS_PP, MEAS_RISE, MEAS_DELAY,
+	MAX_MEASURES  = 8,
+	MEAS_NAME_LEN = 12,
+};
+
+struct Measure {
+	char    name[MEAS_NAME_LEN];
+	uint8_t kind, node, ref;       /// ref: V(b) of a delay.
+	rat     from, to;              /// window, to <= from means open-ended.
+	rat     lo, hi;                /// rise thresholds, lo is a delay's level.
+	/// per run.
+	rat     t_prev, v_prev, r_prev, acc, acc_t, top, bottom, t_start, value;
+	bool    seen, started, done;
+};
+
+struct MeasureSet {
+	struct Measure      m[MAX_MEASURES];
+	struct RunningStats summary[MAX_MEASURES];
+	size_t              count;
+};
+
+/// measurements in front of another sink, which may be absent.
+struct MeasureRun {
+	struct MeasureSet     *set;
+	struct TranSink const *inner;
+};
+
+CIRCUIT_EXPORT NO_NULLS uint8_t measure_parse_node(char const tok[const restrict static 1]) {
+	size_t i = 0;
+	while( tok[i] != 0 && !isdigit(tok[i]) ) {
+		i++;
+	}
+	unsigned long const node = strtoul(&tok[i], NULL, 10);
+	return node < MAX_NODES? node : 0;
+}
+
+/// .measure and .meas
+CIRCUIT_EXPORT NO_NULLS bool measure_parse_directive(struct MeasureSet *const restrict set, char const line[const restrict static 1]) {
+	size_t const word = strcspn(line, " \t\r\n");
+	if( !(word==5 && strncmp(line, ".meas", 5)==0) && !(word==8 && strncmp(line, ".measure", 8)==0) ) {
+		return false;
+	}
+	char name[MEAS_NAME_LEN] = {0}, kind[8] = {0}, tok[3][24] = {{0}};
+	int const got = sscanf(&line[word], " %11s %7s %23s %23s %23s", name, kind, tok[0], tok[1], tok[2]);
+	if( got < 3 || set->count >= MAX_MEASURES ) {
+		return true;
+	}
+	for( size_t i=0; kind[i] != 0; i++ ) {
+		kind[i] = tolower(kind[i]);
+	}
+	struct Measure m = { .node = measure_parse_node(tok[0]), .from = rat_zero(), .to = rat_zero() };
+	memcpy(m.name, name, sizeof m.name);
+	static char const *const kinds[] = { "avg", "rms", "max", "min", "pp", "rise", "delay" };
+	m.kind = sizeof kinds / sizeof kinds[0];
+	for( uint8_t k=0; k < sizeof kinds / sizeof kinds[0]; k++ ) {
+		if( !strcmp(kind, kinds[k]) ) {
+			m.kind = k;
+		}
+	}
+	if( m.node==0 ) {
+		return true;
+	}
+	switch( m.kind ) {
+		case MEAS_RISE:
+			if( got < 5 ) {
+				return true;
+			}
+			m.lo = parse_si_scalar(tok[1]);
+			m.hi = parse_si_scalar(tok[2]);
+			break;
+		case MEAS_DELAY:
+			m.ref = measure_parse_node(tok[1]);
+			if( got < 5 || m.ref==0 ) {
+				return true;
+			}
+			m.lo = parse_si_scalar(tok[2]);
+			break;
+		case MEAS_AVG: case MEAS_RMS: case MEAS_MAX: case MEAS_MIN: case MEAS_PP:
+			for( int t=1; t < ( int )(sizeof tok / sizeof tok[0]) && t < got - 2; t++ ) {
+				char *const eq = strchr(tok[t], '=');
+				if( eq==NULL ) {
+					continue;
+				} else if( tolower(tok[t][0])=='f' ) {
+					m.from = parse_si_scalar(eq + 1);
+				} else if( tolower(tok[t][0])=='t' ) {
+					m.to = parse_si_scalar(eq + 1);
+				}
+			}
+			break;
+		default:
+			return true;
+	}
+	set->m[set->count++] = m;
+	return true;
+}
+
+CIRCUIT_EXPORT NO_NULLS void measure_reset(struct MeasureSet *const set) {
+	for( size_t k=0; k < set->count; k++ ) {
+		struct Measure *const m = &set->m[k];
+		m->acc = m->acc_t = m->value = rat_zero();
+		m->seen = m->started = m->done = false;
+	}
+}
+
+/// where v crosses `level` between (t0, v0) and (t1, v1) going the way `rising` says.
+CIRCUIT_EXPORT NO_NULLS bool measure_cross(rat const t0, rat const v0, rat const t1, rat const v1, rat const level, bool const rising, rat *const restrict t) {
+	bool const crossed = rising? (rat_lt(v0, level) && rat_le(level, v1)) : (rat_lt(level, v0) && rat_le(v1, level));
+	if( crossed ) {
+		*t = rat_addmul(t0, rat_sub(t1, t0), rat_div(rat_sub(level, v0), rat_sub(v1, v0)));
+	}
+	return crossed;
+}
+
+/// either way.
+CIRCUIT_EXPORT NO_NULLS bool measure_cross_any(rat const t0, rat const v0, rat const t1, rat const v1, rat const level, rat *const restrict t) {
+	return measure_cross(t0, v0, t1, v1, level, true, t) || measure_cross(t0, v0, t1, v1, level, false, t);
+}
+
+CIRCUIT_EXPORT NO_NULLS void measure_window(struct Measure *const m, rat const t, rat const v) {
+	bool const open_end = rat_le(m->to, m->from);
+	if( m->kind==MEAS_MAX || m->kind==MEAS_MIN || m->kind==MEAS_PP ) {
+		if( rat_lt(t, m->from) || (!open_end && rat_lt(m->to, t)) ) {
+			return;
+		} else if( !m->started ) {
+			m->top = m->bottom = v;
+			m->started = true;
+		}
+		m->top    = rat_max(m->top, v);
+		m->bottom = rat_min(m->bottom, v);
+		return;
+	}
+	if( !m->seen ) {
+		return;
+	}
+	/// trapezoid over [t_prev, t] clipped to the window, ends interpolated.
+	rat const a = rat_max(m->t_prev, m->from);
+	rat const b = open_end? t : rat_min(t, m->to);
+	if( !rat_lt(a, b) ) {
+		return;
+	}
+	rat const dt = rat_sub(t, m->t_prev);
+	rat const slope = rat_div(rat_sub(v, m->v_prev), dt);
+	rat const va = rat_addmul(m->v_prev, slope, rat_sub(a, m->t_prev));
+	rat const vb = rat_addmul(m->v_prev, slope, rat_sub(b, m->t_prev));
+	rat const h = rat_sub(b, a);
+	if( m->kind==MEAS_AVG ) {
+		m->acc = rat_addmul(m->acc, h, rat_mul(rat_add(va, vb), float_to_rat(0.5f)));
+	} else {
+		/// exact for the linear segment, (va^2 + va*vb + vb^2) / 3.
+		rat const sq = rat_add(rat_add(rat_mul(va, va), rat_mul(va, vb)), rat_mul(vb, vb));
+		m->acc = rat_addmul(m->acc, h, rat_div(sq, rat_from_int(3)));
+	}
+	m->acc_t = rat_add(m->acc_t, h);
+	m->started = true;
+}
+
+CIRCUIT_EXPORT NO_NULLS void measure_point(struct Measure *const m, rat const t, rat const (*const V)[MAX_NODES]) {
+	rat const v = (*V)[m->node];
+	rat const r = m->kind==MEAS_DELAY? (*V)[m->ref] : rat_zero();
+	rat cross;
+	switch( m->kind ) {
+		case MEAS_RISE:
+			if( m->seen && !m->done ) {
+				bool const rising = rat_lt(m->lo, m->hi);
+				if( !m->started && measure_cross(m->t_prev, m->v_prev, t, v, m->lo, rising, &cross) ) {
+					m->t_start = cross;
+					m->started = true;
+				}
+				/// both thresholds can fall in the same segment.
+				if( m->started && measure_cross(m->t_prev, m->v_prev, t, v, m->hi, rising, &cross) ) {
+					m->value = rat_sub(cross, m->t_start);
+					m->done = true;
+				}
+			}
+			break;
+		case MEAS_DELAY:
+			if( m->seen && !m->done ) {
+				if( !m->started && measure_cross_any(m->t_prev, m->v_prev, t, v, m->lo, &cross) ) {
+					m->t_start = cross;
+					m->started = true;
+				}
+				if( m->started && measure_cross_any(m->t_prev, m->r_prev, t, r, m->lo, &cross) && rat_le(m->t_start, cross) ) {
+					m->value = rat_sub(cross, m->t_start);
+					m->done = true;
+				}
+			}
+			break;
+		default:
+			measure_window(m, t, v);
+			break;
+	}
+	m->t_prev = t;
+	m->v_prev = v;
+	m->r_prev = r;
+	m->seen   = true;
+}
+
+/// finishes a run, false if the measurement never triggered.
+CIRCUIT_EXPORT NO_NULLS bool measure_finish(struct Measure *const m) {
+	switch( m->kind ) {
+		case MEAS_AVG:
+			m->value = m->started? rat_div(m->acc, m->acc_t) : rat_zero();
+			return m->started;
+		case MEAS_RMS:
+			m->value = m->started? rat_sqrt(rat_div(m->acc, m->acc_t)) : rat_zero();
+			return m->started;
+		case MEAS_MAX: m->value = m->top;    return m->started;
+		case MEAS_MIN: m->value = m->bottom; return m->started;
+		case MEAS_PP:  m->value = rat_sub(m->top, m->bottom); return m->started;
+		default:       return m->done;
+	}
+}
+
+/// TranSink callback, `ctx` is a MeasureRun.
+CIRCUIT_EXPORT void measure_emit(void *const ctx, rat const t, size_t const node_bits, rat const (*const V)[MAX_NODES]) {
+	struct MeasureRun const *const run = ctx;
+	for( size_t k=0; k < run->set->count; k++ ) {
+		measure_point(&run->set->m[k], t, V);
+	}
+	if( run->inner != NULL ) {
+		run->inner->emit(run->inner->ctx, t, node_bits, V);
+	}
+}
+
+/// one transient with the measurements attached, prints and summarizes them.
+CIRCUIT_EXPORT NO_NULLS int measure_run(struct Circuit *const restrict c, struct TranSettings const *const restrict tr, struct MultirateSettings const *const restrict mr, struct MeasureRun *const restrict run, FILE *const restrict out) {
+	struct MeasureSet *const set = run->set;
+	measure_reset(set);
+	struct TranSink const sink = { .emit = measure_emit, .ctx = run };
+	int err;
+	if( mr->on ) {
+		struct MultirateStats stats;
+		err = circuit_tran_multirate(c, tr, mr, &sink, &stats);
+	} else {
+		struct TranStats stats;
+		err = circuit_tran(c, tr, &sink, &stats);
+	}
+	if( err != ERR_OK ) {
+		fputs(err==ERR_SINGULAR? "tran: singular companion matrix\n" : err==ERR_OOM? "tran: out of memory\n" : "tran: bad settings\n", out);
+		return err;
+	}
+	for( size_t k=0; k < set->count; k++ ) {
+		struct Measure *const m = &set->m[k];
+		char num[48] = {0};
+		if( measure_finish(m) ) {
+			running_stats_push(&set->summary[k], m->value);
+			fprintf(out, "meas %s = %s\n", m->name, rat_to_cstr(m->value, sizeof num, num));
+		} else {
+			fprintf(out, "meas %s = failed\n", m->name);
+		}
+	}
+	return ERR_OK;
+}
+
+/**
+ * Runs the transient with the measurements, once or at every .step point,
+ * and after a sweep prints count, mean, sd, min and max of each over the runs.
+ * `inner` gets the points as well when waves are being written, it may be NULL.
+ */
+CIRCUIT_EXPORT void circuit_measure_sweep(
+	struct Circuit                 *const restrict c,
+	struct ParamDeck               *const restrict pd,
+	struct TranSettings      const *const restrict tr,
+	struct MultirateSettings const *const restrict mr,
+	struct MeasureSet              *const restrict set,
+	struct TranSink          const *const          inner,
+	FILE                           *const restrict out
+) {
+	struct MeasureRun run = { .set = set, .inner = inner };
+	for( size_t k=0; k < set->count; k++ ) {
+		set->summary[k] = (struct RunningStats){0};
+	}
+	if( circuit_has_devices(c) ) {
+		fputs("tran: linear circuits only\n", out);
+		return;
+	}
+	if( pd->step_dims==0 ) {
+		( void )(measure_run(c, tr, mr, &run, out));
+		return;
+	}
+	struct StepCursor cur;
+	size_t runs = 0;
+	step_begin(pd, &cur);
+	( void )(param_propagate(pd, cur.stepped, cur.stepped, NULL, NULL));
+	for( bool more = true; more; ) {
+		step_print_point(pd, out);
+		if( measure_run(c, tr, mr, &run, out) != ERR_OK ) {
+			break;
+		}
+		runs++;
+		uint32_t changed = 0;
+		more = step_next(pd, &cur, &changed);
+		if( more ) {
+			( void )(param_propagate(pd, changed, cur.stepped, NULL, NULL));
+		}
+	}
+	step_end(pd, &cur);
+	
+	fprintf(out, "meas: %zu runs\n", runs);
+	for( size_t k=0; k < set->count; k++ ) {
+		struct RunningStats const *const s = &set->summary[k];
+		char mean[48] = {0}, sd[48] = {0}, lo[48] = {0}, hi[48] = {0};
+		fprintf(out, "meas %s: %zu ok, mean %s, sd %s, min %s, max %s\n", set->m[k].name, s->count,
+			rat_to_cstr(s->mean, sizeof mean, mean),
+			rat_to_cstr(running_stats_sd(s), sizeof sd, sd),
+			rat_to_cstr(s->min, sizeof lo, lo),
+			rat_to_cstr(s->max, sizeof hi, hi));
+	}
+}
+#endif
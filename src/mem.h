@@ -2,10 +2,20 @@
 #	define MEM_H_INCLUDED
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <inttypes.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#ifndef TICE_H
+#	include <sys/mman.h>
+/// strict ISO C hides it, the translation unit defines _DEFAULT_SOURCE before any include.
+#	if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#		define MAP_ANONYMOUS    MAP_ANON
+#	elif !defined(MAP_ANONYMOUS)
+#		error "mem.h needs MAP_ANONYMOUS, define _DEFAULT_SOURCE before the first #include"
+#	endif
+#endif
 
 
 #define TI_MEM_EXPORT    static inline
@@ -25,6 +35,17 @@
 #	define EXTANT_RET       __attribute__((returns_nonnull))
 #endif
 
+#ifdef TICE_H
+#	define TI_THREAD_LOCAL
+#else
+#	define TI_THREAD_LOCAL  _Thread_local
+#endif
+
+
+/// every allocation starts on this, so any type can go anywhere in a stack or region.
+#ifndef TI_MEM_ALIGN
+#	define TI_MEM_ALIGN     _Alignof(max_align_t)
+#endif
 
 TI_MEM_EXPORT size_t _align_size(size_t const size, size_t const align) {
 	return (size + (align - 1)) & ~(align - 1);
@@ -46,7 +67,7 @@ TI_MEM_EXPORT NO_NULLS void region_reset(struct TIMemRegion *const r) {
 }
 
 TI_MEM_EXPORT NO_NULLS void *region_alloc(struct TIMemRegion *const r, size_t bytes) {
-	bytes = _align_size(bytes, sizeof bytes);
+	bytes = _align_size(bytes, TI_MEM_ALIGN);
 	if( r->offs + bytes >= r->len ) {
 		return NULL;
 	}
@@ -56,7 +77,7 @@ TI_MEM_EXPORT NO_NULLS void *region_alloc(struct TIMemRegion *const r, size_t by
 }
 
 TI_MEM_EXPORT NO_NULLS void *region_alloc_reset_when_full(struct TIMemRegion *const r, size_t bytes, bool *const restrict was_reset) {
-	bytes = _align_size(bytes, sizeof bytes);
+	bytes = _align_size(bytes, TI_MEM_ALIGN);
 	if( r->offs + bytes >= r->len ) {
 		r->offs = 0;
 		*was_reset = true;
@@ -70,6 +91,18 @@ TI_MEM_EXPORT NO_NULLS int region_size_remaining(struct TIMemRegion const *const
 	return ( int )(r->len - r->offs);
 }
 
+/// a checkpoint, region_release frees whatever was allocated after it.
+TI_MEM_EXPORT NO_NULLS size_t region_mark(struct TIMemRegion const *const r) {
+	return r->offs;
+}
+
+/// never grows the region, releasing an older mark first makes a newer one a no-op.
+TI_MEM_EXPORT NO_NULLS void region_release(struct TIMemRegion *const r, size_t const mark) {
+	if( mark < r->offs ) {
+		r->offs = mark;
+	}
+}
+
 
 /** Bifurcated/Double-Ended Stack */
 struct TIBiStack {
@@ -78,7 +111,9 @@ struct TIBiStack {
 };
 
 
-TI_MEM_EXPORT NO_NULLS struct TIBiStack bistack_make(uint8_t *const buf, size_t const len) {
+/// `buf` should be TI_MEM_ALIGN aligned, `len` is cut down to a multiple of it so the back end is too.
+TI_MEM_EXPORT NO_NULLS struct TIBiStack bistack_make(uint8_t *const buf, size_t len) {
+	len &= ~( size_t )(TI_MEM_ALIGN - 1);
 	return (struct TIBiStack){ .mem = buf, .len = len, .front = 0, .back = len };
 }
 
@@ -94,7 +129,7 @@ TI_MEM_EXPORT NO_NULLS void bistack_reset_back(struct TIBiStack *const s) {
 }
 
 TI_MEM_EXPORT NO_NULLS void *bistack_alloc_front(struct TIBiStack *const s, size_t bytes) {
-	bytes = _align_size(bytes, sizeof bytes);
+	bytes = _align_size(bytes, TI_MEM_ALIGN);
 	if( s->front + bytes >= s->back ) {
 		return NULL;
 	}
@@ -104,7 +139,7 @@ TI_MEM_EXPORT NO_NULLS void *bistack_alloc_front(struct TIBiStack *const s, size
 }
 
 TI_MEM_EXPORT NO_NULLS void *bistack_alloc_front_vec(struct TIBiStack *const s, size_t len, size_t elem_size) {
-	size_t const bytes = _align_size(len * elem_size, sizeof len);
+	size_t const bytes = _align_size(len * elem_size, TI_MEM_ALIGN);
 	if( s->front + bytes >= s->back ) {
 		return NULL;
 	}
@@ -114,8 +149,8 @@ TI_MEM_EXPORT NO_NULLS void *bistack_alloc_front_vec(struct TIBiStack *const s,
 }
 
 TI_MEM_EXPORT NO_NULLS void *bistack_alloc_back(struct TIBiStack *const s, size_t bytes) {
-	bytes = _align_size(bytes, sizeof bytes);
-	if( s->back - bytes <= s->front ) {
+	bytes = _align_size(bytes, TI_MEM_ALIGN);
+	if( bytes >= s->back - s->front ) {
 		return NULL;
 	}
 	s->back -= bytes;
@@ -123,8 +158,8 @@ TI_MEM_EXPORT NO_NULLS void *bistack_alloc_back(struct TIBiStack *const s, size_
 }
 
 TI_MEM_EXPORT NO_NULLS void *bistack_alloc_back_vec(struct TIBiStack *const s, size_t len, size_t elem_size) {
-	size_t const bytes = _align_size(len * elem_size, sizeof len);
-	if( s->back - bytes <= s->front ) {
+	size_t const bytes = _align_size(len * elem_size, TI_MEM_ALIGN);
+	if( bytes >= s->back - s->front ) {
 		return NULL;
 	}
 	s->back -= bytes;
@@ -135,6 +170,135 @@ TI_MEM_EXPORT NO_NULLS int bistack_get_margins(struct TIBiStack const *const s)
 	return s->back - s->front;
 }
 
+/// Checkpoints of both ends. A nested analysis marks, allocates its temporaries and
+/// releases, and whatever its caller had on either side before the mark stays put.
+struct TIBiStackMark {
+	size_t front, back;
+};
+
+TI_MEM_EXPORT NO_NULLS struct TIBiStackMark bistack_mark(struct TIBiStack const *const s) {
+	return (struct TIBiStackMark){ .front = s->front, .back = s->back };
+}
+
+/// the release functions only ever free, releasing an older mark first makes a newer one a no-op.
+TI_MEM_EXPORT NO_NULLS void bistack_release_front(struct TIBiStack *const s, struct TIBiStackMark const mark) {
+	if( mark.front < s->front ) {
+		s->front = mark.front;
+	}
+}
+TI_MEM_EXPORT NO_NULLS void bistack_release_back(struct TIBiStack *const s, struct TIBiStackMark const mark) {
+	if( mark.back > s->back && mark.back <= s->len ) {
+		s->back = mark.back;
+	}
+}
+TI_MEM_EXPORT NO_NULLS void bistack_release(struct TIBiStack *const s, struct TIBiStackMark const mark) {
+	bistack_release_front(s, mark);
+	bistack_release_back(s, mark);
+}
+
+/// The calling thread's scratch stack. A worker binds its own arena once and code
+/// deep inside it can find it without threading it through every call.
+/// There's one thread on the calculator and this is an ordinary global there.
+TI_MEM_EXPORT struct TIBiStack **_bistack_local_slot(void) {
+	static TI_THREAD_LOCAL struct TIBiStack *slot = NULL;
+	return &slot;
+}
+
+/// binds `s` to the calling thread, NULL unbinds. Returns what was bound before.
+TI_MEM_EXPORT struct TIBiStack *bistack_local_bind(struct TIBiStack *const s) {
+	struct TIBiStack *const was = *_bistack_local_slot();
+	*_bistack_local_slot() = s;
+	return was;
+}
+
+/// the calling thread's stack, NULL if it never bound one.
+TI_MEM_EXPORT struct TIBiStack *bistack_local(void) {
+	return *_bistack_local_slot();
+}
+
+
+/** Chained Arena */
+/// A region over a fixed buffer that spills into mapped chunks when the buffer runs
+/// out, instead of failing. Each chunk remembers the region it took over from, so
+/// releasing a mark unmaps every chunk mapped since and picks the old region back up.
+/// Allocations are never moved, pointers stay good until their mark is released.
+/// The calculator has nothing to map, chained arenas there fail like a region does.
+struct TIChunk {
+	struct TIChunk    *prev;
+	struct TIMemRegion prev_region;
+	size_t             len;
+};
+
+struct TIChainArena {
+	struct TIMemRegion cur;
+	struct TIChunk    *chunks;     /// mapped chunks, newest first.
+	size_t             chunk_len;  /// least a chunk is mapped with.
+	size_t             mapped;     /// bytes mapped at the moment.
+};
+
+struct TIChainMark {
+	struct TIChunk const *chunk;
+	size_t                offs;
+};
+
+TI_MEM_EXPORT NO_NULLS struct TIChainArena chain_make(uint8_t *const buf, size_t const len, size_t const chunk_len) {
+	return (struct TIChainArena){ .cur = region_make(buf, len), .chunk_len = chunk_len };
+}
+
+/// maps a chunk big enough for `bytes` and carves from it from now on.
+TI_MEM_EXPORT NO_NULLS bool chain_grow(struct TIChainArena *const a, size_t const bytes) {
+#	ifdef TICE_H
+	( void )(a);
+	( void )(bytes);
+	return false;
+#	else
+	size_t const head = _align_size(sizeof(struct TIChunk), TI_MEM_ALIGN);
+	size_t const need = head + _align_size(bytes, TI_MEM_ALIGN) + sizeof bytes;
+	size_t const len  = need > a->chunk_len? need : a->chunk_len;
+	void *const map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if( map==MAP_FAILED ) {
+		return false;
+	}
+	struct TIChunk *const chunk = map;
+	*chunk = (struct TIChunk){ .prev = a->chunks, .prev_region = a->cur, .len = len };
+	a->chunks  = chunk;
+	a->cur     = region_make(( uint8_t* )(map) + head, len - head);
+	a->mapped += len;
+	return true;
+#	endif
+}
+
+TI_MEM_EXPORT NO_NULLS void *chain_alloc(struct TIChainArena *const a, size_t const bytes) {
+	void *const p = region_alloc(&a->cur, bytes);
+	if( p != NULL || !chain_grow(a, bytes) ) {
+		return p;
+	}
+	return region_alloc(&a->cur, bytes);
+}
+
+TI_MEM_EXPORT NO_NULLS struct TIChainMark chain_mark(struct TIChainArena const *const a) {
+	return (struct TIChainMark){ .chunk = a->chunks, .offs = region_mark(&a->cur) };
+}
+
+/// unmaps the chunks mapped since `mark` and frees what was carved after it.
+TI_MEM_EXPORT NO_NULLS void chain_release(struct TIChainArena *const a, struct TIChainMark const mark) {
+	while( a->chunks != NULL && a->chunks != mark.chunk ) {
+		struct TIChunk *const chunk = a->chunks;
+		a->chunks  = chunk->prev;
+		a->cur     = chunk->prev_region;
+		a->mapped -= chunk->len;
+#	ifndef TICE_H
+		munmap(chunk, chunk->len);
+#	endif
+	}
+	region_release(&a->cur, mark.offs);
+}
+
+/// gives back every chunk, the fixed buffer is reset.
+TI_MEM_EXPORT NO_NULLS void chain_free(struct TIChainArena *const a) {
+	chain_release(a, (struct TIChainMark){ .chunk = NULL, .offs = 0 });
+}
+
 
 struct TIBuffer {
 	uint8_t *data;
@@ -0,0 +1,524 @@
+#ifndef MONTECARLO_H_INCLUDED
+#	define MONTECARLO_H_INCLUDED
+
+#include "nonlinear.h"
+
+
+/// Monte Carlo and corner analysis of the DC operating point.
+///   .tol R 5% [gauss]    tolerance for every component of a kind, uniform by default.
+///                       gauss treats the tolerance as 3 sigma.
+///   .mc N [seed]        N random samples.
+///   .corners            every +/- tolerance combination of the toleranced kinds.
+/// The netlist is parsed once. Every sample draws its values from its own RNG stream,
+/// seeded from (seed, sample index), so a sample comes out the same no matter which
+/// worker runs it or in what order.
+/// Linear circuits share one symbolic factorization taken from the nominal matrix,
+/// every worker stamps, factors and solves in its own arena carved off the circuit's
+/// front stack and never touches the circuit. The workers run through par_for, as many as
+/// there are threads but never fewer than MC_WORKERS, and are merged in order at the end.
+/// Circuits with devices perturb the components in place and run the Newton solve,
+/// device state makes them single-worker.
+/// Statistics are running (Welford) and the histograms widen by merging bin pairs,
+/// so memory is fixed no matter how many samples run.
+
+enum {
+	MC_HIST_BINS        = 16, /// a multiple of 4, widening keeps the nominal value on a bin edge.
+	MC_WORKERS          = 4,
+	MC_MAX_CORNER_KINDS = 8,
+	MC_MAX_WIDENINGS    = 64,
+};
+
+enum {
+	MC_UNIFORM = 0,
+	MC_GAUSS,
+};
+
+struct MCSettings {
+	rat      tol[MAX_COMP_TYPES];  /// relative, by component kind.
+	uint8_t  dist[MAX_COMP_TYPES];
+	size_t   samples;
+	uint32_t seed;
+	bool     corners;
+};
+
+struct RunningStats {
+	size_t count;
+	rat    mean, m2, min, max;
+};
+
+/// bins are `width` wide, centered on the nominal value.
+struct Histogram {
+	size_t bins[MC_HIST_BINS];
+	rat    center, width;
+	size_t widenings;
+};
+
+struct MCNodeStats {
+	struct RunningStats stats;
+	struct Histogram    hist;
+};
+
+struct MCWorker {
+	struct TIBiStack   arena;
+	struct MCNodeStats nodes[MAX_NODES];
+	size_t             failed;
+};
+
+struct MCResult {
+	struct MCNodeStats nodes[MAX_NODES];
+	rat                nominal[MAX_NODES];
+	size_t             samples, failed, workers;
+};
+
+CIRCUIT_EXPORT NO_NULLS bool mc_parse_directive(struct MCSettings *const restrict mc, char const line[const restrict static 1]) {
+	char kind_tok[8] = {0}, tol_tok[48] = {0}, dist_tok[8] = {0};
+	/// three directives share the settings, so match on the whole first word.
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word==4 && strncmp(line, ".tol", 4)==0 ) {
+		if( sscanf(line, " .tol %7s %47s %7s", kind_tok, tol_tok, dist_tok) < 2 ) {
+			return true;
+		}
+		uint8_t const kind = kind_from_letter(kind_tok[0]);
+		size_t const len = strlen(tol_tok);
+		bool const percent = len > 0 && tol_tok[len - 1]=='%';
+		if( percent ) {
+			tol_tok[len - 1] = 0;
+		}
+		rat const tol = parse_si_scalar(tol_tok);
+		mc->tol[kind]  = percent? rat_div(tol, rat_from_int(100)) : tol;
+		mc->dist[kind] = tolower(dist_tok[0])=='g'? MC_GAUSS : MC_UNIFORM;
+		return true;
+	} else if( word==3 && strncmp(line, ".mc", 3)==0 ) {
+		unsigned long samples = 0, seed = 1;
+		if( sscanf(line, " .mc %lu %lu", &samples, &seed) >= 1 ) {
+			mc->samples = samples;
+			mc->seed    = ( uint32_t )(seed);
+		}
+		return true;
+	} else if( word==8 && strncmp(line, ".corners", 8)==0 ) {
+		mc->corners = true;
+		return true;
+	}
+	return false;
+}
+
+CIRCUIT_EXPORT NO_NULLS void running_stats_push(struct RunningStats *const s, rat const x) {
+	s->count++;
+	if( s->count==1 ) {
+		s->mean = s->min = s->max = x;
+		s->m2   = rat_zero();
+		return;
+	}
+	rat const delta = rat_sub(x, s->mean);
+	s->mean = rat_add(s->mean, rat_div(delta, rat_from_int(s->count)));
+	s->m2   = rat_addmul(s->m2, delta, rat_sub(x, s->mean));
+	s->min  = rat_min(s->min, x);
+	s->max  = rat_max(s->max, x);
+}
+
+/// Chan et al.'s pairwise combination, `dst` ends up as if it had seen both streams.
+CIRCUIT_EXPORT NO_NULLS void running_stats_merge(struct RunningStats *const restrict dst, struct RunningStats const *const restrict src) {
+	if( src->count==0 ) {
+		return;
+	} else if( dst->count==0 ) {
+		*dst = *src;
+		return;
+	}
+	rat const na = rat_from_int(dst->count), nb = rat_from_int(src->count);
+	rat const n = rat_add(na, nb);
+	rat const delta = rat_sub(src->mean, dst->mean);
+	dst->mean = rat_add(dst->mean, rat_div(rat_mul(delta, nb), n));
+	dst->m2   = rat_add(rat_add(dst->m2, src->m2), rat_div(rat_mul(rat_mul(delta, delta), rat_mul(na, nb)), n));
+	dst->min  = rat_min(dst->min, src->min);
+	dst->max  = rat_max(dst->max, src->max);
+	dst->count += src->count;
+}
+
+CIRCUIT_EXPORT NO_NULLS rat running_stats_sd(struct RunningStats const *const s) {
+	return s->count < 2? rat_zero() : rat_sqrt(rat_div(s->m2, rat_from_int(s->count - 1)));
+}
+
+CIRCUIT_EXPORT struct Histogram histogram_make(rat const center, rat const width) {
+	return (struct Histogram){ .center = center, .width = width };
+}
+
+/// doubles the bin width about the center, pairs of old bins fold into one.
+CIRCUIT_EXPORT NO_NULLS void histogram_widen(struct Histogram *const h) {
+	size_t bins[MC_HIST_BINS] = {0};
+	for( size_t b=0; b < MC_HIST_BINS; b++ ) {
+		bins[(b + MC_HIST_BINS/2) / 2] += h->bins[b];
+	}
+	memcpy(h->bins, bins, sizeof bins);
+	h->width = rat_mul(h->width, rat_from_int(2));
+	h->widenings++;
+}
+
+CIRCUIT_EXPORT NO_NULLS void histogram_push(struct Histogram *const h, rat const x) {
+	for( size_t tries=0; tries < MC_MAX_WIDENINGS; tries++ ) {
+		rat const pos = rat_add(rat_floor(rat_div(rat_sub(x, h->center), h->width)), rat_from_int(MC_HIST_BINS/2));
+		if( !rat_lt(pos, rat_zero()) && rat_lt(pos, rat_from_int(MC_HIST_BINS)) ) {
+			h->bins[( size_t )(rat_to_float(pos))]++;
+			return;
+		}
+		histogram_widen(h);
+	}
+}
+
+/// both must share a center and starting width, the narrower one widens to match.
+CIRCUIT_EXPORT NO_NULLS void histogram_merge(struct Histogram *const restrict dst, struct Histogram const *const restrict src) {
+	struct Histogram s = *src;
+	while( s.widenings < dst->widenings ) {
+		histogram_widen(&s);
+	}
+	while( dst->widenings < s.widenings ) {
+		histogram_widen(dst);
+	}
+	for( size_t b=0; b < MC_HIST_BINS; b++ ) {
+		dst->bins[b] += s.bins[b];
+	}
+}
+
+/// lowbias32 integer hash, decorrelates neighbouring sample indices.
+CIRCUIT_EXPORT uint32_t mc_hash32(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7FEB352Du;
+	x ^= x >> 15;
+	x *= 0x846CA68Bu;
+	x ^= x >> 16;
+	return x;
+}
+
+struct MCRng {
+	uint32_t state;
+};
+
+CIRCUIT_EXPORT struct MCRng mc_rng_for_sample(uint32_t const seed, size_t const sample) {
+	uint32_t const state = mc_hash32(seed ^ mc_hash32(( uint32_t )(sample) + 0x9E3779B9u));
+	return (struct MCRng){ .state = state==0? 1 : state };
+}
+
+/// xorshift32, uniform in [-1, 1).
+CIRCUIT_EXPORT NO_NULLS rat mc_rng_uniform(struct MCRng *const rng) {
+	rng->state ^= rng->state << 13;
+	rng->state ^= rng->state >> 17;
+	rng->state ^= rng->state << 5;
+	/// 23 bits, the TI's int24 can hold them.
+	rat const u = rat_div(rat_from_int(( int )(rng->state >> 9)), rat_from_int(1 << 22));
+	return rat_sub(u, rat_pos1());
+}
+
+/// Irwin-Hall, twelve uniforms on [-1/2, 1/2) sum to roughly a standard normal.
+CIRCUIT_EXPORT NO_NULLS rat mc_rng_gauss(struct MCRng *const rng) {
+	rat z = rat_zero();
+	for( size_t i=0; i < 12; i++ ) {
+		z = rat_add(z, mc_rng_uniform(rng));
+	}
+	return rat_div(z, rat_from_int(2));
+}
+
+/// kinds that carry a tolerance, in kind order, these are the corner bits.
+CIRCUIT_EXPORT NO_NULLS size_t mc_corner_kinds(struct MCSettings const *const restrict mc, uint8_t kinds[const restrict static MC_MAX_CORNER_KINDS]) {
+	size_t count = 0;
+	for( uint8_t kind=0; kind < MAX_COMP_TYPES && count < MC_MAX_CORNER_KINDS; kind++ ) {
+		if( !rat_lt(rat_abs(mc->tol[kind]), rat_epsilon()) ) {
+			kinds[count++] = kind;
+		}
+	}
+	return count;
+}
+
+/**
+ * The factor sample `sample` scales a component of `kind` by.
+ * Random samples draw from `rng` whether the kind has a tolerance or not,
+ * so every component sees the same stream position in every sample.
+ * Corners pick the sign of each toleranced kind from the bits of `sample`.
+ */
+CIRCUIT_EXPORT NO_NULLS rat mc_factor(struct MCSettings const *const restrict mc, uint8_t const kind, size_t const sample, struct MCRng *const restrict rng) {
+	rat const tol = mc->tol[kind];
+	if( mc->corners ) {
+		uint8_t kinds[MC_MAX_CORNER_KINDS];
+		size_t const count = mc_corner_kinds(mc, kinds);
+		for( size_t k=0; k < count; k++ ) {
+			if( kinds[k]==kind ) {
+				return (sample >> k) & 1? rat_add(rat_pos1(), tol) : rat_sub(rat_pos1(), tol);
+			}
+		}
+		return rat_pos1();
+	}
+	rat const u = mc->dist[kind]==MC_GAUSS? rat_div(mc_rng_gauss(rng), rat_from_int(3)) : mc_rng_uniform(rng);
+	return rat_addmul(rat_pos1(), tol, u);
+}
+
+CIRCUIT_EXPORT NO_NULLS size_t mc_sample_count(struct MCSettings const *const mc) {
+	if( mc->corners ) {
+		uint8_t kinds[MC_MAX_CORNER_KINDS];
+		return ( size_t )(1) << mc_corner_kinds(mc, kinds);
+	}
+	return mc->samples;
+}
+
+/// starts each node's histogram on its nominal value, about 2 tolerances across.
+CIRCUIT_EXPORT NO_NULLS void mc_stats_init(struct MCSettings const *const restrict mc, rat const nominal[const restrict static MAX_NODES], struct MCNodeStats nodes[const restrict static MAX_NODES]) {
+	rat max_tol = rat_zero();
+	for( size_t kind=0; kind < MAX_COMP_TYPES; kind++ ) {
+		max_tol = rat_max(max_tol, rat_abs(mc->tol[kind]));
+	}
+	for( size_t i=0; i < MAX_NODES; i++ ) {
+		rat width = rat_div(rat_mul(rat_from_int(4), rat_mul(max_tol, rat_abs(nominal[i]))), rat_from_int(MC_HIST_BINS));
+		if( rat_lt(width, float_to_rat(1E-9f)) ) {
+			width = float_to_rat(1E-6f);
+		}
+		nodes[i] = (struct MCNodeStats){ .hist = histogram_make(nominal[i], width) };
+	}
+}
+
+CIRCUIT_EXPORT NO_NULLS void mc_stats_push(struct MCNodeStats nodes[const restrict static MAX_NODES], size_t const node_bits, rat const V[const restrict static MAX_NODES]) {
+	for( size_t i=1; i < MAX_NODES; i++ ) {
+		if( node_bits & (1 << i) ) {
+			running_stats_push(&nodes[i].stats, V[i]);
+			histogram_push(&nodes[i].hist, V[i]);
+		}
+	}
+}
+
+/// what every linear worker shares, read-only once set up.
+struct MCLinear {
+	struct LUSymbolic sym;
+	uint8_t           node_to_matrix_id[MAX_NODES], matrix_id_to_node[MAX_NODES];
+	size_t            n, stamps;
+};
+
+/// arena bytes one linear sample needs.
+CIRCUIT_EXPORT NO_NULLS size_t mc_linear_arena_size(struct MCLinear const *const lin) {
+	return _align_size((lin->n * lin->n + lin->n) * sizeof(rat), sizeof(size_t)) + _align_size(lin->n * sizeof(rat), sizeof(size_t))
+		+ _align_size((lin->stamps + 1) * sizeof(struct Stamp), sizeof(size_t)) + 4*sizeof(size_t);
+}
+
+/**
+ * One sample of a linear circuit inside the worker's arena.
+ * The circuit is only read, perturbed values go through stack copies of the components.
+ */
+CIRCUIT_EXPORT NO_NULLS void mc_sample_linear(struct Circuit const *const restrict c, struct MCSettings const *const restrict mc, struct MCLinear const *const restrict lin, struct MCWorker *const restrict w, size_t const sample) {
+	size_t const n = lin->n;
+	struct TIBiStackMark const mark = bistack_mark(&w->arena);
+	rat *const G = alloc_vec(&w->arena, n*n);
+	rat *const V = alloc_vec(&w->arena, n);
+	struct StampBuffer buf = { .cap = lin->stamps + 1 };
+	buf.data = bistack_alloc_front_vec(&w->arena, buf.cap, sizeof *buf.data);
+	if( G==NULL || V==NULL || buf.data==NULL ) {
+		w->failed++;
+		bistack_release_front(&w->arena, mark);
+		return;
+	}
+	struct MCRng rng = mc_rng_for_sample(mc->seed, sample);
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+			struct Comp copy = *cmp;
+			copy.value = rat_mul(cmp->value, mc_factor(mc, cmp->kind, sample, &rng));
+			comp_stamp_dc(&copy, ( uint8_t const(*)[MAX_NODES] )(&lin->node_to_matrix_id), &buf);
+		}
+	}
+	stamps_apply(&buf, n, G, V);
+	bool solved = lu_factor_scheduled(&lin->sym, G);
+	if( solved ) {
+		lu_solve_scheduled(&lin->sym, G, V);
+	} else {
+		/// a perturbed value emptied a pivot, redo this one densely.
+		uint8_t piv[MAX_NODES];
+		memset(G, 0, n*n * sizeof *G);
+		memset(V, 0, n * sizeof *V);
+		stamps_apply(&buf, n, G, V);
+		solved = lu_factor(n, G, piv);
+		if( solved ) {
+			lu_solve(n, G, piv, V);
+		}
+	}
+	if( solved ) {
+		rat out[MAX_NODES] = {0};
+		for( size_t i=0; i < n; i++ ) {
+			out[lin->matrix_id_to_node[i]] = V[i];
+		}
+		mc_stats_push(w->nodes, c->active_nodes, out);
+	} else {
+		w->failed++;
+	}
+	bistack_release_front(&w->arena, mark);
+}
+
+/// one sample of a circuit with devices, perturbing in place around `nominal`.
+CIRCUIT_EXPORT NO_NULLS void mc_sample_nonlinear(struct Circuit *const restrict c, struct MCSettings const *const restrict mc, rat const nominal[const restrict], struct MCWorker *const restrict w, size_t const sample) {
+	struct MCRng rng = mc_rng_for_sample(mc->seed, sample);
+	size_t k = 0;
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		for( struct Comp *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+			*comp_param_ref(cmp, 0) = rat_mul(nominal[k++], mc_factor(mc, cmp->kind, sample, &rng));
+		}
+	}
+	rat V[MAX_NODES];
+	struct NRStats stats;
+	if( circuit_dc_nonlinear(c, &V, &stats) != ERR_OK ) {
+		w->failed++;
+		return;
+	}
+	mc_stats_push(w->nodes, c->active_nodes, V);
+}
+
+/// what a par_for over the linear workers needs.
+struct MCLinearRun {
+	struct Circuit const    *c;
+	struct MCSettings const *mc;
+	struct MCLinear const   *lin;
+	struct MCWorker         *w;
+	size_t                   workers, samples;
+};
+
+/// sample s always goes to worker s % workers, any schedule gives the same samples.
+CIRCUIT_EXPORT void mc_linear_worker_body(void *const ctx, size_t const k, size_t const thread) {
+	struct MCLinearRun const *const run = ctx;
+	( void )(thread);
+	for( size_t s=k; s < run->samples; s += run->workers ) {
+		mc_sample_linear(run->c, run->mc, run->lin, &run->w[k], s);
+	}
+}
+
+/**
+ * Runs every sample and merges the workers into `res`.
+ * Returns ERR_OK, ERR_OOM or ERR_SINGULAR when the nominal circuit doesn't solve.
+ */
+CIRCUIT_EXPORT NO_NULLS int circuit_monte_carlo(struct Circuit *const restrict c, struct MCSettings const *const restrict mc, struct MCResult *const restrict res) {
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	*res = (struct MCResult){ .samples = mc_sample_count(mc) };
+	bool const nonlinear = circuit_has_devices(c);
+	if( nonlinear ) {
+		struct NRStats stats;
+		if( circuit_dc_nonlinear(c, &res->nominal, &stats) != ERR_OK ) {
+			return ERR_SINGULAR;
+		}
+	} else if( circuit_dc_voltages(c, &res->nominal)==RREFResultBadMatrix ) {
+		return ERR_SINGULAR;
+	}
+	mc_stats_init(mc, res->nominal, res->nodes);
+	
+	/// worker bookkeeping lives on the back and is handed back at the end.
+	size_t workers = nonlinear? 1 : par_threads() > MC_WORKERS? par_threads() : MC_WORKERS;
+	struct MCWorker *const w = bistack_alloc_back_vec(&c->bistack, workers, sizeof *w);
+	if( w==NULL ) {
+		return ERR_OOM;
+	}
+	for( size_t k=0; k < workers; k++ ) {
+		mc_stats_init(mc, res->nominal, w[k].nodes);
+	}
+	
+	if( nonlinear ) {
+		size_t comps = 0;
+		for( uint8_t node=1; node < MAX_NODES; node++ ) {
+			for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+				comps++;
+			}
+		}
+		rat *const nominal = bistack_alloc_back_vec(&c->bistack, comps + 1, sizeof *nominal);
+		if( nominal==NULL ) {
+			bistack_release_back(&c->bistack, mark);
+			return ERR_OOM;
+		}
+		size_t k = 0;
+		for( uint8_t node=1; node < MAX_NODES; node++ ) {
+			for( struct Comp *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+				nominal[k++] = *comp_param_ref(cmp, 0);
+			}
+		}
+		for( size_t s=0; s < res->samples; s++ ) {
+			mc_sample_nonlinear(c, mc, nominal, &w[0], s);
+		}
+		k = 0;
+		for( uint8_t node=1; node < MAX_NODES; node++ ) {
+			for( struct Comp *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+				*comp_param_ref(cmp, 0) = nominal[k++];
+			}
+		}
+	} else {
+		/// the symbolic factorization and stamp count come from the nominal matrix, once.
+		struct MCLinear lin = {0};
+		rat *G = NULL, *V = NULL;
+		lin.n = circuit_build_dc(c, &lin.matrix_id_to_node, &G, &V);
+		if( lin.n==0 ) {
+			bistack_release(&c->bistack, mark);
+			return ERR_OK;
+		} else if( G==NULL || V==NULL ) {
+			bistack_release(&c->bistack, mark);
+			return ERR_OOM;
+		}
+		lu_symbolic(lin.n, G, &lin.sym);
+		for( size_t i=0; i < lin.n; i++ ) {
+			lin.node_to_matrix_id[lin.matrix_id_to_node[i]] = i;
+		}
+		struct StampBuffer counter = {0};
+		circuit_stamp_nodes(c, 1, MAX_NODES, ( uint8_t const(*)[MAX_NODES] )(&lin.node_to_matrix_id), &counter);
+		lin.stamps = counter.len;
+		bistack_release_front(&c->bistack, mark);
+		
+		/// one arena per worker, fewer workers if the memory isn't there.
+		size_t const arena_size = mc_linear_arena_size(&lin);
+		for( size_t k=0; k < workers; k++ ) {
+			uint8_t *const mem = bistack_alloc_front(&c->bistack, arena_size);
+			if( mem==NULL ) {
+				workers = k;
+				break;
+			}
+			w[k].arena = bistack_make(mem, arena_size);
+		}
+		if( workers==0 ) {
+			bistack_release(&c->bistack, mark);
+			return ERR_OOM;
+		}
+		struct MCLinearRun run = { .c = c, .mc = mc, .lin = &lin, .w = w, .workers = workers, .samples = res->samples };
+		par_for(workers, mc_linear_worker_body, &run);
+		bistack_release_front(&c->bistack, mark);
+	}
+	
+	for( size_t k=0; k < workers; k++ ) {
+		for( size_t i=0; i < MAX_NODES; i++ ) {
+			running_stats_merge(&res->nodes[i].stats, &w[k].nodes[i].stats);
+			histogram_merge(&res->nodes[i].hist, &w[k].nodes[i].hist);
+		}
+		res->failed += w[k].failed;
+	}
+	res->workers = workers;
+	bistack_release_back(&c->bistack, mark);
+	return ERR_OK;
+}
+
+CIRCUIT_EXPORT NO_NULLS void circuit_solve_monte_carlo(struct Circuit *const restrict c, struct MCSettings const *const restrict mc, FILE *const restrict out) {
+	struct MCResult res;
+	int const err = circuit_monte_carlo(c, mc, &res);
+	if( err==ERR_OOM ) {
+		fputs("mc: out of memory\n", out);
+		return;
+	} else if( err != ERR_OK ) {
+		fputs("mc: nominal circuit has no solution\n", out);
+		return;
+	}
+	fprintf(out, "%s: %zu samples, %zu workers, %zu failed\n", mc->corners? "corners" : "mc", res.samples, res.workers, res.failed);
+	for( size_t i=1; i < MAX_NODES; i++ ) {
+		if( (c->active_nodes & (1 << i))==0 || res.nodes[i].stats.count==0 ) {
+			continue;
+		}
+		struct RunningStats const *const s = &res.nodes[i].stats;
+		struct Histogram const *const h = &res.nodes[i].hist;
+		char nom[48] = {0}, mean[48] = {0}, sd[48] = {0}, lo[48] = {0}, hi[48] = {0};
+		fprintf(out, "V%zu: nominal = %s  mean = %s  sd = %s  min = %s  max = %s\n", i,
+			rat_to_cstr(res.nominal[i], sizeof nom, nom),
+			rat_to_cstr(s->mean, sizeof mean, mean),
+			rat_to_cstr(running_stats_sd(s), sizeof sd, sd),
+			rat_to_cstr(s->min, sizeof lo, lo),
+			rat_to_cstr(s->max, sizeof hi, hi));
+		rat const start = rat_sub(h->center, rat_mul(h->width, rat_from_int(MC_HIST_BINS/2)));
+		rat const end   = rat_add(h->center, rat_mul(h->width, rat_from_int(MC_HIST_BINS/2)));
+		fprintf(out, "V%zu: [%s, %s)", i, rat_to_cstr(start, sizeof lo, lo), rat_to_cstr(end, sizeof hi, hi));
+		for( size_t b=0; b < MC_HIST_BINS; b++ ) {
+			fprintf(out, " %zu", h->bins[b]);
+		}
+		fputc('\n', out);
+	}
+}
+#endif
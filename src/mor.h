@@ -0,0 +1,314 @@
+#ifndef MOR_H_INCLUDED
+#	define MOR_H_INCLUDED
+
+#include "ac.h"
+
+
+/// Model-order reduction (PRIMA) for AC sweeps of RC networks.
+/// Around a real expansion point s0, the Krylov space of A = (G + s0*C)^-1 * C started at
+/// r = (G + s0*C)^-1 * b is orthonormalized into V (Arnoldi), then congruence gives
+///   Gr = V^T G V,  Cr = V^T C V,  br = V^T b
+/// and every frequency only solves the q x q system (Gr + jωCr) z = br with x = V z.
+/// The residual |b - (G + jωC) V z| / |b| is the error estimate, needing no factorization.
+/// It's dense, so it's only taken at MOR_ERR_SAMPLES points spread over the sweep, and
+/// where it's too big the worst of them becomes another expansion point. The lifted x of
+/// those points is kept for the printout, every other point is solved once, reduced.
+/// A model that grows to the full order saves nothing and the full sweep runs instead.
+/// PRIMA needs Y(s) linear in s, so circuits with inductors go through the full sweep.
+
+enum {
+	MOR_MAX_EXPANSIONS = 4,
+	MOR_ERR_SAMPLES    = 8,
+};
+
+/// .mor <order per expansion> [tolerance]
+struct MORSettings {
+	rat    tol;
+	size_t order;
+};
+
+struct MORModel {
+	rat              *V;    /// n x cap basis, column k starts at V + k*n.
+	rat              *Gr, *Cr, *br;
+	struct LUSymbolic sym;  /// of the dense q x q reduced system, redone by mor_project.
+	size_t            n, q, cap;
+};
+
+CIRCUIT_EXPORT NO_NULLS bool mor_parse_directive(struct MORSettings *const restrict mor, char const line[const restrict static 1]) {
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word != 4 || strncmp(line, ".mor", 4) != 0 ) {
+		return false;
+	}
+	char tol_tok[48] = {0};
+	*mor = (struct MORSettings){ .tol = float_to_rat(1E-6) };
+	if( sscanf(line, " .mor %zu %47s", &mor->order, tol_tok) >= 2 ) {
+		mor->tol = parse_si_scalar(tol_tok);
+	}
+	return true;
+}
+
+CIRCUIT_EXPORT rat vec_dot(size_t const n, rat const a[const static n], rat const b[const static n]) {
+	rat acc = rat_zero();
+	for( size_t i=0; i < n; i++ ) {
+		acc = rat_addmul(acc, a[i], b[i]);
+	}
+	return acc;
+}
+
+/// out = M * v for a row-major n x n matrix.
+CIRCUIT_EXPORT void mat_vec(size_t const n, rat const M[const restrict static n*n], rat const v[const restrict static n], rat out[const restrict static n]) {
+	for( size_t i=0; i < n; i++ ) {
+		out[i] = vec_dot(n, &M[idx_2_to_1(i,0,n)], v);
+	}
+}
+
+/// orthonormalizes `w` against the basis (modified Gram-Schmidt, twice) and appends it.
+/// returns false when `w` is already in the span, i.e. the Krylov space is exhausted.
+CIRCUIT_EXPORT NO_NULLS bool mor_append(struct MORModel *const restrict model, rat w[const restrict]) {
+	size_t const n = model->n;
+	rat const before = rat_sqrt(vec_dot(n, w, w));
+	for( size_t pass=0; pass < 2; pass++ ) {
+		for( size_t k=0; k < model->q; k++ ) {
+			rat const *const v = &model->V[k*n];
+			rat const h = vec_dot(n, v, w);
+			for( size_t i=0; i < n; i++ ) {
+				w[i] = rat_sub(w[i], rat_mul(h, v[i]));
+			}
+		}
+	}
+	rat const norm = rat_sqrt(vec_dot(n, w, w));
+	if( model->q >= model->cap || rat_le(norm, rat_mul(before, float_to_rat(1E-9))) || rat_lt(norm, rat_epsilon()) ) {
+		return false;
+	}
+	rat *const v = &model->V[model->q*n];
+	for( size_t i=0; i < n; i++ ) {
+		v[i] = rat_div(w[i], norm);
+	}
+	model->q++;
+	return true;
+}
+
+/**
+ * Adds up to `order` Arnoldi vectors around s0 (rad/s).
+ * - A0, piv, w: n*n, n, n scratch.
+ * Returns false if G + s0*C is singular.
+ */
+CIRCUIT_EXPORT NO_NULLS bool mor_expand(
+	struct ACSystem const *const restrict sys,
+	struct MORModel       *const restrict model,
+	rat                    const          s0,
+	size_t                 const          order,
+	rat                                   A0[const restrict],
+	uint8_t                               piv[const restrict],
+	rat                                   w[const restrict]
+) {
+	size_t const n = sys->n;
+	for( size_t i=0; i < n*n; i++ ) {
+		A0[i] = rat_addmul(sys->G[i], s0, sys->C[i]);
+	}
+	if( !lu_factor(n, A0, piv) ) {
+		return false;
+	}
+	for( size_t i=0; i < n; i++ ) {
+		w[i] = cplx_real(sys->rhs[i]);
+	}
+	lu_solve(n, A0, piv, w);
+	for( size_t k=0; k < order; k++ ) {
+		if( !mor_append(model, w) ) {
+			break;
+		}
+		mat_vec(n, sys->C, &model->V[(model->q-1)*n], w);
+		lu_solve(n, A0, piv, w);
+	}
+	return true;
+}
+
+/// congruence transform onto the current basis and the reduced system's analysis, `tmp` is n scratch.
+CIRCUIT_EXPORT NO_NULLS void mor_project(struct ACSystem const *const restrict sys, struct MORModel *const restrict model, rat tmp[const restrict]) {
+	size_t const n = model->n, q = model->q;
+	for( size_t j=0; j < q; j++ ) {
+		rat const *const vj = &model->V[j*n];
+		mat_vec(n, sys->G, vj, tmp);
+		for( size_t i=0; i < q; i++ ) {
+			model->Gr[idx_2_to_1(i,j,q)] = vec_dot(n, &model->V[i*n], tmp);
+		}
+		mat_vec(n, sys->C, vj, tmp);
+		for( size_t i=0; i < q; i++ ) {
+			model->Cr[idx_2_to_1(i,j,q)] = vec_dot(n, &model->V[i*n], tmp);
+		}
+	}
+	for( size_t i=0; i < q; i++ ) {
+		rat acc = rat_zero();
+		for( size_t k=0; k < n; k++ ) {
+			acc = rat_addmul(acc, model->V[i*n + k], cplx_real(sys->rhs[k]));
+		}
+		model->br[i] = acc;
+	}
+	size_t dense[MAX_NODES] = {0};
+	for( size_t i=0; i < q; i++ ) {
+		dense[i] = (( size_t )(1) << q) - 1;
+	}
+	lu_symbolic_from_pattern(q, dense, &model->sym);
+}
+
+/**
+ * Solves the reduced model at ω and lifts it back to x (n).
+ * - Yr, z: q*q and q complex scratch.
+ * Returns false with x zeroed if the reduced system is singular there.
+ */
+CIRCUIT_EXPORT NO_NULLS bool mor_solve_point(
+	struct MORModel const *const restrict model,
+	rat                    const          omega,
+	cplx                                  Yr[const restrict],
+	cplx                                  z[const restrict],
+	cplx                                  x[const restrict]
+) {
+	size_t const n = model->n, q = model->q;
+	for( size_t i=0; i < q*q; i++ ) {
+		Yr[i] = cplx_make(model->Gr[i], rat_mul(omega, model->Cr[i]));
+	}
+	if( !lu_factor_scheduled_cplx(&model->sym, Yr) ) {
+		for( size_t k=0; k < n; k++ ) {
+			x[k] = cplx_zero();
+		}
+		return false;
+	}
+	for( size_t i=0; i < q; i++ ) {
+		z[i] = cplx_make(model->br[i], rat_zero());
+	}
+	lu_solve_scheduled_cplx(&model->sym, Yr, z);
+	for( size_t k=0; k < n; k++ ) {
+		x[k] = cplx_zero();
+		for( size_t i=0; i < q; i++ ) {
+			x[k] = cplx_add_cplx(x[k], cplx_mul_rat(z[i], model->V[i*n + k]));
+		}
+	}
+	return true;
+}
+
+/// |b - (G + jωC) x| / |b| over the full system.
+CIRCUIT_EXPORT NO_NULLS rat mor_residual(struct ACSystem const *const restrict sys, rat const omega, cplx const x[const restrict]) {
+	size_t const n = sys->n;
+	rat res = rat_zero(), ref = rat_zero();
+	for( size_t i=0; i < n; i++ ) {
+		cplx r = sys->rhs[i];
+		for( size_t j=0; j < n; j++ ) {
+			size_t const ij = idx_2_to_1(i,j,n);
+			r = cplx_sub_cplx(r, cplx_mul_cplx(cplx_make(sys->G[ij], rat_mul(omega, sys->C[ij])), x[j]));
+		}
+		res = rat_addmul(res, cplx_abs(r), cplx_abs(r));
+		ref = rat_addmul(ref, cplx_abs(sys->rhs[i]), cplx_abs(sys->rhs[i]));
+	}
+	if( rat_lt(ref, rat_epsilon()) ) {
+		return rat_zero();
+	}
+	return rat_sqrt(rat_div(res, ref));
+}
+
+/// the sweep points the error is checked at, spread evenly over the sweep's indices, returns how many.
+CIRCUIT_EXPORT size_t mor_sample_points(size_t const count, size_t samples[const static MOR_ERR_SAMPLES]) {
+	if( count <= MOR_ERR_SAMPLES ) {
+		for( size_t k=0; k < count; k++ ) {
+			samples[k] = k;
+		}
+		return count;
+	}
+	for( size_t k=0; k < MOR_ERR_SAMPLES; k++ ) {
+		samples[k] = k * (count - 1) / (MOR_ERR_SAMPLES - 1);
+	}
+	return MOR_ERR_SAMPLES;
+}
+
+/**
+ * AC sweep through a PRIMA reduced model.
+ * Returns false without printing anything when the circuit isn't reducible
+ * (devices, inductors, singular G + s0*C) or the model grows to the full order,
+ * the caller should sweep the full system instead.
+ */
+CIRCUIT_EXPORT NO_NULLS bool circuit_solve_ac_mor(struct Circuit *const restrict c, struct ACSweep const *const restrict sw, struct MORSettings const *const restrict mor, FILE *const restrict out) {
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	size_t const count = ac_sweep_count(sw);
+	struct ACSystem sys = {0};
+	if( count==0 || mor->order==0 || circuit_has_devices(c) || !circuit_build_ac(c, &sys) || mor->order >= sys.n ) {
+		bistack_release_front(&c->bistack, mark);
+		return false;
+	}
+	size_t const n = sys.n;
+	for( size_t i=0; i < n*n; i++ ) {
+		if( !rat_lt(rat_abs(sys.Gam[i]), rat_epsilon()) ) {
+			bistack_release_front(&c->bistack, mark);
+			return false;
+		}
+	}
+	
+	struct MORModel model = { .n = n, .cap = n };
+	model.V  = alloc_vec(&c->bistack, n*n);
+	model.Gr = alloc_vec(&c->bistack, n*n);
+	model.Cr = alloc_vec(&c->bistack, n*n);
+	model.br = alloc_vec(&c->bistack, n);
+	rat     *const A0  = alloc_vec(&c->bistack, n*n);
+	rat     *const w   = alloc_vec(&c->bistack, n);
+	uint8_t *const piv = bistack_alloc_front(&c->bistack, n);
+	cplx    *const Yr  = bistack_alloc_front_vec(&c->bistack, n*n, sizeof *Yr);
+	cplx    *const z   = bistack_alloc_front_vec(&c->bistack, n, sizeof *z);
+	cplx    *const x   = bistack_alloc_front_vec(&c->bistack, n, sizeof *x);
+	cplx    *const xs  = bistack_alloc_front_vec(&c->bistack, MOR_ERR_SAMPLES*n, sizeof *xs);
+	if( model.V==NULL || model.Gr==NULL || model.Cr==NULL || model.br==NULL || A0==NULL || w==NULL || piv==NULL || Yr==NULL || z==NULL || x==NULL || xs==NULL ) {
+		bistack_release_front(&c->bistack, mark);
+		return false;
+	}
+	
+	rat const two_pi = rat_mul(rat_from_int(2), rat_pi());
+	rat s0 = rat_mul(two_pi, rat_sqrt(rat_mul(sw->fstart, sw->fstop)));
+	if( !mor_expand(&sys, &model, s0, mor->order, A0, piv, w) || model.q==0 ) {
+		bistack_release_front(&c->bistack, mark);
+		return false;
+	}
+	size_t samples[MOR_ERR_SAMPLES];
+	size_t const sampled = mor_sample_points(count, samples);
+	rat worst_err = rat_zero();
+	for( size_t expansions=1;; expansions++ ) {
+		mor_project(&sys, &model, w);
+		worst_err = rat_zero();
+		rat worst_omega = s0;
+		for( size_t k=0; k < sampled; k++ ) {
+			rat const omega = rat_mul(two_pi, ac_sweep_freq(sw, samples[k]));
+			/// a singular reduced system counts as infinitely wrong so it gets expanded there.
+			rat const err = mor_solve_point(&model, omega, Yr, z, &xs[k*n])? mor_residual(&sys, omega, &xs[k*n]) : rat_div(rat_pos1(), rat_epsilon());
+			if( rat_lt(worst_err, err) ) {
+				worst_err = err;
+				worst_omega = omega;
+			}
+		}
+		if( rat_le(worst_err, mor->tol) || model.q >= model.cap || expansions >= MOR_MAX_EXPANSIONS ) {
+			break;
+		}
+		size_t const q_before = model.q;
+		s0 = worst_omega;
+		if( !mor_expand(&sys, &model, s0, mor->order, A0, piv, w) || model.q==q_before ) {
+			break;
+		}
+	}
+	
+	if( model.q >= n ) {
+		bistack_release_front(&c->bistack, mark);
+		return false;
+	}
+	
+	char num[48] = {0};
+	fprintf(out, "MOR order %zu of %zu, max error %s over %zu samples\n", model.q, n, rat_to_cstr(worst_err, sizeof num, num), sampled);
+	for( size_t p=0, k=0; p < count; p++ ) {
+		rat const freq = ac_sweep_freq(sw, p);
+		fprintf(out, "f = %s Hz\n", rat_to_cstr(freq, sizeof num, num));
+		cplx const *point = x;
+		if( k < sampled && samples[k]==p ) {
+			point = &xs[k++*n];
+		} else {
+			( void )(mor_solve_point(&model, rat_mul(two_pi, freq), Yr, z, x));
+		}
+		ac_print_point(out, &sys, point);
+	}
+	bistack_release_front(&c->bistack, mark);
+	return true;
+}
+#endif
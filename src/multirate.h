@@ -0,0 +1,481 @@
+#ifndef MULTIRATE_H_INCLUDED
+#	define MULTIRATE_H_INCLUDED
+
+#include "tran.h"
+
+
+/// Multirate transient through waveform relaxation.
+/// Nodes are grouped into blocks that only touch each other through weak conductances,
+/// anything reactive between two nodes keeps them in one block.
+/// Time advances in windows of tstep. In a window, every block integrates on its own with
+/// its own step control, seeing the other blocks' node voltages as waveforms from the
+/// latest sweep (Gauss-Seidel), until no waveform moves anymore.
+/// A block that didn't move during its last window and whose inputs haven't changed
+/// is latent, it keeps its voltages for the window without being solved.
+/// Steps are W / 2^k, so every block lands on the window's end without shortening a step.
+
+enum {
+	WR_SAMPLES    = 32,        /// waveform samples per window handed between blocks.
+	WR_TICK_BITS  = 16,        /// positions in a window count in W / 2^WR_TICK_BITS.
+	WR_TICKS      = 1L << WR_TICK_BITS,
+	WR_MAX_SWEEPS = 16,
+};
+
+/// .multirate [coupling]
+/// off-diagonal conductances above `coupling` times the smaller diagonal join two blocks.
+struct MultirateSettings {
+	rat  coupling;
+	bool on;
+};
+
+struct MultirateStats {
+	size_t blocks, windows, sweeps, block_steps, bypassed, rejected, factorizations, unconverged;
+};
+
+/// one block solved on its own, `sys` is indexed by local ids, `ids` maps them to the full system.
+struct WRBlock {
+	struct TranSystem sys;
+	struct TranState *saved;          /// states at the start of the window.
+	rat               saved_t[3];
+	rat               seen[MAX_NODES]; /// inputs at the end of the last solved window, by full id.
+	size_t            saved_history, bits;
+	uint32_t          h, h_prev, saved_h, saved_h_prev; /// in ticks.
+	uint8_t           ids[MAX_NODES];
+	bool              settled;
+};
+
+CIRCUIT_EXPORT NO_NULLS bool mr_parse_directive(struct MultirateSettings *const restrict mr, char const line[const restrict static 1]) {
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word != 10 || strncmp(line, ".multirate", 10) != 0 ) {
+		return false;
+	}
+	char tok[48] = {0};
+	*mr = (struct MultirateSettings){ .coupling = float_to_rat(0.1f), .on = true };
+	if( sscanf(line, " .multirate %47s", tok)==1 ) {
+		mr->coupling = parse_si_scalar(tok);
+	}
+	return true;
+}
+
+/// splits the full system into weakly coupled blocks, returns the block count.
+CIRCUIT_EXPORT NO_NULLS size_t wr_partition(struct TranSystem const *const full, rat const coupling, size_t (*const blocks)[MAX_NODES]) {
+	size_t const n = full->n;
+	size_t group[MAX_NODES] = {0};
+	for( size_t i=0; i < n; i++ ) {
+		group[i] = (1 << i);
+	}
+	for( size_t i=0; i < n; i++ ) {
+		for( size_t j=i+1; j < n; j++ ) {
+			rat const gij = rat_max(rat_abs(full->G[idx_2_to_1(i,j,n)]), rat_abs(full->G[idx_2_to_1(j,i,n)]));
+			rat const diag = rat_min(rat_abs(full->G[idx_2_to_1(i,i,n)]), rat_abs(full->G[idx_2_to_1(j,j,n)]));
+			bool strong = rat_lt(rat_mul(coupling, diag), gij);
+			for( size_t k=0; k < full->count && !strong; k++ ) {
+				struct TranState const *const st = &full->states[k];
+				strong = !st->b_g && ((st->a==i && st->b==j) || (st->a==j && st->b==i));
+			}
+			if( strong && group[i] != group[j] ) {
+				size_t const merged = group[i] | group[j];
+				for( size_t k=0; k < n; k++ ) {
+					if( merged & (1 << k) ) {
+						group[k] = merged;
+					}
+				}
+			}
+		}
+	}
+	size_t count = 0, seen = 0;
+	for( size_t i=0; i < n; i++ ) {
+		if( !(seen & (1 << i)) ) {
+			(*blocks)[count++] = group[i];
+			seen |= group[i];
+		}
+	}
+	return count;
+}
+
+/// carves the block over `bits` (full ids) out of `full`, on the front stack.
+CIRCUIT_EXPORT NO_NULLS int wr_block_make(struct TIBiStack *const restrict s, struct TranSystem const *const restrict full, size_t const bits, struct WRBlock *const restrict blk) {
+	*blk = (struct WRBlock){ .bits = bits, .h = WR_TICKS >> 6 };
+	blk->h_prev = blk->h;
+	struct TranSystem *const sys = &blk->sys;
+	uint8_t local[MAX_NODES] = {0};
+	for( size_t i=0; i < full->n; i++ ) {
+		if( bits & (1 << i) ) {
+			local[i] = sys->n;
+			blk->ids[sys->n] = i;
+			sys->matrix_id_to_node[sys->n] = full->matrix_id_to_node[i];
+			sys->n++;
+		}
+	}
+	for( size_t k=0; k < full->count; k++ ) {
+		sys->count += (bits & (1 << full->states[k].a)) != 0;
+	}
+	size_t const m = sys->n;
+	sys->G      = alloc_vec(s, m*m);
+	sys->rhs0   = alloc_vec(s, m);
+	sys->LU     = alloc_vec(s, m*m);
+	sys->rhs    = alloc_vec(s, m);
+	sys->states = bistack_alloc_front_vec(s, sys->count + 1, sizeof *sys->states);
+	blk->saved  = bistack_alloc_front_vec(s, sys->count + 1, sizeof *blk->saved);
+	if( sys->G==NULL || sys->rhs0==NULL || sys->LU==NULL || sys->rhs==NULL || sys->states==NULL || blk->saved==NULL ) {
+		return ERR_OOM;
+	}
+	for( size_t i=0; i < m; i++ ) {
+		for( size_t j=0; j < m; j++ ) {
+			sys->G[idx_2_to_1(i,j,m)] = full->G[idx_2_to_1(blk->ids[i], blk->ids[j], full->n)];
+		}
+	}
+	for( size_t k=0, q=0; k < full->count; k++ ) {
+		struct TranState const *const st = &full->states[k];
+		if( bits & (1 << st->a) ) {
+			sys->states[q] = *st;
+			sys->states[q].a = local[st->a];
+			sys->states[q].b = local[st->b];
+			q++;
+		}
+	}
+	tran_analyze(sys);
+	sys->t[0] = sys->t[1] = sys->t[2] = sys->a0 = rat_zero();
+	for( size_t i=0; i < MAX_NODES; i++ ) {
+		blk->seen[i] = rat_zero();
+	}
+	return ERR_OK;
+}
+
+CIRCUIT_EXPORT NO_NULLS void wr_block_save(struct WRBlock *const blk) {
+	memcpy(blk->saved, blk->sys.states, blk->sys.count * sizeof *blk->saved);
+	memcpy(blk->saved_t, blk->sys.t, sizeof blk->saved_t);
+	blk->saved_history = blk->sys.history;
+	blk->saved_h       = blk->h;
+	blk->saved_h_prev  = blk->h_prev;
+}
+
+CIRCUIT_EXPORT NO_NULLS void wr_block_restore(struct WRBlock *const blk) {
+	memcpy(blk->sys.states, blk->saved, blk->sys.count * sizeof *blk->saved);
+	memcpy(blk->sys.t, blk->saved_t, sizeof blk->saved_t);
+	blk->sys.history = blk->saved_history;
+	blk->h           = blk->saved_h;
+	blk->h_prev      = blk->saved_h_prev;
+}
+
+/// which blocks read each block's waveform through a coupling conductance, as bitflags of block indices.
+CIRCUIT_EXPORT NO_NULLS void wr_block_neighbors(struct TranSystem const *const full, struct WRBlock const blocks[const], size_t const count, size_t (*const readers)[MAX_NODES]) {
+	size_t const n = full->n;
+	memset(*readers, 0, sizeof *readers);
+	for( size_t b=0; b < count; b++ ) {
+		for( size_t o=0; o < count; o++ ) {
+			if( o==b ) {
+				continue;
+			}
+			for( size_t i=0; i < n; i++ ) {
+				for( size_t j=0; (blocks[b].bits & (1 << i)) && j < n; j++ ) {
+					if( (blocks[o].bits & (1 << j)) && !rat_lt(rat_abs(full->G[idx_2_to_1(i,j,n)]), rat_epsilon()) ) {
+						(*readers)[o] |= (1 << b);
+					}
+				}
+			}
+		}
+	}
+}
+
+/// how far apart two waveform values may be, relative to `v`.
+CIRCUIT_EXPORT rat wr_tol(rat const v, rat const reltol) {
+	return rat_addmul(float_to_rat(1E-6), reltol, rat_abs(v));
+}
+
+/// waveform of full id `j` at `pos` ticks into the window, `wave` is (WR_SAMPLES+1) x n.
+CIRCUIT_EXPORT rat wr_wave_at(size_t const n, rat const wave[const static (WR_SAMPLES+1)*n], size_t const j, uint32_t const pos) {
+	uint32_t const per = WR_TICKS / WR_SAMPLES;
+	uint32_t const s = pos / per;
+	if( s >= WR_SAMPLES ) {
+		return wave[idx_2_to_1(WR_SAMPLES, j, n)];
+	}
+	rat const lo = wave[idx_2_to_1(s, j, n)], hi = wave[idx_2_to_1(s+1, j, n)];
+	return rat_addmul(lo, rat_div(rat_from_int(pos % per), rat_from_int(per)), rat_sub(hi, lo));
+}
+
+/// true if every input of `blk` stays where it was when the block last moved.
+CIRCUIT_EXPORT NO_NULLS bool wr_inputs_steady(struct TranSystem const *const full, struct WRBlock const *const blk, rat const wave[const]) {
+	size_t const n = full->n;
+	for( size_t j=0; j < n; j++ ) {
+		if( blk->bits & (1 << j) ) {
+			continue;
+		}
+		bool coupled = false;
+		for( size_t i=0; i < blk->sys.n && !coupled; i++ ) {
+			coupled = !rat_lt(rat_abs(full->G[idx_2_to_1(blk->ids[i], j, n)]), rat_epsilon());
+		}
+		for( size_t s=0; coupled && s <= WR_SAMPLES; s++ ) {
+			rat const v = wave[idx_2_to_1(s, j, n)];
+			if( rat_lt(wr_tol(v, float_to_rat(1E-6)), rat_abs(rat_sub(v, blk->seen[j]))) ) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Integrates `blk` across the window starting at T against the other blocks' waveforms
+ * and writes its own nodes' samples into `wave`.
+ * `change` gets the biggest move of any of its samples over the relaxation tolerance.
+ * Returns ERR_OK or ERR_SINGULAR.
+ */
+CIRCUIT_EXPORT NO_NULLS int wr_block_integrate(
+	struct TranSystem     const *const restrict full,
+	struct WRBlock              *const restrict blk,
+	rat                          const          W,
+	uint8_t                      const          method,
+	rat                                         wave[const restrict],
+	rat                                         v[const restrict],
+	rat                         *const restrict change,
+	struct MultirateStats       *const restrict stats
+) {
+	struct TranSystem *const sys = &blk->sys;
+	size_t const n = full->n, m = sys->n;
+	uint32_t const per = WR_TICKS / WR_SAMPLES;
+	rat const tick = rat_div(W, rat_from_int(WR_TICKS));
+	rat const relax_tol = float_to_rat(1E-4f);
+	rat v_prev[MAX_NODES] = {0};
+	for( size_t i=0; i < m; i++ ) {
+		v_prev[i] = wave[idx_2_to_1(0, blk->ids[i], n)];
+	}
+	*change = rat_zero();
+	struct TranStats ts = {0};
+	for( uint32_t pos=0; pos < WR_TICKS; ) {
+		uint32_t const h = blk->h;
+		rat const h_r = rat_mul(tick, rat_from_int(h)), h_prev_r = rat_mul(tick, rat_from_int(blk->h_prev));
+		for( size_t i=0; i < m; i++ ) {
+			size_t const gi = blk->ids[i];
+			rat acc = full->rhs0[gi];
+			for( size_t j=0; j < n; j++ ) {
+				if( !(blk->bits & (1 << j)) ) {
+					acc = rat_sub(acc, rat_mul(full->G[idx_2_to_1(gi,j,n)], wr_wave_at(n, wave, j, pos + h)));
+				}
+			}
+			sys->rhs0[i] = acc;
+		}
+		uint8_t const step_method = sys->history==0? TRAN_BE : method;
+		if( !tran_step(sys, step_method, h_r, h_prev_r, v, &ts) ) {
+			stats->factorizations += ts.factorizations;
+			return ERR_SINGULAR;
+		}
+		size_t const order = tran_order(step_method);
+		rat const ratio = tran_error_ratio(sys, step_method, h_r);
+		if( rat_lt(rat_pos1(), ratio) && h > 1 ) {
+			stats->rejected++;
+			rat const shrink = rat_mul(float_to_rat(0.9f), rat_root(ratio, rat_from_int(order + 1)));
+			uint32_t const shift = 1 + rat_lt(rat_from_int(2), shrink) + rat_lt(rat_from_int(4), shrink);
+			blk->h = (h >> shift) > 0? (h >> shift) : 1;
+			continue;
+		}
+		tran_accept(sys, step_method, h_r, h_prev_r);
+		stats->block_steps++;
+		
+		/// resample onto the shared grid.
+		uint32_t const next = pos + h;
+		for( uint32_t s = pos / per + 1; s <= WR_SAMPLES && s * per <= next; s++ ) {
+			rat const frac = rat_div(rat_from_int(s * per - pos), rat_from_int(h));
+			for( size_t i=0; i < m; i++ ) {
+				rat *const sample = &wave[idx_2_to_1(s, blk->ids[i], n)];
+				rat const val = rat_addmul(v_prev[i], frac, rat_sub(v[i], v_prev[i]));
+				*change = rat_max(*change, rat_div(rat_abs(rat_sub(val, *sample)), wr_tol(val, relax_tol)));
+				*sample = val;
+			}
+		}
+		for( size_t i=0; i < m; i++ ) {
+			v_prev[i] = v[i];
+		}
+		pos = next;
+		blk->h_prev = h;
+		rat const grow = rat_lt(ratio, rat_epsilon())? rat_from_int(4) : rat_mul(float_to_rat(0.9f), rat_root(rat_recip(ratio), rat_from_int(order + 1)));
+		if( rat_le(rat_from_int(2), grow) && 2*h <= WR_TICKS && pos % (2*h)==0 ) {
+			blk->h = 2*h;
+		}
+	}
+	stats->factorizations += ts.factorizations;
+	return ERR_OK;
+}
+
+/// holds a latent block's voltages through the window, `wave` already has them from sample 0.
+CIRCUIT_EXPORT NO_NULLS void wr_block_bypass(struct TranSystem const *const full, struct WRBlock *const blk, rat const wave[const], rat *const change) {
+	size_t const n = full->n;
+	*change = rat_zero();
+	for( size_t i=0; i < blk->sys.n; i++ ) {
+		size_t const gi = blk->ids[i];
+		rat const v0 = wave[idx_2_to_1(0, gi, n)];
+		for( size_t s=1; s <= WR_SAMPLES; s++ ) {
+			*change = rat_max(*change, rat_div(rat_abs(rat_sub(wave[idx_2_to_1(s, gi, n)], v0)), wr_tol(v0, float_to_rat(1E-4f))));
+		}
+	}
+}
+
+/// commits a window the block sat out, the history stays flat so the next step sees no motion.
+CIRCUIT_EXPORT NO_NULLS void wr_block_skip_window(struct WRBlock *const blk, rat const W) {
+	struct TranSystem *const sys = &blk->sys;
+	rat const h = rat_mul(rat_div(W, rat_from_int(WR_TICKS)), rat_from_int(blk->h));
+	for( size_t k=0; k < sys->count; k++ ) {
+		struct TranState *const st = &sys->states[k];
+		st->x[1] = st->x[2] = st->x[0];
+		st->dx = rat_zero();
+	}
+	sys->t[0] = rat_add(sys->t[0], W);
+	sys->t[1] = rat_sub(sys->t[0], h);
+	sys->t[2] = rat_sub(sys->t[1], h);
+	blk->h_prev = blk->h;
+}
+
+/// after solving a window: did the block move, and what inputs did it see at the end.
+CIRCUIT_EXPORT NO_NULLS void wr_block_settle(struct TranSystem const *const full, struct WRBlock *const blk, rat const wave[const]) {
+	size_t const n = full->n;
+	rat const latency_tol = float_to_rat(1E-6f);
+	blk->settled = true;
+	for( size_t i=0; i < blk->sys.n && blk->settled; i++ ) {
+		size_t const gi = blk->ids[i];
+		for( size_t s=1; s <= WR_SAMPLES; s++ ) {
+			rat const v = wave[idx_2_to_1(s, gi, n)];
+			if( rat_lt(wr_tol(v, latency_tol), rat_abs(rat_sub(v, wave[idx_2_to_1(0, gi, n)]))) ) {
+				blk->settled = false;
+				break;
+			}
+		}
+	}
+	for( size_t k=0; k < blk->sys.count && blk->settled; k++ ) {
+		struct TranState const *const st = &blk->sys.states[k];
+		blk->settled = !rat_lt(wr_tol(st->x[0], latency_tol), rat_abs(rat_sub(st->x[0], blk->saved[k].x[0])));
+	}
+	for( size_t j=0; j < n; j++ ) {
+		blk->seen[j] = wave[idx_2_to_1(WR_SAMPLES, j, n)];
+	}
+}
+
+/**
+ * Multirate twin of circuit_tran, same sink and error codes.
+ * tstep is rounded down so a whole number of windows reaches tstop, the outputs
+ * land on the window ends. A circuit that doesn't split goes through circuit_tran.
+ */
+CIRCUIT_EXPORT NO_NULLS int circuit_tran_multirate(
+	struct Circuit                 *const restrict c,
+	struct TranSettings      const *const restrict tr,
+	struct MultirateSettings const *const restrict mr,
+	struct TranSink          const *const restrict sink,
+	struct MultirateStats          *const restrict stats
+) {
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	*stats = (struct MultirateStats){0};
+	if( rat_le(tr->tstep, rat_zero()) || rat_lt(tr->tstop, tr->tstep) ) {
+		return ERR_NODE_OOB;
+	}
+	struct TranSystem full;
+	int err = tran_build(c, &full);
+	if( err != ERR_OK ) {
+		bistack_release_front(&c->bistack, mark);
+		return err;
+	}
+	size_t const n = full.n;
+	size_t bits[MAX_NODES] = {0};
+	stats->blocks = wr_partition(&full, mr->coupling, &bits);
+	if( stats->blocks < 2 ) {
+		bistack_release_front(&c->bistack, mark);
+		struct TranStats ts;
+		err = circuit_tran(c, tr, sink, &ts);
+		stats->block_steps    = ts.steps;
+		stats->rejected       = ts.rejected;
+		stats->factorizations = ts.factorizations;
+		return err;
+	}
+	struct WRBlock *const blocks = bistack_alloc_front_vec(&c->bistack, stats->blocks, sizeof *blocks);
+	rat *const wave = alloc_vec(&c->bistack, (WR_SAMPLES+1) * n);
+	rat *const v    = alloc_vec(&c->bistack, n);
+	if( blocks==NULL || wave==NULL || v==NULL ) {
+		bistack_release_front(&c->bistack, mark);
+		return ERR_OOM;
+	}
+	for( size_t b=0; b < stats->blocks; b++ ) {
+		if( (err = wr_block_make(&c->bistack, &full, bits[b], &blocks[b])) != ERR_OK ) {
+			bistack_release_front(&c->bistack, mark);
+			return err;
+		}
+	}
+	
+	size_t const windows = ( size_t )(rat_to_float(rat_floor(rat_add(rat_div(tr->tstop, tr->tstep), float_to_rat(0.999f)))));
+	rat const W = rat_div(tr->tstop, rat_from_int(windows));
+	size_t const node_bits = c->active_nodes & ~(1 << GND_IDX);
+	rat V_out[MAX_NODES] = {0};
+	for( size_t i=0; i < MAX_NODES; i++ ) {
+		V_out[i] = rat_zero();
+	}
+	sink->emit(sink->ctx, rat_zero(), node_bits, &V_out);
+	
+	size_t readers[MAX_NODES] = {0};
+	wr_block_neighbors(&full, blocks, stats->blocks, &readers);
+	bool bypassed[MAX_NODES] = {0};
+	for( size_t w=0; w < windows && err==ERR_OK; w++ ) {
+		stats->windows++;
+		/// every block starts flat at where the last window ended.
+		for( size_t j=0; j < n; j++ ) {
+			rat const v0 = wave[idx_2_to_1(WR_SAMPLES, j, n)];
+			for( size_t s=0; s <= WR_SAMPLES; s++ ) {
+				wave[idx_2_to_1(s, j, n)] = v0;
+			}
+		}
+		for( size_t b=0; b < stats->blocks; b++ ) {
+			wr_block_save(&blocks[b]);
+		}
+		/// a block is stale until solved, and again whenever a waveform it reads moves.
+		size_t stale = (1 << stats->blocks) - 1;
+		for( size_t sweep=0; sweep < WR_MAX_SWEEPS && stale != 0 && err==ERR_OK; sweep++ ) {
+			stats->sweeps++;
+			for( size_t b=0; b < stats->blocks && err==ERR_OK; b++ ) {
+				if( !(stale & (1 << b)) ) {
+					continue;
+				}
+				struct WRBlock *const blk = &blocks[b];
+				rat change = rat_zero();
+				stale &= ~(1 << b);
+				wr_block_restore(blk);
+				bypassed[b] = blk->settled && wr_inputs_steady(&full, blk, wave);
+				if( bypassed[b] ) {
+					wr_block_bypass(&full, blk, wave, &change);
+				} else {
+					err = wr_block_integrate(&full, blk, W, tr->method, wave, v, &change, stats);
+				}
+				if( rat_lt(rat_pos1(), change) ) {
+					stale |= readers[b];
+				}
+			}
+		}
+		bool const converged = stale==0;
+		stats->unconverged += !converged;
+		for( size_t b=0; b < stats->blocks; b++ ) {
+			if( bypassed[b] ) {
+				stats->bypassed++;
+				wr_block_skip_window(&blocks[b], W);
+			} else {
+				wr_block_settle(&full, &blocks[b], wave);
+			}
+		}
+		for( size_t j=0; j < n; j++ ) {
+			V_out[full.matrix_id_to_node[j]] = wave[idx_2_to_1(WR_SAMPLES, j, n)];
+		}
+		sink->emit(sink->ctx, rat_mul(W, rat_from_int(w + 1)), node_bits, &V_out);
+	}
+	bistack_release_front(&c->bistack, mark);
+	return err;
+}
+
+CIRCUIT_EXPORT NO_NULLS void circuit_solve_tran_multirate(struct Circuit *const restrict c, struct TranSettings const *const restrict tr, struct MultirateSettings const *const restrict mr, struct TranSink const *const restrict sink, FILE *const restrict out) {
+	if( circuit_has_devices(c) ) {
+		fputs("tran: linear circuits only\n", out);
+		return;
+	}
+	struct MultirateStats stats;
+	int const err = circuit_tran_multirate(c, tr, mr, sink, &stats);
+	if( err==ERR_SINGULAR ) {
+		fputs("tran: singular companion matrix\n", out);
+	} else if( err==ERR_OOM ) {
+		fputs("tran: out of memory\n", out);
+	}
+	fprintf(out, "multirate: %zu blocks, %zu windows, %zu sweeps, %zu block steps, %zu bypassed, %zu unconverged, %zu factorizations\n", stats.blocks, stats.windows, stats.sweeps, stats.block_steps, stats.bypassed, stats.unconverged, stats.factorizations);
+}
+#endif
@@ -8,6 +8,7 @@
 #include <ctype.h>
 #include "mem.h"
 #include "realtype.h"
+#include "par.h"
 
 #define CIRCUIT_EXPORT    static inline
 
@@ -26,6 +27,10 @@ enum {
 	COMP_VCVS,           /// E - Voltage Controlled Voltage Source
 	COMP_CCVS,           /// H - Current Controlled Voltage Source
 	COMP_CCCS,           /// F - Current Controlled Current Source
+	COMP_MACROMODEL,     /// X - Reduced subcircuit, stamped as a port admittance matrix.
+	COMP_DIODE,          /// D - I = Is * (e^(V/Vt) - 1)
+	COMP_MOSFET,         /// M - Square-law NMOS.
+	COMP_BJT,            /// Q - Ebers-Moll NPN.
 	MAX_COMP_TYPES,
 };
 
@@ -59,6 +64,8 @@ CIRCUIT_EXPORT rat parse_si_scalar(char const tok[const static 1]) {
 		case 'm':           scale = float_to_rat(1E-3);   break;
 		case 'u':           scale = float_to_rat(1E-6);   break;
 		case 'n':           scale = float_to_rat(1E-9);   break;
+		case 'p':           scale = float_to_rat(1E-12);  break;
+		case 'f':           scale = float_to_rat(1E-15);  break;
 		default:            scale = rat_pos1(); last = 0; break;
 	}
 	
@@ -75,7 +82,7 @@ CIRCUIT_EXPORT uint8_t kind_from_letter(char const c) {
 	switch( c ) {
 		case 'R': case 'r': return COMP_RESISTOR;
 		case 'V':           return COMP_DC_VOLTAGE_SRC;
-		case 'v':           return COMP_DC_VOLTAGE_SRC;
+		case 'v':           return COMP_AC_VOLTAGE_SRC;
 		case 'I':           return COMP_DC_CURRENT_SRC;
 		case 'i':           return COMP_AC_CURRENT_SRC;
 		case 'C': case 'c': return COMP_CAPACITOR;
@@ -85,10 +92,20 @@ CIRCUIT_EXPORT uint8_t kind_from_letter(char const c) {
 		case 'H': case 'h': return COMP_CCVS;
 		case 'F': case 'f': return COMP_CCCS;
 		case 'W': case 'w': return COMP_WIRE;
+		case 'D': case 'd': return COMP_DIODE;
+		case 'M': case 'm': return COMP_MOSFET;
+		case 'Q': case 'q': return COMP_BJT;
+		case 'X': case 'x': return COMP_MACROMODEL;
 		default:            return COMP_INVALID;
 	}
 }
 
+/// the netlist letter of a kind, the inverse of kind_from_letter.
+CIRCUIT_EXPORT char letter_from_kind(uint8_t const kind) {
+	static char const letters[MAX_COMP_TYPES + 1] = "?WVvIiRCLGEHFXDMQ";
+	return kind < MAX_COMP_TYPES? letters[kind] : '?';
+}
+
 CIRCUIT_EXPORT NO_NULLS rat lex_decimal(size_t *const restrict i_ref, char const text[const restrict static 1]) {
 	bool has_dot = false;
 	size_t n = 0;
@@ -130,7 +147,7 @@ CIRCUIT_EXPORT size_t idx_2_to_1(size_t const idx_dim1, size_t const idx_dim2, s
 
 CIRCUIT_EXPORT NO_NULLS rat *alloc_vec(struct TIBiStack *const s, size_t const n) {
 	rat *const v = bistack_alloc_front_vec(s, n, sizeof *v);
-	for( size_t i=0; i < n; i++ ) {
+	for( size_t i=0; v != NULL && i < n; i++ ) {
 		v[i] = rat_zero();
 	}
 	return v;
@@ -138,18 +155,32 @@ CIRCUIT_EXPORT NO_NULLS rat *alloc_vec(struct TIBiStack *const s, size_t const n
 
 CIRCUIT_EXPORT bool node_is_ground(uint8_t const n) { return n==GND_IDX; }
 
+/// 64-bit FNV-1a, start from FNV_OFFSET.
+#define FNV_OFFSET    0xCBF29CE484222325ULL
+CIRCUIT_EXPORT uint64_t fnv1a_byte(uint64_t const h, uint8_t const b) {
+	return (h ^ b) * 0x100000001B3ULL;
+}
+
+CIRCUIT_EXPORT uint64_t fnv1a(uint64_t h, void const *const data, size_t const len) {
+	uint8_t const *const bytes = data;
+	for( size_t i=0; i < len; i++ ) {
+		h = fnv1a_byte(h, bytes[i]);
+	}
+	return h;
+}
+
 #ifndef TICE_H
-CIRCUIT_EXPORT void print_matrix(size_t const n, rat const G[const static n*n], rat const v[const static n]) {
+CIRCUIT_EXPORT void print_matrix(size_t const n, rat const G[const static n*n], rat const v[const static n], FILE *const out) {
 	enum { NUM_CSTR_LEN=12 };
 	for( size_t i=0; i < n; i++ ) {
-		printf("| ");
+		fputs("| ", out);
 		for( size_t j=0; j < n; j++ ) {
-			printf("%10s", rat_to_cstr(G[idx_2_to_1(i,j,n)], NUM_CSTR_LEN, (char[NUM_CSTR_LEN]){0}));
+			fprintf(out, "%10s", rat_to_cstr(G[idx_2_to_1(i,j,n)], NUM_CSTR_LEN, (char[NUM_CSTR_LEN]){0}));
 			if( j+1 < n ) {
-				printf(", ");
+				fputs(", ", out);
 			}
 		}
-		printf(" | I[V%zu]: %10s\n", i+1, rat_to_cstr(v[i], NUM_CSTR_LEN, (char[NUM_CSTR_LEN]){0}));
+		fprintf(out, " | I[V%zu]: %10s\n", i+1, rat_to_cstr(v[i], NUM_CSTR_LEN, (char[NUM_CSTR_LEN]){0}));
 	}
 }
 #endif
@@ -258,15 +289,479 @@ CIRCUIT_EXPORT enum RREFResult gaussian_rref(size_t const matrix_len, rat A[cons
 	return curr_pivot_row==matrix_len? RREFResultOk : RREFResultFreeVars;
 }
 
+/**
+ * LU factorization with partial pivoting (Doolittle), in place.
+ * - A: n x n stored row-major via idx_2_to_1(i,j,n).
+ * - piv: piv[k] is the row that was swapped with row k at step k.
+ * On return, A holds L below the diagonal (unit diagonal implied) and U on and above it.
+ * The factors can be reused by lu_solve for any number of right-hand sides.
+ * 
+ * Returns false if a pivot is under epsilon (singular matrix).
+ */
+CIRCUIT_EXPORT bool lu_factor(size_t const n, rat A[const restrict static n*n], uint8_t piv[const restrict static n]) {
+	rat const eps = rat_epsilon();
+	for( size_t k=0; k < n; k++ ) {
+		size_t p = k;
+		rat cur_max = rat_abs(A[idx_2_to_1(k, k, n)]);
+		for( size_t i=k+1; i < n; i++ ) {
+			rat const mag = rat_abs(A[idx_2_to_1(i, k, n)]);
+			if( rat_lt(cur_max, mag) ) {
+				cur_max = mag;
+				p = i;
+			}
+		}
+		piv[k] = p;
+		if( rat_lt(cur_max, eps) ) {
+			return false;
+		}
+		if( p != k ) {
+			for( size_t j=0; j < n; j++ ) {
+				rat const tmp = A[idx_2_to_1(k, j, n)];
+				A[idx_2_to_1(k, j, n)] = A[idx_2_to_1(p, j, n)];
+				A[idx_2_to_1(p, j, n)] = tmp;
+			}
+		}
+		rat const pivot = A[idx_2_to_1(k, k, n)];
+		for( size_t i=k+1; i < n; i++ ) {
+			size_t const ik = idx_2_to_1(i, k, n);
+			A[ik] = rat_div(A[ik], pivot);
+			if( rat_lt(rat_abs(A[ik]), eps) ) {
+				continue;
+			}
+			for( size_t j=k+1; j < n; j++ ) {
+				size_t const ij = idx_2_to_1(i, j, n);
+				A[ij] = rat_sub(A[ij], rat_mul(A[ik], A[idx_2_to_1(k, j, n)]));
+			}
+		}
+	}
+	return true;
+}
+
+/// solves A*x = b in place on `b` using the factors from lu_factor.
+CIRCUIT_EXPORT void lu_solve(size_t const n, rat const LU[const restrict static n*n], uint8_t const piv[const restrict static n], rat b[const restrict static n]) {
+	for( size_t k=0; k < n; k++ ) {
+		if( piv[k] != k ) {
+			rat const tmp = b[k];
+			b[k] = b[piv[k]];
+			b[piv[k]] = tmp;
+		}
+	}
+	for( size_t i=1; i < n; i++ ) {
+		for( size_t j=0; j < i; j++ ) {
+			b[i] = rat_sub(b[i], rat_mul(LU[idx_2_to_1(i, j, n)], b[j]));
+		}
+	}
+	for( size_t i=n; i-- > 0; ) {
+		for( size_t j=i+1; j < n; j++ ) {
+			b[i] = rat_sub(b[i], rat_mul(LU[idx_2_to_1(i, j, n)], b[j]));
+		}
+		b[i] = rat_div(b[i], LU[idx_2_to_1(i, i, n)]);
+	}
+}
+
+/**
+ * lu_solve over `cols` right-hand sides at once, B is n x cols row-major and solved in place.
+ * Every factor entry is read once and applied across the whole row of B.
+ */
+CIRCUIT_EXPORT void lu_solve_block(size_t const n, rat const LU[const restrict static n*n], uint8_t const piv[const restrict static n], size_t const cols, rat B[const restrict static n*cols]) {
+	for( size_t k=0; k < n; k++ ) {
+		if( piv[k] != k ) {
+			for( size_t c=0; c < cols; c++ ) {
+				rat const tmp = B[idx_2_to_1(k, c, cols)];
+				B[idx_2_to_1(k, c, cols)] = B[idx_2_to_1(piv[k], c, cols)];
+				B[idx_2_to_1(piv[k], c, cols)] = tmp;
+			}
+		}
+	}
+	for( size_t i=1; i < n; i++ ) {
+		for( size_t j=0; j < i; j++ ) {
+			rat const l = LU[idx_2_to_1(i, j, n)];
+			for( size_t c=0; c < cols; c++ ) {
+				B[idx_2_to_1(i, c, cols)] = rat_sub(B[idx_2_to_1(i, c, cols)], rat_mul(l, B[idx_2_to_1(j, c, cols)]));
+			}
+		}
+	}
+	for( size_t i=n; i-- > 0; ) {
+		for( size_t j=i+1; j < n; j++ ) {
+			rat const u = LU[idx_2_to_1(i, j, n)];
+			for( size_t c=0; c < cols; c++ ) {
+				B[idx_2_to_1(i, c, cols)] = rat_sub(B[idx_2_to_1(i, c, cols)], rat_mul(u, B[idx_2_to_1(j, c, cols)]));
+			}
+		}
+		rat const d = LU[idx_2_to_1(i, i, n)];
+		for( size_t c=0; c < cols; c++ ) {
+			B[idx_2_to_1(i, c, cols)] = rat_div(B[idx_2_to_1(i, c, cols)], d);
+		}
+	}
+}
+
+/**
+ * Symbolic LU over a nonzero pattern, for factoring without pivoting.
+ * Nodal matrices are diagonally dominant, so the pivots can stay on the diagonal
+ * and the pattern, fill and schedule only depend on the topology.
+ * Analyze once, then factor and solve as many value sets as needed.
+ * - L_rows[i]: columns j < i where L is nonzero, fill included.
+ * - U_rows[i]: columns j > i where U is nonzero, fill included.
+ * - parent: elimination tree of the symmetrized pattern, `n` marks a root.
+ * - *_order: columns bucketed by level, *_levels[l] is where level l starts.
+ *   Nothing in a level depends on anything else in that level.
+ *   factor:   height in the elimination tree, a column waits only on its descendants.
+ *   forward:  dependency depth of L*y = b.
+ *   backward: dependency depth of U*x = y.
+ */
+struct LUSymbolic {
+	size_t  L_rows[MAX_NODES], U_rows[MAX_NODES];
+	uint8_t parent[MAX_NODES];
+	uint8_t factor_order[MAX_NODES], forward_order[MAX_NODES], backward_order[MAX_NODES];
+	uint8_t factor_levels[MAX_NODES+1], forward_levels[MAX_NODES+1], backward_levels[MAX_NODES+1];
+	uint8_t n, factor_depth, forward_depth, backward_depth;
+};
+
+/// counting sort of columns by level, returns the number of levels.
+CIRCUIT_EXPORT size_t lu_schedule(size_t const n, uint8_t const level[const restrict static n], uint8_t order[const restrict static n], uint8_t starts[const restrict static n+1]) {
+	size_t depth = 0;
+	for( size_t i=0; i < n; i++ ) {
+		if( level[i] + 1U > depth ) {
+			depth = level[i] + 1U;
+		}
+	}
+	memset(starts, 0, n+1);
+	for( size_t i=0; i < n; i++ ) {
+		starts[level[i] + 1]++;
+	}
+	for( size_t l=0; l < depth; l++ ) {
+		starts[l+1] += starts[l];
+	}
+	uint8_t fill[MAX_NODES+1] = {0};
+	for( size_t i=0; i < n; i++ ) {
+		order[starts[level[i]] + fill[level[i]]++] = i;
+	}
+	return depth;
+}
+
+/// `rows[i]` is the bitflag of nonzero columns in row i.
+CIRCUIT_EXPORT NO_NULLS void lu_symbolic_from_pattern(size_t const n, size_t const rows[const restrict static n], struct LUSymbolic *const restrict sym) {
+	*sym = (struct LUSymbolic){ .n = n };
+	size_t P[MAX_NODES] = {0};
+	for( size_t i=0; i < n; i++ ) {
+		P[i] |= rows[i] | (1 << i);
+		for( size_t j=0; j < n; j++ ) {
+			if( rows[i] & (1 << j) ) {
+				P[j] |= (1 << i);
+			}
+		}
+	}
+	/// symbolic elimination, eliminating k fills row i with k's pattern past k.
+	for( size_t k=0; k < n; k++ ) {
+		size_t const past_k = P[k] & ~((2U << k) - 1);
+		for( size_t i=k+1; i < n; i++ ) {
+			if( P[i] & (1 << k) ) {
+				P[i] |= past_k;
+			}
+		}
+	}
+	
+	uint8_t height[MAX_NODES] = {0}, fwd[MAX_NODES] = {0}, bwd[MAX_NODES] = {0};
+	for( size_t k=0; k < n; k++ ) {
+		sym->L_rows[k] = P[k] & ((1U << k) - 1);
+		sym->U_rows[k] = P[k] & ~((2U << k) - 1);
+		sym->parent[k] = n;
+		for( size_t i=k+1; i < n; i++ ) {
+			if( sym->U_rows[k] & (1 << i) ) {
+				sym->parent[k] = i;
+				break;
+			}
+		}
+		if( sym->parent[k] < n && height[k] + 1 > height[sym->parent[k]] ) {
+			height[sym->parent[k]] = height[k] + 1;
+		}
+		for( size_t j=0; j < k; j++ ) {
+			if( (sym->L_rows[k] & (1 << j)) && fwd[j] + 1 > fwd[k] ) {
+				fwd[k] = fwd[j] + 1;
+			}
+		}
+	}
+	for( size_t k=n; k-- > 0; ) {
+		for( size_t j=k+1; j < n; j++ ) {
+			if( (sym->U_rows[k] & (1 << j)) && bwd[j] + 1 > bwd[k] ) {
+				bwd[k] = bwd[j] + 1;
+			}
+		}
+	}
+	sym->factor_depth   = lu_schedule(n, height, sym->factor_order,   sym->factor_levels);
+	sym->forward_depth  = lu_schedule(n, fwd,    sym->forward_order,  sym->forward_levels);
+	sym->backward_depth = lu_schedule(n, bwd,    sym->backward_order, sym->backward_levels);
+}
+
+CIRCUIT_EXPORT NO_NULLS void lu_symbolic(size_t const n, rat const A[const restrict static n*n], struct LUSymbolic *const restrict sym) {
+	size_t rows[MAX_NODES] = {0};
+	rat const eps = rat_epsilon();
+	for( size_t i=0; i < n; i++ ) {
+		for( size_t j=0; j < n; j++ ) {
+			if( !rat_lt(rat_abs(A[idx_2_to_1(i,j,n)]), eps) ) {
+				rows[i] |= (1 << j);
+			}
+		}
+	}
+	lu_symbolic_from_pattern(n, rows, sym);
+}
+
+/// column k of L and row k of U from k's descendants, false on a pivot under epsilon.
+CIRCUIT_EXPORT NO_NULLS bool lu_factor_column(struct LUSymbolic const *const restrict sym, rat A[const restrict], size_t const k) {
+	size_t const n = sym->n;
+	/// diagonal and column k of L.
+	for( size_t i=k; i < n; i++ ) {
+		if( i > k && !(sym->L_rows[i] & (1 << k)) ) {
+			continue;
+		}
+		rat acc = A[idx_2_to_1(i,k,n)];
+		for( size_t j=0; j < k; j++ ) {
+			if( (sym->L_rows[i] & (1 << j)) && (sym->U_rows[j] & (1 << k)) ) {
+				acc = rat_sub(acc, rat_mul(A[idx_2_to_1(i,j,n)], A[idx_2_to_1(j,k,n)]));
+			}
+		}
+		A[idx_2_to_1(i,k,n)] = acc;
+	}
+	/// row k of U.
+	for( size_t i=k+1; i < n; i++ ) {
+		if( !(sym->U_rows[k] & (1 << i)) ) {
+			continue;
+		}
+		rat acc = A[idx_2_to_1(k,i,n)];
+		for( size_t j=0; j < k; j++ ) {
+			if( (sym->L_rows[k] & (1 << j)) && (sym->U_rows[j] & (1 << i)) ) {
+				acc = rat_sub(acc, rat_mul(A[idx_2_to_1(k,j,n)], A[idx_2_to_1(j,i,n)]));
+			}
+		}
+		A[idx_2_to_1(k,i,n)] = acc;
+	}
+	rat const pivot = A[idx_2_to_1(k,k,n)];
+	if( rat_lt(rat_abs(pivot), rat_epsilon()) ) {
+		return false;
+	}
+	for( size_t i=k+1; i < n; i++ ) {
+		if( sym->L_rows[i] & (1 << k) ) {
+			A[idx_2_to_1(i,k,n)] = rat_div(A[idx_2_to_1(i,k,n)], pivot);
+		}
+	}
+	return true;
+}
+
+/// one level of a schedule, what the par_for bodies below get.
+struct LULevel {
+	struct LUSymbolic const *sym;
+	rat                     *A;   /// factored in place.
+	rat               const *LU;  /// or solved with.
+	rat                     *b;
+	uint8_t           const *order;
+	bool                    *ok;  /// by position in `order`.
+};
+
+CIRCUIT_EXPORT void lu_factor_level_body(void *const ctx, size_t const o, size_t const worker) {
+	struct LULevel const *const lvl = ctx;
+	( void )(worker);
+	lvl->ok[o] = lu_factor_column(lvl->sym, lvl->A, lvl->order[o]);
+}
+
+/**
+ * Numeric Crout LU on the symbolic pattern, in place, walking the elimination tree level by level.
+ * Column k of L and row k of U only read columns/rows of k's descendants,
+ * so the columns within a level are factored by par_for, concurrently on PC.
+ * Returns false on a pivot under epsilon, `A` is then garbage and the caller should pivot densely.
+ */
+CIRCUIT_EXPORT NO_NULLS bool lu_factor_scheduled(struct LUSymbolic const *const restrict sym, rat A[const restrict]) {
+	for( size_t l=0; l < sym->factor_depth; l++ ) {
+		size_t const start = sym->factor_levels[l], width = sym->factor_levels[l+1] - start;
+		bool ok[MAX_NODES] = {0};
+		struct LULevel lvl = { .sym = sym, .A = A, .order = &sym->factor_order[start], .ok = ok };
+		par_for(width, lu_factor_level_body, &lvl);
+		for( size_t o=0; o < width; o++ ) {
+			if( !ok[o] ) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+CIRCUIT_EXPORT void lu_forward_level_body(void *const ctx, size_t const o, size_t const worker) {
+	struct LULevel const *const lvl = ctx;
+	( void )(worker);
+	size_t const n = lvl->sym->n, i = lvl->order[o];
+	for( size_t j=0; j < i; j++ ) {
+		if( lvl->sym->L_rows[i] & (1 << j) ) {
+			lvl->b[i] = rat_sub(lvl->b[i], rat_mul(lvl->LU[idx_2_to_1(i,j,n)], lvl->b[j]));
+		}
+	}
+}
+
+CIRCUIT_EXPORT void lu_backward_level_body(void *const ctx, size_t const o, size_t const worker) {
+	struct LULevel const *const lvl = ctx;
+	( void )(worker);
+	size_t const n = lvl->sym->n, i = lvl->order[o];
+	for( size_t j=i+1; j < n; j++ ) {
+		if( lvl->sym->U_rows[i] & (1 << j) ) {
+			lvl->b[i] = rat_sub(lvl->b[i], rat_mul(lvl->LU[idx_2_to_1(i,j,n)], lvl->b[j]));
+		}
+	}
+	lvl->b[i] = rat_div(lvl->b[i], lvl->LU[idx_2_to_1(i,i,n)]);
+}
+
+/// level-scheduled forward/back substitution on `b` in place, each level through par_for.
+CIRCUIT_EXPORT NO_NULLS void lu_solve_scheduled(struct LUSymbolic const *const restrict sym, rat const LU[const restrict], rat b[const restrict]) {
+	struct LULevel lvl = { .sym = sym, .LU = LU, .b = b };
+	for( size_t l=0; l < sym->forward_depth; l++ ) {
+		lvl.order = &sym->forward_order[sym->forward_levels[l]];
+		par_for(sym->forward_levels[l+1] - sym->forward_levels[l], lu_forward_level_body, &lvl);
+	}
+	for( size_t l=0; l < sym->backward_depth; l++ ) {
+		lvl.order = &sym->backward_order[sym->backward_levels[l]];
+		par_for(sym->backward_levels[l+1] - sym->backward_levels[l], lu_backward_level_body, &lvl);
+	}
+}
+
+/**
+ * Solves A^T * x = b in place with the factors of A = L*U from lu_factor_scheduled.
+ * U^T is lower triangular and L^T unit upper, so it's a forward pass over U's columns
+ * then a backward pass over L's. Used for adjoint solves, no refactorization needed.
+ */
+CIRCUIT_EXPORT NO_NULLS void lu_solve_transposed(struct LUSymbolic const *const restrict sym, rat const LU[const restrict], rat b[const restrict]) {
+	size_t const n = sym->n;
+	for( size_t i=0; i < n; i++ ) {
+		for( size_t j=0; j < i; j++ ) {
+			if( sym->U_rows[j] & (1 << i) ) {
+				b[i] = rat_sub(b[i], rat_mul(LU[idx_2_to_1(j,i,n)], b[j]));
+			}
+		}
+		b[i] = rat_div(b[i], LU[idx_2_to_1(i,i,n)]);
+	}
+	for( size_t i=n; i-- > 0; ) {
+		for( size_t j=i+1; j < n; j++ ) {
+			if( sym->L_rows[j] & (1 << i) ) {
+				b[i] = rat_sub(b[i], rat_mul(LU[idx_2_to_1(j,i,n)], b[j]));
+			}
+		}
+	}
+}
+
+/**
+ * Rows a partial solve for x[targets] has to touch, both bitflags over matrix ids.
+ * - back: x[i] reads x[j] for every j in U_rows[i], closed from the targets.
+ * - forward: y[i] reads y[j] for every j in L_rows[i], closed from `back`.
+ * `forward` is also closed under row-wise factorization, row i of L and U only read
+ * rows L_rows[i] of U, so those are the only rows worth factoring.
+ */
+CIRCUIT_EXPORT NO_NULLS void lu_reach(struct LUSymbolic const *const restrict sym, size_t const targets, size_t *const restrict forward, size_t *const restrict back) {
+	size_t const n = sym->n;
+	/// U_rows only points up and L_rows only down, so one sweep each closes the set.
+	size_t b = targets;
+	for( size_t i=0; i < n; i++ ) {
+		if( b & (1 << i) ) {
+			b |= sym->U_rows[i];
+		}
+	}
+	size_t f = b;
+	for( size_t i=n; i-- > 0; ) {
+		if( f & (1 << i) ) {
+			f |= sym->L_rows[i];
+		}
+	}
+	*forward = f;
+	*back    = b;
+}
+
+/**
+ * Row-wise Doolittle on the symbolic pattern restricted to `rows`, in place.
+ * `rows` has to be closed the way lu_reach's forward set is. Rows outside it are left
+ * as they were. Returns false on a pivot under epsilon.
+ */
+CIRCUIT_EXPORT NO_NULLS bool lu_factor_rows(struct LUSymbolic const *const restrict sym, size_t const rows, rat A[const restrict]) {
+	size_t const n = sym->n;
+	rat const eps = rat_epsilon();
+	for( size_t i=0; i < n; i++ ) {
+		if( !(rows & (1 << i)) ) {
+			continue;
+		}
+		for( size_t j=0; j < n; j++ ) {
+			size_t const cols = j < i? sym->L_rows[i] : sym->U_rows[i] | (1 << i);
+			if( !(cols & (1 << j)) ) {
+				continue;
+			}
+			rat acc = A[idx_2_to_1(i,j,n)];
+			size_t const before = j < i? j : i;
+			for( size_t m=0; m < before; m++ ) {
+				if( (sym->L_rows[i] & (1 << m)) && (sym->U_rows[m] & (1 << j)) ) {
+					acc = rat_sub(acc, rat_mul(A[idx_2_to_1(i,m,n)], A[idx_2_to_1(m,j,n)]));
+				}
+			}
+			if( j < i ) {
+				acc = rat_div(acc, A[idx_2_to_1(j,j,n)]);
+			} else if( j==i && rat_lt(rat_abs(acc), eps) ) {
+				return false;
+			}
+			A[idx_2_to_1(i,j,n)] = acc;
+		}
+	}
+	return true;
+}
+
+/// forward substitution over `forward` and back substitution over `back` only, from lu_reach.
+CIRCUIT_EXPORT NO_NULLS void lu_solve_partial(struct LUSymbolic const *const restrict sym, rat const LU[const restrict], size_t const forward, size_t const back, rat b[const restrict]) {
+	size_t const n = sym->n;
+	for( size_t i=0; i < n; i++ ) {
+		if( !(forward & (1 << i)) ) {
+			continue;
+		}
+		for( size_t j=0; j < i; j++ ) {
+			if( sym->L_rows[i] & (1 << j) ) {
+				b[i] = rat_sub(b[i], rat_mul(LU[idx_2_to_1(i,j,n)], b[j]));
+			}
+		}
+	}
+	for( size_t i=n; i-- > 0; ) {
+		if( !(back & (1 << i)) ) {
+			continue;
+		}
+		for( size_t j=i+1; j < n; j++ ) {
+			if( sym->U_rows[i] & (1 << j) ) {
+				b[i] = rat_sub(b[i], rat_mul(LU[idx_2_to_1(i,j,n)], b[j]));
+			}
+		}
+		b[i] = rat_div(b[i], LU[idx_2_to_1(i,i,n)]);
+	}
+}
 
 
 enum {
+	ERR_BAD_EXPR  = -5,
+	ERR_SINGULAR  = -4,
+	ERR_BAD_PORT  = -3,
 	ERR_NODE_OOB  = -2,
 	ERR_OOM       = -1,
 	ERR_SELF_LOOP = +0,
 	ERR_OK        = +1,
 };
 
+/// a subcircuit reduced to its ports, see macromodel.h.
+/// the parent stamps `Y` and `J` directly, the internals are never solved again.
+struct Macromodel {
+	rat    *Y;     /// ports x ports admittance, row-major.
+	rat    *J;     /// equivalent current injected into each port.
+	uint8_t ports;
+};
+
+/// one placement of a Macromodel, `nodes[i]` is the parent node tied to port i.
+struct MacroInstance {
+	struct Macromodel const *model;
+	uint8_t                  nodes[MAX_NODES];
+};
+
+/// a nonlinear device as placed, nonlinear.h copies it into a DeviceBatch to evaluate it.
+struct Device {
+	rat     p[2];      /// model parameters.
+	uint8_t nodes[3];  /// D: anode cathode, M: drain gate source, Q: collector base emitter.
+};
+
 /// represents a component that's connected to between two nodes.
 /// 24 bytes.
 /// Using linked list to save memory (ironically).
@@ -275,6 +770,8 @@ struct Comp {
 	union {
 		rat current;
 		struct { uint8_t np, nn, _pad; } dep;
+		struct MacroInstance const *macro;
+		struct Device              *dev;
 	} aux;
 	struct Comp *next; /// ptrs are 3 bytes on the TI8*.
 	rat        value;
@@ -319,6 +816,18 @@ CIRCUIT_EXPORT NO_NULLS void circuit_connect_component(
 	c->active_nodes |= (1 << n1) | (1 << n2);
 }
 
+/// removes `comp` from its owner's list, memory stays on the bistack.
+CIRCUIT_EXPORT NO_NULLS bool circuit_unlink_component(struct Circuit *const c, struct Comp *const comp) {
+	for( struct Comp **link = &c->components[comp->owner]; *link != NULL; link = &(*link)->next ) {
+		if( *link==comp ) {
+			*link = comp->next;
+			comp->next = NULL;
+			return true;
+		}
+	}
+	return false;
+}
+
 CIRCUIT_EXPORT NO_NULLS int circuit_add_component(
 	struct Circuit *const c,
 	uint8_t         const n1,
@@ -340,6 +849,71 @@ CIRCUIT_EXPORT NO_NULLS int circuit_add_component(
 	return ERR_OK;
 }
 
+/// terminal count of a nonlinear device kind, 0 for everything else.
+CIRCUIT_EXPORT size_t device_terminals(uint8_t const kind) {
+	switch( kind ) {
+		case COMP_DIODE:                return 2;
+		case COMP_MOSFET: case COMP_BJT: return 3;
+	}
+	return 0;
+}
+
+/// the value numeric field `field` of a component's line sets, NULL past the last one.
+/// devices keep theirs in the Device.
+CIRCUIT_EXPORT NO_NULLS rat *comp_param_ref(struct Comp *const cmp, size_t const field) {
+	if( device_terminals(cmp->kind) > 0 ) {
+		return field < 2? &cmp->aux.dev->p[field] : NULL;
+	}
+	return field==0? &cmp->value : NULL;
+}
+
+/// places a nonlinear device, `nodes` in the order listed in struct Device.
+CIRCUIT_EXPORT NO_NULLS int circuit_add_device(
+	struct Circuit *const restrict c,
+	uint8_t         const          kind,
+	uint8_t         const          nodes[const restrict static 3],
+	rat             const          p0,
+	rat             const          p1
+) {
+	size_t const terminals = device_terminals(kind);
+	/// stamped from its owner's list, so the owner can't be ground.
+	size_t owner = terminals, other = terminals;
+	for( size_t t=0; t < terminals; t++ ) {
+		if( nodes[t] >= MAX_NODES ) {
+			return ERR_NODE_OOB;
+		} else if( owner==terminals && !node_is_ground(nodes[t]) ) {
+			owner = t;
+		}
+	}
+	for( size_t t=0; t < terminals && owner < terminals; t++ ) {
+		if( other==terminals && nodes[t] != nodes[owner] ) {
+			other = t;
+		}
+	}
+	/// tying terminals together is fine (diode-connected), tying all of them isn't.
+	if( owner==terminals || other==terminals ) {
+		return ERR_SELF_LOOP;
+	}
+	struct Device *const dev = bistack_alloc_back(&c->bistack, sizeof *dev);
+	if( dev==NULL ) {
+		return ERR_OOM;
+	}
+	dev->p[0] = p0;
+	dev->p[1] = p1;
+	size_t node_bits = 0;
+	for( size_t t=0; t < terminals; t++ ) {
+		dev->nodes[t] = nodes[t];
+		node_bits |= (1 << nodes[t]);
+	}
+	struct Comp *const comp = component_new(&c->bistack, p0, kind, nodes[other]);
+	if( comp==NULL ) {
+		return ERR_OOM;
+	}
+	comp->aux.dev = dev;
+	circuit_connect_component(c, nodes[owner], nodes[other], comp);
+	c->active_nodes |= node_bits;
+	return ERR_OK;
+}
 
 CIRCUIT_EXPORT int circuit_add_from_line(struct Circuit *const restrict c, char const line[const restrict static 1]) {
 	size_t i=0;
@@ -354,6 +928,10 @@ CIRCUIT_EXPORT int circuit_add_from_line(struct Circuit *const restrict c, char
 	}
 	i++;
 	uint8_t const kind = kind_from_letter(letter);
+	/// instances need their .subckt, the deck places them.
+	if( kind==COMP_MACROMODEL ) {
+		return ERR_OK;
+	}
 	
 	uint8_t n1 = 0, n2 = 0;
 	char val_tok[48] = {0};
@@ -375,6 +953,27 @@ CIRCUIT_EXPORT int circuit_add_from_line(struct Circuit *const restrict c, char
 		return ERR_OK;
 	}
 	
+	if( device_terminals(kind) > 0 ) {
+		/// D a k [Is], M d g s [K [Vt]], Q c b e [Is [beta]]
+		uint8_t nodes[3] = {0};
+		char p1_tok[48] = {0};
+		int const got = kind==COMP_DIODE?
+			sscanf(line, " %c %hhu %hhu %47s", &letter, &nodes[0], &nodes[1], val_tok) - 3 :
+			sscanf(line, " %c %hhu %hhu %hhu %47s %47s", &letter, &nodes[0], &nodes[1], &nodes[2], val_tok, p1_tok) - 4;
+		if( got < 0 ) {
+			return ERR_OK;
+		}
+		rat p0 = kind==COMP_MOSFET? float_to_rat(1E-3f) : float_to_rat(1E-14f);
+		rat p1 = kind==COMP_MOSFET? rat_pos1() : rat_from_int(100);
+		if( got >= 1 ) {
+			p0 = parse_si_scalar(val_tok);
+		}
+		if( got >= 2 ) {
+			p1 = parse_si_scalar(p1_tok);
+		}
+		return circuit_add_device(c, kind, nodes, p0, p1);
+	}
+	
 	if( sscanf(line, " %c %hhu %hhu %47s", &letter, &n1, &n2, val_tok) < 4 ) {
 		return ERR_OK;
 	}
@@ -420,8 +1019,185 @@ CIRCUIT_EXPORT struct Circuit circuit_make(size_t const memory_size, uint8_t mem
 	return circ;
 }
 
-CIRCUIT_EXPORT size_t circuit_build_dc(
+/// one entry of a component's contribution, `col==STAMP_RHS` lands in the right-hand side.
+struct Stamp {
+	rat     val;
+	uint8_t row, col;
+};
+
+enum {
+	STAMP_RHS        = 0xFF,
+	STAMP_PART_GRAIN = 64,   /// fewest stamps worth handing a partition to another thread.
+};
+
+/// triplet buffer, `len` keeps counting past `cap` so a zero-cap buffer measures a pass.
+struct StampBuffer {
+	struct Stamp *data;
+	size_t        len, cap;
+};
+
+CIRCUIT_EXPORT NO_NULLS void stamp_push(struct StampBuffer *const buf, uint8_t const row, uint8_t const col, rat const val) {
+	if( buf->len < buf->cap ) {
+		buf->data[buf->len] = (struct Stamp){ .val = val, .row = row, .col = col };
+	}
+	buf->len++;
+}
+
+/// adds the triplets into G/rhs in buffer order.
+CIRCUIT_EXPORT NO_NULLS void stamps_apply(struct StampBuffer const *const buf, size_t const n, rat G[const restrict static n*n], rat rhs[const restrict static n]) {
+	for( size_t i=0; i < buf->len && i < buf->cap; i++ ) {
+		struct Stamp const *const st = &buf->data[i];
+		if( st->col==STAMP_RHS ) {
+			rhs[st->row] = rat_add(rhs[st->row], st->val);
+		} else {
+			size_t const rc = idx_2_to_1(st->row, st->col, n);
+			G[rc] = rat_add(G[rc], st->val);
+		}
+	}
+}
+
+/// the usual two-terminal conductance pattern between matrix ids a and b.
+CIRCUIT_EXPORT NO_NULLS void stamp_push_conductance(struct StampBuffer *const buf, uint8_t const a, uint8_t const b, bool const b_g, rat const g) {
+	stamp_push(buf, a, a, g);
+	if( !b_g ) {
+		stamp_push(buf, b, b, g);
+		stamp_push(buf, a, b, rat_neg(g));
+		stamp_push(buf, b, a, rat_neg(g));
+	}
+}
+
+/// emits the DC stamps of a single component.
+CIRCUIT_EXPORT NO_NULLS void comp_stamp_dc(struct Comp const *const cmp, uint8_t const (*const node_to_matrix_id)[MAX_NODES], struct StampBuffer *const buf) {
+	uint8_t const a = (*node_to_matrix_id)[cmp->owner];
+	bool const b_g = node_is_ground(cmp->node);
+	uint8_t const b = b_g? a : (*node_to_matrix_id)[cmp->node];
+	switch( cmp->kind ) {
+		case COMP_RESISTOR: {
+			if( rat_lt(rat_abs(cmp->value), rat_epsilon()) ) {
+				/// TODO: ideal wire
+				break;
+			}
+			stamp_push_conductance(buf, a, b, b_g, rat_div(rat_pos1(), cmp->value));
+			break;
+		}
+		case COMP_DC_CURRENT_SRC: {
+			rat const amps = cmp->value;
+			/// I A+ B- amps ==> A --I-> B
+			/// 0 = vA/R + amps
+			stamp_push(buf, a, STAMP_RHS, rat_neg(amps));
+			if( !b_g ) {
+				stamp_push(buf, b, STAMP_RHS, amps);
+			}
+			break;
+		}
+		case COMP_DC_VOLTAGE_SRC: { /// TODO:
+			/*
+			rat const voltage = cmp->value;
+			if( !b_g ) {
+				/// supernode.
+			}
+			//*/
+			break;
+		}
+		case COMP_VCCS: { /// TODO:
+			/*
+			uint8_t const cp = cmp->aux.ctrl_p;
+			uint8_t const cm = cmp->aux.ctrl_m;
+			rat   const gm = cmp->value;
+			//*/
+			break;
+		}
+		case COMP_VCVS: { /// TODO:
+			/*
+			uint8_t const cp = cmp->aux.ctrl_p;
+			uint8_t const cm = cmp->aux.ctrl_m;
+			bool const a_g = node_is_ground(a);
+			bool const b_g = node_is_ground(b);
+			if( a_g && b_g ) {
+				/// degenerate
+				break;
+			}
+			//*/
+			break;
+		}
+		case COMP_CCVS: { /// TODO:
+			/*
+			uint8_t const cp = cmp->aux.ctrl_p;
+			uint8_t const cm = cmp->aux.ctrl_m;
+			/// if device is shorted to itself or control pins invalid, skip.
+			if( a==b || cp==cm ) {
+				break;
+			}
+			//*/
+			break;
+		}
+		case COMP_CCCS: { /// TODO:
+			/*
+			rat const coef = cmp->value;
+			uint8_t const cp = cmp->aux.dep.np;
+			uint8_t const cm = cmp->aux.dep.nn;
+			if( a==b || cp==cm ) {
+				/// self-loop
+				break;
+			}
+			//*/
+			break;
+		}
+		case COMP_MACROMODEL: {
+			struct MacroInstance const *const inst = cmp->aux.macro;
+			struct Macromodel    const *const mm   = inst->model;
+			for( size_t i=0; i < mm->ports; i++ ) {
+				if( node_is_ground(inst->nodes[i]) ) {
+					continue;
+				}
+				uint8_t const r = (*node_to_matrix_id)[inst->nodes[i]];
+				stamp_push(buf, r, STAMP_RHS, mm->J[i]);
+				for( size_t j=0; j < mm->ports; j++ ) {
+					if( node_is_ground(inst->nodes[j]) ) {
+						continue;
+					}
+					stamp_push(buf, r, (*node_to_matrix_id)[inst->nodes[j]], mm->Y[idx_2_to_1(i,j,mm->ports)]);
+				}
+			}
+			break;
+		}
+	}
+}
+
+/// stamps every component listed under nodes [first, end).
+CIRCUIT_EXPORT NO_NULLS void circuit_stamp_nodes(struct Circuit const *const c, uint8_t const first, uint8_t const end, uint8_t const (*const node_to_matrix_id)[MAX_NODES], struct StampBuffer *const buf) {
+	for( uint8_t node=first; node < end; node++ ) {
+		for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+			comp_stamp_dc(cmp, node_to_matrix_id, buf);
+		}
+	}
+}
+
+/// what each partition's par_for body stamps from and into.
+struct StampPartitions {
+	struct Circuit const *c;
+	uint8_t       const (*n2m)[MAX_NODES];
+	uint8_t       const *bounds;
+	struct StampBuffer  *bufs;
+};
+
+CIRCUIT_EXPORT void stamp_partition_body(void *const ctx, size_t const p, size_t const worker) {
+	struct StampPartitions const *const sp = ctx;
+	( void )(worker);
+	circuit_stamp_nodes(sp->c, sp->bounds[p], sp->bounds[p+1], sp->n2m, &sp->bufs[p]);
+}
+
+/**
+ * Builds the DC system with the node lists split into `parts` partitions.
+ * Every partition stamps into its own triplet buffer carved off the front stack,
+ * then the buffers are merged in partition order. That's the same order the serial
+ * walk adds things in, so G and I come out bit-identical for any `parts`.
+ * The partitions don't share anything until the merge, so they stamp through par_for.
+ * There are never so many that one gets fewer than STAMP_PART_GRAIN stamps.
+ */
+CIRCUIT_EXPORT size_t circuit_build_dc_partitioned(
 	struct Circuit *const restrict c,
+	size_t                         parts,
 	uint8_t       (*const restrict matrix_id_to_node_out)[MAX_NODES],
 	rat                        **G_out,
 	rat                        **I_out
@@ -437,112 +1213,85 @@ CIRCUIT_EXPORT size_t circuit_build_dc(
 	/// allocate our matrices.
 	*G_out = alloc_vec(&c->bistack, n*n);
 	*I_out = alloc_vec(&c->bistack, n);
-	rat const eps = rat_epsilon();
+	if( *G_out==NULL || *I_out==NULL ) {
+		return n;
+	}
+	uint8_t const (*const n2m)[MAX_NODES] = ( uint8_t const(*)[MAX_NODES] )(&node_to_matrix_id);
+	
+	/// split the node lists so each partition gets about the same number of stamps.
+	size_t per_node[MAX_NODES] = {0};
+	size_t total = 0;
 	for( uint8_t node=1; node < MAX_NODES; node++ ) {
-		for( struct Comp *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
-			uint8_t const a = node_to_matrix_id[node];
-			switch( cmp->kind ) {
-				case COMP_RESISTOR: {
-					if( rat_lt(rat_abs(cmp->value), eps) ) {
-						/// TODO: ideal wire
-						continue;
-					}
-					rat const g = rat_div(rat_pos1(), cmp->value);
-					if( node_is_ground(cmp->node) ) {
-						(*G_out)[idx_2_to_1(a,a,n)] = rat_add((*G_out)[idx_2_to_1(a,a,n)], g);
-					} else {
-						uint8_t const b = node_to_matrix_id[cmp->node];
-						(*G_out)[idx_2_to_1(a,a,n)] = rat_add((*G_out)[idx_2_to_1(a,a,n)], g);
-						(*G_out)[idx_2_to_1(b,b,n)] = rat_add((*G_out)[idx_2_to_1(b,b,n)], g);
-						(*G_out)[idx_2_to_1(a,b,n)] = rat_sub((*G_out)[idx_2_to_1(a,b,n)], g);
-						(*G_out)[idx_2_to_1(b,a,n)] = rat_sub((*G_out)[idx_2_to_1(b,a,n)], g);
-					}
-					break;
-				}
-				case COMP_DC_CURRENT_SRC: {
-					rat const amps = cmp->value;
-					/// I A+ B- amps ==> A --I-> B
-					/// 0 = vA/R + amps
-					(*I_out)[a] = rat_sub((*I_out)[a], amps);
-					if( !node_is_ground(cmp->node) ) {
-						uint8_t const b = node_to_matrix_id[cmp->node];
-						(*I_out)[b] = rat_add((*I_out)[b], amps);
-					}
-					break;
-				}
-				case COMP_DC_VOLTAGE_SRC: { /// TODO:
-					bool const b_g = node_is_ground(cmp->node);
-					rat const voltage = cmp->value;
-					if( !node_is_ground(cmp->node) ) {
-						/// supernode.
-						uint8_t const b = node_to_matrix_id[cmp->node];
-					} else {
-						
-					}
-					break;
-				}
-				case COMP_VCCS: { /// TODO:
-					/*
-					uint8_t const cp = cmp->aux.ctrl_p;
-					uint8_t const cm = cmp->aux.ctrl_m;
-					rat   const gm = cmp->value;
-					//*/
-					break;
-				}
-				case COMP_VCVS: { /// TODO:
-					/*
-					uint8_t const cp = cmp->aux.ctrl_p;
-					uint8_t const cm = cmp->aux.ctrl_m;
-					bool const a_g = node_is_ground(a);
-					bool const b_g = node_is_ground(b);
-					if( a_g && b_g ) {
-						/// degenerate
-						break;
-					}
-					//*/
-					break;
-				}
-				case COMP_CCVS: { /// TODO:
-					/*
-					uint8_t const cp = cmp->aux.ctrl_p;
-					uint8_t const cm = cmp->aux.ctrl_m;
-					/// if device is shorted to itself or control pins invalid, skip.
-					if( a==b || cp==cm ) {
-						break;
-					}
-					//*/
-					break;
-				}
-				case COMP_CCCS: { /// TODO:
-					rat const coef = cmp->value;
-					uint8_t const cp = cmp->aux.dep.np;
-					uint8_t const cm = cmp->aux.dep.nn;
-					if( a==b || cp==cm ) {
-						/// self-loop
-						continue;
-					}
-					if( !node_is_ground(cmp->node) ) {
-						uint8_t const b = node_to_matrix_id[cmp->node];
-						
-					}
-					break;
-				}
-			}
+		struct StampBuffer counter = {0};
+		circuit_stamp_nodes(c, node, node+1, n2m, &counter);
+		per_node[node] = counter.len;
+		total += counter.len;
+	}
+	if( parts > total / STAMP_PART_GRAIN ) {
+		parts = total / STAMP_PART_GRAIN;
+	}
+	if( parts==0 ) {
+		parts = 1;
+	} else if( parts > MAX_NODES-1 ) {
+		parts = MAX_NODES-1;
+	}
+	uint8_t bounds[MAX_NODES+1] = {0};
+	bounds[0] = 1;
+	for( size_t p=1, node=1, acc=0; p < parts; p++ ) {
+		while( node < MAX_NODES-1 && acc + per_node[node] <= (total * p) / parts ) {
+			acc += per_node[node++];
+		}
+		bounds[p] = node;
+	}
+	bounds[parts] = MAX_NODES;
+	
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	struct StampBuffer bufs[MAX_NODES] = {0};
+	for( size_t p=0; p < parts; p++ ) {
+		size_t cap = 0;
+		for( uint8_t node=bounds[p]; node < bounds[p+1]; node++ ) {
+			cap += per_node[node];
+		}
+		bufs[p].cap  = cap;
+		bufs[p].data = bistack_alloc_front_vec(&c->bistack, cap + 1, sizeof *bufs[p].data);
+		if( bufs[p].data==NULL ) {
+			*G_out = NULL;
+			return n;
 		}
 	}
+	struct StampPartitions sp = { .c = c, .n2m = n2m, .bounds = bounds, .bufs = bufs };
+	par_for(parts, stamp_partition_body, &sp);
+	for( size_t p=0; p < parts; p++ ) {
+		stamps_apply(&bufs[p], n, *G_out, *I_out);
+	}
+	bistack_release_front(&c->bistack, mark);
 	return n;
 }
 
-CIRCUIT_EXPORT NO_NULLS void circuit_solve_dc(struct Circuit *const c) {
+CIRCUIT_EXPORT size_t circuit_build_dc(
+	struct Circuit *const restrict c,
+	uint8_t       (*const restrict matrix_id_to_node_out)[MAX_NODES],
+	rat                        **G_out,
+	rat                        **I_out
+) {
+	/// one partition per thread, a single one on the calculator.
+	return circuit_build_dc_partitioned(c, par_threads(), matrix_id_to_node_out, G_out, I_out);
+}
+
+CIRCUIT_EXPORT NO_NULLS void circuit_solve_dc(struct Circuit *const restrict c, FILE *const restrict out) {
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
 	uint8_t matrix_id_to_node[MAX_NODES] = {0};
 	rat *G = NULL;
 	rat *V = NULL;
 	size_t const n = circuit_build_dc(c, &matrix_id_to_node, &G, &V);
 	if( n==0 || G==NULL || V==NULL ) {
-		bistack_reset_front(&c->bistack);
+		if( n > 0 ) {
+			fputs("dc: out of memory\n", out);
+		}
+		bistack_release_front(&c->bistack, mark);
 		return;
 	}
-	print_matrix(n, G, V);
+	print_matrix(n, G, V, out);
 	/**
 R 1 0 -2E3
 R 1 3 2E3
@@ -555,9 +1304,51 @@ I 2 0 2E-3
 	if( gaussian_rref(n, G, V) != RREFResultBadMatrix ) {
 		for( size_t i=0; i < n; i++ ) {
 			char num[48] = {0};
-			printf("V%u = %s\n", matrix_id_to_node[i], rat_to_cstr(V[i], sizeof num, num));
+			fprintf(out, "V%u = %s\n", matrix_id_to_node[i], rat_to_cstr(V[i], sizeof num, num));
+		}
+	} else {
+		fputs("dc: singular circuit\n", out);
+	}
+	bistack_release_front(&c->bistack, mark);
+}
+
+/// solves the DC system and scatters the results by node number, ground and inactive nodes read 0.
+/// tries the scheduled sparse LU first and only falls back to gaussian_rref when a pivot vanishes.
+/// only its own front scratch is released, a caller's stays.
+CIRCUIT_EXPORT NO_NULLS enum RREFResult circuit_dc_voltages(struct Circuit *const c, rat (*const V_out)[MAX_NODES]) {
+	for( size_t i=0; i < MAX_NODES; i++ ) {
+		(*V_out)[i] = rat_zero();
+	}
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	uint8_t matrix_id_to_node[MAX_NODES] = {0};
+	rat *G = NULL;
+	rat *V = NULL;
+	size_t const n = circuit_build_dc(c, &matrix_id_to_node, &G, &V);
+	if( n==0 || G==NULL || V==NULL ) {
+		bistack_release_front(&c->bistack, mark);
+		return RREFResultOk;
+	}
+	struct LUSymbolic sym;
+	lu_symbolic(n, G, &sym);
+	enum RREFResult res = RREFResultOk;
+	if( lu_factor_scheduled(&sym, G) ) {
+		lu_solve_scheduled(&sym, G, V);
+	} else {
+		/// the failed factorization clobbered G, build it again.
+		bistack_release_front(&c->bistack, mark);
+		( void )(circuit_build_dc(c, &matrix_id_to_node, &G, &V));
+		if( G==NULL || V==NULL ) {
+			bistack_release_front(&c->bistack, mark);
+			return RREFResultBadMatrix;
+		}
+		res = gaussian_rref(n, G, V);
+	}
+	if( res != RREFResultBadMatrix ) {
+		for( size_t i=0; i < n; i++ ) {
+			(*V_out)[matrix_id_to_node[i]] = V[i];
 		}
 	}
-	bistack_reset_front(&c->bistack);
+	bistack_release_front(&c->bistack, mark);
+	return res;
 }
 #endif
\ No newline at end of file
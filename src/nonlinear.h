@@ -0,0 +1,555 @@
+#ifndef NONLINEAR_H_INCLUDED
+#	define NONLINEAR_H_INCLUDED
+
+#include "node.h"
+
+
+/// Nonlinear DC operating point by Newton-Raphson.
+/// The linear part comes from circuit_build_dc once. Every iteration, each device is
+/// linearized at the present voltages and stamped on top:
+///   i_t(v) ≈ i_t + sum_k ∂i_t/∂vj_k * (vj_k(v) - vj_k)
+/// Devices are evaluated in per-kind batches so the exponentials go through rat_exp_vec.
+/// Junction voltages are limited between iterations (pnjlim for pn junctions, a step
+/// clamp for MOSFETs) so the exponentials can't run away.
+/// A device whose junction voltages barely moved isn't evaluated again, its last
+/// linearization is stamped as is. When the residual is dropping fast, the previous
+/// factorization is kept and the step becomes a chord step with the new residual.
+/// If plain Newton fails, gmin stepping is tried, then source stepping.
+/// Device models:
+///   D: Is (1E-14), emission coefficient 1.
+///   M: K (1m A/V^2) and Vt (1 V), square law, symmetric in drain/source.
+///   Q: Is (1E-14) and beta (100), reverse beta 1.
+
+enum {
+	NR_MAX_ITERS = 100,
+};
+
+enum {
+	NR_PLAIN = 0,
+	NR_GMIN_STEPPING,
+	NR_SOURCE_STEPPING,
+	NR_FAILED,
+};
+
+struct NRStats {
+	size_t  iterations, factorizations, reused, evaluations, bypassed;
+	uint8_t strategy;
+};
+
+/// what an NR iteration works on, by matrix id.
+struct NRSystem {
+	rat    *G, *rhs0;  /// the linear part.
+	rat    *A, *rhs;   /// G plus the device stamps.
+	rat    *LU, *F, *x;
+	uint8_t piv[MAX_NODES];
+	uint8_t matrix_id_to_node[MAX_NODES], node_to_matrix_id[MAX_NODES];
+	size_t  n;
+	bool    factored;
+};
+
+CIRCUIT_EXPORT rat thermal_voltage(void) {
+	return float_to_rat(0.025852f);
+}
+
+CIRCUIT_EXPORT rat device_gmin(void) {
+	return float_to_rat(1E-12f);
+}
+
+/// terminal indices (plus, minus) of junction k.
+CIRCUIT_EXPORT void device_junction(uint8_t const kind, size_t const k, uint8_t *const restrict p, uint8_t *const restrict m) {
+	switch( kind ) {
+		case COMP_DIODE:  *p = 0; *m = 1;                 break; /// Vak
+		case COMP_MOSFET: *p = k==0? 1 : 0; *m = 2;       break; /// Vgs, Vds
+		case COMP_BJT:    *p = 1; *m = k==0? 2 : 0;       break; /// Vbe, Vbc
+		default:          *p = *m = 0;                    break;
+	}
+}
+
+CIRCUIT_EXPORT size_t device_junctions(uint8_t const kind) {
+	return kind==COMP_DIODE? 1 : device_terminals(kind) > 0? 2 : 0;
+}
+
+/// SPICE's pnjlim, keeps a pn junction from jumping far up the exponential in one step.
+CIRCUIT_EXPORT rat pnjlim(rat vnew, rat const vold, rat const vt, rat const vcrit, bool *const restrict limited) {
+	if( rat_lt(vcrit, vnew) && rat_lt(rat_mul(rat_from_int(2), vt), rat_abs(rat_sub(vnew, vold))) ) {
+		if( rat_lt(rat_zero(), vold) ) {
+			rat const arg = rat_add(rat_pos1(), rat_div(rat_sub(vnew, vold), vt));
+			vnew = rat_lt(rat_zero(), arg)? rat_addmul(vold, vt, rat_ln(arg)) : vcrit;
+		} else {
+			vnew = rat_mul(vt, rat_ln(rat_div(vnew, vt)));
+		}
+		*limited = true;
+	}
+	return vnew;
+}
+
+CIRCUIT_EXPORT rat fetlim(rat const vnew, rat const vold, bool *const restrict limited) {
+	rat const step = rat_from_int(2);
+	rat const dv = rat_sub(vnew, vold);
+	if( rat_lt(step, rat_abs(dv)) ) {
+		*limited = true;
+		return rat_lt(rat_zero(), dv)? rat_add(vold, step) : rat_sub(vold, step);
+	}
+	return vnew;
+}
+
+/// the exponent of a junction's e^(v/vt), capped, pnjlim keeps real iterations far below the cap.
+CIRCUIT_EXPORT rat junction_arg(rat const v) {
+	return rat_min(rat_div(v, thermal_voltage()), rat_from_int(80));
+}
+
+/// devices of one kind, copied out of their Comps into one array per field so the
+/// junction exponents of neighbouring devices sit side by side for the array kernels.
+/// keeps each device's last linearization so one that didn't move can be bypassed.
+/// terminal currents flow from the node into the device.
+struct DeviceBatch {
+	rat     *p[2];       /// model parameters.
+	rat     *vcrit;      /// fixed by Is.
+	rat     *vj[2];      /// junction voltages of the last evaluation, after limiting.
+	rat     *i[3];       /// terminal currents there.
+	rat     *di[3][2];   /// ∂i[t]/∂vj[k].
+	rat     *arg[2];     /// gathered junction exponents of the devices that moved.
+	size_t  *moved;      /// which devices those are.
+	uint8_t *nodes[3];   /// D: anode cathode, M: drain gate source, Q: collector base emitter.
+	bool    *evaluated;
+	size_t   count;
+	uint8_t  kind;
+};
+
+/// rat arrays in a batch, carved from one allocation.
+enum { DEVICE_BATCH_RATS = 2 + 1 + 2 + 3 + 3*2 + 2 };
+
+enum { DEVICE_KINDS = 3 };
+
+CIRCUIT_EXPORT uint8_t device_kind_at(size_t const i) {
+	static uint8_t const kinds[DEVICE_KINDS] = { COMP_DIODE, COMP_MOSFET, COMP_BJT };
+	return kinds[i];
+}
+
+/// fills device d's i/di at its (already limited) junction voltages, e[k] = e^junction_arg(vj[k][d]).
+CIRCUIT_EXPORT NO_NULLS void device_eval(struct DeviceBatch const *const batch, size_t const d, rat const gmin, rat const e[const static 2]) {
+	rat const vt = thermal_voltage();
+	rat i[3], di[3][2];
+	for( size_t t=0; t < 3; t++ ) {
+		i[t] = di[t][0] = di[t][1] = rat_zero();
+	}
+	switch( batch->kind ) {
+		case COMP_DIODE: {
+			rat const is = batch->p[0][d], vd = batch->vj[0][d];
+			rat const ef = e[0];
+			rat const id = rat_addmul(rat_mul(is, rat_sub(ef, rat_pos1())), gmin, vd);
+			rat const gd = rat_add(rat_div(rat_mul(is, ef), vt), gmin);
+			i[0] = id;            di[0][0] = gd;
+			i[1] = rat_neg(id);   di[1][0] = rat_neg(gd);
+			break;
+		}
+		case COMP_MOSFET: {
+			rat const k = batch->p[0][d], vth = batch->p[1][d];
+			rat const vgs = batch->vj[0][d], vds = batch->vj[1][d];
+			/// with vds < 0 the source and drain trade places.
+			bool const rev = rat_lt(vds, rat_zero());
+			rat const vgs_e = rev? rat_sub(vgs, vds) : vgs;
+			rat const vds_e = rev? rat_neg(vds) : vds;
+			rat const vov = rat_sub(vgs_e, vth);
+			rat id = rat_zero(), gm = rat_zero(), gds = rat_zero();
+			if( rat_lt(rat_zero(), vov) ) {
+				if( rat_lt(vds_e, vov) ) {
+					id  = rat_mul(k, rat_sub(rat_mul(vov, vds_e), rat_div(rat_mul(vds_e, vds_e), rat_from_int(2))));
+					gm  = rat_mul(k, vds_e);
+					gds = rat_mul(k, rat_sub(vov, vds_e));
+				} else {
+					id = rat_div(rat_mul(k, rat_mul(vov, vov)), rat_from_int(2));
+					gm = rat_mul(k, vov);
+				}
+			}
+			id  = rat_addmul(id, gmin, vds_e);
+			gds = rat_add(gds, gmin);
+			rat const d_vgs = rev? rat_neg(gm) : gm;
+			rat const d_vds = rev? rat_add(gm, gds) : gds;
+			id = rev? rat_neg(id) : id;
+			i[0] = id;            di[0][0] = d_vgs;          di[0][1] = d_vds;
+			i[2] = rat_neg(id);   di[2][0] = rat_neg(d_vgs); di[2][1] = rat_neg(d_vds);
+			break;
+		}
+		case COMP_BJT: {
+			rat const is = batch->p[0][d], beta_f = batch->p[1][d];
+			rat const vbe = batch->vj[0][d], vbc = batch->vj[1][d];
+			rat const ef = e[0], er = e[1];
+			rat const i_f = rat_mul(is, rat_sub(ef, rat_pos1())), g_f = rat_div(rat_mul(is, ef), vt);
+			rat const i_r = rat_mul(is, rat_sub(er, rat_pos1())), g_r = rat_div(rat_mul(is, er), vt);
+			/// transport model with beta_r = 1, gmin across both junctions.
+			rat const ic = rat_sub(rat_sub(i_f, rat_mul(rat_from_int(2), i_r)), rat_mul(gmin, vbc));
+			rat const ib = rat_add(rat_add(rat_div(i_f, beta_f), i_r), rat_mul(gmin, rat_add(vbe, vbc)));
+			i[0] = ic;
+			di[0][0] = g_f;
+			di[0][1] = rat_neg(rat_addmul(gmin, rat_from_int(2), g_r));
+			i[1] = ib;
+			di[1][0] = rat_add(rat_div(g_f, beta_f), gmin);
+			di[1][1] = rat_add(g_r, gmin);
+			i[2] = rat_neg(rat_add(ic, ib));
+			di[2][0] = rat_neg(rat_add(di[0][0], di[1][0]));
+			di[2][1] = rat_neg(rat_add(di[0][1], di[1][1]));
+			break;
+		}
+	}
+	for( size_t t=0; t < 3; t++ ) {
+		batch->i[t][d] = i[t];
+		for( size_t k=0; k < 2; k++ ) {
+			batch->di[t][k][d] = di[t][k];
+		}
+	}
+}
+
+/// the voltage at a terminal, ground reads 0.
+CIRCUIT_EXPORT NO_NULLS rat nr_node_voltage(struct NRSystem const *const sys, uint8_t const node) {
+	return node_is_ground(node)? rat_zero() : sys->x[sys->node_to_matrix_id[node]];
+}
+
+/**
+ * Moves device d's junction voltages toward the present solution, limited.
+ * Returns false when they barely moved and the last linearization still holds,
+ * `limited` is set if any junction got clamped.
+ */
+CIRCUIT_EXPORT NO_NULLS bool device_limit(struct NRSystem const *const restrict sys, struct DeviceBatch const *const restrict batch, size_t const d, bool *const restrict limited) {
+	uint8_t const kind = batch->kind;
+	size_t const junctions = device_junctions(kind);
+	rat vj[2] = {0};
+	bool moved = !batch->evaluated[d];
+	for( size_t k=0; k < junctions; k++ ) {
+		uint8_t p = 0, m = 0;
+		device_junction(kind, k, &p, &m);
+		vj[k] = rat_sub(nr_node_voltage(sys, batch->nodes[p][d]), nr_node_voltage(sys, batch->nodes[m][d]));
+		moved |= rat_lt(float_to_rat(1E-9f), rat_abs(rat_sub(vj[k], batch->vj[k][d])));
+	}
+	if( !moved ) {
+		return false;
+	}
+	if( !batch->evaluated[d] ) {
+		/// start pn junctions at the knee, everything else where the solution says.
+		for( size_t k=0; k < junctions; k++ ) {
+			batch->vj[k][d] = kind==COMP_MOSFET? vj[k] : k==0? batch->vcrit[d] : rat_zero();
+		}
+		*limited = true;
+	} else {
+		for( size_t k=0; k < junctions; k++ ) {
+			batch->vj[k][d] = kind==COMP_MOSFET? fetlim(vj[k], batch->vj[k][d], limited) : pnjlim(vj[k], batch->vj[k][d], thermal_voltage(), batch->vcrit[d], limited);
+		}
+	}
+	return true;
+}
+
+/// copies every device into per-kind batches on the front of the bistack.
+CIRCUIT_EXPORT NO_NULLS bool device_batches_make(struct Circuit *const c, struct DeviceBatch batches[const static DEVICE_KINDS]) {
+	for( size_t b=0; b < DEVICE_KINDS; b++ ) {
+		struct DeviceBatch *const batch = &batches[b];
+		*batch = (struct DeviceBatch){ .kind = device_kind_at(b) };
+		for( uint8_t node=1; node < MAX_NODES; node++ ) {
+			for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+				batch->count += cmp->kind==batch->kind;
+			}
+		}
+		if( batch->count==0 ) {
+			continue;
+		}
+		size_t const count = batch->count;
+		rat *const rats = alloc_vec(&c->bistack, count * DEVICE_BATCH_RATS);
+		uint8_t *const nodes = bistack_alloc_front_vec(&c->bistack, 3*count, sizeof *nodes);
+		batch->moved     = bistack_alloc_front_vec(&c->bistack, count, sizeof *batch->moved);
+		batch->evaluated = bistack_alloc_front_vec(&c->bistack, count, sizeof *batch->evaluated);
+		if( rats==NULL || nodes==NULL || batch->moved==NULL || batch->evaluated==NULL ) {
+			return false;
+		}
+		rat *next = rats;
+		rat **const fields[DEVICE_BATCH_RATS] = {
+			&batch->p[0], &batch->p[1], &batch->vcrit, &batch->vj[0], &batch->vj[1],
+			&batch->i[0], &batch->i[1], &batch->i[2],
+			&batch->di[0][0], &batch->di[0][1], &batch->di[1][0], &batch->di[1][1], &batch->di[2][0], &batch->di[2][1],
+			&batch->arg[0], &batch->arg[1],
+		};
+		for( size_t f=0; f < DEVICE_BATCH_RATS; f++ ) {
+			*fields[f] = next;
+			next += count;
+		}
+		for( size_t t=0; t < 3; t++ ) {
+			batch->nodes[t] = &nodes[t*count];
+		}
+		size_t i = 0;
+		for( uint8_t node=1; node < MAX_NODES; node++ ) {
+			for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+				if( cmp->kind != batch->kind ) {
+					continue;
+				}
+				struct Device const *const dev = cmp->aux.dev;
+				for( size_t k=0; k < 2; k++ ) {
+					batch->p[k][i]  = dev->p[k];
+					batch->vj[k][i] = rat_zero();
+				}
+				for( size_t t=0; t < 3; t++ ) {
+					batch->nodes[t][i] = dev->nodes[t];
+				}
+				batch->evaluated[i++] = false;
+			}
+		}
+		/// vcrit = vt * ln(vt / (sqrt(2) * Is)), once per device for the whole solve.
+		rat const vt = thermal_voltage();
+		for( size_t d=0; d < count; d++ ) {
+			batch->vcrit[d] = rat_div(vt, rat_mul(rat_sqrt(rat_from_int(2)), batch->p[0][d]));
+		}
+		rat_ln_vec(count, batch->vcrit, batch->vcrit);
+		for( size_t d=0; d < count; d++ ) {
+			batch->vcrit[d] = rat_mul(vt, batch->vcrit[d]);
+		}
+	}
+	return true;
+}
+
+/**
+ * Limits every device in the batch, gathers the junction exponents of the ones that moved,
+ * runs them through rat_exp_vec and evaluates those devices from the results.
+ */
+CIRCUIT_EXPORT NO_NULLS void device_batch_update(struct DeviceBatch *const restrict batch, struct NRSystem const *const restrict sys, rat const gmin, bool *const restrict limited, struct NRStats *const restrict stats) {
+	size_t live = 0;
+	for( size_t d=0; d < batch->count; d++ ) {
+		if( !device_limit(sys, batch, d, limited) ) {
+			stats->bypassed++;
+			continue;
+		}
+		batch->moved[live] = d;
+		for( size_t k=0; k < 2; k++ ) {
+			batch->arg[k][live] = junction_arg(batch->vj[k][d]);
+		}
+		live++;
+	}
+	/// the square law needs no exponentials.
+	if( batch->kind != COMP_MOSFET ) {
+		for( size_t k=0; k < device_junctions(batch->kind); k++ ) {
+			rat_exp_vec(live, batch->arg[k], batch->arg[k]);
+		}
+	}
+	for( size_t l=0; l < live; l++ ) {
+		size_t const d = batch->moved[l];
+		device_eval(batch, d, gmin, ( rat[2] ){ batch->arg[0][l], batch->arg[1][l] });
+		batch->evaluated[d] = true;
+	}
+	stats->evaluations += live;
+}
+
+/// scatters device d's linearization into A/rhs.
+CIRCUIT_EXPORT NO_NULLS void device_stamp(struct NRSystem *const restrict sys, struct DeviceBatch const *const restrict batch, size_t const d) {
+	uint8_t const kind = batch->kind;
+	size_t const n = sys->n;
+	for( size_t t=0; t < device_terminals(kind); t++ ) {
+		if( node_is_ground(batch->nodes[t][d]) ) {
+			continue;
+		}
+		uint8_t const row = sys->node_to_matrix_id[batch->nodes[t][d]];
+		rat offset = batch->i[t][d];
+		for( size_t k=0; k < device_junctions(kind); k++ ) {
+			uint8_t p = 0, m = 0;
+			device_junction(kind, k, &p, &m);
+			rat const g = batch->di[t][k][d];
+			offset = rat_sub(offset, rat_mul(g, batch->vj[k][d]));
+			if( !node_is_ground(batch->nodes[p][d]) ) {
+				size_t const rc = idx_2_to_1(row, sys->node_to_matrix_id[batch->nodes[p][d]], n);
+				sys->A[rc] = rat_add(sys->A[rc], g);
+			}
+			if( !node_is_ground(batch->nodes[m][d]) ) {
+				size_t const rc = idx_2_to_1(row, sys->node_to_matrix_id[batch->nodes[m][d]], n);
+				sys->A[rc] = rat_sub(sys->A[rc], g);
+			}
+		}
+		/// the current leaving the node is on the left, its constant part moves right.
+		sys->rhs[row] = rat_sub(sys->rhs[row], offset);
+	}
+}
+
+CIRCUIT_EXPORT NO_NULLS bool circuit_has_devices(struct Circuit const *const c) {
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+			if( device_terminals(cmp->kind) > 0 ) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/// forgets every device's linearization, the next iteration evaluates them all.
+CIRCUIT_EXPORT NO_NULLS void device_batches_reset(struct DeviceBatch batches[const static DEVICE_KINDS]) {
+	for( size_t b=0; b < DEVICE_KINDS; b++ ) {
+		for( size_t d=0; d < batches[b].count; d++ ) {
+			batches[b].evaluated[d] = false;
+		}
+	}
+}
+
+/**
+ * Newton-Raphson from sys->x with an extra `gnode` from every node to ground and the
+ * independent sources scaled by `scale`. Returns true once it converged.
+ */
+CIRCUIT_EXPORT NO_NULLS bool nr_solve(struct DeviceBatch batches[const static DEVICE_KINDS], struct NRSystem *const restrict sys, rat const gnode, rat const scale, struct NRStats *const restrict stats) {
+	size_t const n = sys->n;
+	rat const reltol = float_to_rat(1E-3f), vntol = float_to_rat(1E-6f);
+	rat const reuse_ratio = float_to_rat(0.1f);
+	rat f_prev = rat_zero();
+	sys->factored = false;
+	for( size_t iter=0; iter < NR_MAX_ITERS; iter++ ) {
+		stats->iterations++;
+		bool limited = false;
+		memcpy(sys->A, sys->G, n*n * sizeof *sys->A);
+		for( size_t i=0; i < n; i++ ) {
+			sys->rhs[i] = rat_mul(scale, sys->rhs0[i]);
+			size_t const ii = idx_2_to_1(i,i,n);
+			sys->A[ii] = rat_add(sys->A[ii], gnode);
+		}
+		for( size_t b=0; b < DEVICE_KINDS; b++ ) {
+			device_batch_update(&batches[b], sys, device_gmin(), &limited, stats);
+			for( size_t d=0; d < batches[b].count; d++ ) {
+				device_stamp(sys, &batches[b], d);
+			}
+		}
+		/// F = A*x - rhs, the KCL residual of this linearization.
+		rat f_norm = rat_zero();
+		for( size_t i=0; i < n; i++ ) {
+			rat acc = rat_neg(sys->rhs[i]);
+			for( size_t j=0; j < n; j++ ) {
+				acc = rat_addmul(acc, sys->A[idx_2_to_1(i,j,n)], sys->x[j]);
+			}
+			sys->F[i] = rat_neg(acc);
+			f_norm = rat_max(f_norm, rat_abs(acc));
+		}
+		/// device Jacobians aren't diagonally dominant (gm), so this factors with pivoting.
+		if( sys->factored && !limited && rat_lt(f_norm, rat_mul(reuse_ratio, f_prev)) ) {
+			stats->reused++;
+		} else {
+			memcpy(sys->LU, sys->A, n*n * sizeof *sys->LU);
+			stats->factorizations++;
+			sys->factored = lu_factor(n, sys->LU, sys->piv);
+			if( !sys->factored ) {
+				return false;
+			}
+		}
+		f_prev = f_norm;
+		lu_solve(n, sys->LU, sys->piv, sys->F);
+		bool converged = !limited;
+		for( size_t i=0; i < n; i++ ) {
+			rat const x_new = rat_add(sys->x[i], sys->F[i]);
+			if( rat_lt(rat_addmul(vntol, reltol, rat_max(rat_abs(x_new), rat_abs(sys->x[i]))), rat_abs(sys->F[i])) ) {
+				converged = false;
+			}
+			sys->x[i] = x_new;
+		}
+		if( converged && iter > 0 ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Nonlinear operating point into V_out (by node, ground and inactive nodes read 0).
+ * Plain Newton first, then gmin stepping, then source stepping.
+ * Returns ERR_OK, ERR_OOM or ERR_SINGULAR when nothing converged.
+ */
+CIRCUIT_EXPORT NO_NULLS int circuit_dc_nonlinear(struct Circuit *const restrict c, rat (*const restrict V_out)[MAX_NODES], struct NRStats *const restrict stats) {
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	*stats = (struct NRStats){0};
+	for( size_t i=0; i < MAX_NODES; i++ ) {
+		(*V_out)[i] = rat_zero();
+	}
+	struct NRSystem sys = {0};
+	sys.n = circuit_build_dc(c, &sys.matrix_id_to_node, &sys.G, &sys.rhs0);
+	size_t const n = sys.n;
+	if( n==0 ) {
+		bistack_release_front(&c->bistack, mark);
+		return ERR_OK;
+	}
+	sys.A   = alloc_vec(&c->bistack, n*n);
+	sys.LU  = alloc_vec(&c->bistack, n*n);
+	sys.rhs = alloc_vec(&c->bistack, n);
+	sys.F   = alloc_vec(&c->bistack, n);
+	sys.x   = alloc_vec(&c->bistack, n);
+	rat *const x_good = alloc_vec(&c->bistack, n);
+	if( sys.G==NULL || sys.rhs0==NULL || sys.A==NULL || sys.LU==NULL || sys.rhs==NULL || sys.F==NULL || sys.x==NULL || x_good==NULL ) {
+		bistack_release_front(&c->bistack, mark);
+		return ERR_OOM;
+	}
+	for( size_t i=0; i < n; i++ ) {
+		sys.node_to_matrix_id[sys.matrix_id_to_node[i]] = i;
+	}
+	struct DeviceBatch batches[DEVICE_KINDS];
+	if( !device_batches_make(c, batches) ) {
+		bistack_release_front(&c->bistack, mark);
+		return ERR_OOM;
+	}
+	
+	device_batches_reset(batches);
+	stats->strategy = NR_PLAIN;
+	bool ok = nr_solve(batches, &sys, rat_zero(), rat_pos1(), stats);
+	if( !ok ) {
+		/// gmin stepping: start heavily damped and take the shunts away a decade at a time.
+		stats->strategy = NR_GMIN_STEPPING;
+		device_batches_reset(batches);
+		memset(sys.x, 0, n * sizeof *sys.x);
+		ok = true;
+		for( rat gnode = float_to_rat(1E-2f); ok && rat_lt(device_gmin(), gnode); gnode = rat_div(gnode, rat_from_int(10)) ) {
+			ok = nr_solve(batches, &sys, gnode, rat_pos1(), stats);
+		}
+		ok = ok && nr_solve(batches, &sys, rat_zero(), rat_pos1(), stats);
+	}
+	if( !ok ) {
+		/// source stepping: ramp every source up from zero, halving the step on failure.
+		stats->strategy = NR_SOURCE_STEPPING;
+		device_batches_reset(batches);
+		memset(sys.x, 0, n * sizeof *sys.x);
+		memset(x_good, 0, n * sizeof *x_good);
+		rat scale = rat_zero(), step = float_to_rat(0.1f);
+		ok = nr_solve(batches, &sys, rat_zero(), rat_zero(), stats);
+		while( ok && rat_lt(scale, rat_pos1()) ) {
+			rat const next = rat_min(rat_pos1(), rat_add(scale, step));
+			if( nr_solve(batches, &sys, rat_zero(), next, stats) ) {
+				scale = next;
+				memcpy(x_good, sys.x, n * sizeof *x_good);
+				step = rat_mul(step, float_to_rat(1.5f));
+			} else {
+				memcpy(sys.x, x_good, n * sizeof *sys.x);
+				device_batches_reset(batches);
+				step = rat_div(step, rat_from_int(2));
+				ok = rat_lt(float_to_rat(1E-4f), step);
+			}
+		}
+	}
+	if( !ok ) {
+		stats->strategy = NR_FAILED;
+		bistack_release_front(&c->bistack, mark);
+		return ERR_SINGULAR;
+	}
+	for( size_t i=0; i < n; i++ ) {
+		(*V_out)[sys.matrix_id_to_node[i]] = sys.x[i];
+	}
+	bistack_release_front(&c->bistack, mark);
+	return ERR_OK;
+}
+
+/// prints the operating point like circuit_solve_dc does, plus how Newton got there.
+CIRCUIT_EXPORT NO_NULLS void circuit_solve_op(struct Circuit *const restrict c, FILE *const restrict out) {
+	rat V[MAX_NODES];
+	struct NRStats stats;
+	int const err = circuit_dc_nonlinear(c, &V, &stats);
+	if( err==ERR_OOM ) {
+		fputs("op: out of memory\n", out);
+		return;
+	} else if( err != ERR_OK ) {
+		fprintf(out, "op: no convergence after %zu iterations\n", stats.iterations);
+		return;
+	}
+	for( size_t i=1; i < MAX_NODES; i++ ) {
+		if( c->active_nodes & (1 << i) ) {
+			char num[48] = {0};
+			fprintf(out, "V%zu = %s\n", i, rat_to_cstr(V[i], sizeof num, num));
+		}
+	}
+	static char const *const strategies[] = { "newton", "gmin stepping", "source stepping" };
+	fprintf(out, "op: %s, %zu iterations, %zu factorizations, %zu reused, %zu evaluations, %zu bypassed\n", strategies[stats.strategy], stats.iterations, stats.factorizations, stats.reused, stats.evaluations, stats.bypassed);
+}
+#endif
@@ -0,0 +1,215 @@
+#ifndef NPORT_H_INCLUDED
+#	define NPORT_H_INCLUDED
+
+#include "node.h"
+
+
+/// N-port Z/Y parameters and Thevenin/Norton equivalents at DC.
+///   .nport 1 3:2    port 1 from node 1 to ground, port 2 from node 3 to node 2.
+/// The nodal matrix is factored once. Port k's unit current excitation (into its plus
+/// node, out of its minus node) is one column of a right-hand side block, the sources'
+/// own right-hand side is the last column, and the whole block goes through a single
+/// lu_solve_block. Then
+///   Z[j][k] = v_plus(j) - v_minus(j) under excitation k
+///   Voc[j]  = v_plus(j) - v_minus(j) under the sources
+///   Y       = Z^-1 when it exists
+/// and port k's Thevenin equivalent is Voc[k] behind Z[k][k], Norton is Voc[k]/Z[k][k]
+/// in parallel with the same resistance.
+
+struct NPort {
+	rat    *Z, *Y, *Voc;   /// ports x ports row-major, Y is NULL when Z is singular.
+	size_t  ports;
+	uint8_t plus[MAX_NODES], minus[MAX_NODES];
+};
+
+struct NPortSettings {
+	uint8_t plus[MAX_NODES], minus[MAX_NODES];
+	size_t  ports;
+};
+
+/// .nport a[:b] ..., b defaults to ground.
+CIRCUIT_EXPORT NO_NULLS bool nport_parse_directive(struct NPortSettings *const restrict np, char const line[const restrict static 1]) {
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word != 6 || strncmp(line, ".nport", 6) != 0 ) {
+		return false;
+	}
+	np->ports = 0;
+	for( size_t i=6; line[i] != 0 && np->ports < MAX_NODES - 1; ) {
+		skip_ws(line, &i);
+		if( !isdigit(line[i]) ) {
+			break;
+		}
+		char *end = NULL;
+		unsigned long const plus = strtoul(&line[i], &end, 10);
+		unsigned long minus = GND_IDX;
+		i = end - line;
+		if( line[i]==':' ) {
+			minus = strtoul(&line[i+1], &end, 10);
+			i = end - line;
+		}
+		if( plus < MAX_NODES && minus < MAX_NODES && plus != minus ) {
+			np->plus[np->ports]  = plus;
+			np->minus[np->ports] = minus;
+			np->ports++;
+		}
+	}
+	return true;
+}
+
+/**
+ * Extracts the N-port seen at (plus[k], minus[k]) for k < ports.
+ * Z, Voc and Y go on `store`, the circuit's front stack is scratch and reset on return.
+ * Returns ERR_OK, ERR_BAD_PORT (inactive or repeated terminals, or more ports than unknowns), ERR_SINGULAR or ERR_OOM.
+ */
+CIRCUIT_EXPORT NO_NULLS int circuit_extract_nport(
+	struct Circuit   *const restrict c,
+	size_t            const          ports,
+	uint8_t           const          plus[const restrict static ports],
+	uint8_t           const          minus[const restrict static ports],
+	struct TIBiStack *const restrict store,
+	struct NPort     *const restrict out
+) {
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	*out = (struct NPort){ .ports = ports };
+	if( ports==0 || ports >= MAX_NODES ) {
+		return ERR_BAD_PORT;
+	}
+	for( size_t k=0; k < ports; k++ ) {
+		bool const active = (c->active_nodes & (1 << plus[k])) && (node_is_ground(minus[k]) || (c->active_nodes & (1 << minus[k])));
+		if( plus[k]==minus[k] || node_is_ground(plus[k]) || !active ) {
+			return ERR_BAD_PORT;
+		}
+		/// the same terminals twice, either way round, would make Z singular by construction.
+		for( size_t j=0; j < k; j++ ) {
+			if( (plus[j]==plus[k] && minus[j]==minus[k]) || (plus[j]==minus[k] && minus[j]==plus[k]) ) {
+				return ERR_BAD_PORT;
+			}
+		}
+		out->plus[k]  = plus[k];
+		out->minus[k] = minus[k];
+	}
+	uint8_t matrix_id_to_node[MAX_NODES] = {0}, node_to_matrix_id[MAX_NODES] = {0};
+	rat *G = NULL, *rhs = NULL;
+	size_t const n = circuit_build_dc(c, &matrix_id_to_node, &G, &rhs);
+	int err = ERR_OK;
+	size_t const cols = ports + 1;
+	rat     *const B   = alloc_vec(&c->bistack, n*cols);
+	uint8_t *const piv = bistack_alloc_front(&c->bistack, MAX_NODES);
+	if( n==0 || ports > n ) {
+		err = ERR_BAD_PORT;
+		goto done;
+	} else if( G==NULL || rhs==NULL || B==NULL || piv==NULL ) {
+		err = ERR_OOM;
+		goto done;
+	}
+	for( size_t i=0; i < n; i++ ) {
+		node_to_matrix_id[matrix_id_to_node[i]] = i;
+	}
+	/// column k < ports: unit current into plus[k] and out of minus[k], column `ports`: the sources.
+	for( size_t k=0; k < ports; k++ ) {
+		B[idx_2_to_1(node_to_matrix_id[plus[k]], k, cols)] = rat_pos1();
+		if( !node_is_ground(minus[k]) ) {
+			B[idx_2_to_1(node_to_matrix_id[minus[k]], k, cols)] = rat_neg1();
+		}
+	}
+	for( size_t i=0; i < n; i++ ) {
+		B[idx_2_to_1(i, ports, cols)] = rhs[i];
+	}
+	if( !lu_factor(n, G, piv) ) {
+		err = ERR_SINGULAR;
+		goto done;
+	}
+	lu_solve_block(n, G, piv, cols, B);
+	
+	out->Z   = bistack_alloc_back_vec(store, ports*ports, sizeof *out->Z);
+	out->Voc = bistack_alloc_back_vec(store, ports, sizeof *out->Voc);
+	if( out->Z==NULL || out->Voc==NULL ) {
+		err = ERR_OOM;
+		goto done;
+	}
+	for( size_t j=0; j < ports; j++ ) {
+		uint8_t const pj = node_to_matrix_id[plus[j]];
+		bool const mg = node_is_ground(minus[j]);
+		uint8_t const mj = mg? 0 : node_to_matrix_id[minus[j]];
+		for( size_t k=0; k <= ports; k++ ) {
+			rat const v = rat_sub(B[idx_2_to_1(pj, k, cols)], mg? rat_zero() : B[idx_2_to_1(mj, k, cols)]);
+			if( k < ports ) {
+				out->Z[idx_2_to_1(j, k, ports)] = v;
+			} else {
+				out->Voc[j] = v;
+			}
+		}
+	}
+	
+	/// Y = Z^-1 through the same block solve against the identity, Z is factored in a scratch copy.
+	rat *const Y  = bistack_alloc_back_vec(store, ports*ports, sizeof *Y);
+	rat *const Zf = alloc_vec(&c->bistack, ports*ports);
+	if( Y==NULL || Zf==NULL ) {
+		err = ERR_OOM;
+		goto done;
+	}
+	memcpy(Zf, out->Z, ports*ports * sizeof *Zf);
+	for( size_t i=0; i < ports; i++ ) {
+		for( size_t j=0; j < ports; j++ ) {
+			Y[idx_2_to_1(i, j, ports)] = i==j? rat_pos1() : rat_zero();
+		}
+	}
+	if( lu_factor(ports, Zf, piv) ) {
+		lu_solve_block(ports, Zf, piv, ports, Y);
+		out->Y = Y;
+	}
+done:
+	bistack_release_front(&c->bistack, mark);
+	return err;
+}
+
+/// single-port convenience, the Thevenin voltage and resistance seen at (plus, minus).
+CIRCUIT_EXPORT NO_NULLS int circuit_thevenin(struct Circuit *const restrict c, uint8_t const plus, uint8_t const minus, rat *const restrict v_th, rat *const restrict r_th) {
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	struct NPort np;
+	int const err = circuit_extract_nport(c, 1, &plus, &minus, &c->bistack, &np);
+	if( err==ERR_OK ) {
+		*v_th = np.Voc[0];
+		*r_th = np.Z[0];
+	}
+	bistack_release_back(&c->bistack, mark);
+	return err;
+}
+
+CIRCUIT_EXPORT NO_NULLS void nport_print_matrix(char const name, size_t const ports, rat const M[const restrict static ports*ports], FILE *const restrict out) {
+	for( size_t i=0; i < ports; i++ ) {
+		fprintf(out, "%c%zu:", name, i+1);
+		for( size_t j=0; j < ports; j++ ) {
+			char num[48] = {0};
+			fprintf(out, " %s", rat_to_cstr(M[idx_2_to_1(i, j, ports)], sizeof num, num));
+		}
+		fputc('\n', out);
+	}
+}
+
+CIRCUIT_EXPORT NO_NULLS void circuit_solve_nport(struct Circuit *const restrict c, struct NPortSettings const *const restrict np, FILE *const restrict out) {
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	struct NPort res;
+	int const err = circuit_extract_nport(c, np->ports, np->plus, np->minus, &c->bistack, &res);
+	if( err != ERR_OK ) {
+		fputs(err==ERR_BAD_PORT? "nport: bad port\n" : err==ERR_SINGULAR? "nport: singular circuit\n" : "nport: out of memory\n", out);
+		bistack_release_back(&c->bistack, mark);
+		return;
+	}
+	for( size_t k=0; k < res.ports; k++ ) {
+		rat const r_th = res.Z[idx_2_to_1(k, k, res.ports)];
+		char vth[48] = {0}, rth[48] = {0}, in[48] = {0};
+		fprintf(out, "port %zu (%u, %u): Vth = %s  Rth = %s  In = %s\n", k+1, res.plus[k], res.minus[k],
+			rat_to_cstr(res.Voc[k], sizeof vth, vth),
+			rat_to_cstr(r_th, sizeof rth, rth),
+			rat_lt(rat_abs(r_th), rat_epsilon())? "inf" : rat_to_cstr(rat_div(res.Voc[k], r_th), sizeof in, in));
+	}
+	nport_print_matrix('Z', res.ports, res.Z, out);
+	if( res.Y != NULL ) {
+		nport_print_matrix('Y', res.ports, res.Y, out);
+	} else {
+		fputs("Y: Z is singular\n", out);
+	}
+	bistack_release_back(&c->bistack, mark);
+}
+#endif
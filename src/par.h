@@ -0,0 +1,166 @@
+#ifndef PAR_H_INCLUDED
+#	define PAR_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#	ifndef TICE_H
+#include <pthread.h>
+#include <stdatomic.h>
+#	endif
+
+
+/// Loop parallelism for the solvers.
+/// par_for(count, body, ctx) calls body(ctx, i, worker) once for every i < count and returns
+/// when all of them are done. The caller and par_threads()-1 pool threads take indices off a
+/// shared counter one at a time, so a slow item doesn't hold the others up.
+/// `worker` is below par_threads() and unique among the calls running at the same time.
+/// A body must not allocate from a shared stack, it gets its scratch through ctx.
+/// It's a plain loop on the caller with one thread, fewer than two items, from inside
+/// another par_for or while another thread has the pool. Bodies can nest freely that way.
+/// The thread count is one process-wide knob, 1 unless `--threads <n>` says otherwise.
+/// PC only, the calculator always runs the plain loop.
+
+#define PAR_EXPORT    static inline
+
+enum {
+	PAR_MAX_THREADS = 64,
+};
+
+typedef void ParBody(void *ctx, size_t i, size_t worker);
+
+#	ifndef TICE_H
+struct ParPool {
+	pthread_mutex_t busy;     /// held by whoever is running a par_for on the pool.
+	pthread_mutex_t lock;
+	pthread_cond_t  start, done;
+	ParBody        *body;
+	void           *ctx;
+	atomic_size_t   next;
+	size_t          count, active, pending, spawned, threads, generation;
+};
+
+PAR_EXPORT struct ParPool *par_pool(void) {
+	static struct ParPool pool = {
+		.busy    = PTHREAD_MUTEX_INITIALIZER,
+		.lock    = PTHREAD_MUTEX_INITIALIZER,
+		.start   = PTHREAD_COND_INITIALIZER,
+		.done    = PTHREAD_COND_INITIALIZER,
+		.threads = 1,
+	};
+	return &pool;
+}
+
+/// set on the pool threads for good and on a caller for the length of its par_for.
+PAR_EXPORT bool *par_inside(void) {
+	static _Thread_local bool inside = false;
+	return &inside;
+}
+#	endif
+
+PAR_EXPORT size_t par_threads(void) {
+#	ifdef TICE_H
+	return 1;
+#	else
+	struct ParPool *const pool = par_pool();
+	pthread_mutex_lock(&pool->lock);
+	size_t const threads = pool->threads;
+	pthread_mutex_unlock(&pool->lock);
+	return threads;
+#	endif
+}
+
+/// clamped to [1, PAR_MAX_THREADS], pool threads are started on the next par_for that needs them.
+PAR_EXPORT void par_set_threads(size_t const threads) {
+#	ifdef TICE_H
+	( void )(threads);
+#	else
+	struct ParPool *const pool = par_pool();
+	pthread_mutex_lock(&pool->lock);
+	pool->threads = threads==0? 1 : threads > PAR_MAX_THREADS? PAR_MAX_THREADS : threads;
+	pthread_mutex_unlock(&pool->lock);
+#	endif
+}
+
+#	ifndef TICE_H
+PAR_EXPORT void par_drain(struct ParPool *const pool, size_t const worker) {
+	ParBody *const body = pool->body;
+	void *const ctx = pool->ctx;
+	size_t const count = pool->count;
+	for( size_t i; (i = atomic_fetch_add(&pool->next, 1)) < count; ) {
+		body(ctx, i, worker);
+	}
+}
+
+PAR_EXPORT void *par_worker_main(void *const arg) {
+	struct ParPool *const pool = par_pool();
+	size_t const id = ( size_t )(( uintptr_t )(arg));
+	*par_inside() = true;
+	size_t seen = 0;
+	pthread_mutex_lock(&pool->lock);
+	for(;;) {
+		while( pool->generation==seen ) {
+			pthread_cond_wait(&pool->start, &pool->lock);
+		}
+		seen = pool->generation;
+		/// threads past the current count sit this loop out.
+		if( id >= pool->active ) {
+			continue;
+		}
+		pthread_mutex_unlock(&pool->lock);
+		par_drain(pool, id);
+		pthread_mutex_lock(&pool->lock);
+		if( --pool->pending==0 ) {
+			pthread_cond_signal(&pool->done);
+		}
+	}
+	return NULL;
+}
+#	endif
+
+PAR_EXPORT void par_for(size_t const count, ParBody *const body, void *const ctx) {
+#	ifndef TICE_H
+	struct ParPool *const pool = par_pool();
+	if( count > 1 && !*par_inside() && pthread_mutex_trylock(&pool->busy)==0 ) {
+		pthread_mutex_lock(&pool->lock);
+		size_t const want = pool->threads < count? pool->threads : count;
+		/// the pool only ever grows, a thread that won't start just leaves fewer of them.
+		while( pool->spawned + 1 < want ) {
+			pthread_t thread;
+			if( pthread_create(&thread, NULL, par_worker_main, ( void* )(( uintptr_t )(pool->spawned + 1)))!=0 ) {
+				break;
+			}
+			pthread_detach(thread);
+			pool->spawned++;
+		}
+		size_t const active = want < pool->spawned + 1? want : pool->spawned + 1;
+		if( active > 1 ) {
+			pool->body    = body;
+			pool->ctx     = ctx;
+			pool->count   = count;
+			pool->active  = active;
+			pool->pending = active - 1;
+			atomic_store(&pool->next, 0);
+			pool->generation++;
+			pthread_cond_broadcast(&pool->start);
+			pthread_mutex_unlock(&pool->lock);
+			*par_inside() = true;
+			par_drain(pool, 0);
+			*par_inside() = false;
+			pthread_mutex_lock(&pool->lock);
+			while( pool->pending > 0 ) {
+				pthread_cond_wait(&pool->done, &pool->lock);
+			}
+			pthread_mutex_unlock(&pool->lock);
+			pthread_mutex_unlock(&pool->busy);
+			return;
+		}
+		pthread_mutex_unlock(&pool->lock);
+		pthread_mutex_unlock(&pool->busy);
+	}
+#	endif
+	for( size_t i=0; i < count; i++ ) {
+		body(ctx, i, 0);
+	}
+}
+#endif
@@ -0,0 +1,660 @@
+#ifndef PARAM_H_INCLUDED
+#	define PARAM_H_INCLUDED
+
+#include "nonlinear.h"
+
+
+/// Netlist parameters and .step sweeps.
+///   .param rload=1k gain={rload/100}
+///   R 1 2 {2*rload}
+///   .step [param] rload 1k 10k 1k
+/// Expressions are compiled once into a small stack bytecode over the parameter table
+/// and never looked at as text again. Every expression knows which parameters it
+/// depends on (through other parameters too), so a sweep point only re-evaluates the
+/// parameters and component values downstream of what the step changed.
+/// Parameters are evaluated in dependency order, which a redefinition can change,
+/// so the order and the dependency masks are rebuilt on every .param.
+/// On a linear circuit the changed components are restamped as a difference on top of
+/// the previous point's matrix instead of rebuilding it, the symbolic LU is shared.
+/// The first .step line is the innermost loop.
+/// Every `{}` in a component line binds to that line's numeric fields in order,
+/// the value for passives and Is/K then Vt/beta for devices.
+
+enum {
+	MAX_PARAMS      = 16,
+	PARAM_NAME_LEN  = 12,
+	EXPR_MAX_CODE   = 48,
+	EXPR_MAX_CONSTS = 8,
+	EXPR_MAX_STACK  = 8,
+	STEP_MAX_DIMS   = 3,
+	PARAM_SHOWN_LEN = 48,
+};
+
+enum {
+	EXPR_CONST = 0,  /// followed by a const index.
+	EXPR_PARAM,      /// followed by a parameter index.
+	EXPR_ADD, EXPR_SUB, EXPR_MUL, EXPR_DIV, EXPR_POW, EXPR_NEG,
+};
+
+struct ParamExpr {
+	rat      consts[EXPR_MAX_CONSTS];
+	uint8_t  code[EXPR_MAX_CODE];
+	uint8_t  len, nconsts;
+	uint32_t deps;  /// parameter bitflags, transitive.
+};
+
+struct ParamTable {
+	char             names[MAX_PARAMS][PARAM_NAME_LEN];
+	rat              values[MAX_PARAMS];
+	struct ParamExpr exprs[MAX_PARAMS];
+	uint8_t          order[MAX_PARAMS];  /// every parameter after the ones it reads.
+	size_t           count;
+};
+
+/// a compiled expression driving one numeric field of a component.
+struct ParamBinding {
+	struct ParamExpr     expr;
+	struct Comp         *cmp;
+	struct ParamBinding *next;
+	uint8_t              field;
+};
+
+struct StepDim {
+	rat     start, stop, incr;
+	uint8_t param;
+};
+
+struct ParamDeck {
+	struct ParamTable    table;
+	struct ParamBinding *bindings;
+	struct StepDim       steps[STEP_MAX_DIMS];
+	size_t               step_dims;
+	size_t               rejected;                 /// lines with an expression that didn't compile.
+	char                 first_rejected[PARAM_SHOWN_LEN];
+};
+
+/// keeps the first line that didn't compile for param_print_rejected.
+CIRCUIT_EXPORT NO_NULLS void param_reject(struct ParamDeck *const restrict pd, char const line[const restrict static 1]) {
+	if( pd->rejected++==0 ) {
+		size_t const len = strcspn(line, "\r\n");
+		size_t const kept = len < sizeof pd->first_rejected - 1? len : sizeof pd->first_rejected - 1;
+		memcpy(pd->first_rejected, line, kept);
+		pd->first_rejected[kept] = 0;
+	}
+}
+
+CIRCUIT_EXPORT NO_NULLS void param_print_rejected(struct ParamDeck const *const restrict pd, FILE *const restrict out) {
+	if( pd->rejected==1 ) {
+		fprintf(out, "param: can't compile '%s', skipped\n", pd->first_rejected);
+	} else if( pd->rejected > 1 ) {
+		fprintf(out, "param: can't compile '%s' and %zu more lines, skipped\n", pd->first_rejected, pd->rejected - 1);
+	}
+}
+
+CIRCUIT_EXPORT NO_NULLS int param_find(struct ParamTable const *const restrict tab, char const name[const restrict static 1], size_t const len) {
+	for( size_t p=0; p < tab->count; p++ ) {
+		if( strlen(tab->names[p])==len && strncmp(tab->names[p], name, len)==0 ) {
+			return ( int )(p);
+		}
+	}
+	return -1;
+}
+
+struct ExprCompiler {
+	char const              *src;
+	struct ParamExpr        *out;
+	struct ParamTable const *tab;
+	size_t                   i, depth;
+	bool                     ok;
+};
+
+CIRCUIT_EXPORT NO_NULLS void expr_emit(struct ExprCompiler *const ec, uint8_t const op, int const stack_change) {
+	if( ec->out->len >= EXPR_MAX_CODE ) {
+		ec->ok = false;
+		return;
+	}
+	ec->out->code[ec->out->len++] = op;
+	ec->depth += stack_change;
+	if( ec->depth > EXPR_MAX_STACK ) {
+		ec->ok = false;
+	}
+}
+
+CIRCUIT_EXPORT NO_NULLS void expr_compile_sum(struct ExprCompiler *const ec);
+
+CIRCUIT_EXPORT NO_NULLS void expr_compile_primary(struct ExprCompiler *const ec) {
+	char const *const s = ec->src;
+	skip_ws(s, &ec->i);
+	if( s[ec->i]=='(' ) {
+		ec->i++;
+		expr_compile_sum(ec);
+		skip_ws(s, &ec->i);
+		if( s[ec->i] != ')' ) {
+			ec->ok = false;
+			return;
+		}
+		ec->i++;
+	} else if( isdigit(s[ec->i]) || s[ec->i]=='.' ) {
+		/// a number with an optional exponent and SI suffix, parse_si_scalar does the rest.
+		char tok[48] = {0};
+		size_t len = 0;
+		while( len < sizeof tok - 1 && (isdigit(s[ec->i]) || s[ec->i]=='.') ) {
+			tok[len++] = s[ec->i++];
+		}
+		/// the exponent's sign only right after the e, so `2e3-1000` stays a subtraction.
+		if( (s[ec->i]=='e' || s[ec->i]=='E') && (isdigit(s[ec->i+1]) || ((s[ec->i+1]=='-' || s[ec->i+1]=='+') && isdigit(s[ec->i+2]))) ) {
+			tok[len++] = s[ec->i++];
+			if( s[ec->i]=='-' || s[ec->i]=='+' ) {
+				tok[len++] = s[ec->i++];
+			}
+			while( len < sizeof tok - 1 && isdigit(s[ec->i]) ) {
+				tok[len++] = s[ec->i++];
+			}
+		}
+		if( len < sizeof tok - 1 && strchr("kKMGmunpf", s[ec->i]) != NULL && s[ec->i] != 0 ) {
+			tok[len++] = s[ec->i++];
+		}
+		if( ec->out->nconsts >= EXPR_MAX_CONSTS ) {
+			ec->ok = false;
+			return;
+		}
+		ec->out->consts[ec->out->nconsts] = parse_si_scalar(tok);
+		expr_emit(ec, EXPR_CONST, 1);
+		expr_emit(ec, ec->out->nconsts++, 0);
+	} else if( isalpha(s[ec->i]) || s[ec->i]=='_' ) {
+		size_t const start = ec->i;
+		while( isalnum(s[ec->i]) || s[ec->i]=='_' ) {
+			ec->i++;
+		}
+		int const p = param_find(ec->tab, &s[start], ec->i - start);
+		if( p < 0 ) {
+			ec->ok = false;
+			return;
+		}
+		ec->out->deps |= (( uint32_t )(1) << p) | ec->tab->exprs[p].deps;
+		expr_emit(ec, EXPR_PARAM, 1);
+		expr_emit(ec, ( uint8_t )(p), 0);
+	} else {
+		ec->ok = false;
+	}
+}
+
+CIRCUIT_EXPORT NO_NULLS void expr_compile_unary(struct ExprCompiler *const ec) {
+	skip_ws(ec->src, &ec->i);
+	if( ec->src[ec->i]=='-' ) {
+		ec->i++;
+		expr_compile_unary(ec);
+		expr_emit(ec, EXPR_NEG, 0);
+	} else if( ec->src[ec->i]=='+' ) {
+		ec->i++;
+		expr_compile_unary(ec);
+	} else {
+		expr_compile_primary(ec);
+	}
+}
+
+/// right associative.
+CIRCUIT_EXPORT NO_NULLS void expr_compile_power(struct ExprCompiler *const ec) {
+	expr_compile_unary(ec);
+	skip_ws(ec->src, &ec->i);
+	if( ec->ok && ec->src[ec->i]=='^' ) {
+		ec->i++;
+		expr_compile_power(ec);
+		expr_emit(ec, EXPR_POW, -1);
+	}
+}
+
+CIRCUIT_EXPORT NO_NULLS void expr_compile_product(struct ExprCompiler *const ec) {
+	expr_compile_power(ec);
+	for(;;) {
+		skip_ws(ec->src, &ec->i);
+		char const op = ec->src[ec->i];
+		if( !ec->ok || (op != '*' && op != '/') ) {
+			return;
+		}
+		ec->i++;
+		expr_compile_power(ec);
+		expr_emit(ec, op=='*'? EXPR_MUL : EXPR_DIV, -1);
+	}
+}
+
+CIRCUIT_EXPORT NO_NULLS void expr_compile_sum(struct ExprCompiler *const ec) {
+	expr_compile_product(ec);
+	for(;;) {
+		skip_ws(ec->src, &ec->i);
+		char const op = ec->src[ec->i];
+		if( !ec->ok || (op != '+' && op != '-') ) {
+			return;
+		}
+		ec->i++;
+		expr_compile_product(ec);
+		expr_emit(ec, op=='+'? EXPR_ADD : EXPR_SUB, -1);
+	}
+}
+
+/**
+ * Compiles `src` up to the first character that can't continue an expression,
+ * `*end` is left there. Returns false on unknown parameters, syntax errors or
+ * expressions too big for a ParamExpr.
+ */
+CIRCUIT_EXPORT NO_NULLS bool expr_compile(struct ParamTable const *const restrict tab, char const src[const restrict static 1], struct ParamExpr *const restrict out, size_t *const restrict end) {
+	*out = (struct ParamExpr){0};
+	struct ExprCompiler ec = { .src = src, .out = out, .tab = tab, .ok = true };
+	expr_compile_sum(&ec);
+	*end = ec.i;
+	return ec.ok;
+}
+
+CIRCUIT_EXPORT NO_NULLS rat expr_eval(struct ParamExpr const *const restrict e, rat const values[const restrict static MAX_PARAMS]) {
+	rat stack[EXPR_MAX_STACK];
+	size_t top = 0;
+	for( size_t pc=0; pc < e->len; pc++ ) {
+		switch( e->code[pc] ) {
+			case EXPR_CONST: stack[top++] = e->consts[e->code[++pc]]; break;
+			case EXPR_PARAM: stack[top++] = values[e->code[++pc]];    break;
+			case EXPR_NEG:   stack[top-1] = rat_neg(stack[top-1]);    break;
+			case EXPR_ADD:   top--; stack[top-1] = rat_add(stack[top-1], stack[top]); break;
+			case EXPR_SUB:   top--; stack[top-1] = rat_sub(stack[top-1], stack[top]); break;
+			case EXPR_MUL:   top--; stack[top-1] = rat_mul(stack[top-1], stack[top]); break;
+			case EXPR_DIV:   top--; stack[top-1] = rat_div(stack[top-1], stack[top]); break;
+			case EXPR_POW:   top--; stack[top-1] = rat_pow(stack[top-1], stack[top]); break;
+		}
+	}
+	return top > 0? stack[top-1] : rat_zero();
+}
+
+/// the parameters an expression reads itself, not through other parameters.
+CIRCUIT_EXPORT NO_NULLS uint32_t expr_direct_deps(struct ParamExpr const *const e) {
+	uint32_t deps = 0;
+	for( size_t pc=0; pc < e->len; pc++ ) {
+		if( e->code[pc]==EXPR_PARAM ) {
+			deps |= 1u << e->code[pc+1];
+		}
+		pc += e->code[pc]==EXPR_PARAM || e->code[pc]==EXPR_CONST;
+	}
+	return deps;
+}
+
+/// compiles a `{expr}` or a bare value token starting at line[*i], leaves *i past it.
+CIRCUIT_EXPORT NO_NULLS bool param_compile_value(struct ParamTable const *const restrict tab, char const line[const restrict static 1], size_t *const restrict i, struct ParamExpr *const restrict out) {
+	skip_ws(line, i);
+	bool const braced = line[*i]=='{';
+	*i += braced;
+	size_t used = 0;
+	if( !expr_compile(tab, &line[*i], out, &used) ) {
+		return false;
+	}
+	*i += used;
+	skip_ws(line, i);
+	if( braced ) {
+		if( line[*i] != '}' ) {
+			return false;
+		}
+		(*i)++;
+	}
+	return true;
+}
+
+/**
+ * Orders the table so every parameter comes after the ones it reads and makes the
+ * dependency masks of the parameters and bindings transitive again.
+ * Returns false and leaves everything as it was when the parameters read each other in a cycle.
+ */
+CIRCUIT_EXPORT NO_NULLS bool param_resolve(struct ParamDeck *const pd) {
+	struct ParamTable *const tab = &pd->table;
+	uint32_t direct[MAX_PARAMS], deps[MAX_PARAMS];
+	uint8_t order[MAX_PARAMS];
+	for( size_t p=0; p < tab->count; p++ ) {
+		direct[p] = expr_direct_deps(&tab->exprs[p]);
+	}
+	uint32_t placed = 0;
+	for( size_t len=0; len < tab->count; ) {
+		size_t const before = len;
+		for( size_t p=0; p < tab->count; p++ ) {
+			if( (placed & (1u << p)) != 0 || (direct[p] & ~placed) != 0 ) {
+				continue;
+			}
+			deps[p] = direct[p];
+			for( size_t q=0; q < tab->count; q++ ) {
+				deps[p] |= (direct[p] & (1u << q)) != 0? deps[q] : 0;
+			}
+			order[len++] = ( uint8_t )(p);
+			placed |= 1u << p;
+		}
+		if( len==before ) {
+			return false;
+		}
+	}
+	for( size_t p=0; p < tab->count; p++ ) {
+		tab->exprs[p].deps = deps[p];
+		tab->order[p]      = order[p];
+	}
+	for( struct ParamBinding *b = pd->bindings; b != NULL; b = b->next ) {
+		uint32_t const reads = expr_direct_deps(&b->expr);
+		b->expr.deps = reads;
+		for( size_t q=0; q < tab->count; q++ ) {
+			b->expr.deps |= (reads & (1u << q)) != 0? deps[q] : 0;
+		}
+	}
+	return true;
+}
+
+/// emits the difference between a component stamped at `old_value` and at its present value.
+CIRCUIT_EXPORT NO_NULLS void comp_restamp_dc(struct Comp const *const restrict cmp, rat const old_value, uint8_t const (*const node_to_matrix_id)[MAX_NODES], struct StampBuffer *const restrict buf) {
+	size_t const first = buf->len;
+	struct Comp old = *cmp;
+	old.value = old_value;
+	comp_stamp_dc(&old, node_to_matrix_id, buf);
+	for( size_t i=first; i < buf->len && i < buf->cap; i++ ) {
+		buf->data[i].val = rat_neg(buf->data[i].val);
+	}
+	comp_stamp_dc(cmp, node_to_matrix_id, buf);
+}
+
+/**
+ * Re-evaluates whatever depends on the `changed` parameters, stepped ones are left as set.
+ * With `buf`, linear components also push their restamp. Returns the bindings updated.
+ */
+CIRCUIT_EXPORT size_t param_propagate(struct ParamDeck *const restrict pd, uint32_t const changed, uint32_t const stepped, uint8_t const (*const node_to_matrix_id)[MAX_NODES], struct StampBuffer *const restrict buf) {
+	struct ParamTable *const tab = &pd->table;
+	for( size_t o=0; o < tab->count; o++ ) {
+		uint8_t const p = tab->order[o];
+		if( (stepped & (1u << p))==0 && (tab->exprs[p].deps & changed) != 0 ) {
+			tab->values[p] = expr_eval(&tab->exprs[p], tab->values);
+		}
+	}
+	size_t updated = 0;
+	for( struct ParamBinding *b = pd->bindings; b != NULL; b = b->next ) {
+		if( (b->expr.deps & changed)==0 ) {
+			continue;
+		}
+		rat *const ref = comp_param_ref(b->cmp, b->field);
+		rat const old = *ref;
+		*ref = expr_eval(&b->expr, tab->values);
+		if( buf != NULL && node_to_matrix_id != NULL && device_terminals(b->cmp->kind)==0 ) {
+			comp_restamp_dc(b->cmp, old, node_to_matrix_id, buf);
+		}
+		updated++;
+	}
+	return updated;
+}
+
+/// .param a=1 b={2*a}, a name can be redefined and whatever reads it follows, a redefinition that would read itself is ignored.
+CIRCUIT_EXPORT NO_NULLS bool param_parse_directive(struct ParamDeck *const restrict pd, char const line[const restrict static 1]) {
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word != 6 || strncmp(line, ".param", 6) != 0 ) {
+		return false;
+	}
+	struct ParamTable *const tab = &pd->table;
+	for( size_t i=6;; ) {
+		skip_ws(line, &i);
+		size_t const start = i;
+		while( isalnum(line[i]) || line[i]=='_' ) {
+			i++;
+		}
+		size_t const len = i - start;
+		skip_ws(line, &i);
+		if( len==0 || len >= PARAM_NAME_LEN || line[i] != '=' ) {
+			return true;
+		}
+		i++;
+		struct ParamExpr expr;
+		if( !param_compile_value(tab, line, &i, &expr) ) {
+			param_reject(pd, line);
+			return true;
+		}
+		int p = param_find(tab, &line[start], len);
+		if( p < 0 ) {
+			if( tab->count >= MAX_PARAMS ) {
+				return true;
+			}
+			p = ( int )(tab->count++);
+			memcpy(tab->names[p], &line[start], len);
+			tab->names[p][len] = 0;
+		}
+		/// only a redefinition can close a cycle, a new name reads existing ones.
+		struct ParamExpr const old = tab->exprs[p];
+		tab->exprs[p] = expr;
+		if( !param_resolve(pd) ) {
+			tab->exprs[p] = old;
+			continue;
+		}
+		tab->values[p] = expr_eval(&expr, tab->values);
+		( void )(param_propagate(pd, 1u << p, 0, NULL, NULL));
+	}
+}
+
+/// .step [param] name start stop incr
+CIRCUIT_EXPORT NO_NULLS bool step_parse_directive(struct ParamDeck *const restrict pd, char const line[const restrict static 1]) {
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word != 5 || strncmp(line, ".step", 5) != 0 ) {
+		return false;
+	}
+	char name[PARAM_NAME_LEN + 8] = {0}, start[48] = {0}, stop[48] = {0}, incr[48] = {0};
+	int got = sscanf(line, " .step %19s %47s %47s %47s", name, start, stop, incr);
+	if( got==4 && strcmp(name, "param")==0 ) {
+		got = sscanf(line, " .step param %19s %47s %47s %47s", name, start, stop, incr);
+	}
+	int const p = param_find(&pd->table, name, strlen(name));
+	if( got < 4 || p < 0 || pd->step_dims >= STEP_MAX_DIMS ) {
+		return true;
+	}
+	struct StepDim const dim = { .param = p, .start = parse_si_scalar(start), .stop = parse_si_scalar(stop), .incr = parse_si_scalar(incr) };
+	if( rat_lt(rat_abs(dim.incr), rat_epsilon()) || rat_lt(rat_mul(rat_sub(dim.stop, dim.start), dim.incr), rat_zero()) ) {
+		return true;
+	}
+	pd->steps[pd->step_dims++] = dim;
+	return true;
+}
+
+/**
+ * Adds a component line with `{}` expressions. Each one is compiled, a placeholder
+ * goes into the text for circuit_add_from_line and the real value is written
+ * into the new component, which keeps the expression as a binding when it depends
+ * on parameters. A line whose expressions don't compile isn't added, it's counted
+ * for param_print_rejected and ERR_BAD_EXPR is returned.
+ */
+CIRCUIT_EXPORT NO_NULLS int param_add_component(struct ParamDeck *const restrict pd, struct Circuit *const restrict c, char const line[const restrict static 1]) {
+	struct ParamExpr exprs[2];
+	size_t count = 0;
+	char text[128] = {0};
+	size_t len = 0;
+	for( size_t i=0; line[i] != 0 && len < sizeof text - 2; ) {
+		if( line[i] != '{' ) {
+			text[len++] = line[i++];
+			continue;
+		}
+		if( count >= 2 || !param_compile_value(&pd->table, line, &i, &exprs[count]) ) {
+			param_reject(pd, line);
+			return ERR_BAD_EXPR;
+		}
+		count++;
+		text[len++] = '1';
+		text[len++] = ' ';
+	}
+	struct Comp *heads[MAX_NODES];
+	memcpy(heads, c->components, sizeof heads);
+	int const err = circuit_add_from_line(c, text);
+	if( err != ERR_OK ) {
+		return err;
+	}
+	/// the new component went on the front of one of the lists.
+	struct Comp *cmp = NULL;
+	for( size_t n=0; n < MAX_NODES && cmp==NULL; n++ ) {
+		if( c->components[n] != heads[n] ) {
+			cmp = c->components[n];
+		}
+	}
+	if( cmp==NULL ) {
+		return ERR_OK;
+	}
+	for( size_t f=0; f < count; f++ ) {
+		rat *const ref = comp_param_ref(cmp, f);
+		if( ref==NULL ) {
+			break;
+		}
+		*ref = expr_eval(&exprs[f], pd->table.values);
+		if( exprs[f].deps==0 ) {
+			continue;
+		}
+		struct ParamBinding *const b = bistack_alloc_back(&c->bistack, sizeof *b);
+		if( b==NULL ) {
+			return ERR_OOM;
+		}
+		*b = (struct ParamBinding){ .expr = exprs[f], .cmp = cmp, .field = f, .next = pd->bindings };
+		pd->bindings = b;
+	}
+	return ERR_OK;
+}
+
+CIRCUIT_EXPORT NO_NULLS size_t step_points(struct StepDim const *const dim) {
+	rat const span = rat_div(rat_sub(dim->stop, dim->start), dim->incr);
+	return ( size_t )(rat_to_float(rat_floor(rat_add(span, float_to_rat(1E-6f))))) + 1;
+}
+
+struct StepStats {
+	size_t points, updates, factorizations;
+};
+
+/// where a sweep is, shared by every analysis that runs under .step.
+struct StepCursor {
+	size_t   idx[STEP_MAX_DIMS], counts[STEP_MAX_DIMS];
+	rat      nominal[STEP_MAX_DIMS];
+	uint32_t stepped;  /// bitflag of the stepped parameters.
+};
+
+/// puts every stepped parameter on its start and keeps the nominal values for step_end, propagating is up to the caller.
+CIRCUIT_EXPORT NO_NULLS void step_begin(struct ParamDeck *const restrict pd, struct StepCursor *const restrict cur) {
+	*cur = (struct StepCursor){0};
+	for( size_t d=0; d < pd->step_dims; d++ ) {
+		cur->stepped |= 1u << pd->steps[d].param;
+		cur->counts[d]  = step_points(&pd->steps[d]);
+		cur->nominal[d] = pd->table.values[pd->steps[d].param];
+		pd->table.values[pd->steps[d].param] = pd->steps[d].start;
+	}
+}
+
+/// odometer, dimension 0 turns fastest. Returns false past the last point, else the parameters it moved are in `changed`.
+CIRCUIT_EXPORT NO_NULLS bool step_next(struct ParamDeck *const restrict pd, struct StepCursor *const restrict cur, uint32_t *const restrict changed) {
+	*changed = 0;
+	for( size_t d=0; d < pd->step_dims; d++ ) {
+		uint8_t const p = pd->steps[d].param;
+		*changed |= 1u << p;
+		if( ++cur->idx[d] < cur->counts[d] ) {
+			pd->table.values[p] = rat_addmul(pd->steps[d].start, rat_from_int(cur->idx[d]), pd->steps[d].incr);
+			return true;
+		}
+		cur->idx[d] = 0;
+		pd->table.values[p] = pd->steps[d].start;
+	}
+	return false;
+}
+
+/// puts the nominal values back and everything that depends on them.
+CIRCUIT_EXPORT NO_NULLS void step_end(struct ParamDeck *const restrict pd, struct StepCursor const *const restrict cur) {
+	for( size_t d=0; d < pd->step_dims; d++ ) {
+		pd->table.values[pd->steps[d].param] = cur->nominal[d];
+	}
+	( void )(param_propagate(pd, cur->stepped, 0, NULL, NULL));
+}
+
+/// the step parameters' values on one line.
+CIRCUIT_EXPORT NO_NULLS void step_print_point(struct ParamDeck const *const restrict pd, FILE *const restrict out) {
+	fputs("step", out);
+	for( size_t d=0; d < pd->step_dims; d++ ) {
+		char num[48] = {0};
+		uint8_t const p = pd->steps[d].param;
+		fprintf(out, " %s = %s", pd->table.names[p], rat_to_cstr(pd->table.values[p], sizeof num, num));
+	}
+	fputc('\n', out);
+}
+
+/**
+ * Runs the DC operating point at every point of the sweep and puts the parameters back after.
+ * A linear circuit keeps G/rhs across points and only adds the changed components' restamps.
+ */
+CIRCUIT_EXPORT NO_NULLS void circuit_solve_step(struct Circuit *const restrict c, struct ParamDeck *const restrict pd, FILE *const restrict out) {
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	struct StepStats stats = {0};
+	struct StepCursor cur;
+	step_begin(pd, &cur);
+	uint32_t const stepped = cur.stepped;
+	bool const nonlinear = circuit_has_devices(c);
+	stats.updates += param_propagate(pd, stepped, stepped, NULL, NULL);
+	
+	/// the linear path owns the front stack for the whole sweep.
+	uint8_t matrix_id_to_node[MAX_NODES] = {0}, node_to_matrix_id[MAX_NODES] = {0};
+	uint8_t piv[MAX_NODES];
+	rat *G = NULL, *rhs = NULL, *LU = NULL, *x = NULL;
+	struct LUSymbolic sym;
+	struct StampBuffer delta = {0};
+	size_t n = 0;
+	if( !nonlinear ) {
+		n = circuit_build_dc(c, &matrix_id_to_node, &G, &rhs);
+		for( size_t i=0; i < n; i++ ) {
+			node_to_matrix_id[matrix_id_to_node[i]] = i;
+		}
+		struct StampBuffer counter = {0};
+		circuit_stamp_nodes(c, 1, MAX_NODES, ( uint8_t const(*)[MAX_NODES] )(&node_to_matrix_id), &counter);
+		delta.cap  = 2*counter.len + 1;
+		delta.data = bistack_alloc_front_vec(&c->bistack, delta.cap, sizeof *delta.data);
+		LU = alloc_vec(&c->bistack, n*n);
+		x  = alloc_vec(&c->bistack, n);
+		if( n==0 || G==NULL || rhs==NULL || delta.data==NULL || LU==NULL || x==NULL ) {
+			fputs(n==0? "step: empty circuit\n" : "step: out of memory\n", out);
+			step_end(pd, &cur);
+			bistack_release_front(&c->bistack, mark);
+			return;
+		}
+		lu_symbolic(n, G, &sym);
+	}
+	
+	for( bool more = true; more; ) {
+		stats.points++;
+		step_print_point(pd, out);
+		rat V[MAX_NODES] = {0};
+		bool solved = false;
+		if( nonlinear ) {
+			struct NRStats nr;
+			solved = circuit_dc_nonlinear(c, &V, &nr)==ERR_OK;
+		} else {
+			memcpy(LU, G, n*n * sizeof *LU);
+			memcpy(x, rhs, n * sizeof *x);
+			stats.factorizations++;
+			solved = lu_factor_scheduled(&sym, LU);
+			if( solved ) {
+				lu_solve_scheduled(&sym, LU, x);
+			} else {
+				memcpy(LU, G, n*n * sizeof *LU);
+				solved = lu_factor(n, LU, piv);
+				if( solved ) {
+					lu_solve(n, LU, piv, x);
+				}
+			}
+			for( size_t i=0; solved && i < n; i++ ) {
+				V[matrix_id_to_node[i]] = x[i];
+			}
+		}
+		for( size_t i=1; i < MAX_NODES; i++ ) {
+			if( c->active_nodes & (1 << i) ) {
+				char num[48] = {0};
+				fprintf(out, "V%zu = %s\n", i, solved? rat_to_cstr(V[i], sizeof num, num) : "?");
+			}
+		}
+		
+		uint32_t changed = 0;
+		more = step_next(pd, &cur, &changed);
+		if( !more ) {
+			break;
+		}
+		delta.len = 0;
+		stats.updates += param_propagate(pd, changed, stepped, nonlinear? NULL : ( uint8_t const(*)[MAX_NODES] )(&node_to_matrix_id), nonlinear? NULL : &delta);
+		if( !nonlinear ) {
+			stamps_apply(&delta, n, G, rhs);
+		}
+	}
+	fprintf(out, "step: %zu points, %zu value updates, %zu factorizations\n", stats.points, stats.updates, stats.factorizations);
+	step_end(pd, &cur);
+	bistack_release_front(&c->bistack, mark);
+}
+#endif
@@ -0,0 +1,151 @@
+#ifndef PROBE_H_INCLUDED
+#	define PROBE_H_INCLUDED
+
+#include "node.h"
+
+
+/// Probe-restricted DC solve.
+///   .print V(3) V(7)
+/// Only the requested voltages get computed. From the symbolic pattern, lu_reach finds
+/// the rows of U*x = y that feed the probes and the rows of L*y = b those need.
+/// Only those rows are factored (row-wise, so the rest of G is never touched) and only
+/// those are substituted. Numbering the probes last makes back substitution the probe
+/// rows alone, and a forward row no source reaches is known to be 0 without solving it.
+
+struct PrintSettings {
+	size_t probes; /// node bitflags.
+};
+
+/// .print V(3) 7 ...
+CIRCUIT_EXPORT NO_NULLS bool print_parse_directive(struct PrintSettings *const restrict pr, char const line[const restrict static 1]) {
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word != 6 || strncmp(line, ".print", 6) != 0 ) {
+		return false;
+	}
+	for( size_t i=6; line[i] != 0; ) {
+		if( isdigit(line[i]) ) {
+			unsigned long const node = strtoul(&line[i], NULL, 10);
+			if( node > 0 && node < MAX_NODES ) {
+				pr->probes |= ( size_t )(1) << node;
+			}
+			while( isdigit(line[i]) ) {
+				i++;
+			}
+		} else {
+			i++;
+		}
+	}
+	return true;
+}
+
+/// rows a partial solve touched, out of n.
+struct ProbeStats {
+	size_t n, factored, forward, back;
+};
+
+/**
+ * Solves for the probed node voltages only, scattered into V_out by node number,
+ * everything else reads 0.
+ * The probes are numbered last, so back substitution is just the probe rows, and the
+ * forward pass skips rows the sources can't reach, those stay 0. Falls back to the
+ * full pivoted solve when a needed pivot vanishes. Returns ERR_OK, ERR_OOM or ERR_SINGULAR.
+ */
+CIRCUIT_EXPORT NO_NULLS int circuit_dc_probe(struct Circuit *const restrict c, size_t const probes, rat (*const restrict V_out)[MAX_NODES], struct ProbeStats *const restrict stats) {
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	for( size_t i=0; i < MAX_NODES; i++ ) {
+		(*V_out)[i] = rat_zero();
+	}
+	*stats = (struct ProbeStats){0};
+	uint8_t matrix_id_to_node[MAX_NODES] = {0};
+	rat *G = NULL, *V = NULL;
+	size_t const n = circuit_build_dc(c, &matrix_id_to_node, &G, &V);
+	rat *const P = n > 0? alloc_vec(&c->bistack, n*n) : NULL;
+	rat *const b = n > 0? alloc_vec(&c->bistack, n) : NULL;
+	int err = ERR_OK;
+	if( n==0 || G==NULL || V==NULL || P==NULL || b==NULL ) {
+		err = n==0? ERR_OK : ERR_OOM;
+		goto done;
+	}
+	/// symmetric permutation, non-probes first then probes, keeps the diagonal dominance.
+	uint8_t order[MAX_NODES] = {0};
+	size_t m = 0, targets = 0;
+	for( int pass=0; pass < 2; pass++ ) {
+		for( size_t i=0; i < n; i++ ) {
+			bool const probed = (probes & (1 << matrix_id_to_node[i])) != 0;
+			if( probed==(pass==1) ) {
+				if( probed ) {
+					targets |= ( size_t )(1) << m;
+				}
+				order[m++] = i;
+			}
+		}
+	}
+	for( size_t i=0; i < n; i++ ) {
+		for( size_t j=0; j < n; j++ ) {
+			P[idx_2_to_1(i, j, n)] = G[idx_2_to_1(order[i], order[j], n)];
+		}
+		b[i] = V[order[i]];
+	}
+	struct LUSymbolic sym;
+	lu_symbolic(n, P, &sym);
+	size_t forward = 0, back = 0;
+	lu_reach(&sym, targets, &forward, &back);
+	/// rows whose forward value can't be nonzero, nothing on the right-hand side reaches them.
+	size_t reached = 0;
+	for( size_t i=0; i < n; i++ ) {
+		if( !rat_lt(rat_abs(b[i]), rat_epsilon()) || (sym.L_rows[i] & reached) ) {
+			reached |= ( size_t )(1) << i;
+		}
+	}
+	stats->n = n;
+	for( size_t i=0; i < n; i++ ) {
+		stats->factored += (forward >> i) & 1;
+		stats->forward  += ((forward & reached) >> i) & 1;
+		stats->back     += (back >> i) & 1;
+	}
+	if( lu_factor_rows(&sym, forward, P) ) {
+		lu_solve_partial(&sym, P, forward & reached, back, b);
+		for( size_t i=0; i < n; i++ ) {
+			if( targets & (1 << i) ) {
+				(*V_out)[matrix_id_to_node[order[i]]] = b[i];
+			}
+		}
+		goto done;
+	}
+	/// needs pivoting after all, solve everything.
+	uint8_t piv[MAX_NODES] = {0};
+	memcpy(P, G, n*n * sizeof *P);
+	if( !lu_factor(n, P, piv) ) {
+		err = ERR_SINGULAR;
+		goto done;
+	}
+	lu_solve(n, P, piv, V);
+	stats->factored = stats->forward = stats->back = n;
+	for( size_t i=0; i < n; i++ ) {
+		if( probes & (1 << matrix_id_to_node[i]) ) {
+			(*V_out)[matrix_id_to_node[i]] = V[i];
+		}
+	}
+done:
+	bistack_release_front(&c->bistack, mark);
+	return err;
+}
+
+/// V<node> = <value> for every active probe, then how much of the system it took.
+CIRCUIT_EXPORT NO_NULLS void circuit_solve_print(struct Circuit *const restrict c, struct PrintSettings const *const restrict pr, FILE *const restrict out) {
+	rat V[MAX_NODES];
+	struct ProbeStats stats;
+	int const err = circuit_dc_probe(c, pr->probes, &V, &stats);
+	if( err != ERR_OK ) {
+		fputs(err==ERR_SINGULAR? "print: singular circuit\n" : "print: out of memory\n", out);
+		return;
+	}
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		if( (pr->probes & (1 << node)) && (c->active_nodes & (1 << node)) ) {
+			char num[48] = {0};
+			fprintf(out, "V%u = %s\n", node, rat_to_cstr(V[node], sizeof num, num));
+		}
+	}
+	fprintf(out, "print: %zu rows, %zu factored, %zu forward, %zu back\n", stats.n, stats.factored, stats.forward, stats.back);
+}
+#endif
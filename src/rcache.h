@@ -0,0 +1,326 @@
+#ifndef RCACHE_H_INCLUDED
+#	define RCACHE_H_INCLUDED
+
+#include "deck.h"
+
+
+/// Persistent result cache for batch runs, keyed by netlist content.
+///   litespice --batch jobs.txt --cache <dir> [limit_kb]
+/// A job's lines are kept as read, canonicalized (whitespace runs squeezed, comments and
+/// blanks already dropped) and hashed together with the cache format and the number type,
+/// so the key covers the circuit and every analysis directive. Component values are
+/// hashed by what they parse to, so 1k and 1000 are the same job. A hit maps the stored
+/// output and writes it out without parsing a line or solving anything. A miss parses
+/// and runs the deck into a temp file in the cache directory, renames it into place and
+/// copies it out. When the directory grows past its limit the least recently used
+/// results go first, a hit counts as a use. Decks with .wave write a file of their own
+/// and always run.
+/// Only the line buffer and key are here for the calculator, it has no filesystem for it.
+
+enum {
+	RCACHE_VERSION    = 2,
+	RCACHE_DIR_LEN    = 192,
+	RCACHE_PATH_LEN   = 256, /// the directory, a slash, a key and a temp suffix.
+	RCACHE_DEFAULT_KB = 16U << 10,
+};
+
+/// one canonical netlist line, kept in the worker's chained line arena.
+struct DeckLine {
+	struct DeckLine *next;
+	char             text[];
+};
+
+struct ResultCache {
+	char   dir[RCACHE_DIR_LEN];
+	size_t limit, bytes, files;
+	size_t hits, misses, stores, evictions, bypassed;
+};
+
+/// a copy of `line` with leading, trailing and repeated whitespace squeezed out. NULL when out of memory.
+CIRCUIT_EXPORT NO_NULLS struct DeckLine *deck_line_keep(struct TIChainArena *const restrict a, char const line[const restrict static 1]) {
+	size_t const len = strlen(line);
+	struct DeckLine *const l = chain_alloc(a, sizeof *l + len + 1);
+	if( l==NULL ) {
+		return NULL;
+	}
+	size_t n = 0;
+	for( size_t i=0; line[i] != 0; i++ ) {
+		if( !isspace(( unsigned char )(line[i])) ) {
+			l->text[n++] = line[i];
+		} else if( n > 0 && l->text[n-1] != ' ' ) {
+			l->text[n++] = ' ';
+		}
+	}
+	if( n > 0 && l->text[n-1]==' ' ) {
+		n--;
+	}
+	l->text[n] = 0;
+	return l;
+}
+
+/// the value of a whole numeric token with an optional SI suffix, false for anything else.
+CIRCUIT_EXPORT NO_NULLS bool si_token_value(char const tok[const restrict static 1], size_t const len, rat *const restrict out) {
+	char buf[48] = {0};
+	if( len==0 || len >= sizeof buf ) {
+		return false;
+	}
+	memcpy(buf, tok, len);
+	char *end = NULL;
+	( void )(strtod(buf, &end));
+	if( end==buf || (end[0] != 0 && (end[1] != 0 || strchr("kKMGmunpf", end[0])==NULL)) ) {
+		return false;
+	}
+	*out = parse_si_scalar(buf);
+	return true;
+}
+
+/// where a component line's values start, counting the letter as token 0. Nodes and names stay as written.
+CIRCUIT_EXPORT NO_NULLS size_t deck_line_first_value(char const text[const static 1]) {
+	if( text[0]=='.' || strchr(text, '{') != NULL ) {
+		return SIZE_MAX;
+	}
+	uint8_t const kind = kind_from_letter(text[0]);
+	switch( kind ) {
+		case COMP_INVALID: case COMP_MACROMODEL:
+			return SIZE_MAX;
+		case COMP_VCCS: case COMP_VCVS: case COMP_CCVS: case COMP_CCCS:
+			return 5;
+		default:
+			return 1 + (device_terminals(kind) > 0? device_terminals(kind) : 2);
+	}
+}
+
+/// one kept line into the key, tagged tokens so a value and text spelling the same bytes differ.
+CIRCUIT_EXPORT NO_NULLS uint64_t deck_line_hash(uint64_t h, char const text[const static 1]) {
+	size_t const first_value = deck_line_first_value(text);
+	for( size_t i=0, tok=0; text[i] != 0; tok++ ) {
+		size_t const len = strcspn(&text[i], " ");
+		rat v;
+		if( tok >= first_value && si_token_value(&text[i], len, &v) ) {
+			/// + 0.0 folds -0 into 0.
+			double const d = rat_to_double(v) + 0.0;
+			h = fnv1a(fnv1a_byte(h, 'v'), &d, sizeof d);
+		} else {
+			h = fnv1a(fnv1a_byte(h, 't'), &text[i], len);
+		}
+		i += len + (text[i+len]==' ');
+	}
+	return fnv1a_byte(h, '\n');
+}
+
+/// content key of a netlist, line order counts since .param has to come before its uses.
+CIRCUIT_EXPORT uint64_t deck_lines_hash(struct DeckLine const *l) {
+	uint32_t const build[2] = { RCACHE_VERSION, sizeof(rat) };
+	uint64_t h = fnv1a(FNV_OFFSET, build, sizeof build);
+	for( ; l != NULL; l=l->next ) {
+		h = deck_line_hash(h, l->text);
+	}
+	return h;
+}
+
+/// false if the deck does more than print, only .wave does for now.
+CIRCUIT_EXPORT bool deck_lines_cacheable(struct DeckLine const *l) {
+	for( ; l != NULL; l=l->next ) {
+		size_t const word = strcspn(l->text, " ");
+		if( word==5 && strncmp(l->text, ".wave", 5)==0 ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+CIRCUIT_EXPORT NO_NULLS void rcache_print_stats(struct ResultCache const *const cache, FILE *const out) {
+	fprintf(out, "cache: %zu hits, %zu misses, %zu bypassed, %zu stored, %zu evicted, %zu files, %zu/%zu bytes\n",
+		cache->hits, cache->misses, cache->bypassed, cache->stores, cache->evictions, cache->files, cache->bytes, cache->limit);
+}
+
+#	ifndef TICE_H
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+
+struct RCacheHeader {
+	char     magic[4];
+	uint32_t version;
+	uint64_t key, payload;
+};
+
+CIRCUIT_EXPORT NO_NULLS void rcache_path(struct ResultCache const *const restrict cache, uint64_t const key, char path[const restrict static RCACHE_PATH_LEN]) {
+	snprintf(path, RCACHE_PATH_LEN, "%s/%016" PRIx64 ".lsr", cache->dir, key);
+}
+
+/// the temp file `writer` runs a deck into, named per process and writer so concurrent runs don't share one.
+CIRCUIT_EXPORT NO_NULLS void rcache_temp_path(struct ResultCache const *const restrict cache, uint64_t const key, size_t const writer, char path[const restrict static RCACHE_PATH_LEN]) {
+	snprintf(path, RCACHE_PATH_LEN, "%s/%016" PRIx64 ".%ld.%zu.tmp", cache->dir, key, ( long )(getpid()), writer);
+}
+
+/// ".lsr" results only, temp files of runs in flight are left alone.
+CIRCUIT_EXPORT NO_NULLS bool rcache_is_entry(char const *const name) {
+	return strlen(name)==20 && !memcmp(&name[16], ".lsr", 4);
+}
+
+/// drops the least recently used results until the directory fits its limit.
+CIRCUIT_EXPORT NO_NULLS void rcache_trim(struct ResultCache *const cache) {
+	while( cache->bytes > cache->limit ) {
+		DIR *const d = opendir(cache->dir);
+		if( d==NULL ) {
+			return;
+		}
+		char oldest[RCACHE_DIR_LEN + sizeof(struct dirent){0}.d_name + 1] = {0};
+		time_t oldest_at = 0;
+		size_t oldest_size = 0;
+		for( struct dirent const *e; (e = readdir(d)) != NULL; ) {
+			char path[RCACHE_DIR_LEN + sizeof e->d_name + 1] = {0};
+			struct stat st;
+			snprintf(path, sizeof path, "%s/%s", cache->dir, e->d_name);
+			if( rcache_is_entry(e->d_name) && stat(path, &st)==0 && (oldest[0]==0 || st.st_mtime < oldest_at) ) {
+				memcpy(oldest, path, sizeof oldest);
+				oldest_at   = st.st_mtime;
+				oldest_size = ( size_t )(st.st_size);
+			}
+		}
+		closedir(d);
+		if( oldest[0]==0 || unlink(oldest) != 0 ) {
+			return;
+		}
+		cache->bytes -= oldest_size < cache->bytes? oldest_size : cache->bytes;
+		cache->files -= cache->files > 0;
+		cache->evictions++;
+	}
+}
+
+/**
+ * Uses `dir` as the cache, creating it if needed, totals what's already there and trims it to fit.
+ * `limit` is in bytes. Returns false if the directory can't be had.
+ */
+CIRCUIT_EXPORT NO_NULLS bool rcache_open(struct ResultCache *const restrict cache, char const dir[const restrict static 1], size_t const limit) {
+	*cache = (struct ResultCache){ .limit = limit };
+	if( strlen(dir) >= sizeof cache->dir ) {
+		return false;
+	}
+	strcpy(cache->dir, dir);
+	mkdir(dir, 0755);
+	DIR *const d = opendir(dir);
+	if( d==NULL ) {
+		return false;
+	}
+	for( struct dirent const *e; (e = readdir(d)) != NULL; ) {
+		char path[RCACHE_DIR_LEN + sizeof e->d_name + 1] = {0};
+		struct stat st;
+		snprintf(path, sizeof path, "%s/%s", dir, e->d_name);
+		if( rcache_is_entry(e->d_name) && stat(path, &st)==0 ) {
+			cache->bytes += ( size_t )(st.st_size);
+			cache->files++;
+		}
+	}
+	closedir(d);
+	rcache_trim(cache);
+	return true;
+}
+
+/// writes the payload of an open result file to `out`, false if it isn't a result for `key`.
+CIRCUIT_EXPORT NO_NULLS bool rcache_copy_out(int const fd, uint64_t const key, FILE *const out) {
+	struct stat st;
+	if( fstat(fd, &st) != 0 || ( size_t )(st.st_size) < sizeof(struct RCacheHeader) ) {
+		return false;
+	}
+	size_t const size = ( size_t )(st.st_size);
+	uint8_t const *const map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if( map==MAP_FAILED ) {
+		return false;
+	}
+	struct RCacheHeader hdr;
+	memcpy(&hdr, map, sizeof hdr);
+	bool const ok = !memcmp(hdr.magic, "LSRC", 4) && hdr.version==RCACHE_VERSION && hdr.key==key && hdr.payload==size - sizeof hdr;
+	if( ok ) {
+		fwrite(&map[sizeof hdr], 1, hdr.payload, out);
+	}
+	munmap(( void* )(map), size);
+	return ok;
+}
+
+/// writes the stored output for `key` and returns true on a hit, counts a miss otherwise.
+CIRCUIT_EXPORT NO_NULLS bool rcache_replay(struct ResultCache *const restrict cache, uint64_t const key, FILE *const restrict out) {
+	char path[RCACHE_PATH_LEN] = {0};
+	rcache_path(cache, key, path);
+	int const fd = open(path, O_RDONLY);
+	bool const hit = fd >= 0 && rcache_copy_out(fd, key, out);
+	if( fd >= 0 ) {
+		close(fd);
+	}
+	if( hit ) {
+		utime(path, NULL);
+		cache->hits++;
+	} else {
+		cache->misses++;
+	}
+	return hit;
+}
+
+/// a temp file in the cache directory for `writer` to run the deck into, its header is filled in by rcache_store.
+CIRCUIT_EXPORT NO_NULLS FILE *rcache_begin(struct ResultCache const *const cache, uint64_t const key, size_t const writer) {
+	char path[RCACHE_PATH_LEN] = {0};
+	rcache_temp_path(cache, key, writer, path);
+	FILE *const tmp = fopen(path, "w+b");
+	if( tmp != NULL ) {
+		fwrite(&(struct RCacheHeader){0}, sizeof(struct RCacheHeader), 1, tmp);
+	}
+	return tmp;
+}
+
+/// what a run wrote into a temp file past its header, read back through stdio for when the file can't be sealed or mapped.
+CIRCUIT_EXPORT NO_NULLS void rcache_copy_unsealed(FILE *const restrict tmp, FILE *const restrict out) {
+	if( fseek(tmp, ( long )(sizeof(struct RCacheHeader)), SEEK_SET) != 0 ) {
+		return;
+	}
+	char chunk[256];
+	for( size_t got; (got = fread(chunk, 1, sizeof chunk, tmp)) > 0; ) {
+		fwrite(chunk, 1, got, out);
+	}
+}
+
+/**
+ * Seals the temp file, copies its output to `out`, renames it into place and trims the directory.
+ * The output reaches `out` even when the result can't be stored.
+ */
+CIRCUIT_EXPORT NO_NULLS void rcache_store(struct ResultCache *const restrict cache, uint64_t const key, size_t const writer, FILE *const restrict tmp, FILE *const restrict out) {
+	long const end = ftell(tmp);
+	struct RCacheHeader const hdr = {
+		.magic = "LSRC", .version = RCACHE_VERSION, .key = key,
+		.payload = end > ( long )(sizeof hdr)? ( uint64_t )(end) - sizeof hdr : 0,
+	};
+	rewind(tmp);
+	bool const written = end >= ( long )(sizeof hdr) && fwrite(&hdr, sizeof hdr, 1, tmp)==1 && fflush(tmp)==0;
+	bool const copied  = written && rcache_copy_out(fileno(tmp), key, out);
+	if( !copied ) {
+		clearerr(tmp);
+		rcache_copy_unsealed(tmp, out);
+	}
+	fclose(tmp);
+	char path[RCACHE_PATH_LEN] = {0}, temp[RCACHE_PATH_LEN] = {0};
+	rcache_path(cache, key, path);
+	rcache_temp_path(cache, key, writer, temp);
+	/// a result already there, stored by another run since our miss, is replaced and stops counting.
+	struct stat old;
+	bool const replacing = stat(path, &old)==0;
+	if( !copied || rename(temp, path) != 0 ) {
+		unlink(temp);
+		fputs("cache: can't store result\n", out);
+		return;
+	}
+	if( replacing ) {
+		size_t const old_size = ( size_t )(old.st_size);
+		cache->bytes -= old_size < cache->bytes? old_size : cache->bytes;
+		cache->files -= cache->files > 0;
+	}
+	cache->bytes += ( size_t )(end);
+	cache->files++;
+	cache->stores++;
+	rcache_trim(cache);
+}
+#	endif
+#endif
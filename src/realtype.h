@@ -16,6 +16,10 @@ typedef real_t rat;
 RATIONAL_EXPORT float rat_to_float(rat const a) {
 	return os_RealToFloat(&a);
 }
+/// the CE's double is the same 32 bits as its float.
+RATIONAL_EXPORT double rat_to_double(rat const a) {
+	return os_RealToFloat(&a);
+}
 RATIONAL_EXPORT rat float_to_rat(float const a) {
 	return os_FloatToReal(a);
 }
@@ -199,6 +203,24 @@ RATIONAL_EXPORT rat rat_round(rat const a, unsigned const digits) {
 	return os_RealRound(&a, ( char )(digits));
 }
 
+/** Array Operations */
+/// out[i] = f(in[i]), out may alias in.
+RATIONAL_EXPORT void rat_exp_vec(size_t const n, rat *const out, rat const *const in) {
+	for( size_t i=0; i < n; i++ ) {
+		out[i] = rat_exp(in[i]);
+	}
+}
+RATIONAL_EXPORT void rat_ln_vec(size_t const n, rat *const out, rat const *const in) {
+	for( size_t i=0; i < n; i++ ) {
+		out[i] = rat_ln(in[i]);
+	}
+}
+RATIONAL_EXPORT void rat_sqrt_vec(size_t const n, rat *const out, rat const *const in) {
+	for( size_t i=0; i < n; i++ ) {
+		out[i] = rat_sqrt(in[i]);
+	}
+}
+
 #	else
 #include <tgmath.h>
 typedef long double    rat;
@@ -208,6 +230,9 @@ typedef long double    rat;
 RATIONAL_EXPORT float rat_to_float(rat const a) {
 	return ( float )(a);
 }
+RATIONAL_EXPORT double rat_to_double(rat const a) {
+	return ( double )(a);
+}
 RATIONAL_EXPORT rat float_to_rat(float const a) {
 	return ( rat )(a);
 }
@@ -381,6 +406,109 @@ RATIONAL_EXPORT rat rat_round(rat const a, unsigned const digits) {
 	rat const tenth_pow = pow(10.0L, digits+0.L);
 	return round(a * tenth_pow) / tenth_pow;
 }
+
+/** Array Operations */
+/// out[i] = f(in[i]), out may alias in.
+/// These run on double lanes in fixed-width blocks with no branches in the inner loops so
+/// the compiler can keep them in vector registers, long double has no SIMD form.
+/// exp and ln are good to a few ulp of double, which is plenty for device models.
+enum { RAT_VEC_LANES = 8 };
+
+/// e^x = 2^k * e^r, |r| <= ln2/2, with a degree 11 Taylor polynomial for e^r. x in [-708, 709].
+RATIONAL_EXPORT void rat_exp_lanes(double v[const static RAT_VEC_LANES]) {
+	double const log2e = 1.4426950408889634, ln2_hi = 6.93147180369123816490e-01, ln2_lo = 1.90821492927058770002e-10;
+	double const round_magic = 6755399441055744.0; /// 1.5 * 2^52, leaves k in the low mantissa bits.
+	for( size_t i=0; i < RAT_VEC_LANES; i++ ) {
+		double const x = v[i];
+		double const t = x * log2e + round_magic;
+		double const kd = t - round_magic;
+		double const r = (x - kd * ln2_hi) - kd * ln2_lo;
+		double p = 1.0 / 39916800.0;
+		p = p * r + 1.0 / 3628800.0;
+		p = p * r + 1.0 / 362880.0;
+		p = p * r + 1.0 / 40320.0;
+		p = p * r + 1.0 / 5040.0;
+		p = p * r + 1.0 / 720.0;
+		p = p * r + 1.0 / 120.0;
+		p = p * r + 1.0 / 24.0;
+		p = p * r + 1.0 / 6.0;
+		p = p * r + 0.5;
+		p = p * r + 1.0;
+		p = p * r + 1.0;
+		uint64_t bits;
+		memcpy(&bits, &t, sizeof bits);
+		bits = (bits + 1023) << 52;
+		double scale;
+		memcpy(&scale, &bits, sizeof scale);
+		v[i] = p * scale;
+	}
+}
+
+/// ln x = e*ln2 + ln m, m in [sqrt(2)/2, sqrt(2)), ln m = 2*atanh((m-1)/(m+1)). x normal and positive.
+RATIONAL_EXPORT void rat_ln_lanes(double v[const static RAT_VEC_LANES]) {
+	double const ln2 = 6.93147180559945309417e-01;
+	uint64_t const sqrt2_bits = 0x3FF6A09E667F3BCDull;
+	for( size_t i=0; i < RAT_VEC_LANES; i++ ) {
+		uint64_t bits;
+		memcpy(&bits, &v[i], sizeof bits);
+		/// all integer ops on the bits, converting through int64 doesn't vectorize without AVX-512.
+		uint64_t const mant = bits & 0x000FFFFFFFFFFFFFull;
+		uint64_t const high = mant > (sqrt2_bits & 0x000FFFFFFFFFFFFFull); /// then halve m into [sqrt(2)/2, 1).
+		uint64_t const m_bits = mant | ((0x3FFull - high) << 52);
+		uint64_t const e_bits = ((bits >> 52) + high) | 0x4330000000000000ull;
+		double m, e;
+		memcpy(&m, &m_bits, sizeof m);
+		memcpy(&e, &e_bits, sizeof e);
+		e -= 4503599627370496.0 + 1023.0; /// 2^52 + bias.
+		double const f = (m - 1.0) / (m + 1.0), s = f * f;
+		double p = 1.0 / 21.0;
+		p = p * s + 1.0 / 19.0;
+		p = p * s + 1.0 / 17.0;
+		p = p * s + 1.0 / 15.0;
+		p = p * s + 1.0 / 13.0;
+		p = p * s + 1.0 / 11.0;
+		p = p * s + 1.0 / 9.0;
+		p = p * s + 1.0 / 7.0;
+		p = p * s + 1.0 / 5.0;
+		p = p * s + 1.0 / 3.0;
+		p = p * s + 1.0;
+		v[i] = e * ln2 + 2.0 * f * p;
+	}
+}
+
+RATIONAL_EXPORT void rat_sqrt_lanes(double v[const static RAT_VEC_LANES]) {
+	for( size_t i=0; i < RAT_VEC_LANES; i++ ) {
+		v[i] = __builtin_sqrt(v[i]);
+	}
+}
+
+/// gathers n rats into lane blocks clamped to the kernel's domain, runs `lanes` on each and scatters back.
+/// the tail is padded with 1. An input outside [lo, hi] or NaN is redone by `exact`, the scalar
+/// function, so the edges come out as they do there: ln(0) = -inf, ln and sqrt of a negative are NaN.
+RATIONAL_EXPORT void rat_map_lanes(size_t const n, rat *const out, rat const *const in, double const lo, double const hi, void lanes(double[const static RAT_VEC_LANES]), rat exact(rat)) {
+	for( size_t i=0; i < n; i += RAT_VEC_LANES ) {
+		double v[RAT_VEC_LANES];
+		size_t const w = n - i < RAT_VEC_LANES? n - i : RAT_VEC_LANES;
+		for( size_t l=0; l < RAT_VEC_LANES; l++ ) {
+			v[l] = l < w? ( double )(rat_clamp(in[i + l], lo, hi)) : 1.0;
+		}
+		lanes(v);
+		for( size_t l=0; l < w; l++ ) {
+			rat const x = in[i + l];
+			out[i + l] = x >= lo && x <= hi? v[l] : exact(x);
+		}
+	}
+}
+
+RATIONAL_EXPORT void rat_exp_vec(size_t const n, rat *const out, rat const *const in) {
+	rat_map_lanes(n, out, in, -708.0, 709.0, rat_exp_lanes, rat_exp);
+}
+RATIONAL_EXPORT void rat_ln_vec(size_t const n, rat *const out, rat const *const in) {
+	rat_map_lanes(n, out, in, 2.2250738585072014e-308, 1.7976931348623157e308, rat_ln_lanes, rat_ln);
+}
+RATIONAL_EXPORT void rat_sqrt_vec(size_t const n, rat *const out, rat const *const in) {
+	rat_map_lanes(n, out, in, 0.0, 1.7976931348623157e308, rat_sqrt_lanes, rat_sqrt);
+}
 #	endif
 
 
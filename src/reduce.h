@@ -0,0 +1,261 @@
+#ifndef REDUCE_H_INCLUDED
+#	define REDUCE_H_INCLUDED
+
+#include "node.h"
+
+
+/// Series/Parallel network reduction.
+/// Runs over the circuit graph before the matrix is built:
+/// * parallel two-terminal elements between the same pair of nodes are merged into one Comp.
+/// * internal nodes that only join two resistors are collapsed, the node leaves the matrix.
+/// Every collapsed node is recorded so its voltage can be recovered after solving.
+///   .reduce    simplify the deck's circuit before any analysis runs.
+/// Probed, port and measured nodes are kept. The DC results get the collapsed nodes back,
+/// the other analyses print the reduced circuit's nodes only.
+
+/// V[node] = V[a] + frac * (V[b] - V[a])
+struct SeriesRecord {
+	struct SeriesRecord *next;
+	rat                  frac;
+	uint8_t              node, a, b;
+};
+
+struct Reduction {
+	struct SeriesRecord *series;        /// newest collapse first, which is the order for back-substitution.
+	size_t               removed_nodes; /// bitflag of collapsed nodes.
+	size_t               merged;        /// number of parallel merges.
+};
+
+struct ReduceSettings {
+	bool on;
+};
+
+CIRCUIT_EXPORT NO_NULLS bool reduce_parse_directive(struct ReduceSettings *const restrict rs, char const line[const restrict static 1]) {
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word != 7 || strncmp(line, ".reduce", 7) != 0 ) {
+		return false;
+	}
+	rs->on = true;
+	return true;
+}
+
+CIRCUIT_EXPORT uint8_t comp_other_node(struct Comp const *const comp, uint8_t const node) {
+	return comp->owner==node? comp->node : comp->owner;
+}
+
+CIRCUIT_EXPORT bool comp_same_pair(struct Comp const *const a, struct Comp const *const b) {
+	return (a->owner==b->owner && a->node==b->node) || (a->owner==b->node && a->node==b->owner);
+}
+
+CIRCUIT_EXPORT bool comp_is_reducible(struct Comp const *const comp) {
+	/// the stamper skips the ground list, so leave whatever is in it alone.
+	if( node_is_ground(comp->owner) ) {
+		return false;
+	}
+	switch( comp->kind ) {
+		case COMP_RESISTOR: case COMP_INDUCTOR:
+			/// zero-ohm resistors are ideal wires, leave them to the stamper.
+			return !rat_lt(rat_abs(comp->value), rat_epsilon());
+		case COMP_CAPACITOR: case COMP_DC_CURRENT_SRC:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/// nodes that dependent sources sense or macromodels and devices tie into must stay in the matrix.
+CIRCUIT_EXPORT NO_NULLS size_t circuit_control_nodes(struct Circuit const *const c) {
+	size_t ctrl = 0;
+	for( uint8_t node=0; node < MAX_NODES; node++ ) {
+		for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+			switch( cmp->kind ) {
+				case COMP_VCCS: case COMP_VCVS: case COMP_CCVS: case COMP_CCCS:
+					ctrl |= (1 << cmp->aux.dep.np) | (1 << cmp->aux.dep.nn);
+					break;
+				case COMP_MACROMODEL:
+					for( size_t i=0; i < cmp->aux.macro->model->ports; i++ ) {
+						ctrl |= (1 << cmp->aux.macro->nodes[i]);
+					}
+					break;
+				case COMP_DIODE: case COMP_MOSFET: case COMP_BJT:
+					for( size_t t=0; t < device_terminals(cmp->kind); t++ ) {
+						ctrl |= (1 << cmp->aux.dev->nodes[t]);
+					}
+					break;
+			}
+		}
+	}
+	return ctrl;
+}
+
+/// folds `dup` into `keep`, both must be the same kind across the same pair of nodes.
+CIRCUIT_EXPORT NO_NULLS void comp_merge_parallel(struct Comp *const keep, struct Comp const *const dup) {
+	switch( keep->kind ) {
+		case COMP_RESISTOR: case COMP_INDUCTOR: {
+			/// R1 || R2 = R1*R2 / (R1 + R2)
+			keep->value = rat_div(rat_mul(keep->value, dup->value), rat_add(keep->value, dup->value));
+			break;
+		}
+		case COMP_CAPACITOR: {
+			keep->value = rat_add(keep->value, dup->value);
+			break;
+		}
+		case COMP_DC_CURRENT_SRC: {
+			/// sources pointing the other way subtract.
+			keep->value = dup->owner==keep->owner? rat_add(keep->value, dup->value) : rat_sub(keep->value, dup->value);
+			break;
+		}
+	}
+}
+
+/// returns the number of merges done.
+CIRCUIT_EXPORT NO_NULLS size_t circuit_merge_parallel(struct Circuit *const c) {
+	size_t merges = 0;
+	for( uint8_t node=0; node < MAX_NODES; node++ ) {
+		for( struct Comp *keep = c->components[node]; keep != NULL; keep=keep->next ) {
+			if( !comp_is_reducible(keep) ) {
+				continue;
+			}
+			/// a parallel twin sits either in this list or in the list of the other node, reversed.
+			uint8_t const lists[] = { keep->owner, keep->node };
+			for( size_t l=0; l < sizeof lists; l++ ) {
+				struct Comp *dup = l==0? keep->next : c->components[lists[l]];
+				while( dup != NULL ) {
+					struct Comp *const next = dup->next;
+					if( dup->kind==keep->kind && comp_same_pair(dup, keep) && comp_is_reducible(dup) ) {
+						comp_merge_parallel(keep, dup);
+						( void )(circuit_unlink_component(c, dup));
+						merges++;
+					}
+					dup = next;
+				}
+			}
+		}
+	}
+	return merges;
+}
+
+/// counts the components touching `node` and hands back the first two.
+CIRCUIT_EXPORT NO_NULLS size_t circuit_node_degree(struct Circuit *const c, uint8_t const node, struct Comp *(*const pair_out)[2]) {
+	size_t degree = 0;
+	for( uint8_t owner=0; owner < MAX_NODES; owner++ ) {
+		for( struct Comp *cmp = c->components[owner]; cmp != NULL; cmp=cmp->next ) {
+			if( cmp->owner != node && cmp->node != node ) {
+				continue;
+			}
+			if( degree < 2 ) {
+				(*pair_out)[degree] = cmp;
+			}
+			degree++;
+		}
+	}
+	return degree;
+}
+
+/// collapses every series node it finds in one pass, returns how many or ERR_OOM.
+CIRCUIT_EXPORT NO_NULLS int circuit_collapse_series(struct Circuit *const c, struct Reduction *const red, size_t const keep_nodes) {
+	int collapsed = 0;
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		if( !(c->active_nodes & (1 << node)) || (keep_nodes & (1 << node)) ) {
+			continue;
+		}
+		struct Comp *pair[2] = { NULL, NULL };
+		if( circuit_node_degree(c, node, &pair) != 2 ) {
+			continue;
+		} else if( pair[0]->kind != COMP_RESISTOR || pair[1]->kind != COMP_RESISTOR || !comp_is_reducible(pair[0]) || !comp_is_reducible(pair[1]) ) {
+			continue;
+		}
+		uint8_t const a = comp_other_node(pair[0], node);
+		uint8_t const b = comp_other_node(pair[1], node);
+		if( a==b ) {
+			continue;
+		}
+		
+		struct SeriesRecord *const rec = bistack_alloc_back(&c->bistack, sizeof *rec);
+		if( rec==NULL ) {
+			return ERR_OOM;
+		}
+		rat const total = rat_add(pair[0]->value, pair[1]->value);
+		rec->frac = rat_div(pair[0]->value, total);
+		rec->node = node;
+		rec->a    = a;
+		rec->b    = b;
+		rec->next = red->series;
+		red->series = rec;
+		
+		( void )(circuit_unlink_component(c, pair[0]));
+		( void )(circuit_unlink_component(c, pair[1]));
+		pair[0]->value = total;
+		if( node_is_ground(a) ) {
+			pair[0]->node = a;
+			circuit_connect_component(c, b, a, pair[0]);
+		} else {
+			pair[0]->node = b;
+			circuit_connect_component(c, a, b, pair[0]);
+		}
+		c->active_nodes &= ~(1 << node);
+		red->removed_nodes |= (1 << node);
+		collapsed++;
+	}
+	return collapsed;
+}
+
+/**
+ * Simplifies the circuit graph in place until nothing else merges or collapses.
+ * `keep_nodes` is a bitflag of nodes that must survive (probes, ports).
+ * Returns ERR_OK or ERR_OOM when the back-substitution records don't fit.
+ */
+CIRCUIT_EXPORT NO_NULLS int circuit_reduce(struct Circuit *const c, struct Reduction *const red, size_t const keep_nodes) {
+	*red = (struct Reduction){0};
+	size_t const keep = keep_nodes | circuit_control_nodes(c);
+	for(;;) {
+		red->merged += circuit_merge_parallel(c);
+		int const collapsed = circuit_collapse_series(c, red, keep);
+		if( collapsed==ERR_OOM ) {
+			return ERR_OOM;
+		} else if( collapsed==0 ) {
+			break;
+		}
+	}
+	return ERR_OK;
+}
+
+/// back-substitution: fills in the voltages of collapsed nodes from the solved ones.
+CIRCUIT_EXPORT NO_NULLS void reduction_recover_voltages(struct Reduction const *const red, rat (*const V)[MAX_NODES]) {
+	for( struct SeriesRecord const *rec = red->series; rec != NULL; rec = rec->next ) {
+		rat const va = (*V)[rec->a];
+		rat const vb = (*V)[rec->b];
+		(*V)[rec->node] = rat_addmul(va, rec->frac, rat_sub(vb, va));
+	}
+}
+
+/// solve on the reduced circuit, then recover every collapsed node.
+CIRCUIT_EXPORT NO_NULLS enum RREFResult circuit_dc_voltages_reduced(struct Circuit *const c, struct Reduction const *const red, rat (*const V_out)[MAX_NODES]) {
+	enum RREFResult const res = circuit_dc_voltages(c, V_out);
+	if( res != RREFResultBadMatrix ) {
+		reduction_recover_voltages(red, V_out);
+	}
+	return res;
+}
+
+/// what the reduction took out, then the DC voltages of the collapsed nodes.
+CIRCUIT_EXPORT NO_NULLS void reduction_print(struct Circuit *const restrict c, struct Reduction const *const restrict red, FILE *const restrict out) {
+	fprintf(out, "reduce: %zu parallel merges, collapsed nodes:", red->merged);
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		if( red->removed_nodes & (1 << node) ) {
+			fprintf(out, " %u", node);
+		}
+	}
+	fputs(red->removed_nodes==0? " none\n" : "\n", out);
+	rat V[MAX_NODES];
+	if( red->removed_nodes==0 || circuit_dc_voltages_reduced(c, red, &V)==RREFResultBadMatrix ) {
+		return;
+	}
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		if( red->removed_nodes & (1 << node) ) {
+			char num[48] = {0};
+			fprintf(out, "V%u = %s\n", node, rat_to_cstr(V[node], sizeof num, num));
+		}
+	}
+}
+#endif
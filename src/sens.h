@@ -0,0 +1,181 @@
+#ifndef SENS_H_INCLUDED
+#	define SENS_H_INCLUDED
+
+#include "nonlinear.h"
+
+
+/// DC sensitivities by the adjoint method.
+///   .sens V(3) V(5)
+/// With G*x = b and an output y = x[o], one transposed solve G^T * l = e_o against the
+/// factorization already used for x gives every derivative at once:
+///   dy/dp = -l^T * (dG/dp * x - db/dp)
+/// Resistor R between a and b:     dy/dR = (l_a - l_b) * (x_a - x_b) / R^2
+/// Current source I from a to b:   dy/dI = l_b - l_a
+/// That's one extra solve per output instead of one per component.
+/// Results come sorted by normalized sensitivity, (p / y) * dy/dp, the relative change
+/// of the output per relative change of the value, which is what ranking wants.
+
+struct SensSettings {
+	size_t outputs; /// node bitflags.
+};
+
+struct Sensitivity {
+	struct Comp const *cmp;
+	rat                d;           /// dy/dvalue.
+	rat                normalized;  /// (value / y) * dy/dvalue, 0 when y is.
+};
+
+/// the factored DC system the adjoint solves share.
+struct SensSystem {
+	struct LUSymbolic sym;
+	rat              *LU, *x;
+	uint8_t           matrix_id_to_node[MAX_NODES], node_to_matrix_id[MAX_NODES];
+	size_t            n;
+};
+
+/// .sens V(3) 5 ...
+CIRCUIT_EXPORT NO_NULLS bool sens_parse_directive(struct SensSettings *const restrict sens, char const line[const restrict static 1]) {
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word != 5 || strncmp(line, ".sens", 5) != 0 ) {
+		return false;
+	}
+	for( size_t i=5; line[i] != 0; ) {
+		if( isdigit(line[i]) ) {
+			unsigned long const node = strtoul(&line[i], NULL, 10);
+			if( node > 0 && node < MAX_NODES ) {
+				sens->outputs |= ( size_t )(1) << node;
+			}
+			while( isdigit(line[i]) ) {
+				i++;
+			}
+		} else {
+			i++;
+		}
+	}
+	return true;
+}
+
+CIRCUIT_EXPORT NO_NULLS rat sens_voltage(struct SensSystem const *const sys, uint8_t const node) {
+	return node_is_ground(node)? rat_zero() : sys->x[sys->node_to_matrix_id[node]];
+}
+
+/**
+ * Builds, factors and solves the DC system once on the front stack.
+ * Returns ERR_OK, ERR_OOM or ERR_SINGULAR when the factorization would need pivoting.
+ */
+CIRCUIT_EXPORT NO_NULLS int sens_prepare(struct Circuit *const restrict c, struct SensSystem *const restrict sys) {
+	*sys = (struct SensSystem){0};
+	rat *G = NULL;
+	sys->n = circuit_build_dc(c, &sys->matrix_id_to_node, &G, &sys->x);
+	if( sys->n==0 ) {
+		return ERR_SINGULAR;
+	} else if( G==NULL || sys->x==NULL ) {
+		return ERR_OOM;
+	}
+	for( size_t i=0; i < sys->n; i++ ) {
+		sys->node_to_matrix_id[sys->matrix_id_to_node[i]] = i;
+	}
+	lu_symbolic(sys->n, G, &sys->sym);
+	if( !lu_factor_scheduled(&sys->sym, G) ) {
+		return ERR_SINGULAR;
+	}
+	sys->LU = G;
+	lu_solve_scheduled(&sys->sym, sys->LU, sys->x);
+	return ERR_OK;
+}
+
+/**
+ * Fills `out` with the sensitivities of V(output) to every resistor and current source,
+ * sorted by |normalized| then |d|, largest first. Returns how many there were,
+ * only the first `cap` are written. `lambda` is n scratch rats.
+ */
+CIRCUIT_EXPORT NO_NULLS size_t sens_for_output(struct Circuit const *const restrict c, struct SensSystem const *const restrict sys, uint8_t const output, rat lambda[const restrict], struct Sensitivity out[const restrict], size_t const cap) {
+	size_t const n = sys->n;
+	for( size_t i=0; i < n; i++ ) {
+		lambda[i] = rat_zero();
+	}
+	lambda[sys->node_to_matrix_id[output]] = rat_pos1();
+	lu_solve_transposed(&sys->sym, sys->LU, lambda);
+	
+	rat const y = sens_voltage(sys, output);
+	bool const y_zero = rat_lt(rat_abs(y), rat_epsilon());
+	size_t count = 0;
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+			rat const l_a = node_is_ground(cmp->owner)? rat_zero() : lambda[sys->node_to_matrix_id[cmp->owner]];
+			rat const l_b = node_is_ground(cmp->node)?  rat_zero() : lambda[sys->node_to_matrix_id[cmp->node]];
+			rat d;
+			if( cmp->kind==COMP_RESISTOR && !rat_lt(rat_abs(cmp->value), rat_epsilon()) ) {
+				rat const dv = rat_sub(sens_voltage(sys, cmp->owner), sens_voltage(sys, cmp->node));
+				d = rat_div(rat_mul(rat_sub(l_a, l_b), dv), rat_mul(cmp->value, cmp->value));
+			} else if( cmp->kind==COMP_DC_CURRENT_SRC ) {
+				d = rat_sub(l_b, l_a);
+			} else {
+				continue;
+			}
+			struct Sensitivity const s = {
+				.cmp = cmp,
+				.d = d,
+				.normalized = y_zero? rat_zero() : rat_div(rat_mul(cmp->value, d), y),
+			};
+			/// insertion into the sorted prefix, the list is only ever a handful long.
+			size_t pos = count < cap? count : cap;
+			while( pos > 0 ) {
+				struct Sensitivity const *const prev = &out[pos-1];
+				int const by_norm = rat_cmp(rat_abs(prev->normalized), rat_abs(s.normalized));
+				if( by_norm > 0 || (by_norm==0 && !rat_lt(rat_abs(prev->d), rat_abs(s.d))) ) {
+					break;
+				}
+				if( pos < cap ) {
+					out[pos] = *prev;
+				}
+				pos--;
+			}
+			if( pos < cap ) {
+				out[pos] = s;
+			}
+			count++;
+		}
+	}
+	return count;
+}
+
+/// one line per component and output: sens V<o> <letter> <a> <b> <value> <dV/dvalue> <normalized>.
+CIRCUIT_EXPORT NO_NULLS void circuit_solve_sens(struct Circuit *const restrict c, struct SensSettings const *const restrict sens, FILE *const restrict out) {
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	if( circuit_has_devices(c) ) {
+		fputs("sens: linear circuits only\n", out);
+		return;
+	}
+	struct SensSystem sys;
+	int const err = sens_prepare(c, &sys);
+	size_t cap = 0;
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+			cap++;
+		}
+	}
+	rat *const lambda = err==ERR_OK? alloc_vec(&c->bistack, sys.n) : NULL;
+	struct Sensitivity *const list = err==ERR_OK? bistack_alloc_front_vec(&c->bistack, cap + 1, sizeof *list) : NULL;
+	if( err != ERR_OK || lambda==NULL || list==NULL ) {
+		fputs(err==ERR_SINGULAR? "sens: no factorization without pivoting\n" : "sens: out of memory\n", out);
+		bistack_release_front(&c->bistack, mark);
+		return;
+	}
+	for( uint8_t o=1; o < MAX_NODES; o++ ) {
+		if( (sens->outputs & (1 << o))==0 || (c->active_nodes & (1 << o))==0 ) {
+			continue;
+		}
+		size_t const count = sens_for_output(c, &sys, o, lambda, list, cap);
+		for( size_t k=0; k < count && k < cap; k++ ) {
+			struct Comp const *const cmp = list[k].cmp;
+			char val[48] = {0}, d[48] = {0}, norm[48] = {0};
+			fprintf(out, "sens V%u %c %u %u %s %s %s\n", o, letter_from_kind(cmp->kind), cmp->owner, cmp->node,
+				rat_to_cstr(cmp->value, sizeof val, val),
+				rat_to_cstr(list[k].d, sizeof d, d),
+				rat_to_cstr(list[k].normalized, sizeof norm, norm));
+		}
+	}
+	bistack_release_front(&c->bistack, mark);
+}
+#endif
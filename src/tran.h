@@ -0,0 +1,417 @@
+#ifndef TRAN_H_INCLUDED
+#	define TRAN_H_INCLUDED
+
+#include "nonlinear.h"
+
+
+/// Transient analysis.
+/// Every capacitor and inductor becomes a companion model for the step being taken:
+/// the integration formula turns x'(n+1) into a0*x(n+1) + hist, so each element is a
+/// conductance that only depends on a0 in parallel with a current set by its history.
+///   capacitor (x = v):  i = C*a0 * v + C*hist
+///   inductor  (x = i):  i = v/(L*a0) - hist/a0
+/// The matrix only changes when a0 does, that is when the step or the formula changes.
+/// Steps only grow by doubling, so runs of equal steps reuse one factorization and
+/// each step costs a right-hand side and two triangular solves.
+/// Sources switch on at t = 0 with every capacitor discharged and every inductor at rest.
+
+enum {
+	TRAN_BE = 0, /// backward Euler, order 1.
+	TRAN_TRAP,   /// trapezoidal, order 2.
+	TRAN_BDF2,   /// Gear order 2, variable step.
+};
+
+/// .tran <tstep> <tstop> [be|trap|bdf2]
+/// tstep is the output spacing and the largest internal step.
+struct TranSettings {
+	rat     tstep, tstop;
+	uint8_t method;
+};
+
+struct TranStats {
+	size_t steps, rejected, factorizations;
+};
+
+/// one capacitor or inductor, x is its voltage or current.
+struct TranState {
+	struct Comp const *comp;
+	rat                x[3];     /// x(n), x(n-1), x(n-2).
+	rat                dx;       /// x'(n), the trapezoidal rule needs it.
+	rat                g, src;   /// companion of the step being taken.
+	rat                next;     /// x(n+1) of the step being taken.
+	uint8_t            a, b;
+	bool               b_g;
+};
+
+struct TranSystem {
+	rat              *G, *rhs0;  /// everything that isn't reactive, from circuit_build_dc.
+	rat              *LU, *rhs;
+	struct TranState *states;
+	struct LUSymbolic sym;
+	rat               t[3];      /// t(n), t(n-1), t(n-2).
+	rat               a0;        /// what LU was factored for.
+	size_t            n, count, history;
+	uint8_t           matrix_id_to_node[MAX_NODES];
+};
+
+/// receives every output point, `V` is indexed by node and `node_bits` says which are live.
+struct TranSink {
+	void (*emit)(void *ctx, rat t, size_t node_bits, rat const (*V)[MAX_NODES]);
+	void  *ctx;
+};
+
+/// returns true if `line` was a .tran directive, malformed ones leave `tr` off.
+CIRCUIT_EXPORT NO_NULLS bool tran_parse_directive(struct TranSettings *const restrict tr, char const line[const restrict static 1]) {
+	char step_tok[48] = {0}, stop_tok[48] = {0}, method[8] = {0};
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word != 5 || strncmp(line, ".tran", 5) != 0 ) {
+		return false;
+	}
+	*tr = (struct TranSettings){ .method = TRAN_TRAP };
+	if( sscanf(line, " .tran %47s %47s %7s", step_tok, stop_tok, method) < 2 ) {
+		return true;
+	}
+	for( size_t i=0; method[i] != 0; i++ ) {
+		method[i] = tolower(method[i]);
+	}
+	tr->method = !strcmp(method, "be")? TRAN_BE : !strcmp(method, "bdf2") || !strcmp(method, "gear")? TRAN_BDF2 : TRAN_TRAP;
+	tr->tstep  = parse_si_scalar(step_tok);
+	tr->tstop  = parse_si_scalar(stop_tok);
+	return true;
+}
+
+CIRCUIT_EXPORT bool tran_is_reactive(struct Comp const *const cmp) {
+	return (cmp->kind==COMP_CAPACITOR || cmp->kind==COMP_INDUCTOR) && !rat_lt(rat_abs(cmp->value), rat_epsilon());
+}
+
+/// order of accuracy, which also sets how much history the error estimate needs.
+CIRCUIT_EXPORT size_t tran_order(uint8_t const method) {
+	return method==TRAN_BE? 1 : 2;
+}
+
+/// x'(n+1) = a0*x(n+1) + hist, `h_prev` only matters for BDF2.
+CIRCUIT_EXPORT rat tran_a0(uint8_t const method, rat const h, rat const h_prev) {
+	switch( method ) {
+		case TRAN_TRAP: return rat_div(rat_from_int(2), h);
+		case TRAN_BDF2: {
+			rat const w = rat_div(h, h_prev);
+			return rat_div(rat_addmul(rat_pos1(), rat_from_int(2), w), rat_mul(h, rat_add(rat_pos1(), w)));
+		}
+	}
+	return rat_recip(h);
+}
+
+CIRCUIT_EXPORT NO_NULLS rat tran_history(uint8_t const method, rat const h, rat const h_prev, struct TranState const *const st) {
+	switch( method ) {
+		case TRAN_TRAP:
+			return rat_sub(rat_neg(rat_div(rat_mul(rat_from_int(2), st->x[0]), h)), st->dx);
+		case TRAN_BDF2: {
+			rat const w  = rat_div(h, h_prev);
+			rat const a1 = rat_neg(rat_div(rat_add(rat_pos1(), w), h));
+			rat const a2 = rat_div(rat_mul(w, w), rat_mul(h, rat_add(rat_pos1(), w)));
+			return rat_addmul(rat_mul(a1, st->x[0]), a2, st->x[1]);
+		}
+	}
+	return rat_neg(rat_div(st->x[0], h));
+}
+
+/// sets the companion conductance and current of `st` for a step.
+CIRCUIT_EXPORT NO_NULLS void tran_companion(struct TranState *const st, rat const a0, rat const hist) {
+	rat const value = st->comp->value;
+	if( st->comp->kind==COMP_CAPACITOR ) {
+		st->g   = rat_mul(value, a0);
+		st->src = rat_mul(value, hist);
+	} else {
+		st->g   = rat_recip(rat_mul(value, a0));
+		st->src = rat_neg(rat_div(hist, a0));
+	}
+}
+
+/// symbolic LU over the pattern of G plus every companion, which stays fixed for the run.
+CIRCUIT_EXPORT NO_NULLS void tran_analyze(struct TranSystem *const sys) {
+	size_t const n = sys->n;
+	size_t rows[MAX_NODES] = {0};
+	rat const eps = rat_epsilon();
+	for( size_t i=0; i < n; i++ ) {
+		for( size_t j=0; j < n; j++ ) {
+			if( !rat_lt(rat_abs(sys->G[idx_2_to_1(i,j,n)]), eps) ) {
+				rows[i] |= (1 << j);
+			}
+		}
+	}
+	for( size_t k=0; k < sys->count; k++ ) {
+		struct TranState const *const st = &sys->states[k];
+		rows[st->a] |= (1 << st->a);
+		if( !st->b_g ) {
+			rows[st->a] |= (1 << st->b);
+			rows[st->b] |= (1 << st->a) | (1 << st->b);
+		}
+	}
+	lu_symbolic_from_pattern(n, rows, &sys->sym);
+}
+
+/**
+ * Assembles the static part and collects the reactive elements, all on the front stack.
+ * Devices aren't stamped, callers refuse circuits that have any.
+ * Returns ERR_OK, ERR_OOM or ERR_NODE_OOB if there's nothing to simulate.
+ */
+CIRCUIT_EXPORT NO_NULLS int tran_build(struct Circuit *const restrict c, struct TranSystem *const restrict sys) {
+	*sys = (struct TranSystem){0};
+	sys->n = circuit_build_dc(c, &sys->matrix_id_to_node, &sys->G, &sys->rhs0);
+	size_t const n = sys->n;
+	if( n==0 ) {
+		return ERR_NODE_OOB;
+	} else if( sys->G==NULL || sys->rhs0==NULL ) {
+		return ERR_OOM;
+	}
+	uint8_t node_to_matrix_id[MAX_NODES] = {0};
+	for( size_t i=0; i < n; i++ ) {
+		node_to_matrix_id[sys->matrix_id_to_node[i]] = i;
+	}
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+			sys->count += tran_is_reactive(cmp);
+		}
+	}
+	sys->LU     = alloc_vec(&c->bistack, n*n);
+	sys->rhs    = alloc_vec(&c->bistack, n);
+	sys->states = bistack_alloc_front_vec(&c->bistack, sys->count + 1, sizeof *sys->states);
+	if( sys->LU==NULL || sys->rhs==NULL || sys->states==NULL ) {
+		return ERR_OOM;
+	}
+	
+	size_t k = 0;
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+			if( !tran_is_reactive(cmp) ) {
+				continue;
+			}
+			struct TranState *const st = &sys->states[k++];
+			*st = (struct TranState){ .comp = cmp, .b_g = node_is_ground(cmp->node) };
+			st->a = node_to_matrix_id[cmp->owner];
+			st->b = st->b_g? st->a : node_to_matrix_id[cmp->node];
+			st->x[0] = st->x[1] = st->x[2] = st->dx = rat_zero();
+		}
+	}
+	tran_analyze(sys);
+	sys->t[0] = sys->t[1] = sys->t[2] = rat_zero();
+	sys->a0 = rat_zero();
+	return ERR_OK;
+}
+
+/// refactors G plus the companion conductances, only called when a0 moved.
+CIRCUIT_EXPORT NO_NULLS bool tran_factor(struct TranSystem *const sys, rat const a0) {
+	size_t const n = sys->n;
+	memcpy(sys->LU, sys->G, n*n * sizeof *sys->LU);
+	for( size_t k=0; k < sys->count; k++ ) {
+		struct TranState *const st = &sys->states[k];
+		tran_companion(st, a0, rat_zero());
+		struct Stamp stamps[4];
+		struct StampBuffer buf = { .data = stamps, .cap = 4 };
+		stamp_push_conductance(&buf, st->a, st->b, st->b_g, st->g);
+		stamps_apply(&buf, n, sys->LU, sys->rhs);
+	}
+	sys->a0 = a0;
+	return lu_factor_scheduled(&sys->sym, sys->LU);
+}
+
+/**
+ * Solves one step of length `h` from t(n) into `v` (by matrix id) and fills each state's `next`.
+ * Nothing is committed, see tran_accept.
+ * Returns false if the companion matrix is singular.
+ */
+CIRCUIT_EXPORT NO_NULLS bool tran_step(struct TranSystem *const restrict sys, uint8_t const method, rat const h, rat const h_prev, rat v[const restrict], struct TranStats *const restrict stats) {
+	size_t const n = sys->n;
+	rat const a0 = tran_a0(method, h, h_prev);
+	if( rat_cmp(a0, sys->a0) != 0 ) {
+		stats->factorizations++;
+		if( !tran_factor(sys, a0) ) {
+			sys->a0 = rat_zero();
+			return false;
+		}
+	}
+	memcpy(v, sys->rhs0, n * sizeof *v);
+	for( size_t k=0; k < sys->count; k++ ) {
+		struct TranState *const st = &sys->states[k];
+		tran_companion(st, a0, tran_history(method, h, h_prev, st));
+		/// the companion current leaves a through the branch.
+		v[st->a] = rat_sub(v[st->a], st->src);
+		if( !st->b_g ) {
+			v[st->b] = rat_add(v[st->b], st->src);
+		}
+	}
+	lu_solve_scheduled(&sys->sym, sys->LU, v);
+	for( size_t k=0; k < sys->count; k++ ) {
+		struct TranState *const st = &sys->states[k];
+		rat const vab = st->b_g? v[st->a] : rat_sub(v[st->a], v[st->b]);
+		st->next = st->comp->kind==COMP_CAPACITOR? vab : rat_addmul(st->src, st->g, vab);
+	}
+	return true;
+}
+
+/// k-th divided difference over t[0..k], x[0..k].
+CIRCUIT_EXPORT rat divided_difference(size_t const k, rat const t[const static k+1], rat const x[const static k+1]) {
+	rat dd[4] = {0};
+	for( size_t i=0; i <= k; i++ ) {
+		dd[i] = x[i];
+	}
+	for( size_t level=1; level <= k; level++ ) {
+		for( size_t i=0; i + level <= k; i++ ) {
+			dd[i] = rat_div(rat_sub(dd[i], dd[i+1]), rat_sub(t[i], t[i+level]));
+		}
+	}
+	return dd[0];
+}
+
+/**
+ * Worst local truncation error of the pending step over its tolerance, <= 1 means accept.
+ * LTE = C * h^(k+1) * x^(k+1), the derivative coming from a divided difference over the
+ * new point and the accepted history. Without enough history the step is taken as is.
+ */
+CIRCUIT_EXPORT NO_NULLS rat tran_error_ratio(struct TranSystem const *const sys, uint8_t const method, rat const h) {
+	size_t const order = tran_order(method);
+	if( sys->history < order ) {
+		return rat_zero();
+	}
+	/// C * (k+1)!: BE 1/2 * 2, trapezoidal 1/12 * 6, BDF2 2/9 * 6.
+	rat const lte_const = method==TRAN_BE? rat_pos1() : method==TRAN_TRAP? float_to_rat(0.5f) : rat_div(rat_from_int(4), rat_from_int(3));
+	rat const h_pow = rat_pow(h, rat_from_int(order + 1));
+	rat const reltol = float_to_rat(1E-3), trtol = rat_from_int(7);
+	rat const t_new = rat_add(sys->t[0], h);
+	rat const tt[4] = { t_new, sys->t[0], sys->t[1], sys->t[2] };
+	rat worst = rat_zero();
+	for( size_t k=0; k < sys->count; k++ ) {
+		struct TranState const *const st = &sys->states[k];
+		rat const xx[4] = { st->next, st->x[0], st->x[1], st->x[2] };
+		rat const lte = rat_abs(rat_mul(rat_mul(lte_const, h_pow), divided_difference(order + 1, tt, xx)));
+		rat const abstol = st->comp->kind==COMP_CAPACITOR? float_to_rat(1E-6) : float_to_rat(1E-12);
+		rat const tol = rat_mul(trtol, rat_addmul(abstol, reltol, rat_max(rat_abs(st->next), rat_abs(st->x[0]))));
+		worst = rat_max(worst, rat_div(lte, tol));
+	}
+	return worst;
+}
+
+/// commits the pending step.
+CIRCUIT_EXPORT NO_NULLS void tran_accept(struct TranSystem *const sys, uint8_t const method, rat const h, rat const h_prev) {
+	rat const a0 = tran_a0(method, h, h_prev);
+	for( size_t k=0; k < sys->count; k++ ) {
+		struct TranState *const st = &sys->states[k];
+		st->dx   = rat_addmul(tran_history(method, h, h_prev, st), a0, st->next);
+		st->x[2] = st->x[1];
+		st->x[1] = st->x[0];
+		st->x[0] = st->next;
+	}
+	sys->t[2] = sys->t[1];
+	sys->t[1] = sys->t[0];
+	sys->t[0] = rat_add(sys->t[0], h);
+	sys->history++;
+}
+
+/**
+ * Runs the transient from 0 to tstop, handing `sink` every multiple of tstep.
+ * Output points are interpolated between the internal steps, so the step control
+ * never has to land on them and the factorization survives across outputs.
+ * Returns ERR_OK, ERR_SINGULAR, ERR_OOM or ERR_NODE_OOB for an empty circuit or bad settings.
+ */
+CIRCUIT_EXPORT NO_NULLS int circuit_tran(struct Circuit *const restrict c, struct TranSettings const *const restrict tr, struct TranSink const *const restrict sink, struct TranStats *const restrict stats) {
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	*stats = (struct TranStats){0};
+	if( rat_le(tr->tstep, rat_zero()) || rat_lt(tr->tstop, tr->tstep) ) {
+		return ERR_NODE_OOB;
+	}
+	struct TranSystem sys;
+	int const err = tran_build(c, &sys);
+	rat *const v = alloc_vec(&c->bistack, sys.n + 1);
+	if( err != ERR_OK || v==NULL ) {
+		bistack_release_front(&c->bistack, mark);
+		return err != ERR_OK? err : ERR_OOM;
+	}
+	size_t const n = sys.n;
+	size_t const node_bits = c->active_nodes & ~(1 << GND_IDX);
+	rat V_prev[MAX_NODES] = {0}, V_now[MAX_NODES] = {0}, V_out[MAX_NODES] = {0};
+	for( size_t i=0; i < MAX_NODES; i++ ) {
+		V_prev[i] = V_now[i] = V_out[i] = rat_zero();
+	}
+	
+	rat const hmax = tr->tstep;
+	rat const hmin = rat_mul(tr->tstop, float_to_rat(1E-9));
+	/// a power of two under hmax, so doubling lands on it exactly.
+	rat h = rat_div(hmax, rat_from_int(64));
+	rat h_prev = h;
+	size_t out_k = 0;
+	sink->emit(sink->ctx, rat_zero(), node_bits, &V_out);
+	out_k++;
+	
+	int res = ERR_OK;
+	while( rat_lt(sys.t[0], tr->tstop) ) {
+		/// the first step has no history for anything but backward Euler.
+		uint8_t const method = sys.history==0? TRAN_BE : tr->method;
+		if( !tran_step(&sys, method, h, h_prev, v, stats) ) {
+			res = ERR_SINGULAR;
+			break;
+		}
+		size_t const order = tran_order(method);
+		rat const ratio = tran_error_ratio(&sys, method, h);
+		if( rat_lt(rat_pos1(), ratio) && rat_lt(hmin, h) ) {
+			stats->rejected++;
+			rat const shrink = rat_mul(float_to_rat(0.9f), rat_root(ratio, rat_from_int(order + 1)));
+			h = rat_max(hmin, rat_div(h, rat_clamp(shrink, rat_from_int(2), rat_from_int(8))));
+			continue;
+		}
+		tran_accept(&sys, method, h, h_prev);
+		stats->steps++;
+		
+		for( size_t i=0; i < MAX_NODES; i++ ) {
+			V_prev[i] = V_now[i];
+		}
+		for( size_t i=0; i < n; i++ ) {
+			V_now[sys.matrix_id_to_node[i]] = v[i];
+		}
+		rat const t_new = sys.t[0], t_old = sys.t[1];
+		for( rat t_out = rat_mul(tr->tstep, rat_from_int(out_k)); rat_le(t_out, t_new) && rat_le(t_out, rat_mul(tr->tstop, float_to_rat(1.000001f))); t_out = rat_mul(tr->tstep, rat_from_int(++out_k)) ) {
+			rat const frac = rat_div(rat_sub(t_out, t_old), rat_sub(t_new, t_old));
+			for( size_t i=0; i < MAX_NODES; i++ ) {
+				V_out[i] = rat_addmul(V_prev[i], frac, rat_sub(V_now[i], V_prev[i]));
+			}
+			sink->emit(sink->ctx, t_out, node_bits, &V_out);
+		}
+		
+		/// only ever double, anything in between would cost a refactor for little gain.
+		h_prev = h;
+		rat const grow = rat_lt(ratio, rat_epsilon())? rat_from_int(4) : rat_mul(float_to_rat(0.9f), rat_root(rat_recip(ratio), rat_from_int(order + 1)));
+		if( rat_le(rat_from_int(2), grow) && rat_lt(h, hmax) ) {
+			h = rat_min(hmax, rat_mul(h, rat_from_int(2)));
+		}
+	}
+	bistack_release_front(&c->bistack, mark);
+	return res;
+}
+
+CIRCUIT_EXPORT void tran_print_point(void *const ctx, rat const t, size_t const node_bits, rat const (*const V)[MAX_NODES]) {
+	FILE *const out = ctx;
+	char num[48] = {0};
+	fprintf(out, "t = %s", rat_to_cstr(t, sizeof num, num));
+	for( size_t i=1; i < MAX_NODES; i++ ) {
+		if( node_bits & (1 << i) ) {
+			fprintf(out, "  V%zu = %s", i, rat_to_cstr((*V)[i], sizeof num, num));
+		}
+	}
+	fputc('\n', out);
+}
+
+/// points go to `sink`, tran_print_point on `out` prints them, diagnostics always go to `out`.
+CIRCUIT_EXPORT NO_NULLS void circuit_solve_tran(struct Circuit *const restrict c, struct TranSettings const *const restrict tr, struct TranSink const *const restrict sink, FILE *const restrict out) {
+	if( circuit_has_devices(c) ) {
+		fputs("tran: linear circuits only\n", out);
+		return;
+	}
+	struct TranStats stats;
+	int const err = circuit_tran(c, tr, sink, &stats);
+	if( err==ERR_SINGULAR ) {
+		fputs("tran: singular companion matrix\n", out);
+	} else if( err==ERR_OOM ) {
+		fputs("tran: out of memory\n", out);
+	}
+	fprintf(out, "tran: %zu steps, %zu rejected, %zu factorizations\n", stats.steps, stats.rejected, stats.factorizations);
+}
+#endif
@@ -0,0 +1,346 @@
+#ifndef WATCH_H_INCLUDED
+#	define WATCH_H_INCLUDED
+
+#include "batch.h"
+
+
+/// Watch mode, re-solves a netlist every time it's saved.
+///   litespice --watch design.cir [reloads]
+/// The file is parsed into a scratch circuit and diffed node by node against the live
+/// one, components are matched on kind and terminals. A changed value is restamped as
+/// the difference from its old one, a removed component has its stamp taken back and
+/// an added one is stamped, all straight into the live G/rhs. Only the rows those
+/// stamps touch, and the rows whose factorization reads them, are refactored, on the
+/// symbolic pattern of the first build as long as the new entries fit in it.
+/// A different node set, devices, subcircuits or any directive mean a full run instead,
+/// the next plain edit after one rebuilds the live system.
+/// The live circuit and the scratch one each get half the memory and trade places on a
+/// rebuild, removed components stay on the live back stack until then.
+/// inotify watches the file's directory so editors that save by rename are seen too.
+
+struct WatchStats {
+	size_t reloads, rebuilds, full_runs;
+	size_t added, removed, changed, rows_refactored;
+};
+
+struct WatchSession {
+	struct Circuit    live;
+	struct LUSymbolic sym;
+	struct WatchStats stats;
+	uint8_t          *arenas[2];
+	rat              *G, *rhs, *LU;  /// on the live back stack.
+	size_t            half, n;
+	uint8_t           node_to_matrix_id[MAX_NODES], matrix_id_to_node[MAX_NODES];
+	uint8_t           scratch;       /// which arena the next parse goes to.
+	bool              ready, factored;
+};
+
+CIRCUIT_EXPORT NO_NULLS void watch_session_make(struct WatchSession *const restrict ws, uint8_t mem[const restrict], size_t const len) {
+	*ws = (struct WatchSession){0};
+	ws->half      = (len / 2) & ~( size_t )(sizeof(rat) - 1);
+	ws->arenas[0] = mem;
+	ws->arenas[1] = &mem[ws->half];
+	ws->live      = circuit_make(ws->half, ws->arenas[0]);
+	ws->scratch   = 1;
+}
+
+/// false for anything that can't be patched into a linear G, devices and subcircuits.
+CIRCUIT_EXPORT NO_NULLS bool watch_patchable(struct Circuit const *const c) {
+	for( uint8_t node=0; node < MAX_NODES; node++ ) {
+		for( struct Comp const *cmp = c->components[node]; cmp != NULL; cmp=cmp->next ) {
+			if( cmp->kind==COMP_MACROMODEL || device_terminals(cmp->kind) > 0 ) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/// same kind between the same terminals, controlling nodes too.
+CIRCUIT_EXPORT NO_NULLS bool comp_same_place(struct Comp const *const a, struct Comp const *const b) {
+	bool const dep = a->kind >= COMP_VCCS && a->kind <= COMP_CCCS;
+	return a->kind==b->kind && a->owner==b->owner && a->node==b->node && (!dep || (a->aux.dep.np==b->aux.dep.np && a->aux.dep.nn==b->aux.dep.nn));
+}
+
+/// makes `next` the live circuit, builds its G/rhs onto its back stack and factors it whole.
+CIRCUIT_EXPORT NO_NULLS void watch_adopt(struct WatchSession *const restrict ws, struct Circuit const *const restrict next) {
+	ws->live    = *next;
+	ws->scratch = !ws->scratch;
+	ws->ready   = false;
+	ws->stats.rebuilds++;
+	struct Circuit *const c = &ws->live;
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	rat *G = NULL, *rhs = NULL;
+	size_t const n = circuit_build_dc(c, &ws->matrix_id_to_node, &G, &rhs);
+	ws->n = n;
+	ws->G   = n > 0? bistack_alloc_back_vec(&c->bistack, n*n, sizeof *ws->G)  : NULL;
+	ws->LU  = n > 0? bistack_alloc_back_vec(&c->bistack, n*n, sizeof *ws->LU) : NULL;
+	ws->rhs = n > 0? bistack_alloc_back_vec(&c->bistack, n,   sizeof *ws->rhs) : NULL;
+	if( n==0 || G==NULL || rhs==NULL || ws->G==NULL || ws->LU==NULL || ws->rhs==NULL ) {
+		bistack_release_front(&c->bistack, mark);
+		return;
+	}
+	memcpy(ws->G, G, n*n * sizeof *G);
+	memcpy(ws->rhs, rhs, n * sizeof *rhs);
+	bistack_release_front(&c->bistack, mark);
+	for( size_t i=0; i < n; i++ ) {
+		ws->node_to_matrix_id[ws->matrix_id_to_node[i]] = i;
+	}
+	lu_symbolic(n, ws->G, &ws->sym);
+	memcpy(ws->LU, ws->G, n*n * sizeof *ws->LU);
+	size_t const all = (( size_t )(1) << n) - 1;
+	ws->factored = lu_factor_rows(&ws->sym, all, ws->LU);
+	ws->stats.rows_refactored += n;
+	ws->ready = true;
+}
+
+/**
+ * Diffs `next` into the live circuit and patches G/rhs and the factors to match.
+ * Returns false when the patch doesn't fit, the live circuit is then half updated
+ * and the caller adopts `next` instead.
+ */
+CIRCUIT_EXPORT NO_NULLS bool watch_patch(struct WatchSession *const restrict ws, struct Circuit const *const restrict next) {
+	struct Circuit *const live = &ws->live;
+	struct TIBiStackMark const mark = bistack_mark(&live->bistack);
+	uint8_t const (*const ids)[MAX_NODES] = ( uint8_t const(*)[MAX_NODES] )(&ws->node_to_matrix_id);
+	struct StampBuffer delta = {0};
+	delta.cap  = (live->bistack.back - live->bistack.front) / (2 * sizeof *delta.data);
+	delta.data = bistack_alloc_front_vec(&live->bistack, delta.cap, sizeof *delta.data);
+	if( delta.data==NULL ) {
+		return false;
+	}
+	size_t added = 0, removed = 0, changed = 0;
+	for( uint8_t node=1; node < MAX_NODES; node++ ) {
+		struct Comp *old = live->components[node], *kept = NULL, **tail = &kept;
+		for( struct Comp const *cmp = next->components[node]; cmp != NULL; cmp=cmp->next ) {
+			struct Comp **link = &old;
+			while( *link != NULL && !comp_same_place(*link, cmp) ) {
+				link = &(*link)->next;
+			}
+			struct Comp *match = *link;
+			if( match != NULL ) {
+				*link = match->next;
+				if( rat_lt(match->value, cmp->value) || rat_lt(cmp->value, match->value) ) {
+					rat const was = match->value;
+					match->value = cmp->value;
+					comp_restamp_dc(match, was, ids, &delta);
+					changed++;
+				}
+			} else {
+				match = component_new(&live->bistack, cmp->value, cmp->kind, cmp->node);
+				if( match==NULL ) {
+					bistack_release_front(&live->bistack, mark);
+					return false;
+				}
+				match->owner = cmp->owner;
+				match->aux   = cmp->aux;
+				comp_stamp_dc(match, ids, &delta);
+				added++;
+			}
+			match->next = NULL;
+			*tail = match;
+			tail  = &match->next;
+		}
+		for( struct Comp const *gone = old; gone != NULL; gone = gone->next ) {
+			size_t const first = delta.len;
+			comp_stamp_dc(gone, ids, &delta);
+			for( size_t i=first; i < delta.len && i < delta.cap; i++ ) {
+				delta.data[i].val = rat_neg(delta.data[i].val);
+			}
+			removed++;
+		}
+		live->components[node] = kept;
+	}
+	if( delta.len > delta.cap ) {
+		bistack_release_front(&live->bistack, mark);
+		return false;
+	}
+	
+	size_t const n = ws->n;
+	stamps_apply(&delta, n, ws->G, ws->rhs);
+	size_t dirty = 0;
+	bool fits = true;
+	for( size_t k=0; k < delta.len; k++ ) {
+		struct Stamp const s = delta.data[k];
+		if( s.col==STAMP_RHS ) {
+			continue;
+		}
+		size_t const slots = ws->sym.L_rows[s.row] | ws->sym.U_rows[s.row] | (( size_t )(1) << s.row);
+		fits  = fits && (slots & (( size_t )(1) << s.col));
+		dirty |= ( size_t )(1) << s.row;
+	}
+	bistack_release_front(&live->bistack, mark);
+	
+	if( !fits ) {
+		lu_symbolic(n, ws->G, &ws->sym);
+		dirty = (( size_t )(1) << n) - 1;
+	} else if( !ws->factored ) {
+		dirty = (( size_t )(1) << n) - 1;
+	}
+	/// row i of the factors reads the rows in L_rows[i], which all come before it.
+	for( size_t i=0; i < n; i++ ) {
+		if( ws->sym.L_rows[i] & dirty ) {
+			dirty |= ( size_t )(1) << i;
+		}
+	}
+	for( size_t i=0; i < n; i++ ) {
+		if( dirty & (( size_t )(1) << i) ) {
+			memcpy(&ws->LU[idx_2_to_1(i,0,n)], &ws->G[idx_2_to_1(i,0,n)], n * sizeof *ws->LU);
+			ws->stats.rows_refactored++;
+		}
+	}
+	ws->factored = dirty==0 || lu_factor_rows(&ws->sym, dirty, ws->LU);
+	ws->stats.added   += added;
+	ws->stats.removed += removed;
+	ws->stats.changed += changed;
+	return true;
+}
+
+/// solves the live system and prints it, through the dense pivoted LU when the factors hit a small pivot.
+CIRCUIT_EXPORT NO_NULLS void watch_print(struct WatchSession *const restrict ws, FILE *const restrict out) {
+	struct Circuit *const c = &ws->live;
+	struct TIBiStackMark const mark = bistack_mark(&c->bistack);
+	size_t const n = ws->n;
+	rat *const x  = bistack_alloc_front_vec(&c->bistack, n, sizeof *x);
+	rat *const LU = ws->factored? ws->LU : bistack_alloc_front_vec(&c->bistack, n*n, sizeof *LU);
+	if( x==NULL || LU==NULL ) {
+		fputs("watch: out of memory\n", out);
+		bistack_release_front(&c->bistack, mark);
+		return;
+	}
+	memcpy(x, ws->rhs, n * sizeof *x);
+	bool solved = true;
+	if( ws->factored ) {
+		size_t const all = (( size_t )(1) << n) - 1;
+		lu_solve_partial(&ws->sym, LU, all, all, x);
+	} else {
+		uint8_t piv[MAX_NODES];
+		memcpy(LU, ws->G, n*n * sizeof *LU);
+		solved = lu_factor(n, LU, piv);
+		if( solved ) {
+			lu_solve(n, LU, piv, x);
+		}
+	}
+	for( size_t i=0; i < n; i++ ) {
+		char num[48] = {0};
+		fprintf(out, "V%u = %s\n", ws->matrix_id_to_node[i], solved? rat_to_cstr(x[i], sizeof num, num) : "?");
+	}
+	bistack_release_front(&c->bistack, mark);
+}
+
+/// reads the netlist from `in` and brings the live circuit up to date with it, or runs it whole.
+CIRCUIT_EXPORT NO_NULLS void watch_reload(struct WatchSession *const restrict ws, FILE *const restrict in, FILE *const restrict out) {
+	struct Circuit next = circuit_make(ws->half, ws->arenas[ws->scratch]);
+	struct Deck deck = {0};
+	size_t lines = 0, directives = 0;
+	for( char line[BATCH_LINE_LEN] = {0}; fgets(line, sizeof line, in) != NULL; ) {
+		if( batch_is_end(line) ) {
+			break;
+		} else if( batch_clean_line(line) ) {
+			size_t i = 0;
+			skip_ws(line, &i);
+			directives += line[i]=='.';
+			deck_add_line(&deck, &next, line);
+			lines++;
+		}
+	}
+	if( lines==0 ) {
+		fputs("watch: empty netlist\n", out);
+		return;
+	}
+	ws->stats.reloads++;
+	if( directives > 0 || !watch_patchable(&next) ) {
+		deck_run(&deck, &next, out);
+		ws->ready = false;
+		ws->stats.full_runs++;
+		return;
+	}
+	struct WatchStats const before = ws->stats;
+	if( !ws->ready || next.active_nodes != ws->live.active_nodes || !watch_patch(ws, &next) ) {
+		watch_adopt(ws, &next);
+	}
+	if( !ws->ready ) {
+		fputs(ws->n==0? "watch: empty circuit\n" : "watch: out of memory\n", out);
+		return;
+	}
+	watch_print(ws, out);
+	if( ws->stats.rebuilds > before.rebuilds ) {
+		fprintf(out, "watch: rebuilt, %zu rows factored\n", ws->n);
+	} else {
+		fprintf(out, "watch: +%zu -%zu ~%zu, %zu/%zu rows refactored\n",
+			ws->stats.added - before.added, ws->stats.removed - before.removed, ws->stats.changed - before.changed,
+			ws->stats.rows_refactored - before.rows_refactored, ws->n);
+	}
+}
+
+#	ifndef TICE_H
+#include <sys/inotify.h>
+#include <unistd.h>
+
+enum { WATCH_PATH_LEN = 256 };
+
+CIRCUIT_EXPORT NO_NULLS void watch_reload_path(struct WatchSession *const restrict ws, char const path[const restrict static 1], FILE *const restrict out) {
+	FILE *const in = fopen(path, "r");
+	if( in==NULL ) {
+		fprintf(out, "watch: can't read %s\n", path);
+		return;
+	}
+	watch_reload(ws, in, out);
+	fclose(in);
+	fflush(out);
+}
+
+/**
+ * Solves `path` now and again after every save, forever or for `max_reloads` saves when
+ * that's nonzero. Returns false if the file's directory can't be watched.
+ */
+CIRCUIT_EXPORT NO_NULLS bool watch_run(char const path[const restrict static 1], uint8_t mem[const restrict], size_t const len, size_t const max_reloads, FILE *const restrict out) {
+	char dir[WATCH_PATH_LEN] = ".";
+	char const *const slash = strrchr(path, '/');
+	char const *const name  = slash != NULL? &slash[1] : path;
+	if( slash != NULL ) {
+		size_t const dir_len = slash==path? 1 : ( size_t )(slash - path);
+		if( dir_len >= sizeof dir ) {
+			return false;
+		}
+		memcpy(dir, path, dir_len);
+		dir[dir_len] = 0;
+	}
+	int const fd = inotify_init1(IN_CLOEXEC);
+	if( fd < 0 || inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0 ) {
+		if( fd >= 0 ) {
+			close(fd);
+		}
+		return false;
+	}
+	struct WatchSession ws;
+	watch_session_make(&ws, mem, len);
+	watch_reload_path(&ws, path, out);
+	for( size_t saves=0; max_reloads==0 || saves < max_reloads; ) {
+		union {
+			struct inotify_event ev;
+			char                 buf[4096];
+		} events;
+		ssize_t const got = read(fd, events.buf, sizeof events.buf);
+		if( got <= 0 ) {
+			break;
+		}
+		/// one reload for however many events the save made.
+		bool saved = false;
+		for( ssize_t p=0; p < got; ) {
+			struct inotify_event const *const ev = ( struct inotify_event const* )(&events.buf[p]);
+			saved = saved || (ev->len > 0 && !strcmp(ev->name, name));
+			p += sizeof *ev + ev->len;
+		}
+		if( saved ) {
+			watch_reload_path(&ws, path, out);
+			saves++;
+		}
+	}
+	fprintf(out, "watch: %zu reloads, %zu rebuilds, %zu full runs, +%zu -%zu ~%zu components, %zu rows refactored\n",
+		ws.stats.reloads, ws.stats.rebuilds, ws.stats.full_runs, ws.stats.added, ws.stats.removed, ws.stats.changed, ws.stats.rows_refactored);
+	close(fd);
+	return true;
+}
+#	endif
+#endif
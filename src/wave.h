@@ -0,0 +1,208 @@
+#ifndef WAVE_H_INCLUDED
+#	define WAVE_H_INCLUDED
+
+#include "tran.h"
+#include <stdio.h>
+
+
+/// Streaming waveform output for transient results.
+///   .wave raw out.raw    SPICE raw, binary doubles, readable by ngspice/LTspice viewers.
+///   .wave csv out.csv    time,V(1),... one row per point.
+/// Samples are packed into a fixed ring as they come off the solver and written in one
+/// large fwrite whenever the next record wouldn't fit, so a run never holds more than
+/// the ring however many points it produces. The raw header's point count isn't known
+/// until the end, it's written as a padded field and patched on close when the file
+/// can seek. On the calculator double is the same 32 bits as float, so raw files there
+/// aren't SPICE readable, use csv.
+
+enum {
+	WAVE_OFF, WAVE_RAW, WAVE_CSV,
+	WAVE_PATH_LEN  = 64,
+	WAVE_RING_SIZE =
+#	ifdef TICE_H
+		1U << 9,
+#	else
+		1U << 16,
+#	endif
+	WAVE_CSV_FIELD = 24, /// ",%.9g" of a double fits.
+};
+
+struct WaveSettings {
+	char    path[WAVE_PATH_LEN];
+	uint8_t format;
+};
+
+struct WaveWriter {
+	struct TIMemRegion ring;
+	FILE              *file;
+	long               points_at;  /// file offset of the raw point count, -1 when unknown.
+	size_t             points, node_bits, flushes, bytes;
+	uint8_t            format;
+	bool               failed;
+};
+
+/// .wave raw|csv <path>
+CIRCUIT_EXPORT NO_NULLS bool wave_parse_directive(struct WaveSettings *const restrict ws, char const line[const restrict static 1]) {
+	size_t const word = strcspn(line, " \t\r\n");
+	if( word != 5 || strncmp(line, ".wave", 5) != 0 ) {
+		return false;
+	}
+	char format[8] = {0}, path[WAVE_PATH_LEN] = {0};
+	if( sscanf(line, " .wave %7s %63s", format, path) < 2 ) {
+		ws->format = WAVE_OFF;
+		return true;
+	}
+	for( size_t i=0; format[i] != 0; i++ ) {
+		format[i] = tolower(format[i]);
+	}
+	ws->format = !strcmp(format, "raw")? WAVE_RAW : !strcmp(format, "csv")? WAVE_CSV : WAVE_OFF;
+	memcpy(ws->path, path, sizeof ws->path);
+	return true;
+}
+
+CIRCUIT_EXPORT NO_NULLS struct WaveWriter wave_make(FILE *const file, uint8_t const format, uint8_t *const ring, size_t const ring_len) {
+	return (struct WaveWriter){ .ring = region_make(ring, ring_len), .file = file, .points_at = -1, .format = format };
+}
+
+/// writes out whatever the ring holds and starts it over.
+CIRCUIT_EXPORT NO_NULLS void wave_flush(struct WaveWriter *const w) {
+	if( w->ring.offs > 0 ) {
+		if( fwrite(w->ring.mem, 1, w->ring.offs, w->file) != w->ring.offs ) {
+			w->failed = true;
+		}
+		w->bytes += w->ring.offs;
+		w->flushes++;
+	}
+	region_reset(&w->ring);
+}
+
+/**
+ * Room for a record of at most `bytes`, flushing first if it wouldn't fit.
+ * Hand the bytes actually used to wave_commit. NULL when one record outgrows the ring.
+ */
+CIRCUIT_EXPORT NO_NULLS uint8_t *wave_reserve(struct WaveWriter *const w, size_t const bytes) {
+	if( _align_size(bytes, sizeof bytes) >= w->ring.len ) {
+		w->failed = true;
+		return NULL;
+	} else if( region_size_remaining(&w->ring) <= ( int )(_align_size(bytes, sizeof bytes)) ) {
+		wave_flush(w);
+	}
+	bool wrapped = false;
+	return region_alloc_reset_when_full(&w->ring, bytes, &wrapped);
+}
+
+/// gives back the aligned tail and whatever a text record didn't use.
+CIRCUIT_EXPORT NO_NULLS void wave_commit(struct WaveWriter *const w, uint8_t const *const rec, size_t const used) {
+	w->ring.offs = ( size_t )(rec - w->ring.mem) + used;
+}
+
+CIRCUIT_EXPORT NO_NULLS void wave_header(struct WaveWriter *const w, size_t const node_bits) {
+	w->node_bits = node_bits;
+	size_t vars = 1;
+	for( size_t i=1; i < MAX_NODES; i++ ) {
+		vars += (node_bits >> i) & 1;
+	}
+	if( w->format==WAVE_CSV ) {
+		fputs("time", w->file);
+		for( size_t i=1; i < MAX_NODES; i++ ) {
+			if( node_bits & (1 << i) ) {
+				fprintf(w->file, ",V(%zu)", i);
+			}
+		}
+		fputc('\n', w->file);
+		return;
+	}
+	fprintf(w->file, "Title: LiteSpiCE\nDate: \nPlotname: Transient Analysis\nFlags: real\nNo. Variables: %zu\nNo. Points: ", vars);
+	w->points_at = ftell(w->file);
+	fprintf(w->file, "%-10zu\nVariables:\n\t0\ttime\ttime\n", ( size_t )(0));
+	size_t k = 1;
+	for( size_t i=1; i < MAX_NODES; i++ ) {
+		if( node_bits & (1 << i) ) {
+			fprintf(w->file, "\t%zu\tv(%zu)\tvoltage\n", k++, i);
+		}
+	}
+	fputs("Binary:\n", w->file);
+}
+
+/// TranSink callback, `ctx` is the WaveWriter.
+CIRCUIT_EXPORT void wave_emit(void *const ctx, rat const t, size_t const node_bits, rat const (*const V)[MAX_NODES]) {
+	struct WaveWriter *const w = ctx;
+	if( w->failed ) {
+		return;
+	} else if( w->points==0 ) {
+		wave_header(w, node_bits);
+	}
+	size_t vars = 1;
+	for( size_t i=1; i < MAX_NODES; i++ ) {
+		vars += (w->node_bits >> i) & 1;
+	}
+	if( w->format==WAVE_CSV ) {
+		size_t const cap = vars*WAVE_CSV_FIELD + 1;
+		char *const rec = ( char* )(wave_reserve(w, cap));
+		if( rec==NULL ) {
+			return;
+		}
+		size_t used = snprintf(rec, cap, "%.9g", rat_to_double(t));
+		for( size_t i=1; i < MAX_NODES; i++ ) {
+			if( w->node_bits & (1 << i) ) {
+				used += snprintf(&rec[used], cap - used, ",%.9g", rat_to_double((*V)[i]));
+			}
+		}
+		rec[used++] = '\n';
+		wave_commit(w, ( uint8_t* )(rec), used);
+	} else {
+		size_t const bytes = vars * sizeof(double);
+		uint8_t *const rec = wave_reserve(w, bytes);
+		if( rec==NULL ) {
+			return;
+		}
+		double sample = rat_to_double(t);
+		memcpy(rec, &sample, sizeof sample);
+		size_t k = 1;
+		for( size_t i=1; i < MAX_NODES; i++ ) {
+			if( w->node_bits & (1 << i) ) {
+				sample = rat_to_double((*V)[i]);
+				memcpy(&rec[sizeof sample * k++], &sample, sizeof sample);
+			}
+		}
+		wave_commit(w, rec, bytes);
+	}
+	w->points++;
+}
+
+/// flushes the tail and patches the raw point count. Returns false if any write failed.
+CIRCUIT_EXPORT NO_NULLS bool wave_close(struct WaveWriter *const w) {
+	wave_flush(w);
+	if( w->format==WAVE_RAW && w->points_at >= 0 && fseek(w->file, w->points_at, SEEK_SET)==0 ) {
+		fprintf(w->file, "%-10zu", w->points);
+		fseek(w->file, 0, SEEK_END);
+	}
+	return fflush(w->file)==0 && !w->failed;
+}
+
+/**
+ * Points `sink` at a writer for `ws->path` with its ring on the circuit's back stack,
+ * the caller restores the back mark after wave_end. Leaves `sink` alone and returns
+ * false when waves are off or the file or ring can't be had.
+ */
+CIRCUIT_EXPORT NO_NULLS bool wave_begin(struct WaveSettings const *const restrict ws, struct Circuit *const restrict c, struct WaveWriter *const restrict w, struct TranSink *const restrict sink, FILE *const restrict out) {
+	if( ws->format==WAVE_OFF ) {
+		return false;
+	}
+	uint8_t *const ring = bistack_alloc_back(&c->bistack, WAVE_RING_SIZE);
+	FILE *const file = ring != NULL? fopen(ws->path, ws->format==WAVE_RAW? "wb" : "w") : NULL;
+	if( file==NULL ) {
+		fprintf(out, "wave: can't write %s\n", ws->path);
+		return false;
+	}
+	*w = wave_make(file, ws->format, ring, WAVE_RING_SIZE);
+	*sink = (struct TranSink){ .emit = wave_emit, .ctx = w };
+	return true;
+}
+
+CIRCUIT_EXPORT NO_NULLS void wave_end(struct WaveSettings const *const restrict ws, struct WaveWriter *const restrict w, FILE *const restrict out) {
+	bool const ok = wave_close(w);
+	fclose(w->file);
+	fprintf(out, "wave: %zu points, %zu sample bytes in %zu writes to %s%s\n", w->points, w->bytes, w->flushes, ws->path, ok? "" : " (write failed)");
+}
+#endif